@@ -41,6 +41,8 @@ CBL {
 		c4db_getLastSequence;
 		c4db_getMaxRevTreeDepth;
 		c4db_setMaxRevTreeDepth;
+		c4db_setDocumentCacheSize;
+		c4db_getDocumentCacheStats;
 		c4db_getUUIDs;
 		c4db_getExtraInfo;
 		c4db_setExtraInfo;
@@ -51,6 +53,7 @@ CBL {
 		c4db_getFLSharedKeys;
 		c4db_encodeJSON;
 		c4db_maintenance;
+		c4db_pruneRemoteRevisions;
 
 		c4raw_free;
 		c4raw_get;
@@ -135,10 +138,12 @@ CBL {
 		c4stream_closeWriter;
 
 		c4dbobs_create;
+		c4dbobs_createBatched;
 		c4dbobs_getChanges;
 		c4dbobs_releaseChanges;
 		c4dbobs_free;
 		c4docobs_create;
+		c4docobs_createMultiple;
 		c4docobs_free;
 
 		c4repl_new;
@@ -286,6 +291,7 @@ CBL {
 		c4_getBuildInfo;
 		c4_setTempDir;
 		c4_runAsyncTask;
+		c4_getActorMetrics;
 
 		c4log;
 		c4vlog;
@@ -316,6 +322,7 @@ CBL {
 		c4db_getConfig2;
 		c4db_getName;
 		c4db_getRemoteDBID;
+		c4db_forgetRemoteDBID;
 		c4db_exists;
 		c4db_startHousekeeping;
 		c4db_findDocAncestors;
@@ -352,6 +359,10 @@ CBL {
 		c4queryenum_getRowCount;
 
 		c4query_fullTextMatched;
+		c4query_cancel;
+		c4query_setProfiling;
+		c4query_getStats;
+		c4queryenum_getStats;
 
 		c4queryobs_create;
 		c4queryobs_setEnabled;
@@ -375,6 +386,7 @@ CBL {
 
 		c4error_return;
 		c4db_markSynced;
+		c4db_getDocCurrentRevision;
 		c4_dumpInstances;
 		gC4ExpectExceptions;
 
@@ -21,6 +21,7 @@
 #include "c4Socket.h"
 
 #include "Actor.hh"
+#include "ActorMetrics.hh"
 #include "Backtrace.hh"
 #include "FilePath.hh"
 #include "Logging.hh"
@@ -329,3 +330,8 @@ bool c4_setTempDir(C4String path, C4Error* err) C4API {
 void c4_runAsyncTask(void (*task)(void*), void *context) C4API {
     actor::Mailbox::runAsyncTask(task, context);
 }
+
+
+C4StringResult c4_getActorMetrics(void) C4API {
+    return C4StringResult(actor::ActorMetrics::allToJSON());
+}
@@ -208,6 +208,18 @@ bool c4db_maintenance(C4Database* database, C4MaintenanceType type, C4Error *out
 }
 
 
+bool c4db_pruneRemoteRevisions(C4Database* database, bool dryRun,
+                               C4RemoteRevisionGCStats *outStats, C4Error *outError) noexcept
+{
+    return tryCatch(outError, [=]{
+        auto stats = database->pruneRemoteRevisions(dryRun);
+        if (outStats)
+            *outStats = {stats.docsScanned, stats.docsPruned,
+                         stats.itemsRemoved, stats.bytesReclaimed};
+    });
+}
+
+
 bool c4db_rekey(C4Database* database, const C4EncryptionKey *newKey, C4Error *outError) noexcept {
     return tryCatch(outError, [=]{return database->rekey(newKey);});
 }
@@ -252,6 +264,22 @@ void c4db_setMaxRevTreeDepth(C4Database *database, uint32_t depth) noexcept {
 }
 
 
+void c4db_setDocumentCacheSize(C4Database *database, size_t maxBytes) noexcept {
+    tryCatch(nullptr, [=]{database->defaultKeyStore().setRecordCacheSize(maxBytes);});
+}
+
+
+C4DocumentCacheStats c4db_getDocumentCacheStats(C4Database *database) noexcept {
+    C4DocumentCacheStats result = {};
+    tryCatch(nullptr, [&]{
+        auto stats = database->defaultKeyStore().recordCache().stats();
+        result = {stats.hits, stats.misses, stats.evictions,
+                  stats.count, stats.bytes, stats.maxBytes};
+    });
+    return result;
+}
+
+
 bool c4db_getUUIDs(C4Database* database, C4UUID *publicUUID, C4UUID *privateUUID,
                    C4Error *outError) noexcept
 {
@@ -80,19 +80,21 @@ struct C4DocEnumerator : public RecordEnumerator, public fleece::InstanceCounted
         if (!*this)
             return false;
 
-        revid vers(record().version());
+        // Only the metadata is needed, so don't make the enumerator copy the body:
+        const Record &rec = recordMetadata();
+        revid vers(rec.version());
         if ((_options.flags & kC4IncludeRevHistory) && vers.isVersion())
             _docRevID = vers.asVersionVector().asASCII();
         else
             _docRevID = vers.expanded();
 
-        outInfo->docID = record().key();
+        outInfo->docID = rec.key();
         outInfo->revID = _docRevID;
-        outInfo->flags = (C4DocumentFlags)record().flags() | kDocExists;
-        outInfo->sequence = record().sequence();
-        outInfo->bodySize = record().bodySize();
-        outInfo->metaSize = record().extraSize();
-        outInfo->expiration = record().expiration();
+        outInfo->flags = (C4DocumentFlags)rec.flags() | kDocExists;
+        outInfo->sequence = rec.sequence();
+        outInfo->bodySize = rec.bodySize();
+        outInfo->metaSize = rec.extraSize();
+        outInfo->expiration = rec.expiration();
         return true;
     }
 
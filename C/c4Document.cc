@@ -31,6 +31,7 @@
 #include "Database.hh"
 #include "LegacyAttachments.hh"
 #include "RevTree.hh"   // only for kDefaultRemoteID
+#include "VersionVector.hh"
 #include "SecureRandomize.hh"
 #include "FleeceImpl.hh"
 
@@ -189,9 +190,6 @@ bool c4doc_selectCommonAncestorRevision(C4Document* doc, C4String rev1, C4String
 #pragma mark - REMOTE DATABASE REVISION TRACKING:
 
 
-static const char * kRemoteDBURLsDoc = "remotes";
-
-
 C4RemoteID c4db_getRemoteDBID(C4Database *db, C4String remoteAddress, bool canCreate,
                               C4Error *outError) C4API
 {
@@ -208,7 +206,7 @@ C4RemoteID c4db_getRemoteDBID(C4Database *db, C4String remoteAddress, bool canCr
             }
 
             // Look up the doc in the db, and the remote URL in the doc:
-            Record doc = db->getRawDocument(toString(kC4InfoStore), slice(kRemoteDBURLsDoc));
+            Record doc = db->getRawDocument(toString(kC4InfoStore), Database::kRemoteDBURLsDoc);
             const Dict *remotes = nullptr;
             C4RemoteID remoteID = 0;
             if (doc.exists()) {
@@ -246,7 +244,7 @@ C4RemoteID c4db_getRemoteDBID(C4Database *db, C4String remoteAddress, bool canCr
                 alloc_slice body = enc.finish();
 
                 // Save the doc:
-                db->putRawDocument(toString(kC4InfoStore), slice(kRemoteDBURLsDoc), nullslice, body);
+                db->putRawDocument(toString(kC4InfoStore), Database::kRemoteDBURLsDoc, nullslice, body);
                 db->endTransaction(true);
                 inTransaction = false;
                 return remoteID;
@@ -265,12 +263,12 @@ C4RemoteID c4db_getRemoteDBID(C4Database *db, C4String remoteAddress, bool canCr
 C4SliceResult c4db_getRemoteDBAddress(C4Database *db, C4RemoteID remoteID) C4API {
     using namespace fleece;
     return tryCatch<C4SliceResult>(nullptr, [&]{
-        Record doc = db->getRawDocument(toString(kC4InfoStore), slice(kRemoteDBURLsDoc));
+        Record doc = db->getRawDocument(toString(kC4InfoStore), Database::kRemoteDBURLsDoc);
         if (doc.exists()) {
             auto body = Value::fromData(doc.body());
             if (body) {
                 for (Dict::iterator i(body->asDict()); i; ++i) {
-                    if (i.value()->asInt() == remoteID)
+                    if (i.value()->asInt() == remoteID && i.keyString().size > 0)
                         return C4SliceResult(i.keyString());
                 }
             }
@@ -280,6 +278,50 @@ C4SliceResult c4db_getRemoteDBAddress(C4Database *db, C4RemoteID remoteID) C4API
 }
 
 
+bool c4db_forgetRemoteDBID(C4Database *db, C4RemoteID remoteID, C4Error *outError) noexcept {
+    using namespace fleece;
+    return tryCatch<bool>(outError, [&]{
+        Database::TransactionHelper t(db);
+        Record doc = db->getRawDocument(toString(kC4InfoStore), Database::kRemoteDBURLsDoc);
+        const Dict *remotes = nullptr;
+        if (doc.exists()) {
+            if (auto body = Value::fromData(doc.body()); body)
+                remotes = body->asDict();
+        }
+        // Rewrite the doc without the entry with this ID. So that c4db_getRemoteDBID won't
+        // reuse the ID, the highest ID ever assigned is kept under the empty key:
+        bool found = false;
+        uint64_t maxID = 0;
+        Encoder enc;
+        enc.beginDictionary();
+        for (Dict::iterator i(remotes); i; ++i) {
+            auto id = i.value()->asUnsigned();
+            maxID = max(maxID, id);
+            if (i.keyString().size == 0) {
+                continue;
+            } else if (id == remoteID) {
+                found = true;
+            } else {
+                enc.writeKey(i.keyString());
+                enc.writeUInt(id);
+            }
+        }
+        enc.writeKey(""_sl);
+        enc.writeUInt(maxID);
+        enc.endDictionary();
+        if (!found) {
+            c4error_return(LiteCoreDomain, kC4ErrorNotFound, {}, outError);
+            return false;
+        }
+        db->putRawDocument(toString(kC4InfoStore), Database::kRemoteDBURLsDoc,
+                           nullslice, enc.finish());
+        db->remoteDBForgotten();
+        t.commit();
+        return true;
+    });
+}
+
+
 C4SliceResult c4doc_getRemoteAncestor(C4Document *doc, C4RemoteID remoteDatabase) C4API {
     return tryCatch<C4SliceResult>(nullptr, [&]{
         return C4SliceResult(asInternal(doc)->remoteAncestorRevID(remoteDatabase));
@@ -297,6 +339,36 @@ bool c4doc_setRemoteAncestor(C4Document *doc, C4RemoteID remoteDatabase, C4Strin
 }
 
 
+bool c4db_getDocCurrentRevision(C4Database *database,
+                                C4String docID,
+                                C4DocumentFlags *outFlags,
+                                C4SliceResult *outRevID,
+                                C4Error *outError) noexcept
+{
+    return tryCatch<bool>(outError, [&]{
+        // Read just the record's metadata, in place, instead of instantiating a Document:
+        VersionVector vector;
+        bool found = database->defaultKeyStore().get(docID, kMetaOnly,
+                                                     [&](const RecordLite &rec) {
+            *outFlags = C4DocumentFlags(rec.flags) | kDocExists;
+            revid vers(rec.version);
+            if (vers.isVersion())
+                vector = vers.asVersionVector();
+            else
+                *outRevID = C4SliceResult(vers.expanded());
+        });
+        if (!found) {
+            c4error_return(LiteCoreDomain, kC4ErrorNotFound, {}, outError);
+            return false;
+        }
+        // (Getting the peer ID may read the database, so it can't be done in the callback.)
+        if (!vector.empty())
+            *outRevID = C4SliceResult(vector.asASCII(peerID{database->myPeerID()}));
+        return true;
+    });
+}
+
+
 // LCOV_EXCL_START
 bool c4db_markSynced(C4Database *database,
                      C4String docID,
@@ -258,6 +258,7 @@ static const char* getErrorName(C4Error err) {
         "CantUpgradeDatabase",
         "DeltaBaseUnknown",
         "CorruptDelta",
+        "Interrupted",
     };
     static_assert(sizeof(kLiteCoreNames)/sizeof(kLiteCoreNames[0]) ==
                   error::NumLiteCoreErrorsPlus1, "Incomplete error message table");
@@ -20,10 +20,73 @@
 #include "c4Observer.h"
 #include "c4Database.hh"
 #include "SequenceTracker.hh"
+#include "Actor.hh"
+#include "Timer.hh"
 #include "InstanceCounted.hh"
+#include <atomic>
 
 using namespace std::placeholders;
 using namespace std;
+using namespace litecore::actor;
+
+
+// Default maximum number of changes delivered to a batched observer's callback at once
+static constexpr uint32_t kDefaultMaxBatchSize = 1000;
+
+
+/** Delivers a batched C4DatabaseObserver's changes to its callback, on its own thread.
+    The notifier's callback just schedules a Timer, so however many transactions are committed
+    during the minimum interval, there's only one delivery; and since the SequenceTracker keeps
+    only the latest change to each document, the batch contains no duplicate docIDs. */
+class DatabaseObserverBatcher : public Actor {
+public:
+    DatabaseObserverBatcher(C4DatabaseObserver *obs,
+                            const C4DatabaseObserverOptions &options,
+                            C4DatabaseObserverBatchCallback callback,
+                            void *context)
+    :Actor(ChangesLog, "DatabaseObserver")
+    ,_observer(obs)
+    ,_callback(callback)
+    ,_context(context)
+    ,_minInterval(chrono::milliseconds(options.minIntervalMS))
+    ,_changes(options.maxBatchSize ? options.maxBatchSize : kDefaultMaxBatchSize)
+    ,_timer([this] {
+        enqueue(FUNCTION_TO_QUEUE(DatabaseObserverBatcher::_deliver));
+    })
+    { }
+
+    /// Called (by the notifier) when there are new changes; thread-safe.
+    void changesAvailable() {
+        if (_scheduled.exchange(true))
+            return;
+        Timer::time fireTime = max(Timer::clock::now(), _lastDelivery.load() + _minInterval);
+        _timer.fireAt(fireTime);
+    }
+
+    /// Synchronously stops deliveries. Must not be called on the actor's own thread.
+    void stop() {
+        enqueue(FUNCTION_TO_QUEUE(DatabaseObserverBatcher::_stop));
+        waitTillCaughtUp();
+    }
+
+private:
+    void _stop() {
+        _timer.stop();
+        _stopped = true;
+    }
+
+    void _deliver();
+
+    C4DatabaseObserver* const               _observer;
+    C4DatabaseObserverBatchCallback const   _callback;
+    void* const                             _context;
+    Timer::duration const                   _minInterval;
+    vector<SequenceTracker::Change>         _changes;       // Reused for each batch
+    Timer                                   _timer;
+    atomic<Timer::time>                     _lastDelivery {};
+    atomic<bool>                            _scheduled {false};
+    bool                                    _stopped {false};
+};
 
 
 struct C4DatabaseObserver : public fleece::InstanceCounted {
@@ -40,16 +103,35 @@ struct C4DatabaseObserver : public fleece::InstanceCounted {
     { }
 
 
+    C4DatabaseObserver(C4Database *db,
+                        SequenceTracker &sequenceTracker,
+                        const C4DatabaseObserverOptions &options,
+                        C4DatabaseObserverBatchCallback callback, void *context)
+    :_db(db),
+     _callback(nullptr),
+     _context(context),
+     _batcher(new DatabaseObserverBatcher(this, options, callback, context)),
+     _notifier(sequenceTracker,
+               bind(&C4DatabaseObserver::dispatchCallback, this, _1),
+               UINT64_MAX)
+    { }
+
+
     void dispatchCallback(DatabaseChangeNotifier&) {
+        if (_batcher) {
+            _batcher->changesAvailable();
+            return;
+        }
         _inCallback = true;
         _callback(this, _context);
         _inCallback = false;
     }
 
     Retained<Database> _db;
-    DatabaseChangeNotifier _notifier;
     C4DatabaseObserverCallback _callback;
     void *_context;
+    Retained<DatabaseObserverBatcher> _batcher;     // Only in batched mode
+    DatabaseChangeNotifier _notifier;
     bool _inCallback {false};
     //NOTE: Order of members is important! _notifier needs to appear after _db so that it will be
     // destructed *before* _db; this ensures that the Database's SequenceTracker is still in
@@ -57,6 +139,33 @@ struct C4DatabaseObserver : public fleece::InstanceCounted {
 };
 
 
+void DatabaseObserverBatcher::_deliver() {
+    _scheduled = false;
+    if (_stopped)
+        return;
+    bool external = false, more = false;
+    auto n = _observer->_db->sequenceTracker().use<uint32_t>([&](SequenceTracker &st) {
+        auto n = (uint32_t) _observer->_notifier.readChanges(_changes.data(), _changes.size(),
+                                                             external);
+        more = _observer->_notifier.hasChanges();
+        return n;
+    });
+    _lastDelivery = Timer::clock::now();
+    if (n == 0)
+        return;
+
+    logVerbose("Delivering %u changes", n);
+    _callback(_observer, (const C4DatabaseChange*)_changes.data(), n, external, _context);
+    for (uint32_t i = 0; i < n; ++i)
+        _changes[i] = {};
+
+    // If changes are left (the batch filled up, or stopped where external changes begin), the
+    // notifier won't call back until they've all been read, so schedule the next delivery now:
+    if (more)
+        changesAvailable();
+}
+
+
 C4DatabaseObserver* c4dbobs_create(C4Database *db,
                                    C4DatabaseObserverCallback callback,
                                    void *context) noexcept
@@ -101,9 +210,29 @@ void c4dbobs_releaseChanges(C4DatabaseChange changes[], uint32_t numChanges) noe
 }
 
 
+C4DatabaseObserver* c4dbobs_createBatched(C4Database *db,
+                                          C4DatabaseObserverOptions options,
+                                          C4DatabaseObserverBatchCallback callback,
+                                          void *context) noexcept
+{
+    return tryCatch<C4DatabaseObserver*>(nullptr, [&]{
+        return db->sequenceTracker().use<C4DatabaseObserver*>([&](SequenceTracker &st) {
+            return new C4DatabaseObserver(db, st, options, callback, context);
+        });
+    });
+}
+
+
 void c4dbobs_free(C4DatabaseObserver* obs) noexcept {
     if (obs) {
         Retained<Database> retainDB((Database*)obs->_db);   // keep db from being deleted too early
+        if (obs->_batcher) {
+            // Stop deliveries first, without holding the SequenceTracker's lock, which
+            // _deliver needs to acquire:
+            Assert(Actor::currentActor() != obs->_batcher.get(),
+                   "c4dbobs_free may not be called from a batched observer's callback");
+            obs->_batcher->stop();
+        }
         retainDB->sequenceTracker().use([&](SequenceTracker &st) {
             delete obs;
         });
@@ -123,9 +252,27 @@ struct C4DocumentObserver : public fleece::InstanceCounted {
     :_db(db),
      _callback(callback),
      _context(context),
-     _notifier(sequenceTracker,
-               docID,
-               bind(&C4DocumentObserver::dispatchCallback, this, _1, _2, _3))
+     _notifier(new DocChangeNotifier(sequenceTracker,
+                                     docID,
+                                     bind(&C4DocumentObserver::dispatchCallback,
+                                          this, _1, _2, _3)))
+    { }
+
+
+    C4DocumentObserver(C4Database *db,
+                        SequenceTracker &sequenceTracker,
+                        const vector<alloc_slice> &keys,
+                        bool matchPrefixes,
+                        C4DocumentObserverCallback callback,
+                        void *context)
+    :_db(db),
+     _callback(callback),
+     _context(context),
+     _setNotifier(new DocSetChangeNotifier(sequenceTracker,
+                                           keys,
+                                           matchPrefixes,
+                                           bind(&C4DocumentObserver::dispatchSetCallback,
+                                                this, _1, _2, _3)))
     { }
 
 
@@ -133,10 +280,15 @@ struct C4DocumentObserver : public fleece::InstanceCounted {
         _callback(this, docID, sequence, _context);
     }
 
+    void dispatchSetCallback(DocSetChangeNotifier&, slice docID, sequence_t sequence) {
+        _callback(this, docID, sequence, _context);
+    }
+
     Retained<Database> _db;
     C4DocumentObserverCallback _callback;
     void *_context;
-    DocChangeNotifier _notifier;
+    unique_ptr<DocChangeNotifier> _notifier;            // Observing a single document, or
+    unique_ptr<DocSetChangeNotifier> _setNotifier;      // observing multiple docs or prefixes
     //NOTE: Order of member variables is important here too (see above).
 };
 
@@ -154,6 +306,25 @@ C4DocumentObserver* c4docobs_create(C4Database *db,
 }
 
 
+C4DocumentObserver* c4docobs_createMultiple(C4Database *db,
+                                            const C4String docIDs[],
+                                            size_t count,
+                                            bool matchPrefixes,
+                                            C4DocumentObserverCallback callback,
+                                            void *context) noexcept
+{
+    return tryCatch<C4DocumentObserver*>(nullptr, [&]{
+        vector<alloc_slice> keys;
+        keys.reserve(count);
+        for (size_t i = 0; i < count; ++i)
+            keys.emplace_back(slice(docIDs[i]));
+        return db->sequenceTracker().use<C4DocumentObserver*>([&](SequenceTracker &st) {
+            return new C4DocumentObserver(db, st, keys, matchPrefixes, callback, context);
+        });
+    });
+}
+
+
 void c4docobs_free(C4DocumentObserver* obs) noexcept {
     if (obs) {
         Retained<Database> retainDB(obs->_db);        // keep db alive until obs is safely deleted
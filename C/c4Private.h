@@ -87,6 +87,16 @@ bool c4db_markSynced(C4Database *database,
                      C4RemoteID remoteID,
                      C4Error* C4NULLABLE outError) C4API;
 
+/** Gets a document's flags and current revision ID (in global form, like
+    \ref c4doc_getSelectedRevIDGlobalForm) without instantiating a C4Document, and without
+    copying the document's data. Used by the replicator to check proposed changes.
+    Returns false with a NotFound error if the document doesn't exist. */
+bool c4db_getDocCurrentRevision(C4Database *database,
+                                C4String docID,
+                                C4DocumentFlags *outFlags,
+                                C4SliceResult *outRevID,
+                                C4Error* C4NULLABLE outError) C4API;
+
 
 /** Flags produced by \ref c4db_findDocAncestors, the result of comparing a local document's
     revision(s) against the requested revID. */
@@ -94,6 +94,11 @@ C4QueryEnumerator* c4query_run(C4Query *query,
 }
 
 
+void c4query_cancel(C4Query *query) noexcept {
+    query->query()->cancel();
+}
+
+
 C4StringResult c4query_explain(C4Query *query) noexcept {
     return tryCatch<C4StringResult>(nullptr, [&]{
         string result = query->query()->explain();
@@ -104,6 +109,33 @@ C4StringResult c4query_explain(C4Query *query) noexcept {
 }
 
 
+static C4QueryStats exportStats(const Query::Stats &stats) {
+    C4QueryStats result;
+    result.runs             = stats.runs;
+    result.rowsReturned     = stats.rowsReturned;
+    result.rowsScanned      = stats.rowsScanned;
+    result.sortOps          = stats.sortOps;
+    result.autoIndexRows    = stats.autoIndexRows;
+    result.vmSteps          = stats.vmSteps;
+    result.fleeceValueCalls = stats.fleeceValueCalls;
+    result.sqliteTime       = stats.sqliteTime;
+    result.encodeTime       = stats.encodeTime;
+    result.fullScan         = stats.fullScan;
+    result.tempBTree        = stats.tempBTree;
+    return result;
+}
+
+
+void c4query_setProfiling(C4Query *query, bool enabled) noexcept {
+    query->query()->setProfiling(enabled);
+}
+
+
+C4QueryStats c4query_getStats(C4Query *query) noexcept {
+    return exportStats(query->query()->stats());
+}
+
+
 C4SliceResult c4query_fullTextMatched(C4Query *query,
                                       const C4FullTextMatch *term,
                                       C4Error *outError) noexcept
@@ -151,6 +183,21 @@ int64_t c4queryenum_getRowCount(C4QueryEnumerator *e,
 
 
 
+bool c4queryenum_getStats(C4QueryEnumerator *e,
+                          C4QueryStats *outStats) noexcept
+{
+    try {
+        const Query::Stats *stats = asInternal(e)->enumerator().stats();
+        if (!stats)
+            return false;
+        *outStats = exportStats(*stats);
+        return true;
+    } catchExceptions()
+    return false;
+}
+
+
+
 C4QueryEnumerator* c4queryenum_refresh(C4QueryEnumerator *e,
                                        C4Error *outError) noexcept
 {
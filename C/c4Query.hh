@@ -49,9 +49,26 @@ struct C4Query : public RefCounted, public fleece::InstanceCountedIn<C4Query>, L
 
     Retained<C4QueryEnumeratorImpl> createEnumerator(const C4QueryOptions *c4options, slice encodedParameters) {
         Query::Options options(encodedParameters ? encodedParameters : _parameters);
+        options.cancelCount = _query->cancelCount();
+        if (c4options) {
+            if (c4options->waitForIndexes)
+                updateDeferredIndexes(c4options->maxUnindexedDocs);
+            options.timeout = c4options->timeoutMS / 1000.0;
+            options.maxRows = c4options->maxRows;
+        }
         return wrapEnumerator( _query->createEnumerator(&options) );
     }
 
+    // Brings the deferred indexes the query uses up to date, if more than `maxUnindexed` docs
+    // are waiting to be indexed. This writes to the database, so it uses a Database transaction.
+    void updateDeferredIndexes(uint64_t maxUnindexed) {
+        if (_query->unindexedDocCount() <= maxUnindexed)
+            return;
+        Database::TransactionHelper t(_database);
+        _query->updateDeferredIndexes();
+        t.commit();
+    }
+
     Retained<C4QueryEnumeratorImpl> wrapEnumerator(QueryEnumerator *e) {
         return e ? new C4QueryEnumeratorImpl(_database, _query, e) : nullptr;
     }
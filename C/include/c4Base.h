@@ -249,6 +249,7 @@ typedef C4_ENUM(int32_t, C4ErrorCode) {
     kC4ErrorCantUpgradeDatabase,/*30*/ // DB can't be upgraded (might be unsupported dev version)
     kC4ErrorDeltaBaseUnknown,       // Replicator can't apply delta: base revision body is missing
     kC4ErrorCorruptDelta,           // Replicator can't apply delta: delta data invalid
+    kC4ErrorInterrupted,            // Operation was canceled, or exceeded its time/size limit
     kC4NumErrorCodesPlus1
 };
 
@@ -537,6 +538,20 @@ bool c4_setTempDir(C4String path, C4Error* C4NULLABLE err) C4API;
         future time when `task` is called. */
 void c4_runAsyncTask(void (*task)(void*), void* C4NULLABLE context) C4API;
 
+/** Returns runtime metrics of LiteCore's Actors (the objects that do background work such as
+    replication), as a JSON object with a key for each Actor class. Each value is an object with:
+    - `actors`: Number of existing Actors of that class (that have handled any messages)
+    - `queueDepth`: Number of messages they have waiting right now
+    - `maxQueueDepth`: Longest queue any one of them has had
+    - `messages`: Total number of messages they've handled
+    - `activations`: Number of times they were scheduled onto a thread
+    - `busySeconds`: Total time spent handling messages
+    - `queueLatency`: Histogram of a sample of messages' time spent waiting in the queue:
+      item 0 counts waits under 1µs, item i counts those under 2^i µs, and the last counts
+      everything longer.
+    (Metrics aren't collected on Apple platforms, where Actors use Grand Central Dispatch.) */
+C4StringResult c4_getActorMetrics(void) C4API;
+
 
 /** @} */
 
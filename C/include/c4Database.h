@@ -203,6 +203,28 @@ extern "C" {
     /** Configures the number of revisions of a document that are tracked. */
     void c4db_setMaxRevTreeDepth(C4Database *database, uint32_t maxRevTreeDepth) C4API;
 
+    /** Statistics of a database's document cache. */
+    typedef struct C4DocumentCacheStats {
+        uint64_t hits;          ///< Document reads satisfied by the cache
+        uint64_t misses;        ///< Document reads that had to go to the database file
+        uint64_t evictions;     ///< Documents removed to keep the cache within its size limit
+        uint64_t count;         ///< Number of documents currently cached
+        uint64_t bytes;         ///< Approximate memory used by cached documents
+        uint64_t maxBytes;      ///< The cache's size limit
+    } C4DocumentCacheStats;
+
+    /** Configures an in-memory cache of recently-read documents, which speeds up repeated reads
+        of the same documents. Changes made by any connection to the database file in this
+        process are invalidated automatically, but changes made by other processes are not, so
+        don't enable the cache if another process writes to the database. The cache is
+        disabled (0) by default.
+        @param database  The database.
+        @param maxBytes  The approximate maximum memory used by the cache, or 0 to disable it. */
+    void c4db_setDocumentCacheSize(C4Database *database, size_t maxBytes) C4API;
+
+    /** Returns statistics about the database's document cache. */
+    C4DocumentCacheStats c4db_getDocumentCacheStats(C4Database *database) C4API;
+
     typedef struct C4UUID {
         uint8_t bytes[16];
     } C4UUID;
@@ -268,6 +290,33 @@ extern "C" {
                           C4Error* C4NULLABLE outError) C4API;
 
 
+    /** Results of \ref c4db_pruneRemoteRevisions. */
+    typedef struct {
+        uint64_t docsScanned;       ///< Number of documents examined
+        uint64_t docsPruned;        ///< Number of documents with data removed (or to remove)
+        uint64_t itemsRemoved;      ///< Number of remote markers and kept bodies removed
+        uint64_t bytesReclaimed;    ///< Approximate number of bytes freed
+    } C4RemoteRevisionGCStats;
+
+    /** Removes obsolete remote-revision data from documents' revision trees: the markers of
+        remote databases that are no longer registered (see \ref c4db_forgetRemoteDBID), and
+        the revision bodies that were kept because they were a remote's latest revision, but
+        no longer are. Documents' current revisions and sequences are unchanged.
+        The documents are processed in batches, each in its own transaction, so this must not
+        be called within a transaction.
+        \note This is also done in the background after \ref c4db_startHousekeeping.
+        \note Databases using version vectors don't accumulate this data, so this does nothing.
+        @param database  The database.
+        @param dryRun  If true, nothing is changed; the stats estimate what would be removed.
+        @param outStats  If non-NULL, the results are stored here.
+        @param outError  On failure, error info will be stored here.
+        @return  True on success, false on failure. */
+    bool c4db_pruneRemoteRevisions(C4Database* database,
+                                   bool dryRun,
+                                   C4RemoteRevisionGCStats* C4NULLABLE outStats,
+                                   C4Error* C4NULLABLE outError) C4API;
+
+
     // DEPRECATED -- call c4db_maintenance instead
     bool c4db_compact(C4Database* database, C4Error* C4NULLABLE outError) C4API;
     
@@ -226,6 +226,17 @@ extern "C" {
     C4SliceResult c4db_getRemoteDBAddress(C4Database *db,
                                           C4RemoteID remoteID) C4API;
 
+    /** Unregisters a remote database ID, after which \ref c4db_pruneRemoteRevisions will
+        remove documents' data about their revisions on that remote. (If the same address is
+        given to \ref c4db_getRemoteDBID later, it will get a new ID.)
+        @param db  The database.
+        @param remoteID  The ID assigned to the remote database.
+        @param outError  Error information is stored here; NotFound if the ID isn't registered.
+        @return  True on success, false on error. */
+    bool c4db_forgetRemoteDBID(C4Database *db,
+                               C4RemoteID remoteID,
+                               C4Error* C4NULLABLE outError) C4API;
+
     /** Returns the revision ID that has been marked as current for the given remote database. */
     C4SliceResult c4doc_getRemoteAncestor(C4Document *doc,
                                           C4RemoteID remoteDatabase) C4API;
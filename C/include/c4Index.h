@@ -71,6 +71,26 @@ extern "C" {
             To provide a custom list of words, use a string containing the words in lowercase
             separated by spaces. */
         const char* C4NULLABLE stopWords;
+
+        /** If true, a full-text or array index is not updated as part of each document save.
+            Instead, the IDs of changed documents are recorded and the index is brought up to date
+            later, in batches, by the database's background housekeeping task (see
+            `c4db_startHousekeeping`.) Until then, queries that use the index won't see the
+            latest changes, unless they set `C4QueryOptions.waitForIndexes`.
+            This speeds up writes at the expense of query freshness.
+            Ignored for other index types. */
+        bool deferred;
+
+        /** If true, each indexed expression of a value index that's a plain document property
+            is materialized: the index also stores what's needed to reproduce the property's
+            value, and queries read the property from the index instead of parsing the
+            document body. So a query that looks up and returns indexed properties can be
+            answered from the index alone. Other value indexes on the same properties are
+            rebuilt to match. Creating the first materialized index upgrades the database
+            schema, after which earlier versions of LiteCore can't open the database at all.
+            Requires SQLite 3.41 or later; with an older SQLite this flag is ignored. Ignored
+            for other index types. */
+        bool materialized;
     } C4IndexOptions;
 
 
@@ -98,6 +98,49 @@ extern "C" {
     void c4dbobs_releaseChanges(C4DatabaseChange changes[C4NONNULL],
                                 uint32_t numChanges) C4API;
 
+    /** Callback invoked by a batched database observer, with a batch of changes.
+        All the changes were made either by this C4Database or by other ones, as indicated by
+        the `external` flag, and each document appears at most once.
+        The changes' strings are only valid until the callback returns; they'll be released
+        afterwards, so don't call \ref c4dbobs_releaseChanges.
+
+        CAUTION: This callback is called on a background thread. It's safe to call LiteCore
+        from it, but it should return promptly, since this observer's next batch is delayed
+        until it does. It must not free the observer.
+        @param observer  The observer that initiated the callback.
+        @param changes  The changes.
+        @param numChanges  The number of changes; never zero.
+        @param external  True if the changes were made by a different C4Database.
+        @param context  user-defined parameter given when registering the callback. */
+    typedef void (*C4DatabaseObserverBatchCallback)(C4DatabaseObserver* observer,
+                                                    const C4DatabaseChange changes[C4NONNULL],
+                                                    uint32_t numChanges,
+                                                    bool external,
+                                                    void* C4NULLABLE context);
+
+    /** Options for a batched database observer. */
+    typedef struct {
+        uint32_t minIntervalMS;     ///< Minimum time between callbacks, in milliseconds
+        uint32_t maxBatchSize;      ///< Max number of changes per callback (0 for default, 1000)
+    } C4DatabaseObserverOptions;
+
+    /** Creates a new database observer that delivers changes itself, in batches, instead of
+        notifying you to call \ref c4dbobs_getChanges. After the database changes, the callback
+        is called on a background thread with all the changes made since the last batch, up to
+        `maxBatchSize`; if there are more, it's called again.
+        Changes made in quick succession are coalesced, as the callback is never called sooner
+        than `minIntervalMS` after the previous batch was collected. Multiple changes to a
+        document within that time appear as a single change.
+        @param database  The database to observe.
+        @param options  The minimum interval and maximum batch size.
+        @param callback  The function to call with changes.
+        @param context  An arbitrary value that will be passed to the callback.
+        @return  The new observer reference. */
+    C4DatabaseObserver* c4dbobs_createBatched(C4Database* database,
+                                              C4DatabaseObserverOptions options,
+                                              C4DatabaseObserverBatchCallback callback,
+                                              void* C4NULLABLE context) C4API;
+
     /** Stops an observer and frees the resources it's using.
         It is safe to pass NULL to this call. */
     void c4dbobs_free(C4DatabaseObserver* C4NULLABLE) C4API;
@@ -130,6 +173,24 @@ extern "C" {
                                         C4DocumentObserverCallback callback,
                                         void* C4NULLABLE context) C4API;
 
+    /** Creates a new document observer that observes multiple documents: either those with
+        the given IDs, or those whose IDs start with any of the given prefixes. The callback
+        will be called every time any of those documents changes.
+        This is much more efficient than creating an observer for each document.
+        @param database  The database to observer.
+        @param docIDs  An array of document IDs, or of document ID prefixes.
+        @param count  The number of items in `docIDs`.
+        @param matchPrefixes  If true, the strings in `docIDs` are prefixes to match.
+        @param callback  The function to call after a document changes.
+        @param context  An arbitrary value that will be passed to the callback.
+        @return  The new observer reference. */
+    C4DocumentObserver* c4docobs_createMultiple(C4Database* database,
+                                                const C4String docIDs[C4NONNULL],
+                                                size_t count,
+                                                bool matchPrefixes,
+                                                C4DocumentObserverCallback callback,
+                                                void* C4NULLABLE context) C4API;
+
     /** Stops an observer and frees the resources it's using.
         It is safe to pass NULL to this call. */
     void c4docobs_free(C4DocumentObserver* C4NULLABLE) C4API;
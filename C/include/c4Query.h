@@ -64,6 +64,33 @@ extern "C" {
     C4StringResult c4query_explain(C4Query*) C4API;
 
 
+    /** Execution statistics of a query, collected while profiling is enabled.
+        (See \ref c4query_setProfiling.) */
+    typedef struct {
+        uint64_t runs;              ///< Number of times the query ran
+        uint64_t rowsReturned;      ///< Number of result rows
+        uint64_t rowsScanned;       ///< Number of rows stepped over by full table scans
+        uint64_t sortOps;           ///< Number of sort operations, for ORDER BY, GROUP BY, etc.
+        uint64_t autoIndexRows;     ///< Number of rows inserted into automatic indexes
+        uint64_t vmSteps;           ///< Number of SQLite virtual machine operations
+        uint64_t fleeceValueCalls;  ///< Number of reads of document bodies or property values
+        double   sqliteTime;        ///< Seconds spent in SQLite (including property lookups)
+        double   encodeTime;        ///< Seconds spent encoding the result rows
+        bool     fullScan;          ///< True if a run scanned an entire table
+        bool     tempBTree;         ///< True if a run sorted rows or built an automatic index
+    } C4QueryStats;
+
+    /** Turns profiling of a query on or off. While on, each run of the query records statistics,
+        which are available from \ref c4query_getStats and \ref c4queryenum_getStats.
+        Profiling has a small cost per result row, so it's off by default.
+        Turning it on resets the statistics. */
+    void c4query_setProfiling(C4Query*, bool enabled) C4API;
+
+    /** Returns the statistics of a query, totaled over all runs since profiling was enabled.
+        (The `fullScan` and `tempBTree` flags are true if they were true of any run.) */
+    C4QueryStats c4query_getStats(C4Query*) C4API;
+
+
     /** Returns the number of columns (the values specified in the WHAT clause) in each row. */
     unsigned c4query_columnCount(C4Query*) C4API;
 
@@ -82,6 +109,15 @@ extern "C" {
     /** Options for running queries. */
     typedef struct {
         bool rankFullText_DEPRECATED;      ///< Ignored; use the `rank()` query function instead.
+        bool waitForIndexes;               ///< If true, deferred indexes the query uses are
+                                           ///< brought up to date first, unless at most
+                                           ///< `maxUnindexedDocs` docs are waiting to be indexed.
+                                           ///< Otherwise results may be stale. (See C4IndexOptions.)
+        uint32_t maxUnindexedDocs;         ///< Deferred-index backlog `waitForIndexes` tolerates.
+        uint32_t timeoutMS;                ///< Max milliseconds the query may run, or 0 for no
+                                           ///< limit; else it fails with kC4ErrorInterrupted.
+        uint32_t maxRows;                  ///< Max number of rows the query may return, or 0 for
+                                           ///< no limit; else it fails with kC4ErrorInterrupted.
     } C4QueryOptions;
 
 
@@ -144,6 +180,11 @@ extern "C" {
                                    C4String encodedParameters,
                                    C4Error* C4NULLABLE outError) C4API;
 
+    /** Interrupts any run of the query (\ref c4query_run) that's in progress on another thread,
+        which will then fail with error kC4ErrorInterrupted. This is useful for canceling a
+        long-running query. It has no effect on runs that start afterwards. */
+    void c4query_cancel(C4Query *query) C4API;
+
     /** Given a C4FullTextMatch from the enumerator, returns the entire text of the property that
         was matched. (The result depends only on the term's `dataSource` and `property` fields,
         so if you get multiple matches of the same property in the same document, you can skip
@@ -188,6 +229,13 @@ extern "C" {
     C4QueryEnumerator* c4queryenum_refresh(C4QueryEnumerator *e,
                                            C4Error* C4NULLABLE outError) C4API;
 
+    /** Gets the statistics of the query run that created this enumerator.
+        @param e  The query enumerator
+        @param outStats  The statistics will be stored here.
+        @return  True on success, false if the query was not being profiled when it ran. */
+    bool c4queryenum_getStats(C4QueryEnumerator *e,
+                              C4QueryStats *outStats) C4API;
+
     /** Closes an enumerator without freeing it. This is optional, but can be used to free up
         resources if the enumeration has not reached its end, but will not be freed for a while. */
     void c4queryenum_close(C4QueryEnumerator*) C4API;
@@ -247,6 +247,79 @@ N_WAY_TEST_CASE_METHOD(C4DatabaseTest, "Database CreateRawDoc", "[Database][Docu
 }
 
 
+N_WAY_TEST_CASE_METHOD(C4DatabaseTest, "Database Document Cache", "[Database][Document][C]") {
+    createRev(kDocID, kRevID, kFleeceBody);
+    CHECK(c4db_getDocumentCacheStats(db).maxBytes == 0);
+    c4db_setDocumentCacheSize(db, 1024*1024);
+
+    auto getRevID = [&](C4Database *inDB) {
+        C4Document* doc = REQUIRED( c4doc_get(inDB, kDocID, true, WITH_ERROR()) );
+        alloc_slice revID(doc->revID);
+        c4doc_release(doc);
+        return revID;
+    };
+
+    // First read misses and fills the cache; the second hits:
+    CHECK(getRevID(db) == kRevID);
+    C4DocumentCacheStats stats = c4db_getDocumentCacheStats(db);
+    CHECK(stats.hits == 0);
+    CHECK(stats.misses > 0);
+    CHECK(stats.count == 1);
+    CHECK(stats.bytes > 0);
+    auto misses = stats.misses;
+    CHECK(getRevID(db) == kRevID);
+    stats = c4db_getDocumentCacheStats(db);
+    CHECK(stats.hits > 0);
+    CHECK(stats.misses == misses);
+
+    // Updating the doc on the same connection invalidates it:
+    createRev(kDocID, kRev2ID, kFleeceBody);
+    CHECK(getRevID(db) == kRev2ID);
+
+    // So does updating it on another connection:
+    C4Database *db2 = c4db_openAgain(db, ERROR_INFO());
+    REQUIRE(db2);
+    CHECK(getRevID(db) == kRev2ID);
+    CHECK(c4db_getDocumentCacheStats(db).count == 1);
+    createRev(db2, kDocID, kRev3ID, kFleeceBody);
+    CHECK(c4db_getDocumentCacheStats(db).count == 0);
+    CHECK(getRevID(db) == kRev3ID);
+
+    // ...even one that only updates the rev tree's remote-ancestor info, keeping its sequence:
+    if (isRevTrees()) {
+        C4Document* doc = REQUIRED( c4db_getDoc(db, kDocID, true, kDocGetAll, WITH_ERROR()) );
+        C4SequenceNumber sequence = doc->sequence;
+        c4doc_release(doc);
+        {
+            TransactionHelper t(db2);
+            doc = REQUIRED( c4db_getDoc(db2, kDocID, true, kDocGetAll, WITH_ERROR()) );
+            REQUIRE(c4doc_setRemoteAncestor(doc, 2, kRev3ID, WITH_ERROR()));
+            REQUIRE(c4doc_save(doc, 0, WITH_ERROR()));
+            c4doc_release(doc);
+        }
+        doc = REQUIRED( c4db_getDoc(db, kDocID, true, kDocGetAll, WITH_ERROR()) );
+        CHECK(doc->sequence == sequence);
+        CHECK(alloc_slice(c4doc_getRemoteAncestor(doc, 2)) == kRev3ID);
+        c4doc_release(doc);
+    }
+
+    // ...and purging it:
+    REQUIRE(c4db_beginTransaction(db2, WITH_ERROR()));
+    REQUIRE(c4db_purgeDoc(db2, kDocID, WITH_ERROR()));
+    REQUIRE(c4db_endTransaction(db2, true, WITH_ERROR()));
+    C4Error error;
+    CHECK(c4doc_get(db, kDocID, true, &error) == nullptr);
+    CHECK(error == C4Error{LiteCoreDomain, kC4ErrorNotFound});
+    c4db_release(db2);
+
+    // Disabling the cache empties it:
+    c4db_setDocumentCacheSize(db, 0);
+    stats = c4db_getDocumentCacheStats(db);
+    CHECK(stats.count == 0);
+    CHECK(stats.bytes == 0);
+}
+
+
 N_WAY_TEST_CASE_METHOD(C4DatabaseTest, "Database Enumerator", "[Database][Document][Enumerator][C]") {
     setupAllDocs();
     C4Error error;
@@ -1017,3 +1090,129 @@ N_WAY_TEST_CASE_METHOD(C4DatabaseTest, "Database Upgrade To Version Vectors", "[
     CHECK(doc->flags == (kDocDeleted | kDocExists));
     c4doc_release(doc);
 }
+
+
+N_WAY_TEST_CASE_METHOD(C4DatabaseTest, "Database Forget Remote DB ID", "[Database][C]") {
+    C4RemoteID remote1 = c4db_getRemoteDBID(db, "wss://example.com/db1"_sl, true, ERROR_INFO());
+    C4RemoteID remote2 = c4db_getRemoteDBID(db, "wss://example.com/db2"_sl, true, ERROR_INFO());
+    CHECK(remote1 == 1);
+    CHECK(remote2 == 2);
+
+    REQUIRE(c4db_forgetRemoteDBID(db, remote1, WITH_ERROR()));
+    CHECK(alloc_slice(c4db_getRemoteDBAddress(db, remote1)) == nullslice);
+    CHECK(alloc_slice(c4db_getRemoteDBAddress(db, remote2)) == "wss://example.com/db2"_sl);
+
+    // It can't be forgotten twice:
+    C4Error error;
+    CHECK(!c4db_forgetRemoteDBID(db, remote1, &error));
+    CHECK(error == C4Error{LiteCoreDomain, kC4ErrorNotFound});
+
+    // Registering the same address again assigns a new ID:
+    CHECK(c4db_getRemoteDBID(db, "wss://example.com/db1"_sl, true, ERROR_INFO()) == 3);
+    CHECK(c4db_getRemoteDBID(db, "wss://example.com/db2"_sl, false, ERROR_INFO()) == remote2);
+}
+
+
+static bool hasRevBody(C4Database *db, slice docID, slice revID) {
+    C4Document *doc = c4db_getDoc(db, docID, true, kDocGetAll, ERROR_INFO());
+    REQUIRE(doc);
+    REQUIRE(c4doc_selectRevision(doc, revID, false, WITH_ERROR()));
+    bool result = c4doc_hasRevisionBody(doc);
+    c4doc_release(doc);
+    return result;
+}
+
+
+static alloc_slice getRemoteRev(C4Database *db, slice docID, C4RemoteID remote) {
+    C4Document *doc = c4db_getDoc(db, docID, true, kDocGetAll, ERROR_INFO());
+    REQUIRE(doc);
+    alloc_slice revID = c4doc_getRemoteAncestor(doc, remote);
+    c4doc_release(doc);
+    return revID;
+}
+
+
+// Creates a doc whose rev 2 is the remote's latest revision, with its body kept, and rev 3.
+static void createRemoteRevDoc(C4Database *db, slice docID, C4RemoteID remote) {
+    C4Test::createFleeceRev(db, docID, "1-abcd"_sl, "{\"rev\":1}"_sl);
+    C4Test::createFleeceRev(db, docID, "2-c001d00d"_sl, "{\"rev\":2}"_sl, kRevKeepBody);
+    setRemoteRev(db, docID, "2-c001d00d"_sl, remote);
+    C4Test::createFleeceRev(db, docID, "3-deadbeef"_sl, "{\"rev\":3}"_sl);
+}
+
+
+N_WAY_TEST_CASE_METHOD(C4DatabaseTest, "Database Prune Remote Revisions", "[Database][C]") {
+    if (!isRevTrees())
+        return;
+
+    C4RemoteID remote1 = c4db_getRemoteDBID(db, "wss://example.com/db1"_sl, true, ERROR_INFO());
+    C4RemoteID remote2 = c4db_getRemoteDBID(db, "wss://example.com/db2"_sl, true, ERROR_INFO());
+    REQUIRE(remote1);
+    REQUIRE(remote2);
+    {
+        TransactionHelper t(db);
+        createRemoteRevDoc(db, "doc-1"_sl, remote1);
+        createRemoteRevDoc(db, "doc-2"_sl, remote2);
+    }
+    C4SequenceNumber lastSeq = c4db_getLastSequence(db);
+
+    // Both remotes are registered, so nothing is obsolete:
+    C4RemoteRevisionGCStats stats;
+    REQUIRE(c4db_pruneRemoteRevisions(db, false, &stats, WITH_ERROR()));
+    CHECK(stats.docsScanned == 2);
+    CHECK(stats.docsPruned == 0);
+    CHECK(stats.itemsRemoved == 0);
+
+    // Now doc-1's remote marker and the body it kept are obsolete:
+    REQUIRE(c4db_forgetRemoteDBID(db, remote1, WITH_ERROR()));
+
+    SECTION("Dry run") {
+        REQUIRE(c4db_pruneRemoteRevisions(db, true, &stats, WITH_ERROR()));
+        CHECK(stats.docsScanned == 2);
+        CHECK(stats.docsPruned == 1);
+        CHECK(stats.itemsRemoved == 2);
+        CHECK(stats.bytesReclaimed > 0);
+
+        CHECK(getRemoteRev(db, "doc-1"_sl, remote1) == "2-c001d00d"_sl);
+        CHECK(hasRevBody(db, "doc-1"_sl, "2-c001d00d"_sl));
+    }
+    SECTION("Prune") {
+        REQUIRE(c4db_pruneRemoteRevisions(db, false, &stats, WITH_ERROR()));
+        CHECK(stats.docsScanned == 2);
+        CHECK(stats.docsPruned == 1);
+        CHECK(stats.itemsRemoved == 2);
+        CHECK(stats.bytesReclaimed > 0);
+
+        CHECK(getRemoteRev(db, "doc-1"_sl, remote1) == nullslice);
+        CHECK(!hasRevBody(db, "doc-1"_sl, "2-c001d00d"_sl));
+        CHECK(hasRevBody(db, "doc-1"_sl, "3-deadbeef"_sl));
+
+        // Another pass finds nothing more to do:
+        REQUIRE(c4db_pruneRemoteRevisions(db, false, &stats, WITH_ERROR()));
+        CHECK(stats.docsPruned == 0);
+    }
+
+    // The other remote's data, and the docs' sequences, are unchanged:
+    CHECK(getRemoteRev(db, "doc-2"_sl, remote2) == "2-c001d00d"_sl);
+    CHECK(hasRevBody(db, "doc-2"_sl, "2-c001d00d"_sl));
+    CHECK(c4db_getLastSequence(db) == lastSeq);
+}
+
+
+N_WAY_TEST_CASE_METHOD(C4DatabaseTest, "Database RemoteRevisionGC In Background", "[Database][C]") {
+    if (!isRevTrees())
+        return;
+
+    C4RemoteID remote1 = c4db_getRemoteDBID(db, "wss://example.com/db1"_sl, true, ERROR_INFO());
+    REQUIRE(remote1);
+    {
+        TransactionHelper t(db);
+        createRemoteRevDoc(db, "doc-1"_sl, remote1);
+    }
+    REQUIRE(c4db_startHousekeeping(db));
+
+    // Forgetting the remote makes the Housekeeper prune its data from all docs:
+    REQUIRE(c4db_forgetRemoteDBID(db, remote1, WITH_ERROR()));
+    REQUIRE_BEFORE(5s, !hasRevBody(db, "doc-1"_sl, "2-c001d00d"_sl));
+    CHECK(getRemoteRev(db, "doc-1"_sl, remote1) == nullslice);
+}
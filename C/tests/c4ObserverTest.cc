@@ -18,6 +18,9 @@
 
 #include "c4Test.hh"
 #include "c4Observer.h"
+#include <condition_variable>
+#include <mutex>
+#include <thread>
 
 
 class C4ObserverTest : public C4Test {
@@ -218,3 +221,105 @@ N_WAY_TEST_CASE_METHOD(C4ObserverTest, "Doc Observer Expiration", "[Observer][C]
 }
 
 
+
+
+N_WAY_TEST_CASE_METHOD(C4ObserverTest, "Batched DB Observer", "[Observer][C]") {
+    struct Batches {
+        std::mutex mutex;
+        std::condition_variable cond;
+        std::vector<std::vector<alloc_slice>> docIDs;
+        alloc_slice firstRevID;
+        size_t total = 0;
+        bool external = false;
+        bool released = false;      // The first callback blocks until this is set
+
+        size_t count() {std::lock_guard<std::mutex> lock(mutex); return total;}
+    } batches;
+
+    auto callback = [](C4DatabaseObserver*, const C4DatabaseChange changes[], uint32_t n,
+                       bool external, void *context) {
+        auto b = (Batches*)context;
+        std::unique_lock<std::mutex> lock(b->mutex);
+        std::vector<alloc_slice> docIDs;
+        for (uint32_t i = 0; i < n; ++i)
+            docIDs.emplace_back(changes[i].docID);
+        if (!b->firstRevID)
+            b->firstRevID = changes[0].revID;
+        b->docIDs.push_back(docIDs);
+        b->total += n;
+        b->external |= external;
+        if (b->docIDs.size() == 1)
+            b->cond.wait_for(lock, 5s, [&]{return b->released;});
+    };
+
+    C4DatabaseObserverOptions options = {200, 2};
+    dbObserver = c4dbobs_createBatched(db, options, callback, &batches);
+    REQUIRE(dbObserver);
+
+    createRev("A"_sl, kDocARev1, kFleeceBody);
+    REQUIRE(WaitUntil(2000ms, [&]{return batches.count() == 1;}));
+
+    // These changes happen while the first callback is blocked, so they're coalesced; and since
+    // the batch size is 2, they arrive in two batches:
+    createRev("B"_sl, kDocBRev1, kFleeceBody);
+    createRev("C"_sl, kDocCRev1, kFleeceBody);
+    createRev("A"_sl, kDocARev2, kFleeceBody);
+    createRev("B"_sl, kDocBRev2, kFleeceBody);
+    {
+        std::lock_guard<std::mutex> lock(batches.mutex);
+        batches.released = true;
+    }
+    batches.cond.notify_all();
+    REQUIRE(WaitUntil(2000ms, [&]{return batches.count() == 4;}));
+
+    // Freeing the observer stops deliveries synchronously, so no more batches can arrive:
+    c4dbobs_free(dbObserver);
+    dbObserver = nullptr;
+
+    createRev("D"_sl, kDocDRev1, kFleeceBody);
+
+    std::lock_guard<std::mutex> lock(batches.mutex);
+    CHECK(batches.total == 4);
+    CHECK(!batches.external);
+    CHECK(batches.firstRevID == kDocARev1);
+    REQUIRE(batches.docIDs.size() == 3);
+    CHECK(batches.docIDs[0] == std::vector<alloc_slice>{alloc_slice("A")});
+    CHECK(batches.docIDs[1] == (std::vector<alloc_slice>{alloc_slice("C"), alloc_slice("A")}));
+    CHECK(batches.docIDs[2] == std::vector<alloc_slice>{alloc_slice("B")});
+}
+
+
+N_WAY_TEST_CASE_METHOD(C4ObserverTest, "Multiple-Doc Observer", "[Observer][C]") {
+    std::vector<alloc_slice> changed;
+    auto callback = [](C4DocumentObserver*, C4String docID, C4SequenceNumber, void *context) {
+        ((std::vector<alloc_slice>*)context)->emplace_back(docID);
+    };
+
+    bool prefixes = false;
+    SECTION("DocIDs") {
+    }
+    SECTION("Prefixes") {
+        prefixes = true;
+    }
+    C4String keys[] = {"A"_sl, "C"_sl};
+    docObserver = c4docobs_createMultiple(db, keys, 2, prefixes, callback, &changed);
+    REQUIRE(docObserver);
+
+    createRev("A"_sl, kDocARev1, kFleeceBody);
+    createRev("B"_sl, kDocBRev1, kFleeceBody);
+    createRev("C"_sl, kDocCRev1, kFleeceBody);
+    createRev("Cx"_sl, kDocDRev1, kFleeceBody);
+    createRev("A"_sl, kDocARev2, kFleeceBody);
+
+    std::vector<alloc_slice> expected;
+    if (prefixes)
+        expected = {alloc_slice("A"), alloc_slice("C"), alloc_slice("Cx"), alloc_slice("A")};
+    else
+        expected = {alloc_slice("A"), alloc_slice("C"), alloc_slice("A")};
+    CHECK(changed == expected);
+
+    c4docobs_free(docObserver);
+    docObserver = nullptr;
+    createRev("C"_sl, kDocCRev1, kFleeceBody);
+    CHECK(changed == expected);
+}
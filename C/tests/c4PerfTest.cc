@@ -336,3 +336,69 @@ N_WAY_TEST_CASE_METHOD(PerfTest, "Import Wikipedia", "[Perf][C][.slow]") {
     reopenDB();
     readRandomDocs(numDocs, 100000);
 }
+
+
+N_WAY_TEST_CASE_METHOD(PerfTest, "FindDocAncestors deep history", "[Perf][C][.slow]") {
+    if (!isRevTrees())
+        return;
+    static constexpr unsigned kNumDocs = 1000, kHistoryDepth = 100, kBatchSize = 100;
+
+    // Each doc gets a linear history of kHistoryDepth revisions:
+    vector<string> revIDs;
+    for (unsigned gen = kHistoryDepth; gen >= 1; --gen) {
+        char revID[50];
+        sprintf(revID, "%u-%08x%08x", gen, gen * 2654435761u, gen);
+        revIDs.push_back(revID);
+    }
+    vector<C4Slice> history;
+    for (auto &revID : revIDs)
+        history.push_back(slice(revID));
+
+    string content(1000, 'a');
+    alloc_slice body = c4db_encodeJSON(db, slice("{\"content\":\"" + content + "\"}"), ERROR_INFO());
+    REQUIRE(body);
+
+    vector<string> docIDs;
+    {
+        TransactionHelper t(db);
+        for (unsigned i = 0; i < kNumDocs; i++) {
+            char docID[20];
+            sprintf(docID, "doc-%04u", i);
+            docIDs.push_back(docID);
+            C4DocPutRequest rq = {};
+            rq.existingRevision = true;
+            rq.docID = slice(docIDs.back());
+            rq.history = history.data();
+            rq.historyCount = history.size();
+            rq.body = body;
+            rq.save = true;
+            auto doc = c4doc_put(db, &rq, nullptr, ERROR_INFO());
+            REQUIRE(doc);
+            c4doc_release(doc);
+        }
+    }
+
+    // Ask about a newer revision of each doc, so every call has to walk the history:
+    char newRevID[50];
+    sprintf(newRevID, "%u-cafebabe", kHistoryDepth + 1);
+    vector<C4String> batchIDs(kBatchSize), batchRevs(kBatchSize, slice(newRevID));
+    vector<C4SliceResult> ancestors(kBatchSize);
+
+    Benchmark b;
+    for (unsigned pass = 0; pass < 10; ++pass) {
+        for (unsigned start = 0; start < kNumDocs; start += kBatchSize) {
+            for (unsigned i = 0; i < kBatchSize; ++i)
+                batchIDs[i] = slice(docIDs[start + i]);
+            b.start();
+            REQUIRE(c4db_findDocAncestors(db, kBatchSize, 20, false, 1,
+                                          batchIDs.data(), batchRevs.data(), ancestors.data(),
+                                          WITH_ERROR()));
+            b.stop();
+            for (auto &a : ancestors) {
+                CHECK(slice(a).hasPrefix("1["_sl));
+                c4slice_free(a);
+            }
+        }
+    }
+    b.printReport(1.0 / kBatchSize, "doc");
+}
@@ -282,6 +282,53 @@ N_WAY_TEST_CASE_METHOD(C4QueryTest, "C4Query expression index", "[Query][C]") {
 }
 
 
+N_WAY_TEST_CASE_METHOD(C4QueryTest, "C4Query profiling", "[Query][C]") {
+    compile(json5("['=', ['length()', ['.name.first']], 9]"));
+
+    // Not profiling yet:
+    C4Error error;
+    C4QueryStats stats;
+    auto e = c4query_run(query, &kC4DefaultQueryOptions, kC4SliceNull, ERROR_INFO(error));
+    REQUIRE(e);
+    CHECK(!c4queryenum_getStats(e, &stats));
+    c4queryenum_release(e);
+    CHECK(c4query_getStats(query).runs == 0);
+
+    c4query_setProfiling(query, true);
+    CHECK(run() == (vector<string>{ "0000015", "0000099" }));
+    CHECK(run() == (vector<string>{ "0000015", "0000099" }));
+    stats = c4query_getStats(query);
+    CHECK(stats.runs == 2);
+    CHECK(stats.rowsReturned == 4);
+    CHECK(stats.rowsScanned >= 2 * 99);         // (every doc is visited, in each run)
+    CHECK(stats.fleeceValueCalls >= 200);       // (every doc's name.first is looked up)
+    CHECK(stats.vmSteps > stats.rowsScanned);
+    CHECK(stats.sortOps == 0);
+    CHECK(stats.sqliteTime > 0.0);
+    CHECK(stats.fullScan);
+    CHECK(!stats.tempBTree);
+
+    // With an index, the query doesn't scan the whole table:
+    REQUIRE(c4db_createIndex(db, C4STR("length"), c4str(json5("[['length()', ['.name.first']]]").c_str()), kC4ValueIndex, nullptr, WITH_ERROR(&error)));
+    compile(json5("['=', ['length()', ['.name.first']], 9]"));
+    c4query_setProfiling(query, true);
+    e = c4query_run(query, &kC4DefaultQueryOptions, kC4SliceNull, ERROR_INFO(error));
+    REQUIRE(e);
+    REQUIRE(c4queryenum_getStats(e, &stats));
+    c4queryenum_release(e);
+    CHECK(stats.runs == 1);
+    CHECK(stats.rowsReturned == 2);
+    CHECK(stats.rowsScanned == 0);
+    CHECK(!stats.fullScan);
+    CHECK(c4query_getStats(query).runs == 1);
+
+    // Turning profiling back on resets the totals:
+    c4query_setProfiling(query, false);
+    c4query_setProfiling(query, true);
+    CHECK(c4query_getStats(query).runs == 0);
+}
+
+
 static bool lookForIndex(C4Database *db, slice name) {
     bool found = false;
     Doc info(alloc_slice(c4db_getIndexesInfo(db, nullptr)));
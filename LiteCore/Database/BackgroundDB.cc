@@ -66,7 +66,7 @@ namespace litecore {
 
             bool commit;
             try {
-                commit = task(dataFile, &sequenceTracker);
+                commit = task(dataFile, t, &sequenceTracker);
             } catch (const exception &) {
                 t.abort();
                 sequenceTracker.endTransaction(false);
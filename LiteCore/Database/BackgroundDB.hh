@@ -27,7 +27,7 @@ namespace litecore {
 
         void close();
 
-        using TransactionTask = function_ref<bool(DataFile*, SequenceTracker*)>;
+        using TransactionTask = function_ref<bool(DataFile*, Transaction&, SequenceTracker*)>;
 
         void useInTransaction(TransactionTask task);
 
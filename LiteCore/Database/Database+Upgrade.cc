@@ -44,7 +44,7 @@ namespace c4Internal {
 
     static const Rev* commonAncestor(const Rev *a, const Rev *b) {
         if (a && b) {
-            for (auto rev = b; rev; rev = rev->parent) {
+            for (auto rev = b; rev; rev = rev->parent()) {
                 if (rev->isAncestorOf(a))
                     return rev;
             }
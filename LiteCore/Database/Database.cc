@@ -35,6 +35,7 @@
 #include "SecureRandomize.hh"
 #include "StringUtil.hh"
 #include <functional>
+#include <inttypes.h>
 
 namespace litecore { namespace constants
 {
@@ -55,6 +56,10 @@ namespace c4Internal {
 
     const slice Database::kPublicUUIDKey = "publicUUID"_sl;
     const slice Database::kPrivateUUIDKey = "privateUUID"_sl;
+    const slice Database::kRemoteDBURLsDoc = "remotes"_sl;
+
+    // Number of documents pruneRemoteRevisions processes per transaction
+    static constexpr unsigned kRemoteRevisionGCBatchSize = 1000;
 
 
 #pragma mark - LIFECYCLE:
@@ -337,6 +342,40 @@ namespace c4Internal {
     }
 
 
+    RemoteRevisionGC::Stats Database::pruneRemoteRevisions(bool dryRun) {
+        mustNotBeInTransaction();
+        if (_configV1.versioning == kC4VectorVersioning)
+            return {};      // VectorRecords store only the latest revision of each remote
+        auto remotes = RemoteRevisionGC::registeredRemotes(getKeyStore(toString(kC4InfoStore)),
+                                                           kRemoteDBURLsDoc);
+        RemoteRevisionGC gc(defaultKeyStore(), move(remotes), dryRun);
+        bool more;
+        do {
+            if (dryRun) {
+                more = gc.processBatch(nullptr, kRemoteRevisionGCBatchSize);
+            } else {
+                TransactionHelper t(this);
+                more = gc.processBatch(&(Transaction&)t, kRemoteRevisionGCBatchSize);
+                t.commit();
+            }
+        } while (more);
+
+        auto &stats = gc.stats();
+        LogTo(DBLog, "%s obsolete remote revision data: %" PRIu64 " of %" PRIu64 " docs, "
+                     "%" PRIu64 " items, %" PRIu64 " bytes",
+              (dryRun ? "Found" : "Removed"), stats.docsPruned, stats.docsScanned,
+              stats.itemsRemoved, stats.bytesReclaimed);
+        return stats;
+    }
+
+
+    void Database::remoteDBForgotten() {
+        RemoteRevisionGC::setCheckpoint(getKeyStore(toString(kC4InfoStore)), 0, transaction());
+        if (_housekeeper)
+            _housekeeper->pruneRemoteRevisions();
+    }
+
+
     void Database::rekey(const C4EncryptionKey *newKey) {
         _dataFile->_logInfo("Rekeying database...");
         C4EncryptionKey keyBuf {kC4EncryptionNone, {}};
@@ -590,17 +629,21 @@ namespace c4Internal {
 
     // The cleanup part of endTransaction
     void Database::_cleanupTransaction(bool committed) {
+        bool changed = false;
         if (_sequenceTracker) {
             _sequenceTracker->use([&](SequenceTracker &st) {
                 if (committed && st.changedDuringTransaction()) {
                     // Notify other Database instances on this file:
                     _transaction->notifyCommitted(st);
+                    changed = true;
                 }
                 st.endTransaction(committed);
             });
         }
         delete _transaction;
         _transaction = nullptr;
+        if (changed && _housekeeper)
+            _housekeeper->documentsChanged();      // in case there are deferred indexes
     }
 
 
@@ -22,6 +22,7 @@
 #include "c4Database.h"
 #include "c4Document.h"
 #include "DataFile.hh"
+#include "RemoteRevisionGC.hh"
 #include "FilePath.hh"
 #include "InstanceCounted.hh"
 #include "access_lock.hh"
@@ -82,6 +83,17 @@ namespace c4Internal {
         
         void maintenance(DataFile::MaintenanceType what);
 
+        /** Removes obsolete remote-revision data from all documents (see RemoteRevisionGC),
+            in a series of short transactions. If `dryRun` is true, just estimates it. */
+        RemoteRevisionGC::Stats pruneRemoteRevisions(bool dryRun);
+
+        /** Call within a transaction after unregistering a remote DB. Resets the background
+            RemoteRevisionGC pass, so that it removes the remote's data from all documents. */
+        void remoteDBForgotten();
+
+        /** The raw document in the info store that maps remote DB addresses to RemoteIDs. */
+        static const slice kRemoteDBURLsDoc;
+
         const C4DatabaseConfig2* config() const         {return &_config;}
         const C4DatabaseConfig* configV1() const        {return &_configV1;};   // TODO: DEPRECATED
 
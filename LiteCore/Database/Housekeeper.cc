@@ -21,7 +21,9 @@
 #include "SequenceTracker.hh"
 #include "BackgroundDB.hh"
 #include "DataFile.hh"
+#include "RemoteRevisionGC.hh"
 #include "Logging.hh"
+#include <atomic>
 #include <inttypes.h>
 
 namespace litecore {
@@ -29,21 +31,99 @@ namespace litecore {
     using namespace actor;
     using namespace std;
 
+    // How long to wait after a change before updating deferred indexes, to batch up changes
+    static constexpr auto kDeferredIndexDelay = chrono::milliseconds(500);
+
+    // Max number of documents to index per transaction, so writers aren't blocked for long
+    static constexpr unsigned kDeferredIndexBatchSize = 500;
+
+    // How long after starting to prune obsolete remote revision data; it's not urgent
+    static constexpr auto kRevisionGCDelay = chrono::minutes(1);
+
+    // Max number of documents to scan for obsolete remote revision data per transaction
+    static constexpr unsigned kRevisionGCBatchSize = 500;
+
+    /** Runs the Housekeeper's bulk work -- deferred-index updates and remote-revision GC --
+        on its own Background-priority mailbox, so that a long run of batches can't hold up
+        document expiration, which stays on the Housekeeper's Interactive mailbox. */
+    class Housekeeper::BulkTasks : public Actor {
+    public:
+        BulkTasks(BackgroundDB *bgdb, bool revTrees)
+        :Actor(DBLog, "Housekeeper-bulk")
+        ,_bgdb(bgdb)
+        ,_indexUpdateTimer([this] {
+            enqueue(FUNCTION_TO_QUEUE(BulkTasks::_updateDeferredIndexes));
+        })
+        ,_revisionGCTimer([this] {
+            enqueue(FUNCTION_TO_QUEUE(BulkTasks::_startRemoteRevisionGC));
+        })
+        ,_revTrees(revTrees)
+        {
+            setPriority(ActorPriority::Background);
+        }
+
+        void start() {
+            documentsChanged();
+            if (_revTrees)
+                _revisionGCTimer.fireAfter(kRevisionGCDelay);
+        }
+
+        void stop() {
+            enqueue(FUNCTION_TO_QUEUE(BulkTasks::_stop));
+            waitTillCaughtUp();
+        }
+
+        void documentsChanged() {
+            // This doesn't have to be enqueued, since Timer is thread-safe.
+            if (!_indexUpdateScheduled.exchange(true))
+                _indexUpdateTimer.fireAfter(kDeferredIndexDelay);
+        }
+
+        void pruneRemoteRevisions() {
+            if (_revTrees)
+                _revisionGCTimer.fireAt(Timer::clock::now());
+        }
+
+    private:
+        void _stop();
+        void _updateDeferredIndexes();
+        void _startRemoteRevisionGC();
+        void _pruneRemoteRevisions();
+
+        BackgroundDB* _bgdb;
+        Timer _indexUpdateTimer;
+        Timer _revisionGCTimer;
+        unique_ptr<RemoteRevisionGC> _revisionGC;       // Exists while a GC pass is running
+        sequence_t _revisionGCCheckpoint {0};           // Checkpoint the pass last saved
+        bool const _revTrees;                           // Does the db use rev-trees?
+        atomic<bool> _indexUpdateScheduled {false};
+        bool _stopped {false};
+    };
+
+
     Housekeeper::Housekeeper(Database *db)
     :Actor(DBLog, "Housekeeper")
     ,_bgdb(db->backgroundDatabase())
     ,_expiryTimer(std::bind(&Housekeeper::_doExpiration, this))
-    { }
+    ,_bulkTasks(new BulkTasks(_bgdb, db->configV1()->versioning != kC4VectorVersioning))
+    {
+        setPriority(ActorPriority::Interactive);
+    }
+
+
+    Housekeeper::~Housekeeper() =default;
 
 
     void Housekeeper::start() {
         enqueue(FUNCTION_TO_QUEUE(Housekeeper::_scheduleExpiration));
+        _bulkTasks->start();
     }
 
 
     void Housekeeper::stop() {
         enqueue(FUNCTION_TO_QUEUE(Housekeeper::_stop));
         waitTillCaughtUp();
+        _bulkTasks->stop();
     }
 
 
@@ -53,6 +133,14 @@ namespace litecore {
     }
 
 
+    void Housekeeper::BulkTasks::_stop() {
+        _indexUpdateTimer.stop();
+        _revisionGCTimer.stop();
+        _revisionGC.reset();
+        _stopped = true;
+    }
+
+
     void Housekeeper::_scheduleExpiration() {
         expiration_t nextExp = _bgdb->use<expiration_t>([&](DataFile *df) {
             return df ? df->defaultKeyStore().nextExpiration() : 0;
@@ -71,7 +159,8 @@ namespace litecore {
 
     void Housekeeper::_doExpiration() {
         LogVerbose(DBLog, "Housekeeper: expiring documents...");
-        _bgdb->useInTransaction([&](DataFile* dataFile, SequenceTracker *sequenceTracker) -> bool {
+        _bgdb->useInTransaction([&](DataFile* dataFile, Transaction&,
+                                    SequenceTracker *sequenceTracker) -> bool {
             auto &keyStore = dataFile->defaultKeyStore();
             if (sequenceTracker) {
                 keyStore.expireRecords([&](slice docID) {
@@ -96,4 +185,74 @@ namespace litecore {
             LogVerbose(DBLog, "Housekeeper: rescheduled expiration, now in %" PRIi64 "ms", delay);
     }
 
+
+    void Housekeeper::documentsChanged() {
+        _bulkTasks->documentsChanged();
+    }
+
+
+    void Housekeeper::pruneRemoteRevisions() {
+        _bulkTasks->pruneRemoteRevisions();
+    }
+
+
+    void Housekeeper::BulkTasks::_updateDeferredIndexes() {
+        _indexUpdateScheduled = false;
+        if (_stopped)
+            return;
+        unsigned indexed = 0;
+        _bgdb->useInTransaction([&](DataFile* dataFile, Transaction&, SequenceTracker*) -> bool {
+            indexed = dataFile->defaultKeyStore().updateDeferredIndexes(kDeferredIndexBatchSize);
+            return indexed > 0;
+        });
+        if (indexed > 0)
+            LogVerbose(DBLog, "Housekeeper: updated deferred indexes with %u docs", indexed);
+        if (indexed == kDeferredIndexBatchSize) {
+            // There may be more; go on with the next batch, after any other pending messages:
+            enqueue(FUNCTION_TO_QUEUE(BulkTasks::_updateDeferredIndexes));
+        }
+    }
+
+
+
+    void Housekeeper::BulkTasks::_startRemoteRevisionGC() {
+        // If a pass is already running it'll continue; it notices if the checkpoint was reset.
+        if (!_revisionGC)
+            _pruneRemoteRevisions();
+    }
+
+
+    void Housekeeper::BulkTasks::_pruneRemoteRevisions() {
+        if (_stopped)
+            return;
+        bool more = false;
+        _bgdb->useInTransaction([&](DataFile* dataFile, Transaction &t, SequenceTracker*) -> bool {
+            KeyStore &info = dataFile->getKeyStore(toString(kC4InfoStore));
+            sequence_t checkpoint = RemoteRevisionGC::checkpoint(info);
+            if (!_revisionGC || checkpoint != _revisionGCCheckpoint) {
+                // Start a pass, or restart it if a remote was forgotten since the last batch:
+                LogVerbose(DBLog, "Housekeeper: pruning obsolete remote revision data after #%"
+                           PRIu64 "...", checkpoint);
+                auto remotes = RemoteRevisionGC::registeredRemotes(info,
+                                                                   Database::kRemoteDBURLsDoc);
+                _revisionGC = make_unique<RemoteRevisionGC>(dataFile->defaultKeyStore(),
+                                                            move(remotes), false, checkpoint);
+            }
+            more = _revisionGC->processBatch(&t, kRevisionGCBatchSize);
+            _revisionGCCheckpoint = _revisionGC->lastSequence();
+            RemoteRevisionGC::setCheckpoint(info, _revisionGCCheckpoint, t);
+            return true;
+        });
+        if (more) {
+            // Go on with the next batch, after any other pending messages:
+            enqueue(FUNCTION_TO_QUEUE(BulkTasks::_pruneRemoteRevisions));
+        } else if (_revisionGC) {
+            auto &stats = _revisionGC->stats();
+            LogVerbose(DBLog, "Housekeeper: pruned remote revision data from %" PRIu64
+                       " of %" PRIu64 " docs, reclaiming %" PRIu64 " bytes",
+                       stats.docsPruned, stats.docsScanned, stats.bytesReclaimed);
+            _revisionGC.reset();
+        }
+    }
+
 }
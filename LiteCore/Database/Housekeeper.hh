@@ -32,7 +32,20 @@ namespace litecore {
         /// reschedule its next expiration for earlier if necessary.
         void documentExpirationChanged(expiration_t exp);
 
+        /// Informs the Housekeeper that documents have changed, so it can bring any deferred
+        /// indexes up to date. Calls made in quick succession are coalesced.
+        void documentsChanged();
+
+        /// Asynchronously removes obsolete remote-revision data from documents updated since the
+        /// last pass, in batches. (This is also done once, soon after the Housekeeper starts.)
+        void pruneRemoteRevisions();
+
+    protected:
+        ~Housekeeper();
+
     private:
+        class BulkTasks;
+
         void _start();
         void _stop();
         void _scheduleExpiration();
@@ -40,6 +53,7 @@ namespace litecore {
 
         BackgroundDB* _bgdb;
         actor::Timer _expiryTimer;
+        Retained<BulkTasks> _bulkTasks;     // Index updates & revision GC, at Background priority
     };
 
 
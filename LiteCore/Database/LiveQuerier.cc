@@ -52,6 +52,7 @@ namespace litecore {
     ,_continuous(continuous)
     ,_delegate(delegate)
     {
+        setPriority(ActorPriority::Interactive);
         logInfo("Created on Query %s", query->loggingName().c_str());
         // Note that we don't keep a reference to `_query`, because it's tied to `db`, but we
         // need to run the query on `_backgroundDB`. So instead we save the query text and
@@ -80,6 +81,12 @@ namespace litecore {
     void LiveQuerier::stop() {
         logInfo("Stopping");
         _stopping = true;
+        {
+            // Interrupt the query if it's running, instead of waiting for it to finish:
+            std::lock_guard<std::mutex> lock(_runningMutex);
+            if (_runningQuery)
+                _runningQuery->cancel();
+        }
         enqueue(FUNCTION_TO_QUEUE(LiveQuerier::_stop));
     }
 
@@ -107,6 +114,12 @@ namespace litecore {
     }
 
 
+    void LiveQuerier::setRunningQuery(Query *query) {
+        std::lock_guard<std::mutex> lock(_runningMutex);
+        _runningQuery = query;
+    }
+
+
     void LiveQuerier::_dbChanged(clock::time_point when) {
         // Do nothing if there's already a _runQuery call pending (but not yet running),
         // or I've already been told to stop, or the query can't be run:
@@ -141,13 +154,18 @@ namespace litecore {
                     if (_continuous)
                         _backgroundDB->addTransactionObserver(this);
                 }
-                // Now run the query:
+                // Now run the query. A `stop` call after this point cancels it:
+                options.cancelCount = _query->cancelCount();
+                setRunningQuery(_query);
+                if (_stopping)
+                    _query->cancel();       // (stop() may have looked before it was set)
                 newQE = _query->createEnumerator(&options);
             } catchError(&error);
+            setRunningQuery(nullptr);
         });
         auto time = st.elapsedMS();
 
-        if (!newQE)
+        if (!newQE && !_stopping)
             logError("Query failed with error %s", c4error_descriptionStr(error));
 
         if (_continuous) {
@@ -14,6 +14,7 @@
 #include <atomic>
 #include <chrono>
 #include <memory>
+#include <mutex>
 
 namespace c4Internal {
     class Database;
@@ -57,6 +58,7 @@ namespace litecore {
         void _runQuery(Query::Options);
         void _stop();
         void _dbChanged(clock::time_point);
+        void setRunningQuery(Query*);
 
         Retained<c4Internal::Database> _database;       // The database
         BackgroundDB* _backgroundDB;                    // Shadow DB on background thread
@@ -69,6 +71,8 @@ namespace litecore {
         bool _continuous;                               // Do I keep running until stopped?
         bool _waitingToRun {false};                     // Is a call to _runQuery scheduled?
         std::atomic<bool> _stopping {false};            // Has stop() been called?
+        std::mutex _runningMutex;                       // Protects _runningQuery
+        Retained<Query> _runningQuery;                  // Query while it's running, else null
     };
 
 }
@@ -0,0 +1,120 @@
+//
+// RemoteRevisionGC.cc
+//
+// Copyright (c) 2021 Couchbase, Inc All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "RemoteRevisionGC.hh"
+#include "RevTreeRecord.hh"
+#include "RecordEnumerator.hh"
+#include "KeyStore.hh"
+#include "Logging.hh"
+#include "FleeceImpl.hh"
+#include <algorithm>
+#include <inttypes.h>
+
+namespace litecore {
+    using namespace std;
+    using namespace fleece::impl;
+
+    // Key of the record in the info KeyStore that holds the background pass's checkpoint
+    static const slice kCheckpointKey("remoteRevisionGC");
+
+
+    optional<vector<RemoteRevisionGC::RemoteID>>
+    RemoteRevisionGC::registeredRemotes(KeyStore &store, slice key) {
+        Record rec = store.get(key);
+        if (!rec.exists())
+            return nullopt;
+        vector<RemoteID> remotes;
+        if (auto body = Value::fromData(rec.body()); body) {
+            for (Dict::iterator i(body->asDict()); i; ++i) {
+                // (The empty key is a placeholder for the highest ID assigned.)
+                if (auto id = i.value()->asUnsigned(); id > 0 && i.keyString().size > 0)
+                    remotes.push_back(RemoteID(id));
+            }
+        }
+        return remotes;
+    }
+
+
+    sequence_t RemoteRevisionGC::checkpoint(KeyStore &info) {
+        return info.get(kCheckpointKey).bodyAsUInt();
+    }
+
+
+    void RemoteRevisionGC::setCheckpoint(KeyStore &info, sequence_t seq, Transaction &t) {
+        Record rec = info.get(kCheckpointKey);
+        if (seq != rec.bodyAsUInt()) {
+            rec.setBodyAsUInt(seq);
+            info.set(rec, t);
+        }
+    }
+
+
+    RemoteRevisionGC::RemoteRevisionGC(KeyStore &docs,
+                                       optional<vector<RemoteID>> remotes,
+                                       bool dryRun,
+                                       sequence_t since)
+    :_docs(docs)
+    ,_remotes(move(remotes))
+    ,_dryRun(dryRun)
+    ,_lastSequence(since)
+    { }
+
+
+    bool RemoteRevisionGC::isKnownRemote(RemoteID remote) const {
+        return !_remotes || find(_remotes->begin(), _remotes->end(), remote) != _remotes->end();
+    }
+
+
+    bool RemoteRevisionGC::processBatch(Transaction *t, unsigned maxDocs) {
+        Assert(_dryRun || t);
+        RecordEnumerator::Options options;
+        options.includeDeleted = true;
+        options.contentOption = kEntireBody;
+        RecordEnumerator e(_docs, _lastSequence, options);
+        unsigned n;
+        for (n = 0; n < maxDocs && e.next(); ++n) {
+            ++_stats.docsScanned;
+            _lastSequence = e.recordMetadata().sequence();
+            // Revisions other than the current one are stored in `extra`; if there isn't any,
+            // there's nothing to remove:
+            if (e.recordMetadata().extraSize() == 0)
+                continue;
+
+            RevTreeRecord doc(_docs, e.record());
+            size_t bytes = 0;
+            unsigned removed = doc.removeObsoleteRemoteData([&](RemoteID remote) {
+                return isKnownRemote(remote);
+            }, bytes);
+            if (removed == 0)
+                continue;
+            if (!_dryRun) {
+                // This doesn't add revisions, so the doc keeps its sequence. If the save
+                // conflicts, the doc has just been updated, and a later batch will get to it.
+                if (doc.save(*t) == RevTreeRecord::kConflict)
+                    continue;
+                LogVerbose(DBLog, "Removed %u obsolete remote revision items from '%.*s'",
+                           removed, SPLAT(doc.docID()));
+            }
+            ++_stats.docsPruned;
+            _stats.itemsRemoved += removed;
+            _stats.bytesReclaimed += bytes;
+        }
+        return n == maxDocs;
+    }
+
+}
@@ -0,0 +1,93 @@
+//
+// RemoteRevisionGC.hh
+//
+// Copyright (c) 2021 Couchbase, Inc All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#pragma once
+#include "Base.hh"
+#include "RevTree.hh"
+#include <optional>
+#include <vector>
+
+namespace litecore {
+    class KeyStore;
+    class Transaction;
+
+    /** Removes obsolete remote-revision data from the rev-trees of documents: the markers of
+        remote databases that are no longer registered, and the bodies kept for revisions that
+        are no longer the latest revision of any remote. This shrinks the documents' `extra`
+        data without changing their current revisions or sequences.
+
+        Documents are scanned in sequence order, in batches, so the work can be spread over
+        multiple short transactions. In a dry run nothing is saved, and the stats estimate what
+        would be reclaimed.
+
+        The Housekeeper's background pass records the sequence it's reached (its "checkpoint")
+        and later starts from there, so it only scans documents updated since. Forgetting a
+        remote resets the checkpoint. Documents saved without a new sequence, e.g. when only a
+        remote ancestor moved, aren't rescanned; a full pass (c4db_pruneRemoteRevisions) gets
+        those. */
+    class RemoteRevisionGC {
+    public:
+        using RemoteID = RevTree::RemoteID;
+
+        struct Stats {
+            uint64_t docsScanned {0};       ///< Documents looked at
+            uint64_t docsPruned {0};        ///< Documents with data removed (or to be removed)
+            uint64_t itemsRemoved {0};      ///< Remote markers and kept bodies removed
+            uint64_t bytesReclaimed {0};    ///< Approximate size of the data removed
+        };
+
+        /** Reads the IDs of the registered remote databases from the record `key` in the
+            KeyStore, as written by `c4db_getRemoteDBID`. Returns nullopt if there's no such
+            record, in which case remote markers shouldn't be removed. */
+        static std::optional<std::vector<RemoteID>> registeredRemotes(KeyStore&, slice key);
+
+        /** Reads the background pass's checkpoint from the info KeyStore; 0 if there is none. */
+        static sequence_t checkpoint(KeyStore &info);
+
+        /** Saves the background pass's checkpoint to the info KeyStore. */
+        static void setCheckpoint(KeyStore &info, sequence_t, Transaction&);
+
+        /** @param docs  The KeyStore of rev-tree documents.
+            @param remotes  The remote DB IDs whose markers to keep, or nullopt to keep all.
+            @param dryRun  If true, no documents will be changed.
+            @param since  Only documents with sequences after this are scanned. */
+        RemoteRevisionGC(KeyStore &docs,
+                         std::optional<std::vector<RemoteID>> remotes,
+                         bool dryRun,
+                         sequence_t since =0);
+
+        /** Processes up to `maxDocs` more documents, saving changes in the transaction (which
+            may be null in a dry run.) Returns false when there are no more documents. */
+        bool processBatch(Transaction*, unsigned maxDocs);
+
+        /** The sequence of the last document scanned (or `since`, if none has been.) */
+        sequence_t lastSequence() const             {return _lastSequence;}
+
+        const Stats& stats() const                  {return _stats;}
+
+    private:
+        bool isKnownRemote(RemoteID) const;
+
+        KeyStore&                               _docs;
+        std::optional<std::vector<RemoteID>>    _remotes;
+        bool const                              _dryRun;
+        sequence_t                              _lastSequence;
+        Stats                                   _stats;
+    };
+
+}
@@ -20,31 +20,40 @@
 #include "Document.hh"
 #include "Logging.hh"
 #include "StringUtil.hh"
+#include "SmallVector.hh"
 #include <algorithm>
 #include <sstream>
 
 
 /* THEORY OF OPERATION:
  
-Placeholders are interspersed with documents (represented by Entry objects) in the _changes list.
+Each known document has an Entry, stored in the `_entries` vector and found by docID through
+`_docIndex`, an open-addressing hash table of indexes into `_entries`.
+
+Changed documents' entries are listed, oldest first, in the change log: a ring buffer of entry
+indexes, `_log`, addressed by increasing positions. Placeholders are interspersed with them; each
+one is a position, meaning "just before the entry at this position". (Here `PlN` is a placeholder.)
     Pl1 -> A -> Z -> Pl2 -> B -> F
-if document A is changed, its Entry's sequence is updated and it moves to the end:
-    Pl1 -> Z -> Pl2 -> B -> F -> A
-DatabaseChangeNotifier's readChanges method moves the placeholder forward, adding any Entrys
+if document A is changed, its log slot is vacated ("--") and it's appended to the end:
+    Pl1 -> -- -> Z -> Pl2 -> B -> F -> A
+DatabaseChangeNotifier's readChanges method moves the placeholder forward, adding any entries
 passed over to the resulting changes[] array until it reaches the end or the array is full.
-           Z -> Pl2 -> B -> F -> A -> Pl1       (and readChanges results in [Z, B, F, A])
-Any document Entry objects before the first placeholder can now be removed:
-                Pl2 -> B -> F -> A -> Pl1
-After a document changes and its Entry moves to the end, if the item(s) _directly_ before the Entry
-are placeholders, their notifiers post notifications.
+           -- -> Z -> Pl2 -> B -> F -> A -> Pl1       (and readChanges results in [Z, B, F, A])
+Any log slots before the first placeholder can now be removed:
+                     Pl2 -> B -> F -> A -> Pl1
+After a document changes and is appended, if the item(s) _directly_ before it (ignoring vacated
+slots) are placeholders, their notifiers post notifications.
 Here document F changed, and notifier 1 posts a notification:
-                Pl2 -> B -> A -> Pl1 -> F
+                     Pl2 -> B -> -- -> A -> Pl1 -> F
 Then document A changes, but no notifications are sent:
-                Pl2 -> B -> Pl1 -> F -> A
+                     Pl2 -> B -> -- -> -- -> Pl1 -> F -> A
+When more than half the log's slots are vacant, it's compacted, and the placeholders renumbered.
+Entries that are removed from the log are deleted, unless they have DocChangeNotifiers, in which
+case they're kept as "idle" entries that aren't in the log.
 
 Transactions:
  On begin:
-    * A special placeholder (`_transaction`) is added at the end of the list.
+    * A special placeholder (`_transaction`) is added at the end of the log.
  After the DB transaction commits:
     * The Database object is responsible for finding all other SequenceTrackers on the same file
       and calling their `addExternalTransaction` method to notify them (see below.)
@@ -71,38 +80,33 @@ namespace litecore {
 
     LogDomain ChangesLog("Changes", LogLevel::Warning);
 
+    static constexpr uint32_t kNoEntry = UINT32_MAX;        // Empty log slot or index bucket
+    static constexpr uint64_t kNotInLog = UINT64_MAX;       // Log position of an idle Entry
+
+    static constexpr size_t kInitialLogSize = 64;           // Must be a power of 2
+    static constexpr size_t kInitialIndexSize = 64;         // Must be a power of 2
+    static constexpr size_t kMinDeadSlotsToCompact = 64;
+
 
     /** Tracks a document's current sequence. */
     struct SequenceTracker::Entry {
-        alloc_slice const               docID;
+        alloc_slice                     docID;
+        alloc_slice                     revID;
         sequence_t                      sequence {0};
-
-        // Document entry (when docID != nullslice):
         sequence_t                      committedSequence {0};
-        alloc_slice                     revID;
-        mutable std::vector<DocChangeNotifier*> documentObservers;
-        RevisionFlags                   flags;
-        bool                            idle     :1;
-        bool                            external :1;
-
-        // Placeholder entry (when docID == nullslice):
-        DatabaseChangeNotifier* const   databaseObserver {nullptr};
+        std::vector<DocChangeNotifier*> documentObservers;
+        LogPosition                     logPos {kNotInLog};
+        RevisionFlags                   flags {RevisionFlags::None};
+        bool                            external {false};
 
-        Entry(const alloc_slice &d, alloc_slice r, sequence_t s, RevisionFlags flags)
-        :docID(d), revID(r), sequence(s), flags(flags), idle(false), external(false) {
-            DebugAssert(docID != nullslice);
-        }
-
-        explicit Entry(DatabaseChangeNotifier *o NONNULL)
-        :databaseObserver(o) { }    // placeholder
+        bool isPurge() const                {return sequence == 0;}
+        bool isIdle() const                 {return logPos == kNotInLog;}
+    };
 
-        bool isPlaceholder() const          {return docID.buf == nullptr;}
-        bool isPurge() const                {return sequence == 0 && !isPlaceholder();}
-        bool isIdle() const                 {return idle && !isPlaceholder();}
 
-        Entry(const Entry&) =delete;
-        Entry& operator=(const Entry&) =delete;
-    };
+    static inline size_t hashDocID(slice docID) {
+        return std::hash<slice>()(docID);
+    }
 
 
 
@@ -126,12 +130,8 @@ namespace litecore {
 
     bool SequenceTracker::changedDuringTransaction() const {
         Assert(inTransaction());
-        if (_lastSequence > _preTransactionLastSequence)
-            return true;
-        for (auto entry = next(_transaction->_placeholder); entry != _changes.end(); ++entry)
-            if (!entry->isPlaceholder())
-                return true;
-        return false;
+        return _lastSequence > _preTransactionLastSequence
+            || hasChangesAfterPlaceholder(_transaction.get());
     }
 
 
@@ -143,9 +143,9 @@ namespace litecore {
             logInfo("commit: sequences #%" PRIu64 " -- #%" PRIu64,
                     _preTransactionLastSequence + 1, _lastSequence);
             // Bump their committedSequences:
-            for (auto entry = next(_transaction->_placeholder); entry != _changes.end(); ++entry) {
-                if (!entry->isPlaceholder()) {
-                    const_cast<Entry&>(*entry).committedSequence = entry->sequence;
+            for (auto pos = _transaction->_position; pos < _logEnd; ++pos) {
+                if (EntryIndex e = logSlot(pos); e != kNoEntry) {
+                    _entries[e].committedSequence = _entries[e].sequence;
                     housekeeping = true;
                 }
             }
@@ -154,19 +154,16 @@ namespace litecore {
             logInfo("abort: from seq #%" PRIu64 " back to #%" PRIu64, _lastSequence, _preTransactionLastSequence);
             _lastSequence = _preTransactionLastSequence;
 
-            // Revert their committedSequences:
-            const_iterator lastEntry = prev(_changes.end());
-            const_iterator nextEntry = _transaction->_placeholder;
-            const_iterator entry;
-            do {
-                entry = nextEntry;
-                nextEntry = next(entry);
-                if (!entry->isPlaceholder()) {
-                    // moves entry!
-                    _documentChanged(entry->docID, entry->revID,
-                                     entry->committedSequence, entry->flags);
-                }
-            } while (entry != lastEntry);
+            // Revert their committedSequences. (Collect them first, since this moves them.)
+            vector<EntryIndex> changed;
+            for (auto pos = _transaction->_position; pos < _logEnd; ++pos) {
+                if (EntryIndex e = logSlot(pos); e != kNoEntry)
+                    changed.push_back(e);
+            }
+            for (EntryIndex e : changed) {
+                Entry &entry = _entries[e];
+                _documentChanged(entry.docID, entry.revID, entry.committedSequence, entry.flags);
+            }
             housekeeping = true;
         }
 
@@ -203,57 +200,59 @@ namespace litecore {
                                            RevisionFlags flags)
     {
         bool listChanged = true;
-        Entry *entry;
-        auto i = _byDocID.find(docID);
-        if (i != _byDocID.end()) {
-            // Move existing entry to the end of the list:
-            entry = &*i->second;
-            if (entry->isIdle() && !hasDBChangeNotifiers()) {
+        EntryIndex e = findEntry(docID);
+        if (e != kNoEntry) {
+            // Move existing entry to the end of the log:
+            Entry &entry = _entries[e];
+            if (entry.isIdle() && !hasDBChangeNotifiers()) {
                 listChanged = false;
+            } else if (entry.isIdle()) {
+                appendToLog(e);
+            } else if (!isLastInLog(entry)) {
+                removeFromLog(entry);
+                appendToLog(e);
             } else {
-                if (entry->isIdle()) {
-                    _changes.splice(_changes.end(), _idle, i->second);
-                    entry->idle = false;
-                } else if (next(i->second) != _changes.end())
-                    _changes.splice(_changes.end(), _changes, i->second);
-                else
-                    listChanged = false;  // it was already at the end
+                listChanged = false;  // it was already at the end
             }
             // Update its revID & sequence:
-            entry->revID = revID;
-            entry->sequence = sequence;
-            entry->flags = flags;
+            entry.revID = revID;
+            entry.sequence = sequence;
+            entry.flags = flags;
         } else {
             // or create a new entry at the end:
-            _changes.emplace_back(docID, revID, sequence, flags);
-            iterator change = prev(_changes.end());
-            _byDocID[change->docID] = change;
-            entry = &*change;
+            e = newEntry(docID);
+            Entry &entry = _entries[e];
+            entry.revID = revID;
+            entry.sequence = sequence;
+            entry.flags = flags;
+            appendToLog(e);
         }
 
         if (!inTransaction()) {
-            entry->committedSequence = sequence;
-            entry->external = true; // it must have come from addExternalTransaction()
+            _entries[e].committedSequence = sequence;
+            _entries[e].external = true; // it must have come from addExternalTransaction()
         }
 
-        // Notify document notifiers:
-        for (auto docNotifier : entry->documentObservers)
-            docNotifier->notify(entry);
-
-        if (listChanged && _numPlaceholders > 0) {
-            // Any placeholders right before this change were up to date, should be notified:
-            bool notified = false;
-            auto ph = next(_changes.rbegin());      // iterating _backwards_, skipping latest
-            while (ph != _changes.rend() && ph->isPlaceholder()) {
-                auto nextph = ph;
-                ++nextph; // precompute next pos, in case 'ph' moves itself during the callback
-                if (ph->databaseObserver) {
-                    ph->databaseObserver->notify();
-                    notified = true;
-                }
-                ph = nextph;
+        // Notify document notifiers. (Not using a reference to the Entry, because a callback
+        // could add a notifier, which can reallocate `_entries`.)
+        for (size_t i = 0; i < _entries[e].documentObservers.size(); ++i)
+            _entries[e].documentObservers[i]->notify(&_entries[e]);
+        if (!_docSetIndex.empty())
+            notifyDocSetNotifiers(docID, sequence);
+
+        if (listChanged && !_placeholders.empty()) {
+            // Any placeholders right before this change were up to date, should be notified.
+            // Collect them first, in case they move themselves during the callback:
+            LogPosition directlyBefore = afterLastLiveEntry(_entries[e].logPos);
+            fleece::smallVector<DatabaseChangeNotifier*, 8> notify;
+            for (auto ph = _placeholders.rbegin(); ph != _placeholders.rend(); ++ph) {
+                if ((*ph)->_position < directlyBefore)
+                    break;
+                notify.push_back(*ph);
             }
-            if (notified)
+            for (auto ph : notify)
+                ph->notify();
+            if (!notify.empty())
                 removeObsoleteEntries();
         }
     }
@@ -262,96 +261,172 @@ namespace litecore {
     void SequenceTracker::addExternalTransaction(const SequenceTracker &other) {
         Assert(!inTransaction());
         Assert(other.inTransaction());
-        if (!_changes.empty() || _numDocObservers > 0) {
+        if (_numLive > 0 || !_placeholders.empty() || _numDocObservers > 0
+                || !_docSetIndex.empty()) {
             logInfo("addExternalTransaction from %s", other.loggingIdentifier().c_str());
-            auto end = other._changes.end();
-            for (auto e = next(other._transaction->_placeholder); e != end; ++e) {
-                if (!e->isPlaceholder()) {
-                    if (e->sequence != 0) {
-                        Assert(e->sequence > _lastSequence);
-                        _lastSequence = e->sequence;
-                    }
-                    _documentChanged(e->docID, e->revID, e->sequence, e->flags);
+            for (auto pos = other._transaction->_position; pos < other._logEnd; ++pos) {
+                EntryIndex oe = other.logSlot(pos);
+                if (oe == kNoEntry)
+                    continue;
+                const Entry &e = other._entries[oe];
+                if (e.sequence != 0) {
+                    Assert(e.sequence > _lastSequence);
+                    _lastSequence = e.sequence;
                 }
+                _documentChanged(e.docID, e.revID, e.sequence, e.flags);
             }
             removeObsoleteEntries();
         }
     }
 
 
-    SequenceTracker::const_iterator SequenceTracker::begin() const     {return _changes.begin();}
-    SequenceTracker::const_iterator SequenceTracker::end() const       {return _changes.end();}
-
-
-    SequenceTracker::const_iterator
+    SequenceTracker::LogPosition
     SequenceTracker::_since(sequence_t sinceSeq) const {
-        if (sinceSeq >= _lastSequence) {
-            return _changes.cend();
-        } else {
+        LogPosition result = _logEnd;
+        if (sinceSeq < _lastSequence) {
             // Scan back till we find a document entry with sequence less than sinceSeq
-            // (but not a purge); then back up one:
-            auto result = _changes.crbegin();
-            for (auto i = _changes.crbegin(); i != _changes.crend(); ++i) {
-                if (i->sequence > sinceSeq || i->isPurge())
-                    result = i;
-                else if (!i->isPlaceholder())
+            // (but not a purge); the result is the entry after it:
+            for (auto pos = _logEnd; pos-- > _logStart; ) {
+                EntryIndex e = logSlot(pos);
+                if (e == kNoEntry)
+                    continue;
+                if (_entries[e].sequence > sinceSeq || _entries[e].isPurge())
+                    result = pos;
+                else
                     break;
             }
-            return prev(result.base());      // (convert `result` to regular fwd iterator)
         }
+        return result;
     }
 
 
     slice SequenceTracker::_docIDAt(sequence_t seq) const {
-        return _since(seq)->docID;
+        auto pos = _since(seq);
+        return pos < _logEnd ? _entries[logSlot(pos)].docID : nullslice;
+    }
+
+
+#pragma mark - CHANGE LOG:
+
+
+    void SequenceTracker::appendToLog(EntryIndex e) {
+        if (_numDead >= kMinDeadSlotsToCompact && _numDead > _numLive)
+            compactLog();
+        if (_logEnd - _logStart == _log.size()) {
+            // The ring buffer is full, so double its size:
+            vector<EntryIndex> newLog(max(2 * _log.size(), kInitialLogSize), kNoEntry);
+            for (auto pos = _logStart; pos < _logEnd; ++pos)
+                newLog[pos & (newLog.size() - 1)] = logSlot(pos);
+            _log = move(newLog);
+        }
+        logSlot(_logEnd) = e;
+        _entries[e].logPos = _logEnd++;
+        ++_numLive;
     }
 
 
-    SequenceTracker::const_iterator
-    SequenceTracker::addPlaceholderAfter(DatabaseChangeNotifier *obs, sequence_t seq) {
+    void SequenceTracker::removeFromLog(Entry &entry) {
+        logSlot(entry.logPos) = kNoEntry;
+        entry.logPos = kNotInLog;
+        --_numLive;
+        ++_numDead;
+    }
+
+
+    // Returns the position after the last entry before `pos`. Placeholders at or after this
+    // position, and not after `pos`, are directly before the entry at `pos`.
+    SequenceTracker::LogPosition SequenceTracker::afterLastLiveEntry(LogPosition pos) const {
+        while (pos > _logStart && logSlot(pos - 1) == kNoEntry)
+            --pos;
+        return pos;
+    }
+
+
+    bool SequenceTracker::isLastInLog(const Entry &entry) const {
+        if (!_placeholders.empty() && _placeholders.back()->_position > entry.logPos)
+            return false;
+        return afterLastLiveEntry(_logEnd) == entry.logPos + 1;
+    }
+
+
+    // Removes vacated slots from the log, renumbering the entries & placeholders after them.
+    void SequenceTracker::compactLog() {
+        LogPosition out = _logStart;
+        auto ph = _placeholders.begin();
+        for (auto pos = _logStart; pos < _logEnd; ++pos) {
+            for (; ph != _placeholders.end() && (*ph)->_position <= pos; ++ph)
+                (*ph)->_position = out;
+            if (EntryIndex e = logSlot(pos); e != kNoEntry) {
+                logSlot(out) = e;
+                _entries[e].logPos = out++;
+            }
+        }
+        for (; ph != _placeholders.end(); ++ph)
+            (*ph)->_position = out;
+        logVerbose("Compacted change log from %" PRIu64 " to %" PRIu64 " entries",
+                   _logEnd - _logStart, out - _logStart);
+        _logEnd = out;
+        _numDead = 0;
+    }
+
+
+    // Adds a placeholder at a log position, either before or after any others already there.
+    void SequenceTracker::insertPlaceholder(DatabaseChangeNotifier *obs,
+                                            LogPosition pos,
+                                            bool beforeOthers)
+    {
+        obs->_position = pos;
+        auto i = find_if(_placeholders.begin(), _placeholders.end(),
+                         [&](DatabaseChangeNotifier *ph) {
+            return beforeOthers ? (ph->_position >= pos) : (ph->_position > pos);
+        });
+        _placeholders.insert(i, obs);
+    }
+
+
+    void SequenceTracker::addPlaceholderAfter(DatabaseChangeNotifier *obs, sequence_t seq) {
         Assert(obs);
-        ++_numPlaceholders;
-        return _changes.emplace(_since(seq), obs);
+        insertPlaceholder(obs, _since(seq), false);
     }
 
-    void SequenceTracker::removePlaceholder(const_iterator placeholder) {
-        _changes.erase(placeholder);
-        --_numPlaceholders;
+    void SequenceTracker::removePlaceholder(DatabaseChangeNotifier *obs) {
+        auto i = find(_placeholders.begin(), _placeholders.end(), obs);
+        Assert(i != _placeholders.end());
+        _placeholders.erase(i);
         removeObsoleteEntries();
     }
 
 
-    bool SequenceTracker::hasChangesAfterPlaceholder(const_iterator placeholder) const {
-        for (auto i = next(placeholder); i != _changes.end(); ++i) {
-            if (!i->isPlaceholder())
-                return true;
-        }
-        return false;
+    bool SequenceTracker::hasChangesAfterPlaceholder(const DatabaseChangeNotifier *obs) const {
+        return afterLastLiveEntry(_logEnd) > obs->_position;
     }
 
 
-    size_t SequenceTracker::readChanges(const_iterator placeholder,
+    size_t SequenceTracker::readChanges(DatabaseChangeNotifier *placeholder,
                                         Change changes[], size_t maxChanges,
                                         bool &external)
     {
         external = false;
         size_t n = 0;
-        auto i = next(placeholder);
-        while (i != _changes.end() && n < maxChanges) {
-            if (!i->isPlaceholder()) {
-                // During the loop, collect only changes with the same value for `external`:
-                if (n == 0)
-                    external = i->external;
-                else if (i->external != external)
-                    break;
-                if (changes)
-                    changes[n++] = Change{i->docID, i->revID, i->sequence, i->flags};
-            }
-            ++i;
+        auto pos = placeholder->_position;
+        for (; pos < _logEnd && n < maxChanges; ++pos) {
+            EntryIndex e = logSlot(pos);
+            if (e == kNoEntry)
+                continue;
+            const Entry &entry = _entries[e];
+            // During the loop, collect only changes with the same value for `external`:
+            if (n == 0)
+                external = entry.external;
+            else if (entry.external != external)
+                break;
+            if (changes)
+                changes[n++] = Change{entry.docID, entry.revID, entry.sequence, entry.flags};
         }
         if (n > 0) {
-            // Move `placeholder` to just before `i`:
-            _changes.splice(i, _changes, placeholder);
+            // Move `placeholder` to just after the last change read. If the array filled up,
+            // that's before any other placeholders there; else it's right before `pos`.
+            _placeholders.erase(find(_placeholders.begin(), _placeholders.end(), placeholder));
+            insertPlaceholder(placeholder, pos, (n == maxChanges));
             removeObsoleteEntries();
         }
         return n;
@@ -362,58 +437,193 @@ namespace litecore {
         if (inTransaction())
             return;
         // Any changes before the first placeholder aren't going to be seen, so remove them:
+        LogPosition firstPlaceholder = _placeholders.empty() ? _logEnd
+                                                             : _placeholders.front()->_position;
         size_t nRemoved = 0;
-        while (_changes.size() > kMinChangesToKeep + _numPlaceholders
-                    && !_changes.front().isPlaceholder()) {
-            auto &entry = _changes.front();
-            if (entry.documentObservers.empty()) {
-                // Remove entry entirely if it has no observers
-                _byDocID.erase(entry.docID);
-                _changes.erase(_changes.begin());
-            } else {
-                // Move entry to idle list if it has observers
-                _idle.splice(_idle.end(), _changes, _changes.begin());
-                entry.idle = true;
+        for (; _logStart < firstPlaceholder; ++_logStart) {
+            EntryIndex e = logSlot(_logStart);
+            if (e == kNoEntry) {
+                --_numDead;
+                continue;
             }
+            if (_numLive <= kMinChangesToKeep)
+                break;
+            Entry &entry = _entries[e];
+            entry.logPos = kNotInLog;
+            --_numLive;
+            // Remove entry entirely if it has no observers; else it becomes idle
+            if (entry.documentObservers.empty())
+                freeEntry(e);
             ++nRemoved;
         }
-        logVerbose("Removed %zu old entries (%zu left; idle has %zd, byDocID has %zu)",
-                   nRemoved, _changes.size(), _idle.size(), _byDocID.size());
+        logVerbose("Removed %zu old entries (%zu left; %zu entries in all)",
+                   nRemoved, _numLive, _entries.size() - _freeEntries.size());
     }
 
 
-    SequenceTracker::const_iterator
+#pragma mark - ENTRIES:
+
+
+    SequenceTracker::EntryIndex SequenceTracker::newEntry(const alloc_slice &docID) {
+        EntryIndex e;
+        if (!_freeEntries.empty()) {
+            e = _freeEntries.back();
+            _freeEntries.pop_back();
+        } else {
+            e = EntryIndex(_entries.size());
+            _entries.emplace_back();
+        }
+        _entries[e].docID = docID;
+        indexEntry(e);
+        return e;
+    }
+
+
+    void SequenceTracker::freeEntry(EntryIndex e) {
+        unindexEntry(e);
+        _entries[e] = Entry();
+        _freeEntries.push_back(e);
+    }
+
+
+    SequenceTracker::EntryIndex SequenceTracker::findEntry(slice docID) const {
+        if (_docIndex.empty())
+            return kNoEntry;
+        size_t mask = _docIndex.size() - 1;
+        for (size_t i = hashDocID(docID) & mask; ; i = (i + 1) & mask) {
+            EntryIndex e = _docIndex[i];
+            if (e == kNoEntry || _entries[e].docID == docID)
+                return e;
+        }
+    }
+
+
+    void SequenceTracker::indexEntry(EntryIndex e) {
+        size_t count = _entries.size() - _freeEntries.size();
+        if (2 * count > _docIndex.size()) {
+            // Keep the table at most half full, so probe sequences stay short:
+            vector<EntryIndex> oldIndex(max(2 * _docIndex.size(), kInitialIndexSize), kNoEntry);
+            swap(oldIndex, _docIndex);
+            for (EntryIndex old : oldIndex) {
+                if (old != kNoEntry)
+                    placeInIndex(old);
+            }
+        }
+        placeInIndex(e);
+    }
+
+
+    void SequenceTracker::placeInIndex(EntryIndex e) {
+        size_t mask = _docIndex.size() - 1;
+        size_t i = hashDocID(_entries[e].docID) & mask;
+        while (_docIndex[i] != kNoEntry)
+            i = (i + 1) & mask;
+        _docIndex[i] = e;
+    }
+
+
+    void SequenceTracker::unindexEntry(EntryIndex e) {
+        size_t mask = _docIndex.size() - 1;
+        size_t i = hashDocID(_entries[e].docID) & mask;
+        while (_docIndex[i] != e)
+            i = (i + 1) & mask;
+        // Fill the hole by shifting back any later items in the probe sequence that can move
+        // into it (i.e. whose home bucket isn't between the hole and their current bucket):
+        for (size_t j = (i + 1) & mask; _docIndex[j] != kNoEntry; j = (j + 1) & mask) {
+            size_t home = hashDocID(_entries[_docIndex[j]].docID) & mask;
+            if (((j - home) & mask) >= ((j - i) & mask)) {
+                _docIndex[i] = _docIndex[j];
+                i = j;
+            }
+        }
+        _docIndex[i] = kNoEntry;
+    }
+
+
+    SequenceTracker::EntryIndex
     SequenceTracker::addDocChangeNotifier(slice docID, DocChangeNotifier* notifier) {
         Assert(docID);
-        iterator entry;
         // Find the entry for the document:
-        auto i = _byDocID.find(docID);
-        if (i != _byDocID.end()) {
-            entry = i->second;
-        } else {
-            // Document isn't known yet; create an entry and put it in the _idle list
-            entry = _idle.emplace(_idle.end(), alloc_slice(docID), alloc_slice(), 0,
-                                  RevisionFlags::None);
-            entry->idle = true;
-            _byDocID[entry->docID] = entry;
+        EntryIndex e = findEntry(docID);
+        if (e == kNoEntry) {
+            // Document isn't known yet; create an idle entry for it
+            e = newEntry(alloc_slice(docID));
         }
-        entry->documentObservers.push_back(notifier);
+        _entries[e].documentObservers.push_back(notifier);
         ++_numDocObservers;
-        return entry;
+        return e;
     }
 
 
-    void SequenceTracker::removeDocChangeNotifier(const_iterator entry, DocChangeNotifier* notifier) {
-        auto &observers = entry->documentObservers;
+    void SequenceTracker::removeDocChangeNotifier(EntryIndex e, DocChangeNotifier* notifier) {
+        auto &observers = _entries[e].documentObservers;
         auto i = find(observers.begin(), observers.end(), notifier);
         Assert(i != observers.end(), "unknown DocChangeNotifier");
         observers.erase(i);
         --_numDocObservers;
-        if (observers.empty() && entry->isIdle()) {
-            _byDocID.erase(entry->docID);
-            Assert(!_idle.empty());
-            _idle.erase(entry);
+        if (observers.empty() && _entries[e].isIdle())
+            freeEntry(e);
+    }
+
+
+#pragma mark - DOC-SET NOTIFIERS:
+
+
+    // Adds a length to a sorted vector of distinct lengths.
+    static void addKeyLength(vector<size_t> &lengths, size_t len) {
+        auto i = lower_bound(lengths.begin(), lengths.end(), len);
+        if (i == lengths.end() || *i != len)
+            lengths.insert(i, len);
+    }
+
+
+    void SequenceTracker::addDocSetNotifier(DocSetChangeNotifier *notifier,
+                                            const vector<alloc_slice> &keys)
+    {
+        // Append the new keys, sort them, then merge them into the existing sorted index:
+        auto oldSize = _docSetIndex.size();
+        _docSetIndex.reserve(oldSize + keys.size());
+        for (auto &key : keys)
+            _docSetIndex.push_back({key, notifier});
+        auto byKey = [](const DocSetKey &a, const DocSetKey &b) {return a.key < b.key;};
+        auto mid = _docSetIndex.begin() + oldSize;
+        sort(mid, _docSetIndex.end(), byKey);
+        inplace_merge(_docSetIndex.begin(), mid, _docSetIndex.end(), byKey);
+
+        for (auto &key : keys)
+            addKeyLength(_docSetKeyLengths, key.size);
+    }
+
+
+    void SequenceTracker::removeDocSetNotifier(DocSetChangeNotifier *notifier) {
+        _docSetIndex.erase(remove_if(_docSetIndex.begin(), _docSetIndex.end(),
+                                     [&](const DocSetKey &k) {return k.notifier == notifier;}),
+                           _docSetIndex.end());
+        _docSetKeyLengths.clear();
+        for (auto &k : _docSetIndex)
+            addKeyLength(_docSetKeyLengths, k.key.size);
+    }
+
+
+    void SequenceTracker::notifyDocSetNotifiers(slice docID, sequence_t sequence) {
+        // A key can only match if it's the same length as the docID, or it's a shorter prefix;
+        // so look up the docID's prefix of each length that's in use:
+        fleece::smallVector<DocSetChangeNotifier*, 8> matches;
+        for (size_t len : _docSetKeyLengths) {
+            if (len > docID.size)
+                break;
+            slice prefix(docID.buf, len);
+            auto i = lower_bound(_docSetIndex.begin(), _docSetIndex.end(), prefix,
+                                 [](const DocSetKey &k, slice p) {return k.key < p;});
+            for (; i != _docSetIndex.end() && i->key == prefix; ++i) {
+                auto notifier = i->notifier;
+                if ((notifier->keysArePrefixes || len == docID.size)
+                        && find(matches.begin(), matches.end(), notifier) == matches.end())
+                    matches.push_back(notifier);
+            }
         }
+        for (auto notifier : matches)
+            notifier->notify(docID, sequence);
     }
 
 
@@ -422,23 +632,35 @@ namespace litecore {
         stringstream s;
         s << "[";
         bool first = true;
-        for (auto i = begin(); i != end(); ++i) {
+        auto delimit = [&] {
             if (first)
                 first = false;
             else
                 s << ", ";
-            if (!i->isPlaceholder()) {
-                s << (string)i->docID << "@" << i->sequence;
-                if (verbose && i->flags != RevisionFlags::None)
-                    s << '#' << hex << int(i->flags) << dec;
-                if (i->external)
-                    s << "'";
-            } else if (_transaction && i == _transaction->_placeholder) {
-                s << "(";
-                first = true;
-            } else {
-                s << "*";
+        };
+        auto ph = _placeholders.begin();
+        for (auto pos = _logStart; pos <= _logEnd; ++pos) {
+            for (; ph != _placeholders.end() && (*ph)->_position <= pos; ++ph) {
+                delimit();
+                if (*ph == _transaction.get()) {
+                    s << "(";
+                    first = true;
+                } else {
+                    s << "*";
+                }
             }
+            if (pos == _logEnd)
+                break;
+            EntryIndex e = logSlot(pos);
+            if (e == kNoEntry)
+                continue;
+            auto &entry = _entries[e];
+            delimit();
+            s << (string)entry.docID << "@" << entry.sequence;
+            if (verbose && entry.flags != RevisionFlags::None)
+                s << '#' << hex << int(entry.flags) << dec;
+            if (entry.external)
+                s << "'";
         }
         if (_transaction)
             s << ")";
@@ -460,18 +682,18 @@ namespace litecore {
     }
 
     DocChangeNotifier::~DocChangeNotifier() {
-        tracker._logVerbose("Removing doc change notifier %p from '%.*s'", this, SPLAT(_docEntry->docID));
+        tracker._logVerbose("Removing doc change notifier %p from '%.*s'", this, SPLAT(docID()));
         tracker.removeDocChangeNotifier(_docEntry, this);
     }
 
 
     slice DocChangeNotifier::docID() const {
-        return _docEntry->docID;
+        return tracker._entries[_docEntry].docID;
     }
 
 
     sequence_t DocChangeNotifier::sequence() const {
-        return _docEntry->sequence;
+        return tracker._entries[_docEntry].sequence;
     }
 
 
@@ -481,6 +703,34 @@ namespace litecore {
 
 
 
+#pragma mark - DOC-SET CHANGE NOTIFIER:
+
+
+    DocSetChangeNotifier::DocSetChangeNotifier(SequenceTracker &t,
+                                               const vector<alloc_slice> &keys,
+                                               bool prefixes,
+                                               Callback cb)
+    :tracker(t)
+    ,callback(move(cb))
+    ,keysArePrefixes(prefixes)
+    {
+        t._logVerbose("Added doc-set change notifier %p for %zu %s",
+                      this, keys.size(), (prefixes ? "prefixes" : "docIDs"));
+        tracker.addDocSetNotifier(this, keys);
+    }
+
+    DocSetChangeNotifier::~DocSetChangeNotifier() {
+        tracker._logVerbose("Removing doc-set change notifier %p", this);
+        tracker.removeDocSetNotifier(this);
+    }
+
+
+    void DocSetChangeNotifier::notify(slice docID, sequence_t sequence) noexcept {
+        if (callback) callback(*this, docID, sequence);
+    }
+
+
+
 #pragma mark - DATABASE CHANGE NOTIFIER:
 
 
@@ -488,8 +738,8 @@ namespace litecore {
     :Logging(ChangesLog)
     ,tracker(t)
     ,callback(move(cb))
-    ,_placeholder(tracker.addPlaceholderAfter(this, afterSeq))
     {
+        tracker.addPlaceholderAfter(this, afterSeq);
         if (callback)
             logInfo("Created, starting after #%" PRIu64, afterSeq);
     }
@@ -498,7 +748,7 @@ namespace litecore {
     DatabaseChangeNotifier::~DatabaseChangeNotifier() {
         if (callback)
             logInfo("Deleting");
-        tracker.removePlaceholder(_placeholder);
+        tracker.removePlaceholder(this);
     }
 
 
@@ -513,7 +763,7 @@ namespace litecore {
     size_t DatabaseChangeNotifier::readChanges(SequenceTracker::Change changes[],
                                                size_t maxChanges,
                                                bool &external) {
-        size_t n = tracker.readChanges(_placeholder, changes, maxChanges, external);
+        size_t n = tracker.readChanges(this, changes, maxChanges, external);
         logInfo("readChanges(%zu) -> %zu changes", maxChanges, n);
         return n;
     }
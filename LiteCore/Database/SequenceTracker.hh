@@ -20,9 +20,8 @@
 #include "Base.hh"
 #include "Error.hh"
 #include "Logging.hh"
-#include <list>
-#include <unordered_map>
 #include <functional>
+#include <vector>
 
 namespace c4Internal {
     class Database;
@@ -32,6 +31,7 @@ namespace c4Internal {
 namespace litecore {
     class DatabaseChangeNotifier;
     class DocChangeNotifier;
+    class DocSetChangeNotifier;
 
     extern LogDomain ChangesLog; // "Changes"
     
@@ -95,53 +95,89 @@ namespace litecore {
 
     protected:
         struct Entry;
-        using iterator = std::list<Entry>::iterator;
-        using const_iterator = std::list<Entry>::const_iterator;
+
+        /** Identifies an Entry; an index into `_entries`. */
+        using EntryIndex = uint32_t;
+
+        /** A position in the change log. These increase monotonically, except that compacting
+            the log renumbers them. */
+        using LogPosition = uint64_t;
 
         static size_t kMinChangesToKeep;        // exposed for testing purposes only
 
         bool inTransaction() const              {return _transaction.get() != nullptr;}
 
         bool hasDBChangeNotifiers() const {
-            return _numPlaceholders - (int)inTransaction() > 0;
+            return _placeholders.size() > (inTransaction() ? 1 : 0);
         }
 
-        /** Returns the oldest Entry. */
-        const_iterator begin() const;
-
-        /** Returns the end of the Entry list. */
-        const_iterator end() const;
-
-        const_iterator addPlaceholderAfter(DatabaseChangeNotifier *obs NONNULL, sequence_t);
-        void removePlaceholder(const_iterator);
-        bool hasChangesAfterPlaceholder(const_iterator) const;
-        size_t readChanges(const_iterator placeholder,
+        void addPlaceholderAfter(DatabaseChangeNotifier *obs NONNULL, sequence_t);
+        void removePlaceholder(DatabaseChangeNotifier *obs NONNULL);
+        bool hasChangesAfterPlaceholder(const DatabaseChangeNotifier *obs NONNULL) const;
+        size_t readChanges(DatabaseChangeNotifier *placeholder NONNULL,
                            Change changes[], size_t maxChanges,
                            bool &external);
-        const_iterator addDocChangeNotifier(slice docID, DocChangeNotifier* NONNULL);
-        void removeDocChangeNotifier(const_iterator, DocChangeNotifier* NONNULL);
+        EntryIndex addDocChangeNotifier(slice docID, DocChangeNotifier* NONNULL);
+        void removeDocChangeNotifier(EntryIndex, DocChangeNotifier* NONNULL);
+        void addDocSetNotifier(DocSetChangeNotifier* NONNULL,
+                               const std::vector<alloc_slice> &keys);
+        void removeDocSetNotifier(DocSetChangeNotifier* NONNULL);
         void removeObsoleteEntries();
 
     private:
         friend class DatabaseChangeNotifier;
         friend class DocChangeNotifier;
+        friend class DocSetChangeNotifier;
         friend class SequenceTrackerTest;
 
         void _documentChanged(const alloc_slice &docID,
                               const alloc_slice &revID,
                               sequence_t sequence,
                               RevisionFlags flags);
-        const_iterator _since(sequence_t s) const;
+        LogPosition _since(sequence_t s) const;
         slice _docIDAt(sequence_t) const; // for tests only
 
+        // Change log:
+        EntryIndex& logSlot(LogPosition pos)    {return _log[pos & (_log.size() - 1)];}
+        EntryIndex logSlot(LogPosition pos) const {return _log[pos & (_log.size() - 1)];}
+        void appendToLog(EntryIndex);
+        void removeFromLog(Entry&);
+        bool isLastInLog(const Entry&) const;
+        LogPosition afterLastLiveEntry(LogPosition before) const;
+        void compactLog();
+        void insertPlaceholder(DatabaseChangeNotifier*, LogPosition, bool beforeOthers);
+
+        // Entries & docID index:
+        EntryIndex findEntry(slice docID) const;
+        EntryIndex newEntry(const alloc_slice &docID);
+        void freeEntry(EntryIndex);
+        void indexEntry(EntryIndex);
+        void placeInIndex(EntryIndex);
+        void unindexEntry(EntryIndex);
+
+        // Doc-set notifiers:
+        void notifyDocSetNotifiers(slice docID, sequence_t);
+
         SequenceTracker(const SequenceTracker&) =delete;
         SequenceTracker& operator=(const SequenceTracker&) =delete;
 
-        std::list<Entry>                        _changes;
-        std::list<Entry>                        _idle;
-        std::unordered_map<slice, iterator>     _byDocID;
+        std::vector<Entry>                      _entries;       // All entries, live or idle
+        std::vector<EntryIndex>                 _freeEntries;   // Unused items in _entries
+        std::vector<EntryIndex>                 _docIndex;      // Hash table of entries by docID
+        std::vector<EntryIndex>                 _log;           // Ring buffer of changed entries
+        LogPosition                             _logStart {0};  // Position of oldest log slot
+        LogPosition                             _logEnd {0};    // Position after newest log slot
+        size_t                                  _numLive {0};   // Number of entries in the log
+        size_t                                  _numDead {0};   // Number of vacated log slots
+        std::vector<DatabaseChangeNotifier*>    _placeholders;  // Placeholders, in log order
+
+        struct DocSetKey {
+            alloc_slice             key;        // A docID or docID prefix
+            DocSetChangeNotifier*   notifier;
+        };
+        std::vector<DocSetKey>                  _docSetIndex;   // Sorted by key
+        std::vector<size_t>                     _docSetKeyLengths; // Distinct key sizes, ascending
         sequence_t                              _lastSequence {0};
-        size_t                                  _numPlaceholders {0};
         size_t                                  _numDocObservers {0};
         unique_ptr<DatabaseChangeNotifier>      _transaction;
         sequence_t                              _preTransactionLastSequence;
@@ -170,7 +206,37 @@ namespace litecore {
         DocChangeNotifier& operator=(const DocChangeNotifier&) =delete;
 
         friend class SequenceTracker;
-        SequenceTracker::const_iterator const _docEntry;
+        SequenceTracker::EntryIndex const _docEntry;
+    };
+
+
+    /** Tracks changes to a set of documents, and calls a client callback. The documents are
+        given either as a list of docIDs, or a list of docID prefixes to match. This is much
+        cheaper than creating a DocChangeNotifier for each document: the tracker keeps a sorted
+        index of the keys, so a change costs one lookup per distinct key length, regardless of
+        the number of keys or notifiers. */
+    class DocSetChangeNotifier {
+    public:
+        using Callback = std::function<void(DocSetChangeNotifier&, slice docID, sequence_t)>;
+
+        DocSetChangeNotifier(SequenceTracker&,
+                             const std::vector<alloc_slice> &keys,
+                             bool keysArePrefixes,
+                             Callback);
+        ~DocSetChangeNotifier();
+
+        SequenceTracker &tracker;
+        Callback const callback;
+        bool const keysArePrefixes;
+
+    protected:
+        void notify(slice docID, sequence_t) noexcept;
+
+    private:
+        DocSetChangeNotifier(const DocSetChangeNotifier&) =delete;
+        DocSetChangeNotifier& operator=(const DocSetChangeNotifier&) =delete;
+
+        friend class SequenceTracker;
     };
 
 
@@ -190,7 +256,7 @@ namespace litecore {
 
         /** Returns true if there are new changes, i.e. if `readChanges` would return nonzero. */
         bool hasChanges() const {
-            return tracker.hasChangesAfterPlaceholder(_placeholder);
+            return tracker.hasChangesAfterPlaceholder(this);
         }
 
         /** Returns changes that have occurred since the last call to `readChanges` (or since
@@ -209,7 +275,8 @@ namespace litecore {
 
         friend class SequenceTracker;
 
-        SequenceTracker::const_iterator const _placeholder;
+        // My placeholder's position: just before the log entry at this position.
+        SequenceTracker::LogPosition _position {0};
     };
 
 }
@@ -605,12 +605,11 @@ namespace c4Internal {
         // These variables get reused in every call to the callback but are declared outside to
         // avoid multiple construct/destruct calls:
         stringstream result;
-        VersionVector localVec, requestedVec;
+        VersionVector requestedVec;
 
         // Subroutine to compare a local version with the requested one:
         auto compareLocalRev = [&](slice revVersion) -> versionOrder {
-            localVec.readBinary(revVersion);
-            return localVec.compareTo(requestedVec);
+            return VersionVector::compareBinary(revVersion, requestedVec);
         };
 
         auto callback = [&](const RecordLite &rec) -> alloc_slice {
@@ -652,7 +651,7 @@ namespace c4Internal {
             VectorRecord::forAllRevIDs(rec, [&](RemoteID, revid aRev, bool hasBody) {
                 if (delim.count() < maxAncestors && hasBody >= mustHaveBodies) {
                     if (!(compareLocalRev(aRev) & kNewer)) {
-                        alloc_slice vector = localVec.asASCII(myPeerID);
+                        alloc_slice vector = aRev.asVersionVector().asASCII(myPeerID);
                         if (added.insert(vector).second)            // [skip duplicate vectors]
                             result << delim << '"' << vector << '"';
                     }
@@ -45,6 +45,8 @@ namespace litecore {
             bool ignoreDiacritics;  ///< True to strip diacritical marks/accents from letters
             bool disableStemming;   ///< Disables stemming
             const char* stopWords;  ///< NULL for default, or comma-delimited string, or empty
+            bool deferred;          ///< FTS/array index is updated in the background, not by triggers
+            bool materialized;      ///< Value index stores indexed properties for queries to read
         };
 
         IndexSpec(std::string name_,
@@ -67,6 +69,10 @@ namespace litecore {
 
         const Options* optionsPtr() const       {return options ? &*options : nullptr;}
 
+        /** True if this is a FTS or array index whose updates are deferred to the background. */
+        bool isDeferred() const                 {return options && options->deferred
+                                                        && (type == kFullText || type == kArray);}
+
         /** The required WHAT clause: the list of expressions to index */
         const fleece::impl::Array* NONNULL what() const;
 
@@ -56,6 +56,42 @@ namespace litecore {
     }
 
 
+    void Query::setProfiling(bool profiling) {
+        std::lock_guard<std::mutex> lock(_statsMutex);
+        if (profiling && !_profiling)
+            _stats = Stats();
+        _profiling = profiling;
+    }
+
+
+    Query::Stats Query::stats() const {
+        std::lock_guard<std::mutex> lock(_statsMutex);
+        return _stats;
+    }
+
+
+    void Query::addStats(const Stats &runStats) {
+        std::lock_guard<std::mutex> lock(_statsMutex);
+        _stats += runStats;
+    }
+
+
+    Query::Stats& Query::Stats::operator+= (const Stats &s) {
+        runs             += s.runs;
+        rowsReturned     += s.rowsReturned;
+        rowsScanned      += s.rowsScanned;
+        sortOps          += s.sortOps;
+        autoIndexRows    += s.autoIndexRows;
+        vmSteps          += s.vmSteps;
+        fleeceValueCalls += s.fleeceValueCalls;
+        sqliteTime       += s.sqliteTime;
+        encodeTime       += s.encodeTime;
+        fullScan         |= s.fullScan;
+        tempBTree        |= s.tempBTree;
+        return *this;
+    }
+
+
     Query::parseError::parseError(const char *message, int errPos)
     :error(error::LiteCore, error::InvalidQuery,
            format("%s near character %d", message, errPos+1))
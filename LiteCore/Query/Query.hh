@@ -22,6 +22,8 @@
 #include "Error.hh"
 #include "Logging.hh"
 #include <atomic>
+#include <mutex>
+#include <optional>
 #include <vector>
 
 namespace fleece::impl {
@@ -65,20 +67,46 @@ namespace litecore {
 
         virtual std::string explain() =0;
 
+        /** Execution statistics, collected while profiling is enabled. The fields correspond
+            to those of C4QueryStats. */
+        struct Stats {
+            uint64_t runs {0};                  ///< Number of times the query ran
+            uint64_t rowsReturned {0};          ///< Number of result rows
+            uint64_t rowsScanned {0};           ///< Rows stepped over by full table scans
+            uint64_t sortOps {0};               ///< Sort operations (ORDER BY, GROUP BY...)
+            uint64_t autoIndexRows {0};         ///< Rows inserted into automatic indexes
+            uint64_t vmSteps {0};               ///< SQLite virtual machine operations
+            uint64_t fleeceValueCalls {0};      ///< Reads of document bodies/Fleece values
+            double   sqliteTime {0};            ///< Seconds spent in SQLite, incl. functions
+            double   encodeTime {0};            ///< Seconds spent encoding rows as Fleece
+            bool     fullScan {false};          ///< A run scanned an entire table
+            bool     tempBTree {false};         ///< A run sorted or built an automatic index
+
+            Stats& operator+= (const Stats&);
+        };
+
+        /** Turns profiling on or off. Turning it on resets the accumulated stats. */
+        void setProfiling(bool profiling);
+        bool profiling() const                                          {return _profiling;}
+
+        /** Returns the stats accumulated over all runs since profiling was enabled. */
+        Stats stats() const;
+
         virtual void close()                                            {_keyStore = nullptr;}
 
         struct Options {
             Options() { }
             
             Options(const Options &o)
-            :paramBindings(o.paramBindings), afterSequence(o.afterSequence) { }
+            :paramBindings(o.paramBindings), afterSequence(o.afterSequence), purgeCount(o.purgeCount)
+            ,timeout(o.timeout), maxRows(o.maxRows) { }
 
             template <class T>
             Options(T bindings, sequence_t afterSeq =0, uint64_t withPurgeCount =0)
             :paramBindings(bindings), afterSequence(afterSeq), purgeCount(withPurgeCount) { }
 
-            Options after(sequence_t afterSeq) const {return Options(paramBindings, afterSeq, purgeCount);}
-            Options withPurgeCount(uint64_t purgeCnt) const {return Options(paramBindings, afterSequence, purgeCnt);}
+            Options after(sequence_t afterSeq) const {return withLimits(Options(paramBindings, afterSeq, purgeCount));}
+            Options withPurgeCount(uint64_t purgeCnt) const {return withLimits(Options(paramBindings, afterSequence, purgeCnt));}
 
             bool notOlderThan(sequence_t afterSeq, uint64_t purgeCnt) const {
                 return afterSequence > 0 && afterSequence >= afterSeq && purgeCnt == purgeCount;
@@ -87,19 +115,52 @@ namespace litecore {
             alloc_slice const paramBindings;
             sequence_t const  afterSequence {0};
             uint64_t const purgeCount {0};
+            double   timeout {0};            // Max seconds a run may take, or 0 for no limit
+            uint64_t maxRows {0};            // Max rows a run may return, or 0 for no limit
+
+            // Query::cancelCount() when the caller started the run; a `cancel` call after that
+            // interrupts it. Defaults to the count when createEnumerator is called. Not copied,
+            // since it applies to a single run.
+            std::optional<unsigned> cancelCount;
+
+        private:
+            Options withLimits(Options o) const {o.timeout = timeout; o.maxRows = maxRows; return o;}
         };
 
+        /** Interrupts any run of this query that's in progress on another thread, causing it
+            to fail with an `Interrupted` error. Doesn't affect later runs. */
+        void cancel()                                                   {++_cancelCount;}
+
+        /** The number of times `cancel` has been called; a running query compares this with
+            the value when it started. (See Options::cancelCount.) */
+        unsigned cancelCount() const                                    {return _cancelCount;}
+
+        /** The number of documents waiting to be added to the deferred indexes this query uses.
+            A query doesn't wait for them, so until the indexes catch up its results are stale. */
+        virtual uint64_t unindexedDocCount()                            {return 0;}
+
+        /** Brings the deferred indexes this query uses up to date. Must be called within a
+            Transaction. */
+        virtual void updateDeferredIndexes()                            { }
+
         virtual QueryEnumerator* createEnumerator(const Options* =nullptr) =0;
 
     protected:
         Query(KeyStore &keyStore, slice expression, QueryLanguage language);
         virtual ~Query();
         virtual std::string loggingIdentifier() const override;
+
+        /** Called by implementations after a profiled run, to add to the stats. */
+        void addStats(const Stats&);
         
     private:
         KeyStore* _keyStore;
         alloc_slice _expression;
         QueryLanguage _language;
+        std::atomic<bool> _profiling {false};
+        std::atomic<unsigned> _cancelCount {0};
+        mutable std::mutex _statsMutex;
+        Stats _stats;
     };
 
 
@@ -122,6 +183,10 @@ namespace litecore {
         virtual int64_t getRowCount() const         {return -1;}
         virtual void seek(int64_t rowIndex)         {error::_throw(error::UnsupportedOperation);}
 
+        /** The stats of the run that produced this enumerator, or null if the query wasn't
+            being profiled. */
+        virtual const Query::Stats* stats() const               {return nullptr;}
+
         virtual bool hasFullText() const                        {return false;}
         virtual const FullTextTerms& fullTextTerms()            {return _fullTextTerms;}
 
@@ -49,6 +49,9 @@ namespace litecore::qp {
     constexpr slice kArrayFnNameWithParens = "array_of()"_sl;
     constexpr slice kDictFnName = "dict_of"_sl;
     constexpr slice kVersionFnName  = "fl_version"_sl;
+    constexpr slice kMaterializeFnName = "fl_materialize"_sl;
+    constexpr slice kMaterializeSubtypeFnName = "fl_materialize_subtype"_sl;
+    constexpr slice kMaterializedValueFnName = "fl_materialized_value"_sl;
 
     // Existing SQLite FTS rank function:
     constexpr slice kRankFnName  = "rank"_sl;
@@ -171,12 +171,14 @@ namespace litecore {
         _parameters.clear();
         _variables.clear();
         _ftsTables.clear();
+        _unnestTables.clear();
         _indexJoinTables.clear();
         _aliases.clear();
         _dbAlias.clear();
         _columnTitles.clear();
         _1stCustomResultCol = 0;
         _isAggregateQuery = _aggregatesOK = _propertiesUseSourcePrefix = _checkedExpiration = false;
+        _materializedSubtypes.clear();
 
         _aliases.insert({_dbAlias, kDBAlias});
     }
@@ -392,7 +394,18 @@ namespace litecore {
             _sql << "CREATE INDEX " << sqlIdentifier(name)
                  << " ON " << sqlIdentifier(_tableName) << " ";
             if (expressionsIter.count() > 0) {
-                writeColumnList(expressionsIter);
+                _sql << '(';
+                _context.push_back(&kColumnListOperation);
+                infixOp(kColumnListOperation.op, expressionsIter);
+                _context.pop_back();
+                if (!_materializedSubtypes.empty() && !isUnnestedTable) {
+                    // Include the flags and subtypes, so the index covers the query's
+                    // deleted-doc test and the property values it returns:
+                    _sql << ", flags";
+                    for (auto &subtype : _materializedSubtypes)
+                        _sql << ", " << subtype;
+                }
+                _sql << ')';
             } else {
                 // No expressions; index the entire body (this is used with unnested/array tables):
                 Assert(isUnnestedTable);
@@ -495,6 +508,7 @@ namespace litecore {
                     case kUnnestTableAlias: {
                         // UNNEST: Optimize query by using the unnest table as a join source:
                         string unnestTable = unnestedTableName(unnest);
+                        _unnestTables.push_back(unnestTable);
                         _sql << " JOIN " << sqlIdentifier(unnestTable)
                              << " AS " << sqlIdentifier(alias)
                              << " ON " << sqlIdentifier(alias) << ".docid="
@@ -1548,6 +1562,14 @@ namespace litecore {
             }
         }
 
+        // Use a materialized column of the document table, if there is one:
+        if (fn == kValueFnName && !param && !property.empty()
+                && (iType->second == kDBAlias || iType->second == kJoinAlias)
+                && _tableName == _delegate.tableName()
+                && _bodyColumnName == _delegate.bodyColumnName()
+                && writeMaterializedProperty(tablePrefix, property))
+            return;
+
         // It's more efficent to get the doc root with fl_root than with fl_value:
         if (property.empty() && fn == kValueFnName)
             fn = kRootFnName;
@@ -1565,6 +1587,56 @@ namespace litecore {
     }
 
 
+    // If a value index materializes the property, writes the expressions it indexes and returns
+    // true. Where SQLite just compares or sorts the value, fl_materialize() is used directly, so
+    // the index applies; elsewhere fl_materialized_value() combines it with the indexed subtype
+    // to produce exactly what fl_value would. Either way SQLite can read them from the index.
+    bool QueryParser::writeMaterializedProperty(const string &tablePrefix, const Path &property) {
+        static constexpr slice kComparisonOps[] = {
+            "="_sl, "!="_sl, "<"_sl, "<="_sl, ">"_sl, ">="_sl, "IS"_sl, "IS NOT"_sl,
+            "IN"_sl, "NOT IN"_sl, "BETWEEN"_sl, "ASC"_sl, "DESC"_sl};
+
+        string propertyStr(property);
+        if (!_delegate.isMaterialized(propertyStr))
+            return false;
+        auto expression = [&](slice fn, const string &prefix) {
+            stringstream out;
+            out << fn << "(" << prefix << _bodyColumnName << ", " << sqlString(propertyStr) << ")";
+            return out.str();
+        };
+        _materializedSubtypes.insert(expression(kMaterializeSubtypeFnName, ""));
+        string value = expression(kMaterializeFnName, tablePrefix);
+        string subtype = expression(kMaterializeSubtypeFnName, tablePrefix);
+
+        auto parent = _context.rbegin();
+        if ((*parent)->handler == &QueryParser::propertyOp
+                || (*parent)->handler == &QueryParser::fallbackOp)
+            ++parent;       // skip the property operation itself
+        if (*parent == &kColumnListOperation
+                || find(begin(kComparisonOps), end(kComparisonOps), (*parent)->op)
+                    != end(kComparisonOps))
+            _sql << value;
+        else
+            _sql << kMaterializedValueFnName << "(" << value << ", " << subtype << ")";
+        return true;
+    }
+
+
+    string QueryParser::documentPropertyPath(const Value *expression) {
+        Path property = (expression->type() == kString) ? Path(expression->asString())
+                                                        : propertyFromNode(expression);
+        if (property.empty())
+            return "";
+        if (property.size() == 1) {
+            slice key = property[0].keyStr();
+            if (key == kDocIDProperty || key == kSequenceProperty || key == kDeletedProperty
+                    || key == kExpirationProperty || key == kRevIDProperty)
+                return "";
+        }
+        return string(property);
+    }
+
+
     void QueryParser::writeUnnestPropertyGetter(slice fn, Path &property,
                                                 const string &alias, aliasType type)
     {
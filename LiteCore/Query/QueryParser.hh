@@ -63,6 +63,9 @@ namespace litecore {
             virtual string predictiveTableName(const string &property) const =0;
 #endif
             virtual bool tableExists(const string &tableName) const =0;
+            /** Returns true if a materialized value index covers the given document property,
+                so queries should read it with `fl_materialize` instead of `fl_value`. */
+            virtual bool isMaterialized(const string &property) const {return false;}
         };
 
 
@@ -87,6 +90,7 @@ namespace litecore {
 
         const set<string>& parameters()                         {return _parameters;}
         const vector<string>& ftsTablesUsed() const             {return _ftsTables;}
+        const vector<string>& unnestTablesUsed() const          {return _unnestTables;}
         unsigned firstCustomResultColumn() const                {return _1stCustomResultCol;}
         const vector<string>& columnTitles() const              {return _columnTitles;}
 
@@ -102,6 +106,10 @@ namespace litecore {
         string predictiveIdentifier(const Value *) const;
         string predictiveTableName(const Value *) const;
 
+        /** If the expression is a plain document property (not metadata), returns its path;
+            else returns an empty string. */
+        static string documentPropertyPath(const Value *expression);
+
     private:
         template <class T, class U> using map = std::map<T,U>;
         using stringstream = std::stringstream;
@@ -188,6 +196,7 @@ namespace litecore {
         void writePropertyGetter(slice fn, Path &&property, const Value *param =nullptr);
         void writeFunctionGetter(slice fn, const Value *source, const Value *param =nullptr);
         void writeUnnestPropertyGetter(slice fn, Path &property, const string &alias, aliasType);
+        bool writeMaterializedProperty(const string &tablePrefix, const Path &property);
         void writeEachExpression(Path &&property);
         void writeEachExpression(const Value *arrayExpr);
         void writeArgList(ArrayIterator& operands);
@@ -227,11 +236,13 @@ namespace litecore {
         set<string> _variables;                  // Active variables, inside ANY/EVERY exprs
         map<string, string> _indexJoinTables;    // index table name --> alias
         vector<string> _ftsTables;               // FTS virtual tables being used
+        vector<string> _unnestTables;            // Unnest index tables being used
         unsigned _1stCustomResultCol {0};        // Index of 1st result after _baseResultColumns
         bool _aggregatesOK {false};              // Are aggregate fns OK to call?
         bool _isAggregateQuery {false};          // Is this an aggregate query?
         bool _checkedDeleted {false};            // Has query accessed _deleted meta-property?
         bool _checkedExpiration {false};         // Has query accessed _expiration meta-property?
+        set<string> _materializedSubtypes;       // Subtype expressions of properties read so far
         Collation _collation;                    // Collation in use during parse
         bool _collationUsed {true};              // Emitted SQL "COLLATION" yet?
         bool _functionWantsCollation {false};    // Current fn wants collation param in its arg list
@@ -59,7 +59,9 @@ namespace litecore {
 
         LogTo(DBLog, "Upgrading database to use 'indexes' table...");
         _exec("CREATE TABLE indexes (name TEXT PRIMARY KEY, type INTEGER NOT NULL,"
-                                  " keyStore TEXT NOT NULL, expression TEXT, indexTableName TEXT)");
+                                  " keyStore TEXT NOT NULL, expression TEXT, indexTableName TEXT,"
+                                  " language INTEGER)");
+        _indexLanguageColumn = true;
         ensureSchemaVersionAtLeast(SchemaVersion::WithIndexTable); // Backward-incompatible with version 2.0/2.1
 
         for (auto &spec : getIndexesOldStyle())
@@ -67,17 +69,67 @@ namespace litecore {
     }
 
 
+    // The 'language' column was added to the 'indexes' table later. Older versions of LiteCore
+    // ignore it, so it's added without changing the schema version; but that means an older
+    // version may have created the table without it, so check for it on every open.
+    void SQLiteDataFile::checkIndexLanguageColumn() {
+        _indexLanguageColumn = false;
+        if (!indexTableExists())
+            return;
+        _indexLanguageColumn = columnExists("indexes", "language");
+        if (!_indexLanguageColumn && options().writeable) {
+            try {
+                _exec("ALTER TABLE indexes ADD COLUMN language INTEGER");
+                _indexLanguageColumn = true;
+            } catch (const SQLite::Exception &x) {
+                // Recover if the db file itself is read-only
+                if (x.getErrorCode() != SQLITE_READONLY)
+                    throw;
+            }
+        }
+    }
+
+
+    // The 'materialized' table records the document properties that materialized value indexes
+    // read with `fl_materialize` (see SQLiteKeyStore::registerMaterializedProperties.) That SQL
+    // function is new, so any connection without it -- an older LiteCore, or the sqlite3 tool --
+    // can't write to a table with such an index. The schema version is
+    // therefore bumped past older versions' MaxReadable, and they refuse to open the database.
+    void SQLiteDataFile::ensureMaterializedTableExists() {
+        if (tableExists("materialized"))
+            return;
+
+        if (!options().upgradeable)
+            error::_throw(error::CantUpgradeDatabase,
+                          "Materialized indexes require upgrading the database schema");
+
+        Assert(inTransaction());
+        ensureIndexTableExists();
+
+        LogTo(DBLog, "Upgrading database to support materialized indexes...");
+        _exec("CREATE TABLE materialized (keyStore TEXT NOT NULL, property TEXT NOT NULL,"
+                                       " indexName TEXT NOT NULL,"
+                                       " PRIMARY KEY (keyStore, property, indexName))");
+        ensureSchemaVersionAtLeast(SchemaVersion::WithMaterializedIndexes); // Backward-incompatible
+    }
+
+
     void SQLiteDataFile::registerIndex(const litecore::IndexSpec &spec,
                                        const string &keyStoreName, const string &indexTableName)
     {
-        SQLite::Statement stmt(*this, "INSERT INTO indexes (name, type, keyStore, expression, indexTableName) "
-                                      "VALUES (?, ?, ?, ?, ?)");
+        SQLite::Statement stmt(*this, _indexLanguageColumn
+                    ? "INSERT INTO indexes (name, type, keyStore, expression, indexTableName, language) "
+                      "VALUES (?, ?, ?, ?, ?, ?)"
+                    : "INSERT INTO indexes (name, type, keyStore, expression, indexTableName) "
+                      "VALUES (?, ?, ?, ?, ?)");
         stmt.bindNoCopy(1, spec.name);
         stmt.bind(      2, spec.type);
         stmt.bindNoCopy(3, keyStoreName);
         stmt.bindNoCopy(4, (char*)spec.expression.buf, (int)spec.expression.size);
         if (spec.type != IndexSpec::kValue)
             stmt.bindNoCopy(5, indexTableName);
+        if (_indexLanguageColumn)
+            stmt.bind(  6, int(spec.queryLanguage));
         LogStatement(stmt);
         stmt.exec();
     }
@@ -105,7 +157,8 @@ namespace litecore {
             if (existingSpec->type == spec.type && existingSpec->keyStoreName == keyStore->name()) {
                 bool same;
                 if (spec.type == IndexSpec::kFullText)
-                    same = schemaExistsWithSQL(indexTableName, "table", indexTableName, indexSQL);
+                    same = schemaExistsWithSQL(indexTableName, "table", indexTableName, indexSQL)
+                        && spec.isDeferred() == keyStore->isDeferredIndexTable(indexTableName);
                 else
                     same = schemaExistsWithSQL(spec.name, "index", indexTableName, indexSQL);
                 if (same)
@@ -147,7 +200,13 @@ namespace litecore {
 
         LogTo(QueryLog, "Dropping unused index table '%s'", tableName.c_str());
         exec(CONCAT("DROP TABLE \"" << tableName << "\""));
+        exec(CONCAT("DROP TABLE IF EXISTS \"" << SQLiteKeyStore::pendingTableName(tableName) << "\""));
+        dropIndexTableTriggers(tableName);
+    }
 
+
+    // Drops the triggers that keep an index table up to date.
+    void SQLiteDataFile::dropIndexTableTriggers(const string &tableName) {
         stringstream sql;
         static const char* kTriggerSuffixes[] = {"ins", "del", "upd", "preupdate", "postupdate",
                                                  nullptr};
@@ -164,8 +223,7 @@ namespace litecore {
     vector<SQLiteIndexSpec> SQLiteDataFile::getIndexes(const KeyStore *store) {
         if (indexTableExists()) {
             vector<SQLiteIndexSpec> indexes;
-            SQLite::Statement stmt(*this, "SELECT name, type, expression, keyStore, indexTableName "
-                                          "FROM indexes ORDER BY name");
+            SQLite::Statement stmt(*this, selectIndexesSQL() + " ORDER BY name");
             while(stmt.executeStep()) {
                 string keyStoreName = stmt.getColumn(3);
                 if (!store || keyStoreName == store->name())
@@ -218,8 +276,7 @@ namespace litecore {
     optional<SQLiteIndexSpec> SQLiteDataFile::getIndex(slice name) {
         if (!indexTableExists())
             return nullopt;
-        SQLite::Statement stmt(*this, "SELECT name, type, expression, keyStore, indexTableName "
-                                      "FROM indexes WHERE name=?");
+        SQLite::Statement stmt(*this, selectIndexesSQL() + " WHERE name=?");
         stmt.bindNoCopy(1, (char*)name.buf, (int)name.size);
         if (stmt.executeStep())
             return specFromStatement(stmt);
@@ -228,15 +285,32 @@ namespace litecore {
     }
 
 
+    // The query that specFromStatement reads from; append a WHERE or ORDER BY clause.
+    string SQLiteDataFile::selectIndexesSQL() const {
+        return _indexLanguageColumn
+            ? "SELECT name, type, expression, keyStore, indexTableName, language FROM indexes"
+            : "SELECT name, type, expression, keyStore, indexTableName, NULL FROM indexes";
+    }
+
+
     SQLiteIndexSpec SQLiteDataFile::specFromStatement(SQLite::Statement &stmt) {
         alloc_slice expressionJSON;
         if (string col = stmt.getColumn(2).getString(); !col.empty())
             expressionJSON = col;
+        auto language = QueryLanguage::kJSON;
+        if (auto col = stmt.getColumn(5); !col.isNull()) {
+            language = QueryLanguage(col.getInt());
+        } else if (slice expr = expressionJSON; expr.size > 0 && expr[0] != '[' && expr[0] != '{') {
+            // Registered by an older version that didn't store the language; a JSON expression
+            // is always an array or object, so anything else must be N1QL:
+            language = QueryLanguage::kN1QL;
+        }
         return SQLiteIndexSpec(stmt.getColumn(0).getString(),
                                (IndexSpec::Type) stmt.getColumn(1).getInt(),
                                expressionJSON,
                                stmt.getColumn(3).getString(),
-                               stmt.getColumn(4).getString());
+                               stmt.getColumn(4).getString(),
+                               language);
     }
 
 
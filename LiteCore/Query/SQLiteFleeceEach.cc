@@ -218,6 +218,7 @@ private:
             return SQLITE_OK;
 
         // Parse the Fleece data:
+        countFleeceValueCall();
         slice data = valueAsSlice(argv[0]);
         if (!data) {
             // Weird not to get a document; have to return early to avoid a crash.
@@ -35,8 +35,13 @@ namespace litecore {
     // Core SQLite functions for accessing values inside Fleece blobs.
 
 
+    thread_local bool tCountFleeceValueCalls = false;
+    thread_local uint64_t tFleeceValueCallCount = 0;
+
+
     // fl_root(body) -> fleeceData
     static void fl_root(sqlite3_context* ctx, int argc, sqlite3_value **argv) noexcept {
+        countFleeceValueCall();
         // Pull the Fleece data out of a raw document body:
         slice body = valueAsSlice(argv[0]);
         if (body) {
@@ -66,6 +71,55 @@ namespace litecore {
         }
     }
 
+    // fl_materialize(body, propertyPath) -> value a materialized value index stores.
+    // The same as fl_value, but without a subtype, since an index can't store one; the index
+    // stores that separately, computed by fl_materialize_subtype.
+    static void fl_materialize(sqlite3_context* ctx, int argc, sqlite3_value **argv) noexcept {
+        try {
+            QueryFleeceScope scope(ctx, argv);
+            setResultFromValue(ctx, scope.root);
+            sqlite3_result_subtype(ctx, 0);
+        } catch (const std::exception &) {
+            sqlite3_result_error(ctx, "fl_materialize: exception!", -1);
+        }
+    }
+
+    // fl_materialize_subtype(body, propertyPath) -> integer or NULL
+    // Returns the subtype fl_value would give the property's value, or NULL if it has none.
+    // (This has to agree with setResultFromValue.)
+    static void fl_materialize_subtype(sqlite3_context* ctx, int argc, sqlite3_value **argv) noexcept {
+        try {
+            QueryFleeceScope scope(ctx, argv);
+            const Value *val = scope.root;
+            int subtype = 0;
+            if (val) {
+                switch (val->type()) {
+                    case kNull:     subtype = kFleeceNullSubtype; break;
+                    case kBoolean:  subtype = kFleeceIntBoolean; break;
+                    case kNumber:
+                        if (val->isInteger() && val->isUnsigned())
+                            subtype = kFleeceIntUnsigned;
+                        break;
+                    default:        break;
+                }
+            }
+            if (subtype)
+                sqlite3_result_int(ctx, subtype);
+            else
+                sqlite3_result_null(ctx);
+        } catch (const std::exception &) {
+            sqlite3_result_error(ctx, "fl_materialize_subtype: exception!", -1);
+        }
+    }
+
+    // fl_materialized_value(value, subtype) -> propertyValue
+    // Combines the two indexed parts of a materialized property back into what fl_value returns.
+    static void fl_materialized_value(sqlite3_context* ctx, int argc, sqlite3_value **argv) noexcept {
+        sqlite3_result_value(ctx, argv[0]);
+        if (sqlite3_value_type(argv[1]) == SQLITE_INTEGER)
+            sqlite3_result_subtype(ctx, sqlite3_value_int(argv[1]));
+    }
+
     // fl_version(version) -> propertyValue (string)
     static void fl_version(sqlite3_context* ctx, int argc, sqlite3_value **argv) noexcept {
         try {
@@ -103,6 +157,7 @@ namespace litecore {
 
     // fl_nested_value(fleeceData, propertyPath) -> propertyValue
     static void fl_nested_value(sqlite3_context* ctx, int argc, sqlite3_value **argv) noexcept {
+        countFleeceValueCall();
         try {
             const Value *val = fleeceParam(ctx, argv[0], false);
             if (!val) {
@@ -486,31 +541,6 @@ namespace litecore {
     }
 
 
-#pragma mark - REVISION HISTORY:
-
-
-    // fl_callback(docID, revID, body, extra, sequence, callback) -> string
-    static void fl_callback(sqlite3_context* ctx, int argc, sqlite3_value **argv) noexcept {
-        RecordLite rec;
-        rec.key = valueAsSlice(argv[0]);
-        rec.version = valueAsSlice(argv[1]);
-        rec.body = valueAsSlice(argv[2]);
-        rec.extra = valueAsSlice(argv[3]);
-        rec.sequence = sqlite3_value_int(argv[4]);
-        auto callback = sqlite3_value_pointer(argv[5], kWithDocBodiesCallbackPointerType);
-        if (!callback || !rec.key) {
-            sqlite3_result_error(ctx, "Missing or invalid callback", -1);
-            return;
-        }
-        try {
-            alloc_slice result = (*(KeyStore::WithDocBodyCallback*)callback)(rec);
-            setResultTextFromSlice(ctx, result);
-        } catch (const std::exception &) {
-            sqlite3_result_error(ctx, "fl_callback: exception!", -1);
-        }
-    }
-
-
 #pragma mark - REGISTRATION:
 
 
@@ -518,6 +548,9 @@ namespace litecore {
         { "fl_root",           1, fl_root },
         { "fl_value",          2, fl_value },
         { "fl_version",        1, fl_version },
+        { "fl_materialize",    2, fl_materialize },
+        { "fl_materialize_subtype", 2, fl_materialize_subtype },
+        { "fl_materialized_value", 2, fl_materialized_value },
         { "fl_nested_value",   2, fl_nested_value },
         { "fl_fts_value",      2, fl_fts_value },
         { "fl_blob",           2, fl_blob },
@@ -530,7 +563,6 @@ namespace litecore {
         { "fl_bool",           1, fl_bool },
         { "array_of",         -1, array_of },
         { "dict_of",          -1, dict_of },
-        { "fl_callback",       6, fl_callback },
         { }
     };
 
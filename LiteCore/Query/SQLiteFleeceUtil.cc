@@ -120,6 +120,7 @@ namespace litecore {
     :Scope(argAsDocBody(ctx, argv[0]),
            ((fleeceFuncContext*)sqlite3_user_data(ctx))->sharedKeys)
     {
+        countFleeceValueCall();
         if (_usuallyTrue(data().buf != nullptr)) {
             root = Value::fromTrustedData(data());
             if (_usuallyFalse(!root)) {
@@ -44,6 +44,12 @@ namespace litecore {
 
     extern const char* const kFleeceValuePointerType;
 
+    // Counts a call that reads a document body or Fleece value, if a query is being profiled.
+    static inline void countFleeceValueCall() noexcept {
+        if (_usuallyFalse(tCountFleeceValueCalls))
+            ++tFleeceValueCallCount;
+    }
+
     static inline const fleece::impl::Value* asFleeceValue(sqlite3_value *value) {
         return (const fleece::impl::Value*) sqlite3_value_pointer(value, kFleeceValuePointerType);
     }
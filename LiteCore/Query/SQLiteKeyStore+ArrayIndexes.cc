@@ -31,15 +31,66 @@ namespace litecore {
 
     bool SQLiteKeyStore::createArrayIndex(const IndexSpec &spec) {
         Array::iterator iExprs(spec.what());
-        string arrayTableName = createUnnestedTable(iExprs.value(), spec.optionsPtr());
-        return createIndex(spec, arrayTableName, ++iExprs);
+        bool tableChanged = false;
+        string arrayTableName = createUnnestedTable(iExprs.value(), spec.optionsPtr(),
+                                                    tableChanged);
+        bool created = createIndex(spec, arrayTableName, ++iExprs);
+        return created || tableChanged;
     }
 
 
-    string SQLiteKeyStore::createUnnestedTable(const Value *expression, const IndexSpec::Options *options) {
+    string SQLiteKeyStore::createUnnestedTable(const Value *expression,
+                                               const IndexSpec::Options *options,
+                                               bool &outChanged)
+    {
         // Derive the table name from the expression it unnests:
         auto kvTableName = tableName();
         auto unnestTableName = QueryParser(*this).unnestedTableName(expression);
+        bool deferred = options && options->deferred;
+
+        QueryParser qp(*this);
+        qp.setBodyColumnName("old.body");
+        string oldArrayExpr = qp.expressionSQL(expression);
+        qp.setBodyColumnName("new.body");
+        string newArrayExpr = qp.expressionSQL(expression);
+        string eachExpr = qp.eachExpressionSQL(expression);
+
+        // An update needs no re-indexing if it leaves the array and the deletion flag alone:
+        string unchangedSQL = CONCAT("(old.flags & 1) = (new.flags & 1) AND (" << oldArrayExpr
+                                     << ") IS (" << newArrayExpr << ")");
+
+        // Creates the triggers that keep the index-table up to date as documents change, unless
+        // they already exist; returns true if anything changed:
+        auto createUpdateTriggers = [&] {
+            bool changed = dropObsoleteTriggers(unnestTableName);
+            if (deferred)
+                return createDeferredIndexTriggers(unnestTableName, unchangedSQL) || changed;
+            // ...on insertion:
+            string insertTriggerExpr = CONCAT("INSERT INTO \"" << unnestTableName <<
+                                              "\" (docid, i, body) "
+                                              "SELECT new.rowid, _each.rowid, _each.value " <<
+                                              "FROM " << eachExpr << " AS _each ");
+            changed |= createTrigger(unnestTableName, "ins",
+                                     "AFTER INSERT",
+                                     "WHEN (new.flags & 1) = 0",
+                                     insertTriggerExpr);
+
+            // ...on delete:
+            string deleteTriggerExpr = CONCAT("DELETE FROM \"" << unnestTableName << "\" "
+                                              "WHERE docid = old.rowid");
+            changed |= createTrigger(unnestTableName, "del",
+                                     "BEFORE DELETE",
+                                     "WHEN (old.flags & 1) = 0",
+                                     deleteTriggerExpr);
+
+            // ...on update, unless the array is unchanged:
+            string reinsertTriggerExpr = insertTriggerExpr + "WHERE (new.flags & 1) = 0";
+            changed |= createTrigger(unnestTableName, "upd",
+                                     "AFTER UPDATE OF body, flags",
+                                     CONCAT("WHEN NOT (" << unchangedSQL << ")"),
+                                     deleteTriggerExpr + "; " + reinsertTriggerExpr);
+            return changed;
+        };
 
         // Create the index table, unless an identical one already exists:
         string sql = CONCAT("CREATE TABLE \"" << unnestTableName << "\" "
@@ -52,50 +103,61 @@ namespace litecore {
             LogTo(QueryLog, "Creating UNNEST table '%s' on %s", unnestTableName.c_str(),
                   expression->toJSON(true).asString().c_str());
             db().exec(sql);
+            createUpdateTriggers();
 
-            QueryParser qp(*this);
-            qp.setBodyColumnName("new.body");
-            string eachExpr = qp.eachExpressionSQL(expression);
+            if (deferred) {
+                // Let the background task populate the index-table:
+                db().exec(CONCAT("INSERT INTO \"" << pendingTableName(unnestTableName) << "\" "
+                                 "(docid) SELECT rowid FROM " << kvTableName <<
+                                 " WHERE (flags & 1) = 0"));
+            } else {
+                // Populate the index-table with data from existing documents:
+                db().exec(CONCAT("INSERT INTO \"" << unnestTableName << "\" (docid, i, body) "
+                                 "SELECT new.rowid, _each.rowid, _each.value " <<
+                                 "FROM " << kvTableName << " as new, " << eachExpr << " AS _each "
+                                 "WHERE (new.flags & 1) = 0"));
+            }
+            outChanged = true;
 
-            // Populate the index-table with data from existing documents:
-            db().exec(CONCAT("INSERT INTO \"" << unnestTableName << "\" (docid, i, body) "
-                             "SELECT new.rowid, _each.rowid, _each.value " <<
-                             "FROM " << kvTableName << " as new, " << eachExpr << " AS _each "
-                             "WHERE (new.flags & 1) = 0"));
+        } else if (deferred != isDeferredIndexTable(unnestTableName)) {
+            // The table exists but is kept up to date the other way, so switch its triggers:
+            LogTo(QueryLog, "Making UNNEST table '%s' %s", unnestTableName.c_str(),
+                  (deferred ? "deferred" : "immediate"));
+            string pendingTable = pendingTableName(unnestTableName);
+            if (!deferred) {
+                updateUnnestedTable(unnestTableName, expression,
+                                    CONCAT("(SELECT docid FROM \"" << pendingTable << "\")"));
+                db().exec(CONCAT("DROP TABLE \"" << pendingTable << "\""));
+            }
+            db().dropIndexTableTriggers(unnestTableName);
+            createUpdateTriggers();
+            outChanged = true;
 
-            // Set up triggers to keep the index-table up to date
-            // ...on insertion:
-            string insertTriggerExpr = CONCAT("INSERT INTO \"" << unnestTableName <<
-                                              "\" (docid, i, body) "
-                                              "SELECT new.rowid, _each.rowid, _each.value " <<
-                                              "FROM " << eachExpr << " AS _each ");
-            createTrigger(unnestTableName, "ins",
-                          "AFTER INSERT",
-                          "WHEN (new.flags & 1) = 0",
-                          insertTriggerExpr);
-
-            // ...on delete:
-            string deleteTriggerExpr = CONCAT("DELETE FROM \"" << unnestTableName << "\" "
-                                              "WHERE docid = old.rowid");
-            createTrigger(unnestTableName, "del",
-                          "BEFORE DELETE",
-                          "WHEN (old.flags & 1) = 0",
-                          deleteTriggerExpr);
-
-            // ...on update:
-            createTrigger(unnestTableName, "preupdate",
-                          "BEFORE UPDATE OF body, flags",
-                          "WHEN (old.flags & 1) = 0",
-                          deleteTriggerExpr);
-            createTrigger(unnestTableName, "postupdate",
-                          "AFTER UPDATE OF body, flags",
-                          "WHEN (new.flags & 1 = 0)",
-                          insertTriggerExpr);
+        } else if (createUpdateTriggers()) {
+            // The table exists, but its triggers were from an older version:
+            LogTo(QueryLog, "Updated triggers of UNNEST table '%s'", unnestTableName.c_str());
+            outChanged = true;
         }
         return unnestTableName;
     }
 
 
+    // Re-indexes the documents whose rowids are returned by the SQL subquery `docIDsSQL`.
+    void SQLiteKeyStore::updateUnnestedTable(const string &unnestTableName,
+                                             const Value *expression,
+                                             const string &docIDsSQL)
+    {
+        QueryParser qp(*this);
+        qp.setBodyColumnName("new.body");
+        string eachExpr = qp.eachExpressionSQL(expression);
+        db().exec(CONCAT("DELETE FROM \"" << unnestTableName << "\" WHERE docid IN " << docIDsSQL));
+        db().exec(CONCAT("INSERT INTO \"" << unnestTableName << "\" (docid, i, body) "
+                         "SELECT new.rowid, _each.rowid, _each.value " <<
+                         "FROM " << tableName() << " as new, " << eachExpr << " AS _each "
+                         "WHERE (new.flags & 1) = 0 AND new.rowid IN " << docIDsSQL));
+    }
+
+
     string SQLiteKeyStore::unnestedTableName(const std::string &property) const {
         return tableName() + ":unnest:" + property;
     }
@@ -38,71 +38,123 @@ namespace litecore {
     static void writeTokenizerOptions(stringstream &sql, const IndexSpec::Options*);
 
 
+    // The SQL fragments used to populate a FTS table from documents.
+    struct FTSIndexSQL {
+        string columns;     // Comma-separated names of the FTS columns
+        string exprs;       // Comma-separated expressions that populate the columns
+        string whereNew;    // WHERE clause for the partial index, applied to the `new` row
+        string whereOld;    // WHERE clause for the partial index, applied to the `old` row
+        string unchanged;   // Condition that's true if an update leaves the indexed text alone
+
+        FTSIndexSQL(const QueryParser::delegate &delegate, const IndexSpec &spec) {
+            // Collect the name of each FTS column and the SQL expression that populates it,
+            // plus a comparison of that expression's old and new values:
+            QueryParser qp(delegate);
+            vector<string> colNames, colExprs, comparisons;
+            for (Array::iterator i(spec.what()); i; ++i) {
+                colNames.push_back(CONCAT('"' << QueryParser::FTSColumnName(i.value()) << '"'));
+                qp.setBodyColumnName("old.body");
+                string oldExpr = qp.FTSExpressionSQL(i.value());
+                qp.setBodyColumnName("new.body");
+                colExprs.push_back(qp.FTSExpressionSQL(i.value()));
+                comparisons.push_back(CONCAT("(" << oldExpr << ") IS (" << colExprs.back() << ")"));
+            }
+            columns = join(colNames, ", ");
+            exprs = join(colExprs, ", ");
+
+            auto where = spec.where();
+            qp.setBodyColumnName("body");
+            whereNew = qp.whereClauseSQL(where, "new");
+            whereOld = qp.whereClauseSQL(where, "old");
+
+            // The WHERE clauses also test for deletion, so comparing them covers that too:
+            comparisons.push_back(CONCAT("(" << whereOld.substr(strlen("WHERE ")) << ") IS ("
+                                         << whereNew.substr(strlen("WHERE ")) << ")"));
+            unchanged = join(comparisons, " AND ");
+        }
+    };
+
+
     // Creates a FTS index.
     bool SQLiteKeyStore::createFTSIndex(const IndexSpec &spec)
     {
         auto ftsTableName = FTSTableName(spec.name);
-        // Collect the name of each FTS column and the SQL expression that populates it:
-        QueryParser qp(*this);
-        qp.setBodyColumnName("new.body");
-        vector<string> colNames, colExprs;
-        for (Array::iterator i(spec.what()); i; ++i) {
-            colNames.push_back(CONCAT('"' << QueryParser::FTSColumnName(i.value()) << '"'));
-            colExprs.push_back(qp.FTSExpressionSQL(i.value()));
-        }
-        string columns = join(colNames, ", ");
-        string exprs = join(colExprs, ", ");
-
-        auto where = spec.where();
-        qp.setBodyColumnName("body");
-        string whereNewSQL = qp.whereClauseSQL(where, "new");
-        string whereOldSQL = qp.whereClauseSQL(where, "old");
+        FTSIndexSQL fts(*this, spec);
+
+        // Creates the triggers that keep the FTS table up to date as documents change, unless
+        // they already exist; returns true if anything changed:
+        auto createUpdateTriggers = [&] {
+            bool changed = dropObsoleteTriggers(ftsTableName);
+            if (spec.isDeferred())
+                return createDeferredIndexTriggers(ftsTableName, fts.unchanged) || changed;
+
+            // ...on insertion:
+            string insertNewSQL = CONCAT("INSERT INTO \"" << ftsTableName
+                                         << "\" (docid, " << fts.columns << ") "
+                                         "VALUES (new.rowid, " << fts.exprs << ")");
+            changed |= createTrigger(ftsTableName, "ins",
+                                     "AFTER INSERT",
+                                     fts.whereNew,
+                                     insertNewSQL);
+
+            // ...on delete:
+            string deleteOldSQL = CONCAT("DELETE FROM \"" << ftsTableName << "\" WHERE docid = old.rowid");
+            changed |= createTrigger(ftsTableName, "del",
+                                     "AFTER DELETE",
+                                     fts.whereOld,
+                                     deleteOldSQL);
+
+            // ...on update, unless the indexed text and the WHERE clause's result are unchanged:
+            string reinsertNewSQL = CONCAT("INSERT INTO \"" << ftsTableName
+                                           << "\" (docid, " << fts.columns << ") "
+                                           "SELECT new.rowid, " << fts.exprs << " " << fts.whereNew);
+            changed |= createTrigger(ftsTableName, "upd",
+                                     "AFTER UPDATE OF body",
+                                     CONCAT("WHEN NOT (" << fts.unchanged << ")"),
+                                     deleteOldSQL + "; " + reinsertNewSQL);
+            return changed;
+        };
 
         // Build the SQL that creates an FTS table, including the tokenizer options:
         {
             stringstream sql;
-            sql << "CREATE VIRTUAL TABLE \"" << ftsTableName << "\" USING fts4(" << columns << ", ";
+            sql << "CREATE VIRTUAL TABLE \"" << ftsTableName << "\" USING fts4(" << fts.columns << ", ";
             writeTokenizerOptions(sql, spec.optionsPtr());
             sql << ")";
-            if (!db().createIndex(spec, this, ftsTableName, sql.str()))
-                return false;
+            if (!db().createIndex(spec, this, ftsTableName, sql.str())) {
+                // The index already exists, but its triggers may be from an older version:
+                return createUpdateTriggers();
+            }
         }
 
-        // Index the existing records:
-        db().exec(CONCAT("INSERT INTO \"" << ftsTableName << "\" (docid, " << columns << ") "
-                         "SELECT rowid, " << exprs << " FROM kv_" << name() << " AS new "
-                         << whereNewSQL));
-
-        // Set up triggers to keep the FTS table up to date
-        // ...on insertion:
-        string insertNewSQL = CONCAT("INSERT INTO \"" << ftsTableName
-                                     << "\" (docid, " << columns << ") "
-                                     "VALUES (new.rowid, " << exprs << ")");
-        createTrigger(ftsTableName, "ins",
-                      "AFTER INSERT",
-                      whereNewSQL,
-                      insertNewSQL);
-
-        // ...on delete:
-        string deleteOldSQL = CONCAT("DELETE FROM \"" << ftsTableName << "\" WHERE docid = old.rowid");
-        createTrigger(ftsTableName, "del",
-                      "AFTER DELETE",
-                      whereOldSQL,
-                      deleteOldSQL);
-
-        // ...on update:
-        createTrigger(ftsTableName, "preupdate",
-                      "BEFORE UPDATE OF body",
-                      whereOldSQL,
-                      deleteOldSQL);
-        createTrigger(ftsTableName, "postupdate",
-                      "AFTER UPDATE OF body",
-                      whereNewSQL,
-                      insertNewSQL);
+        createUpdateTriggers();
+        if (spec.isDeferred()) {
+            // Let the background task index the existing records:
+            db().exec(CONCAT("INSERT INTO \"" << pendingTableName(ftsTableName) << "\" (docid) "
+                             "SELECT rowid FROM kv_" << name() << " WHERE (flags & 1) = 0"));
+        } else {
+            // Index the existing records:
+            db().exec(CONCAT("INSERT INTO \"" << ftsTableName << "\" (docid, " << fts.columns << ") "
+                             "SELECT rowid, " << fts.exprs << " FROM kv_" << name() << " AS new "
+                             << fts.whereNew));
+        }
         return true;
     }
 
 
+    // Re-indexes the documents whose rowids are returned by the SQL subquery `docIDsSQL`.
+    void SQLiteKeyStore::updateFTSTable(const IndexSpec &spec,
+                                        const string &ftsTableName,
+                                        const string &docIDsSQL)
+    {
+        FTSIndexSQL fts(*this, spec);
+        db().exec(CONCAT("DELETE FROM \"" << ftsTableName << "\" WHERE docid IN " << docIDsSQL));
+        db().exec(CONCAT("INSERT INTO \"" << ftsTableName << "\" (docid, " << fts.columns << ") "
+                         "SELECT rowid, " << fts.exprs << " FROM kv_" << name() << " AS new "
+                         << fts.whereNew << " AND new.rowid IN " << docIDsSQL));
+    }
+
+
     string SQLiteKeyStore::FTSTableName(const std::string &property) const {
         return tableName() + "::" + property;
     }
@@ -27,6 +27,10 @@
 #include "SQLiteCpp/SQLiteCpp.h"
 #include "Stopwatch.hh"
 #include "Array.hh"
+#include <algorithm>
+#include <inttypes.h>
+#include <set>
+#include <sqlite3.h>
 
 using namespace std;
 using namespace fleece;
@@ -34,8 +38,18 @@ using namespace fleece::impl;
 
 namespace litecore {
 
+    // Number of documents re-indexed per step, when bringing a deferred index up to date
+    static constexpr unsigned kDeferredIndexBatchSize = 1000;
+
+
     /*
      - A value index is a SQL index named 'NAME'.
+       If it's materialized, each indexed document property PATH is read by the index (and by
+       queries) as `fl_materialize(body, 'PATH')` instead of `fl_value`, and the index also
+       includes `flags` and `fl_materialize_subtype(body, 'PATH')`, so that SQLite can answer a
+       query on those properties from the index alone. The 'materialized' table records which
+       indexes materialize which properties; other value indexes on a property are rebuilt
+       whenever it starts or stops being materialized, so they match the queries.
      - A FTS index is a SQL virtual table named 'kv_default::NAME'
      - An array index has two parts:
          * A SQL table named `kv_default:unnest:PATH`, where PATH is the property path
@@ -51,6 +65,10 @@ namespace litecore {
         - expression (JSON)
         - table name (string)
      The SQL index always is always named `name`.
+
+     - A deferred FTS or array index isn't updated by its triggers. Instead the triggers add the
+       rowids of changed documents to a table named `TABLE::pending`, where TABLE is the index
+       table's name, and `updateDeferredIndexes` later re-indexes those documents in batches.
      */
 
 
@@ -59,6 +77,7 @@ namespace litecore {
 
         Stopwatch st;
         Transaction t(db());
+        checkMaterializedProperties();
         bool created;
         switch (spec.type) {
             case IndexSpec::kValue:      created = createValueIndex(spec); break;
@@ -102,6 +121,9 @@ namespace litecore {
         auto spec = db().getIndex(name);
         if (spec) {
             db().deleteIndex(*spec);
+            if (spec->type == IndexSpec::kValue)
+                if (unregisterMaterializedProperties(spec->name))
+                    rebuildValueIndexes(spec->name);
             t.commit();
         } else {
             t.abort();
@@ -154,8 +176,271 @@ namespace litecore {
 
 
     bool SQLiteKeyStore::createValueIndex(const IndexSpec &spec) {
+        // First update the materialized properties. Queries read those with fl_materialize
+        // instead of fl_value, so other indexes on a property that starts or stops being
+        // materialized won't match queries anymore, and have to be rebuilt:
+        set<string> properties = materializableProperties(spec);
+        bool changed = unregisterMaterializedProperties(spec.name, properties);
+        changed = registerMaterializedProperties(spec, properties) || changed;
+        if (changed)
+            rebuildValueIndexes(spec.name);
         Array::iterator expressions(spec.what());
-        return createIndex(spec, tableName(), expressions);
+        return createIndex(spec, tableName(), expressions) || changed;
+    }
+
+
+    // Recreates every value index other than `exceptIndex`. (This only affects those whose SQL
+    // changed, i.e. the ones reading a property whose materialization changed.)
+    void SQLiteKeyStore::rebuildValueIndexes(const string &exceptIndex) {
+        for (auto &other : getIndexes()) {
+            if (other.type == IndexSpec::kValue && other.name != exceptIndex) {
+                Array::iterator expressions(other.what());
+                createIndex(other, tableName(), expressions);
+            }
+        }
+    }
+
+
+    // Returns the plain document properties a materialized value index covers.
+    set<string> SQLiteKeyStore::materializableProperties(const IndexSpec &spec) const {
+        set<string> properties;
+        if (spec.options && spec.options->materialized) {
+            // (Older SQLite can't read an indexed expression's value from the index.)
+            if (sqlite3_libversion_number() < 3041000) {
+                Warn("Can't materialize properties of index '%s': SQLite 3.41+ is required",
+                     spec.name.c_str());
+                return properties;
+            }
+            for (Array::iterator i(spec.what()); i; ++i) {
+                string property = QueryParser::documentPropertyPath(i.value());
+                if (!property.empty())
+                    properties.insert(property);
+            }
+        }
+        return properties;
+    }
+
+
+    // Records that the index materializes the properties. Returns true if any of them weren't
+    // already materialized by another index.
+    bool SQLiteKeyStore::registerMaterializedProperties(const IndexSpec &spec,
+                                                        const set<string> &properties)
+    {
+        if (properties.empty())
+            return false;
+        db().ensureMaterializedTableExists();
+        bool added = false;
+        for (auto &property : properties)
+            added = added || !isMaterialized(property);
+
+        SQLite::Statement reg(db(), "INSERT OR IGNORE INTO materialized (keyStore, property, indexName)"
+                                    " VALUES (?, ?, ?)");
+        for (auto &property : properties) {
+            reg.bindNoCopy(1, name());
+            reg.bindNoCopy(2, property);
+            reg.bindNoCopy(3, spec.name);
+            LogStatement(reg);
+            reg.exec();
+            reg.reset();
+        }
+        _materializedSchemaVersion = -1;
+        return added;
+    }
+
+
+    // Forgets that the index materializes any properties other than `keepProperties`. Returns
+    // true if any of those are no longer materialized by any index.
+    bool SQLiteKeyStore::unregisterMaterializedProperties(const string &indexName,
+                                                          const set<string> &keepProperties)
+    {
+        if (!db().tableExists("materialized"))
+            return false;
+
+        vector<string> unregistered;
+        {
+            SQLite::Statement stmt(db(), "SELECT property FROM materialized"
+                                         " WHERE keyStore=? AND indexName=?");
+            stmt.bindNoCopy(1, name());
+            stmt.bindNoCopy(2, indexName);
+            while (stmt.executeStep()) {
+                string property = stmt.getColumn(0).getString();
+                if (keepProperties.find(property) == keepProperties.end())
+                    unregistered.push_back(property);
+            }
+        }
+        if (unregistered.empty())
+            return false;
+
+        bool removed = false;
+        for (auto &property : unregistered) {
+            SQLite::Statement del(db(), "DELETE FROM materialized"
+                                        " WHERE keyStore=? AND property=? AND indexName=?");
+            del.bindNoCopy(1, name());
+            del.bindNoCopy(2, property);
+            del.bindNoCopy(3, indexName);
+            del.exec();
+
+            SQLite::Statement used(db(), "SELECT 1 FROM materialized WHERE keyStore=? AND property=?");
+            used.bindNoCopy(1, name());
+            used.bindNoCopy(2, property);
+            if (!used.executeStep()) {
+                LogTo(QueryLog, "Property '%s' is no longer materialized", property.c_str());
+                removed = true;
+            }
+        }
+        _materializedSchemaVersion = -1;
+        return removed;
+    }
+
+
+    bool SQLiteKeyStore::isMaterialized(const string &property) const {
+        if (_materializedSchemaVersion < 0)
+            loadMaterializedProperties();
+        return _materializedProperties.find(property) != _materializedProperties.end();
+    }
+
+
+    void SQLiteKeyStore::checkMaterializedProperties() const {
+        if (_materializedSchemaVersion >= 0
+                && db().intQuery("PRAGMA schema_version") != _materializedSchemaVersion)
+            _materializedSchemaVersion = -1;
+    }
+
+
+    // Caches the set of materialized properties, so the QueryParser doesn't have to
+    // query the database for each property it sees.
+    void SQLiteKeyStore::loadMaterializedProperties() const {
+        _materializedProperties.clear();
+        _materializedSchemaVersion = int(db().intQuery("PRAGMA schema_version"));
+        if (sqlite3_libversion_number() < 3041000 || !db().tableExists("materialized"))
+            return;
+        SQLite::Statement stmt(db(), "SELECT DISTINCT property FROM materialized WHERE keyStore=?");
+        stmt.bindNoCopy(1, name());
+        while (stmt.executeStep())
+            _materializedProperties.insert(stmt.getColumn(0).getString());
+    }
+
+
+#pragma mark - DEFERRED INDEXES:
+
+
+    string SQLiteKeyStore::pendingTableName(const string &indexTableName) {
+        return indexTableName + "::pending";
+    }
+
+
+    bool SQLiteKeyStore::isDeferredIndexTable(const string &indexTableName) const {
+        return db().tableExists(pendingTableName(indexTableName));
+    }
+
+
+    // Creates the table of documents pending indexing, and the triggers that add to it, unless
+    // they already exist; returns true if anything changed.
+    // `unchangedSQL` is a condition on `old` and `new` that's true if an update doesn't affect
+    // the index; such updates don't make the document pending.
+    bool SQLiteKeyStore::createDeferredIndexTriggers(const string &indexTableName,
+                                                     const string &unchangedSQL)
+    {
+        string pendingTable = pendingTableName(indexTableName);
+        bool changed = false;
+        if (!db().tableExists(pendingTable)) {
+            db().exec(CONCAT("CREATE TABLE \"" << pendingTable << "\" (docid INTEGER PRIMARY KEY)"));
+            changed = true;
+        }
+        auto addPendingSQL = [&](const char *row) {
+            return CONCAT("INSERT OR IGNORE INTO \"" << pendingTable << "\" (docid) "
+                          "VALUES (" << row << ".rowid)");
+        };
+        changed |= createTrigger(indexTableName, "ins", "AFTER INSERT", "", addPendingSQL("new"));
+        changed |= createTrigger(indexTableName, "del", "AFTER DELETE", "", addPendingSQL("old"));
+        changed |= createTrigger(indexTableName, "upd", "AFTER UPDATE OF body, flags",
+                                 CONCAT("WHEN NOT (" << unchangedSQL << ")"),
+                                 addPendingSQL("new"));
+        return changed;
+    }
+
+
+    unsigned SQLiteKeyStore::updateDeferredIndexes(unsigned maxDocs) {
+        unsigned total = 0;
+        set<string> updatedTables;     // (multiple array indexes may share an unnest table)
+        for (auto &spec : db().getIndexes(this)) {
+            if (total >= maxDocs)
+                break;
+            if (spec.indexTableName.empty() || updatedTables.count(spec.indexTableName) > 0
+                    || !isDeferredIndexTable(spec.indexTableName))
+                continue;
+            total += updateDeferredIndex(spec, maxDocs - total);
+            updatedTables.insert(spec.indexTableName);
+        }
+        return total;
+    }
+
+
+    // Re-indexes up to `maxDocs` of the documents pending in a deferred index's table.
+    // Returns the number of documents indexed.
+    unsigned SQLiteKeyStore::updateDeferredIndex(const SQLiteIndexSpec &spec, unsigned maxDocs) {
+        string pendingTable = pendingTableName(spec.indexTableName);
+        unsigned count;
+        int64_t lastDocID;
+        {
+            SQLite::Statement stmt(db(), CONCAT("SELECT count(*), max(docid) FROM "
+                                                "(SELECT docid FROM \"" << pendingTable << "\" "
+                                                "ORDER BY docid LIMIT " << maxDocs << ")"));
+            LogStatement(stmt);
+            if (!stmt.executeStep())
+                return 0;
+            count = (unsigned)stmt.getColumn(0).getInt();
+            lastDocID = stmt.getColumn(1).getInt64();
+        }
+        if (count == 0)
+            return 0;
+
+        Stopwatch st;
+        string docIDsSQL = CONCAT("(SELECT docid FROM \"" << pendingTable << "\" "
+                                  "WHERE docid <= " << lastDocID << ")");
+        switch (spec.type) {
+            case IndexSpec::kFullText:
+                updateFTSTable(spec, spec.indexTableName, docIDsSQL);
+                break;
+            case IndexSpec::kArray:
+                updateUnnestedTable(spec.indexTableName, spec.what()->get(0), docIDsSQL);
+                break;
+            default:
+                error::_throw(error::UnexpectedError, "Index '%s' cannot be deferred",
+                              spec.name.c_str());
+        }
+        db().exec(CONCAT("DELETE FROM \"" << pendingTable << "\" WHERE docid <= " << lastDocID));
+        LogTo(QueryLog, "Updated deferred index '%s' with %u docs in %.3f sec",
+              spec.name.c_str(), count, st.elapsed());
+        return count;
+    }
+
+
+    uint64_t SQLiteKeyStore::unindexedDocCount(const vector<string> &indexTables) const {
+        int64_t count = 0;
+        for (auto &indexTable : indexTables) {
+            if (isDeferredIndexTable(indexTable))
+                count += db().intQuery(CONCAT("SELECT count(*) FROM \""
+                                              << pendingTableName(indexTable) << "\"").c_str());
+        }
+        return count;
+    }
+
+
+    void SQLiteKeyStore::updateDeferredIndexes(const vector<string> &indexTables) {
+        Assert(db().inTransaction());
+        auto specs = db().getIndexes(this);
+        for (auto &indexTable : indexTables) {
+            if (!isDeferredIndexTable(indexTable))
+                continue;
+            auto spec = find_if(specs.begin(), specs.end(), [&](const SQLiteIndexSpec &s) {
+                return s.indexTableName == indexTable;
+            });
+            if (spec != specs.end()) {
+                while (updateDeferredIndex(*spec, kDeferredIndexBatchSize) > 0)
+                    ;
+            }
+        }
     }
 
 
@@ -76,6 +76,7 @@ namespace litecore {
                 }
             }
 
+            keyStore.checkMaterializedProperties();
             QueryParser qp(keyStore);
             qp.parseJSON(_json);
 
@@ -93,6 +94,10 @@ namespace litecore {
                     error::_throw(error::NoSuchIndex, "'match' test requires a full-text index");
             }
 
+            _indexTables = _ftsTables;
+            for (auto &unnestTable : qp.unnestTablesUsed())
+                _indexTables.push_back(unnestTable);
+
             if (qp.usesExpiration())
                 keyStore.addExpiration();
 
@@ -100,6 +105,7 @@ namespace litecore {
             logInfo("Compiled as %s", sql.c_str());
             LogTo(SQL, "Compiled {Query#%u}: %s", getObjectRef(), sql.c_str());
             _statement.reset(keyStore.compile(sql));
+            _statementHandle = StatementHandle(keyStore.db(), *_statement);
             
             _1stCustomResultColumn = qp.firstCustomResultColumn();
             _columnTitles = qp.columnTitles();
@@ -109,6 +115,7 @@ namespace litecore {
         virtual void close() override {
             logInfo("Closing query (db is closing)");
             _statement.reset();
+            _statementHandle = nullptr;
             _matchedTextStatement.reset();
             Query::close();
         }
@@ -176,8 +183,45 @@ namespace litecore {
             return result.str();
         }
 
+        // Resets the statement's SQLite counters, before a profiled run.
+        void resetRunStats() {
+            if (_statementHandle) {
+                for (int op : {SQLITE_STMTSTATUS_FULLSCAN_STEP, SQLITE_STMTSTATUS_SORT,
+                               SQLITE_STMTSTATUS_AUTOINDEX, SQLITE_STMTSTATUS_VM_STEP})
+                    sqlite3_stmt_status(_statementHandle, op, 1);
+            }
+        }
+
+        // Adds the statement's SQLite counters to the stats of a profiled run, resetting them,
+        // then adds the run's stats to the totals.
+        void addRunStats(Query::Stats &stats) {
+            if (_statementHandle) {
+                auto counter = [&](int op) {
+                    return (uint64_t)sqlite3_stmt_status(_statementHandle, op, 1);
+                };
+                stats.rowsScanned   = counter(SQLITE_STMTSTATUS_FULLSCAN_STEP);
+                stats.sortOps       = counter(SQLITE_STMTSTATUS_SORT);
+                stats.autoIndexRows = counter(SQLITE_STMTSTATUS_AUTOINDEX);
+                stats.vmSteps       = counter(SQLITE_STMTSTATUS_VM_STEP);
+                stats.fullScan      = stats.rowsScanned > 0;
+                stats.tempBTree     = stats.sortOps > 0 || stats.autoIndexRows > 0;
+            }
+            addStats(stats);
+        }
+
         QueryEnumerator* createEnumerator(const Options *options) override;
 
+        uint64_t unindexedDocCount() override {
+            if (_indexTables.empty())
+                return 0;
+            return ((SQLiteKeyStore&)keyStore()).unindexedDocCount(_indexTables);
+        }
+
+        void updateDeferredIndexes() override {
+            if (!_indexTables.empty())
+                ((SQLiteKeyStore&)keyStore()).updateDeferredIndexes(_indexTables);
+        }
+
         shared_ptr<SQLite::Statement> statement() const {
             if (!_statement)
                 error::_throw(error::NotOpen);
@@ -188,6 +232,7 @@ namespace litecore {
 
         set<string> _parameters;            // Names of the bindable parameters
         vector<string> _ftsTables;          // Names of the FTS tables used
+        vector<string> _indexTables;        // Names of all FTS & unnest tables used
         unsigned _1stCustomResultColumn;    // Column index of the 1st column declared in JSON
 
     protected:
@@ -197,6 +242,7 @@ namespace litecore {
     private:
         alloc_slice _json;                                  // Original JSON form of the query
         shared_ptr<SQLite::Statement> _statement;           // Compiled SQLite statement
+        sqlite3_stmt* _statementHandle {nullptr};           // _statement's SQLite handle
         unique_ptr<SQLite::Statement> _matchedTextStatement;// Gets the matched text
         vector<string> _columnTitles;                       // Titles of columns
     };
@@ -215,7 +261,8 @@ namespace litecore {
                               uint64_t purgeCount,
                               Doc *recording,
                               unsigned long long rowCount,
-                              double elapsedTime)
+                              double elapsedTime,
+                              const Query::Stats *stats)
         :QueryEnumerator(options, lastSequence, purgeCount)
         ,Logging(QueryLog)
         ,_recording(recording)
@@ -223,6 +270,8 @@ namespace litecore {
         ,_1stCustomResultColumn(query->_1stCustomResultColumn)
         ,_hasFullText(!query->_ftsTables.empty())
         {
+            if (stats)
+                _stats = make_unique<Query::Stats>(*stats);
             logInfo("Created on {Query#%u} with %llu rows (%zu bytes) in %.3fms",
                 query->objectRef(), rowCount, recording->data().size, elapsedTime*1000);
         }
@@ -311,6 +360,10 @@ namespace litecore {
             return nullptr;
         }
 
+        const Query::Stats* stats() const override {
+            return _stats.get();
+        }
+
         bool hasFullText() const override {
             return _hasFullText;
         }
@@ -343,6 +396,7 @@ namespace litecore {
         unsigned _1stCustomResultColumn;    // Column index of the 1st column declared in JSON
         bool _hasFullText;
         bool _first {true};
+        unique_ptr<Query::Stats> _stats;    // Profiling stats of the run, if any
     };
 
 
@@ -351,13 +405,15 @@ namespace litecore {
     // which is then used as the data source of a SQLiteQueryEnum.
     class SQLiteQueryRunner {
     public:
-        SQLiteQueryRunner(SQLiteQuery *query, const Query::Options *options, sequence_t lastSequence, uint64_t purgeCount)
+        SQLiteQueryRunner(SQLiteQuery *query, const Query::Options *options, sequence_t lastSequence,
+                          uint64_t purgeCount, unsigned cancelCount)
         :_query(query)
         ,_lastSequence(lastSequence)
         ,_purgeCount(purgeCount)
         ,_statement(query->statement())
         ,_sk(query->keyStore().dataFile().documentKeys())
         ,_options(options ? *options : Query::Options())
+        ,_cancelCount(cancelCount)
         {
             _statement->clearBindings();
             _unboundParameters = query->_parameters;
@@ -472,10 +528,42 @@ namespace litecore {
             enc.setSharedKeys(sk);
             enc.beginArray();
 
+            // If profiling, time the SQLite and Fleece parts of each row separately:
+            bool profiling = _query->profiling();
+            Query::Stats stats;
+            uint64_t startFleeceValueCalls = tFleeceValueCallCount;
+            double lapTime = 0;
+            auto lap = [&](double &total) {
+                double now = st.elapsed();
+                total += now - lapTime;
+                lapTime = now;
+            };
+
+            // Have SQLite periodically check whether the query's been canceled or run out of time:
+            auto &dataFile = (SQLiteDataFile&)_query->keyStore().dataFile();
+            const char *interruption = nullptr;
+            dataFile.setProgressHandler([&] {
+                if (_query->cancelCount() != _cancelCount)
+                    interruption = "Query was canceled";
+                else if (_options.timeout > 0 && st.elapsed() > _options.timeout)
+                    interruption = "Query exceeded its time limit";
+                return interruption != nullptr;
+            });
+            auto cleanup = [&] {
+                unicodesn_tokenizerRunningQuery(false);
+                dataFile.setProgressHandler(nullptr);
+                tCountFleeceValueCalls = false;
+            };
+
             unicodesn_tokenizerRunningQuery(true);
+            tCountFleeceValueCalls = profiling;
+            if (profiling)
+                _query->resetRunStats();
             try {
                  auto firstCustomCol = _query->_1stCustomResultColumn;
                  while (_statement->executeStep()) {
+                     if (profiling)
+                         lap(stats.sqliteTime);
                      uint64_t missingCols = 0;
                      enc.beginArray(nCols);
                      for (int i = 0; i < nCols; ++i) {
@@ -488,16 +576,38 @@ namespace litecore {
                     // Add an integer containing a bit-map of which columns are missing/undefined:
                     enc.writeUInt(missingCols);
                     ++rowCount;
+                    if (profiling)
+                        lap(stats.encodeTime);
+                    if (_options.maxRows > 0 && rowCount > _options.maxRows)
+                        error::_throw(error::Interrupted, "Query exceeded its limit of %llu rows",
+                                      (unsigned long long)_options.maxRows);
                 }
+                if (profiling)
+                    lap(stats.sqliteTime);          // (the final step that found no more rows)
+            } catch (const SQLite::Exception &x) {
+                cleanup();
+                if (x.getErrorCode() == SQLITE_INTERRUPT && interruption)
+                    error::_throw(error::Interrupted, "%s", interruption);
+                throw;
             } catch (...) {
-                unicodesn_tokenizerRunningQuery(false);
+                cleanup();
                 throw;
             }
-            unicodesn_tokenizerRunningQuery(false);
+            cleanup();
 
             enc.endArray();
+            Retained<Doc> recording = enc.finishDoc();
+
+            if (profiling) {
+                lap(stats.encodeTime);
+                stats.runs = 1;
+                stats.rowsReturned = rowCount;
+                stats.fleeceValueCalls = tFleeceValueCallCount - startFleeceValueCalls;
+                _query->addRunStats(stats);
+            }
             return new SQLiteQueryEnumerator(_query, &_options, _lastSequence, _purgeCount,
-                                             enc.finishDoc(), rowCount, st.elapsed());
+                                             recording, rowCount, st.elapsed(),
+                                             (profiling ? &stats : nullptr));
         }
 
     private:
@@ -508,6 +618,7 @@ namespace litecore {
         shared_ptr<SQLite::Statement> _statement;
         set<string> _unboundParameters;
         SharedKeys* _sk;
+        unsigned _cancelCount;          // Query's cancelCount when the run started
     };
 
 
@@ -521,6 +632,8 @@ namespace litecore {
     // The factory method that creates a SQLite QueryEnumerator, but only if the database has
     // changed since lastSeq.
     QueryEnumerator* SQLiteQuery::createEnumerator(const Options *options) {
+        unsigned cancelCount = (options && options->cancelCount) ? *options->cancelCount
+                                                                 : this->cancelCount();
         // Start a read-only transaction, to ensure that the result of lastSequence() and purgeCount() will be
         // consistent with the query results.
         ReadOnlyTransaction t(keyStore().dataFile());
@@ -529,7 +642,7 @@ namespace litecore {
         uint64_t purgeCnt = purgeCount();
         if(options && options->notOlderThan(curSeq, purgeCnt))
             return nullptr;
-        SQLiteQueryRunner recorder(this, options, curSeq, purgeCnt);
+        SQLiteQueryRunner recorder(this, options, curSeq, purgeCnt, cancelCount);
         return recorder.fastForward();
     }
 
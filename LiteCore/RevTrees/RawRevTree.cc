@@ -35,10 +35,15 @@ namespace litecore {
 #pragma pack()
 
 
-    std::deque<Rev> RawRevision::decodeTree(slice raw_tree,
-                                            RevTree::RemoteRevMap &remoteMap,
-                                            RevTree* owner,
-                                            sequence_t curSeq)
+    // Number of extra Revs (with revIDs) to leave room for in the arena after decoding, so that
+    // the usual single insertion doesn't need another allocation.
+    static constexpr size_t kArenaRevsToReserve = 2;
+    static constexpr size_t kArenaSpaceToReserve = kArenaRevsToReserve * (sizeof(Rev) + 40);
+
+    void RawRevision::decodeTree(slice raw_tree,
+                                 RevTree* owner,
+                                 sequence_t curSeq,
+                                 bool lazily)
     {
         const RawRevision *rawRev = (const RawRevision*)raw_tree.buf;
         if (fleece::endian::dec32(rawRev->size_BE) > raw_tree.size)
@@ -46,14 +51,49 @@ namespace litecore {
         unsigned count = rawRev->count();
         if (count > UINT16_MAX)
             error::_throw(error::CorruptRevisionData);
-        deque<Rev> revs(count);
-        auto rev = revs.begin();
-        for (; rawRev->isValid(); rawRev = rawRev->next()) {
-            rawRev->copyTo(*rev, revs);
-            if (rev->sequence == 0)
-                rev->sequence = curSeq;
-            rev->owner = owner;
-            rev++;
+
+        auto &arena = owner->_arena;
+        arena.reset(count * sizeof(Rev) + kArenaSpaceToReserve);
+        Rev *revs = (Rev*)arena.allocate(count * sizeof(Rev), alignof(Rev));
+        owner->_revs.clear();
+        owner->_revs.reserve(count + kArenaRevsToReserve);
+        owner->_remoteRevs.clear();
+        owner->_undecodedTree = nullslice;
+
+        if (lazily && count > 0) {
+            // Decode just the current revision, which comes first. The rest of the array is
+            // left unconstructed until decodeRemainder, which also sets the parent link.
+            rawRev->decodeRev(revs, 0, count, owner, curSeq);
+            revs[0]._parent = nullptr;
+            owner->_sorted = true;
+            owner->_undecodedTree = raw_tree;
+            owner->_undecodedSequence = curSeq;
+        } else {
+            decodeRevs(raw_tree, revs, 0, count, owner, curSeq);
+        }
+    }
+
+
+    void RawRevision::decodeRemainder(RevTree *owner) {
+        slice raw_tree = owner->_undecodedTree;
+        Assert(raw_tree && owner->_revs.size() == 1);
+        owner->_undecodedTree = nullslice;
+        unsigned count = ((const RawRevision*)raw_tree.buf)->count();
+        decodeRevs(raw_tree, owner->_revs[0], 1, count, owner, owner->_undecodedSequence);
+    }
+
+
+    // Decodes the revs from index `start` onwards (earlier ones just get their parent links),
+    // then the remote entries that follow them.
+    void RawRevision::decodeRevs(slice raw_tree, Rev revs[], unsigned start, unsigned count,
+                                 RevTree *owner, sequence_t curSeq)
+    {
+        const RawRevision *rawRev = (const RawRevision*)raw_tree.buf;
+        for (unsigned i = 0; rawRev->isValid(); rawRev = rawRev->next(), ++i) {
+            if (i < start)
+                revs[i]._parent = rawRev->parentIn(revs, count);
+            else
+                rawRev->decodeRev(revs, i, count, owner, curSeq);
         }
 
         auto entry = (const RemoteEntry*)offsetby(rawRev, sizeof(uint32_t));
@@ -62,14 +102,27 @@ namespace litecore {
             auto revIndex = endian::dec16(entry->revIndex_BE);
             if (remoteID == 0 || revIndex >= count)
                 error::_throw(error::CorruptRevisionData);
-            remoteMap[remoteID] = &revs[revIndex];
+            owner->_remoteRevs[remoteID] = &revs[revIndex];
             ++entry;
         }
 
         if ((uint8_t*)entry != (uint8_t*)raw_tree.end()) {
             error::_throw(error::CorruptRevisionData);
         }
-        return revs;
+    }
+
+
+    // Constructs revs[i] from this raw revision and appends it to the owner's _revs.
+    void RawRevision::decodeRev(Rev revs[], unsigned i, unsigned count,
+                                RevTree *owner, sequence_t curSeq) const
+    {
+        Rev *rev = new (&revs[i]) Rev();
+        copyTo(*rev, revs, count);
+        if (rev->sequence == 0)
+            rev->sequence = curSeq;
+        rev->owner = owner;
+        rev->_index = i;
+        owner->_revs.push_back(rev);
     }
 
 
@@ -115,7 +168,7 @@ namespace litecore {
         this->size_BE = endian::enc32((uint32_t)revSize);
         this->revIDLen = (uint8_t)rev.revID.size;
         memcpy(this->revID, rev.revID.buf, rev.revID.size);
-        this->parentIndex_BE = endian::enc16(uint16_t(rev.parent ? rev.parent->index() : kNoParent));
+        this->parentIndex_BE = endian::enc16(uint16_t(rev._parent ? rev._parent->index() : kNoParent));
 
         uint8_t dstFlags = rev.flags & ~kNonPersistentFlags;
         if (rev._body)
@@ -129,15 +182,11 @@ namespace litecore {
         return (RawRevision*)offsetby(this, revSize);
     }
 
-    void RawRevision::copyTo(Rev &dst, const deque<Rev> &revs) const {
+    void RawRevision::copyTo(Rev &dst, Rev revs[], unsigned count) const {
         const void* end = this->next();
         dst.revID = {this->revID, this->revIDLen};
         dst.flags = (Rev::Flags)(this->flags & ~kPersistentOnlyFlags);
-        auto parentIndex = endian::dec16(this->parentIndex_BE);
-        if (parentIndex == kNoParent)
-            dst.parent = nullptr;
-        else
-            dst.parent = &revs[parentIndex];
+        dst._parent = parentIn(revs, count);
         const void *data = offsetby(&this->revID, this->revIDLen);
         ptrdiff_t len = (uint8_t*)end-(uint8_t*)data;
         data = offsetby(data, GetUVarInt(slice(data, len), &dst.sequence));
@@ -148,6 +197,17 @@ namespace litecore {
     }
 
 
+    const Rev* RawRevision::parentIn(Rev revs[], unsigned count) const {
+        auto parentIndex = endian::dec16(this->parentIndex_BE);
+        if (parentIndex == kNoParent)
+            return nullptr;
+        else if (parentIndex < count)
+            return &revs[parentIndex];
+        else
+            error::_throw(error::CorruptRevisionData);
+    }
+
+
     slice RawRevision::body() const {
         if (_usuallyTrue(this->flags & RawRevision::kHasData)) {
             const void* end = this->next();
@@ -21,7 +21,6 @@
 #include "RevTree.hh"
 #include "KeyStore.hh"
 #include "Endian.hh"
-#include <deque>
 #include <vector>
 
 
@@ -36,10 +35,18 @@ namespace litecore {
     // revision is the current one for every remote database.
     class RawRevision {
     public:
-        static std::deque<Rev> decodeTree(slice raw_tree,
-                                          RevTree::RemoteRevMap &remoteMap,
-                                          RevTree *owner NONNULL,
-                                          sequence_t curSeq);
+        /** Decodes a raw tree into `owner`'s revs and remote map, replacing any existing ones.
+            All the Revs are allocated in one block of the owner's arena; their revIDs and bodies
+            point into `raw_tree`, which must remain valid.
+            If `lazily` is true, only the current revision is decoded, and the owner remembers
+            `raw_tree` so it can call \ref decodeRemainder when it needs the rest. */
+        static void decodeTree(slice raw_tree,
+                               RevTree *owner NONNULL,
+                               sequence_t curSeq,
+                               bool lazily =false);
+
+        /** Finishes a lazy \ref decodeTree. */
+        static void decodeRemainder(RevTree *owner NONNULL);
 
         static alloc_slice encodeTree(const std::vector<Rev*> &revs,
                                       const RevTree::RemoteRevMap &remoteMap);
@@ -81,8 +88,14 @@ namespace litecore {
             return count;
         }
 
+        static void decodeRevs(slice raw_tree, Rev revs[], unsigned start, unsigned count,
+                               RevTree *owner, sequence_t curSeq);
+        void decodeRev(Rev revs[], unsigned i, unsigned count,
+                       RevTree *owner, sequence_t curSeq) const;
+        const Rev* parentIn(Rev revs[], unsigned count) const;
+
         static size_t sizeToWrite(const Rev&);
-        void copyTo(Rev &dst, const std::deque<Rev>&) const;
+        void copyTo(Rev &dst, Rev revs[], unsigned count) const;
         RawRevision* copyFrom(const Rev &rev);
     };
 
@@ -25,6 +25,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <type_traits>
 #if DEBUG
 #include <iostream>
 #include <sstream>
@@ -36,8 +37,8 @@ namespace litecore {
 
     static bool compareRevs(const Rev *rev1, const Rev *rev2);
 
-    RevTree::RevTree(slice body, slice extra, sequence_t seq) {
-        decode(body, extra, seq);
+    RevTree::RevTree(slice body, slice extra, sequence_t seq, bool lazily) {
+        decode(body, extra, seq, lazily);
     }
 
     RevTree::RevTree(const RevTree &other)
@@ -46,18 +47,21 @@ namespace litecore {
     ,_changed(other._changed)
     ,_unknown(other._unknown)
     {
-        // It's important to have _revs in the same order as other._revs.
-        // That means we can't just copy other._revsStorage to _revsStorage;
-        // we have to copy _revs in order:
+        other.decodeRemainder();
+        // It's important to have _revs in the same order as other._revs, so copy them in order.
+        // RevIDs in other's arena have to be copied too; the rest point into the shared record.
+        _arena.reset(other._revs.size() * sizeof(Rev));
         _revs.reserve(other._revs.size());
         for (const Rev *otherRev : other._revs) {
-            _revsStorage.emplace_back(*otherRev);
-            _revs.push_back(&_revsStorage.back());
+            Rev *rev = _arena.make<Rev>(*otherRev);
+            if (other._arena.owns(rev->revID.buf))
+                rev->revID = revid(_arena.copy(rev->revID));
+            _revs.push_back(rev);
         }
         // Fix up the newly copied Revs so they point to me (and my other Revs), not other:
         for (Rev *rev : _revs) {
-            if (rev->parent)
-                rev->parent = _revs[rev->parent->index()];
+            if (rev->_parent)
+                rev->_parent = _revs[rev->_parent->index()];
             rev->owner = this;
         }
         // Copy _remoteRevs:
@@ -66,12 +70,11 @@ namespace litecore {
         }
     }
 
-    void RevTree::decode(slice body, slice extra, sequence_t seq) {
+    void RevTree::decode(slice body, slice extra, sequence_t seq, bool lazily) {
         // In 2.0 schema, entire tree is stored in `body` and there is no `extra`.
         // In 3.0 schema, the rev tree is in `extra`, except the current rev's body is in `body`.
         slice rawTree = (extra ? extra : body);
-        _revsStorage = RawRevision::decodeTree(rawTree, _remoteRevs, this, seq);
-        initRevs();
+        RawRevision::decodeTree(rawTree, this, seq, lazily);
         if (body && extra) {
             auto cur = currentRevision();
             Assert(cur);
@@ -80,16 +83,19 @@ namespace litecore {
         }
     }
 
-    void RevTree::initRevs() {
-        _revs.resize(_revsStorage.size());
-        auto i = _revs.begin();
-        for (Rev &rev : _revsStorage) {
-            *i = &rev;
-            ++i;
-        }
+    void RevTree::_decodeRemainder() {
+        RawRevision::decodeRemainder(this);
+    }
+
+    // Updates each Rev's cached index after _revs has been reordered.
+    void RevTree::renumber() {
+        uint32_t i = 0;
+        for (Rev *rev : _revs)
+            rev->_index = i++;
     }
 
     pair<slice,alloc_slice> RevTree::encode() {
+        decodeRemainder();
         sort();
         const Rev *cur = currentRevision();
         slice curBody;
@@ -117,6 +123,74 @@ namespace litecore {
     }
 #endif
 
+#pragma mark - ARENA:
+
+
+    static_assert(std::is_trivially_destructible<Rev>::value,
+                  "Revs live in a RevTreeArena, which never calls destructors");
+
+    struct RevTreeArena::Chunk {
+        Chunk*  prev;
+        size_t  size;
+        uint8_t* begin()                {return (uint8_t*)(this + 1);}
+    };
+
+    static constexpr size_t kMinArenaChunkSize = 512;
+
+    void RevTreeArena::reset(size_t capacity) {
+        while (_chunk) {
+            Chunk *prev = _chunk->prev;
+            ::free(_chunk);
+            _chunk = prev;
+        }
+        _next = _end = nullptr;
+        if (capacity > 0)
+            addChunk(capacity);
+    }
+
+    void RevTreeArena::addChunk(size_t minSize) {
+        // Grow geometrically so a tree that keeps getting inserted into needs few chunks:
+        size_t size = std::max(minSize, _chunk ? 2 * _chunk->size : kMinArenaChunkSize);
+        auto chunk = (Chunk*)::malloc(sizeof(Chunk) + size);
+        if (!chunk)
+            throw std::bad_alloc();
+        chunk->prev = _chunk;
+        chunk->size = size;
+        _chunk = chunk;
+        _next = chunk->begin();
+        _end = _next + size;
+    }
+
+    void* RevTreeArena::allocate(size_t size, size_t alignment) {
+        auto align = [=](uint8_t *p) {
+            return (uint8_t*)(((uintptr_t)p + alignment - 1) & ~(uintptr_t)(alignment - 1));
+        };
+        uint8_t *result = align(_next);
+        if (!_chunk || result + size > _end) {
+            addChunk(size + alignment);
+            result = align(_next);
+        }
+        _next = result + size;
+        return result;
+    }
+
+    slice RevTreeArena::copy(slice s) {
+        if (s.size == 0)
+            return s;
+        void *dst = allocate(s.size, 1);
+        memcpy(dst, s.buf, s.size);
+        return {dst, s.size};
+    }
+
+    bool RevTreeArena::owns(const void *ptr) const {
+        for (Chunk *chunk = _chunk; chunk; chunk = chunk->prev) {
+            if (ptr >= chunk->begin() && ptr < chunk->begin() + chunk->size)
+                return true;
+        }
+        return false;
+    }
+
+
 #pragma mark - ACCESSORS:
 
     const Rev* RevTree::currentRevision() {
@@ -127,11 +201,19 @@ namespace litecore {
 
     const Rev* RevTree::get(unsigned index) const {
         Assert(!_unknown);
+        if (index > 0)
+            decodeRemainder();
         Assert(index < _revs.size());
         return _revs[index];
     }
 
     const Rev* RevTree::get(revid revID) const {
+        if (isPartiallyDecoded()) {
+            // The current revision is the most likely to be asked for, so check it first:
+            if (_revs[0]->revID == revID)
+                return _revs[0];
+            decodeRemainder();
+        }
         for (Rev *rev : _revs) {
             if (rev->revID == revID)
                 return rev;
@@ -141,6 +223,7 @@ namespace litecore {
     }
 
     const Rev* RevTree::getBySequence(sequence_t seq) const {
+        decodeRemainder();
         for (Rev *rev : _revs) {
             if (rev->sequence == seq)
                 return rev;
@@ -150,6 +233,7 @@ namespace litecore {
     }
 
     bool RevTree::hasConflict() const {
+        decodeRemainder();
         if (_revs.size() < 2) {
             Assert(!_unknown);
             return false;
@@ -192,10 +276,8 @@ namespace litecore {
     }
 
     unsigned Rev::index() const {
-        auto &revs = owner->_revs;
-        auto i = find(revs.begin(), revs.end(), this);
-        Assert(i != revs.end());
-        return (unsigned)(i - revs.begin());
+        DebugAssert(_index < owner->_revs.size() && owner->_revs[_index] == this);
+        return _index;
     }
 
     const Rev* Rev::next() const {
@@ -205,7 +287,7 @@ namespace litecore {
 
     std::vector<const Rev*> Rev::history() const {
         std::vector<const Rev*> h;
-        for (const Rev* rev = this; rev; rev = rev->parent)
+        for (const Rev* rev = this; rev; rev = rev->parent())
             h.push_back(rev);
         return h;
     }
@@ -214,7 +296,7 @@ namespace litecore {
         do {
             if (rev == this)
                 return true;
-            rev = rev->parent;
+            rev = rev->parent();
         } while (rev);
         return false;
     }
@@ -229,7 +311,7 @@ namespace litecore {
 
     bool RevTree::confirmLeaf(Rev* testRev) {
         for (Rev *rev : _revs)
-            if (rev->parent == testRev)
+            if (rev->_parent == testRev)
                 return false;
         testRev->addFlag(Rev::kLeaf);
         return true;
@@ -297,22 +379,21 @@ namespace litecore {
                           Rev::Flags revFlags,
                           bool markConflict)
     {
+        decodeRemainder();
         revFlags = Rev::Flags(revFlags & (Rev::kDeleted | Rev::kClosed | Rev::kHasAttachments | Rev::kKeepBody));
         Assert(!((revFlags & Rev::kClosed) && !(revFlags & Rev::kDeleted)));
 
         Assert(!_unknown);
         // Allocate copies of the revID and data so they'll stay around:
-        _insertedData.emplace_back(unownedRevID);
-        revid revID = revid(_insertedData.back());
+        revid revID = revid(_arena.copy(unownedRevID));
 
-        _revsStorage.emplace_back();
-        Rev *newRev = &_revsStorage.back();
+        Rev *newRev = _arena.make<Rev>();
         newRev->owner = this;
         newRev->revID = revID;
         newRev->_body = (slice)copyBody(body);
         newRev->sequence = 0; // Sequence is unknown till record is saved
         newRev->flags = Rev::Flags(Rev::kLeaf | Rev::kNew | revFlags);
-        newRev->parent = parentRev;
+        newRev->_parent = parentRev;
 
         if (parentRev) {
             if (markConflict && (!parentRev->isLeaf() || parentRev->isConflict()))
@@ -331,6 +412,7 @@ namespace litecore {
         _changed = true;
         if (!_revs.empty())
             _sorted = false;
+        newRev->_index = uint32_t(_revs.size());
         _revs.push_back(newRev);
         return newRev;
     }
@@ -410,8 +492,9 @@ namespace litecore {
     }
 
     void RevTree::markBranchAsNotConflict(const Rev *branch, bool winningBranch) {
+        decodeRemainder();
         bool keepBodies = winningBranch;
-        for (auto rev = const_cast<Rev*>(branch); rev; rev = const_cast<Rev*>(rev->parent)) {
+        for (auto rev = const_cast<Rev*>(branch); rev; rev = const_cast<Rev*>(rev->_parent)) {
             if (rev->isConflict()) {
                 rev->clearFlag(Rev::kIsConflict);
                 _changed = true;
@@ -438,12 +521,13 @@ void RevTree::resetConflictSequence(const Rev* winningRev) {
 #pragma mark - REMOVAL (prune / purge / compact):
 
     void RevTree::keepBody(const Rev *rev_in) {
+        decodeRemainder();
         auto rev = const_cast<Rev*>(rev_in);
         rev->addFlag(Rev::kKeepBody);
 
         // Only one rev in a branch can have the keepBody flag
         bool conflict = rev->isConflict();
-        for (auto ancestor = rev->parent; ancestor; ancestor = ancestor->parent) {
+        for (auto ancestor = rev->_parent; ancestor; ancestor = ancestor->_parent) {
             if (conflict && !ancestor->isConflict())
                 break;  // stop at end of a conflict branch
             const_cast<Rev*>(ancestor)->clearFlag(Rev::kKeepBody);
@@ -459,14 +543,16 @@ void RevTree::resetConflictSequence(const Rev* winningRev) {
     }
 
     void RevTree::removeBodiesOnBranch(const Rev* rev) {
+        decodeRemainder();
         do {
             removeBody(rev);
-            rev = rev->parent;
+            rev = rev->_parent;
         } while (rev);
     }
 
     // Remove bodies of already-saved revs that are no longer leaves:
     void RevTree::removeNonLeafBodies() {
+        decodeRemainder();
         for (Rev *rev : _revs) {
             if (rev->_body.size > 0 && !(rev->flags & (Rev::kLeaf | Rev::kNew | Rev::kKeepBody))) {
                 rev->removeBody();
@@ -477,6 +563,7 @@ void RevTree::resetConflictSequence(const Rev* winningRev) {
 
     unsigned RevTree::prune(unsigned maxDepth) {
         Assert(maxDepth > 0);
+        decodeRemainder();
         if (_revs.size() <= maxDepth)
             return 0;
 
@@ -486,7 +573,7 @@ void RevTree::resetConflictSequence(const Rev* winningRev) {
             if (rev->isLeaf()) {
                 // Starting from a leaf rev, trace its ancestry to find its depth:
                 unsigned depth = 0;
-                for (Rev* anc = rev; anc; anc = (Rev*)anc->parent) {
+                for (Rev* anc = rev; anc; anc = (Rev*)anc->_parent) {
                     if (++depth > maxDepth && !anc->keepBody()) {
                         // Mark revs that are too far away:
                         anc->addFlag(Rev::kPurge);
@@ -515,8 +602,8 @@ void RevTree::resetConflictSequence(const Rev* winningRev) {
         // Clear parent links that point to revisions being pruned:
         for (auto &rev : _revs) {
             if (!rev->isMarkedForPurge()) {
-                while (rev->parent && rev->parent->isMarkedForPurge())
-                    rev->parent = rev->parent->parent;
+                while (rev->_parent && rev->_parent->isMarkedForPurge())
+                    rev->_parent = rev->_parent->_parent;
             }
         }
         compact();
@@ -524,6 +611,7 @@ void RevTree::resetConflictSequence(const Rev* winningRev) {
     }
 
     int RevTree::purge(revid leafID) {
+        decodeRemainder();
         int nPurged = 0;
         Rev* rev = (Rev*)get(leafID);
         if (!rev || !rev->isLeaf())
@@ -531,8 +619,8 @@ void RevTree::resetConflictSequence(const Rev* winningRev) {
         do {
             nPurged++;
             rev->addFlag(Rev::kPurge);
-            const Rev* parent = (Rev*)rev->parent;
-            rev->parent = nullptr;                      // unlink from parent
+            const Rev* parent = (Rev*)rev->_parent;
+            rev->_parent = nullptr;                      // unlink from parent
             rev = (Rev*)parent;
         } while (rev && confirmLeaf(rev));
         compact();
@@ -541,6 +629,7 @@ void RevTree::resetConflictSequence(const Rev* winningRev) {
     }
 
     int RevTree::purgeAll() {
+        decodeRemainder();
         int result = (int)_revs.size();
         _revs.resize(0);
         _changed = true;
@@ -559,6 +648,7 @@ void RevTree::resetConflictSequence(const Rev* winningRev) {
             }
         }
         _revs.resize(dst - _revs.begin());
+        renumber();
 
         // Remove purged revs from _remoteRevs:
         auto tempRemoteRevs = _remoteRevs;
@@ -571,6 +661,34 @@ void RevTree::resetConflictSequence(const Rev* winningRev) {
     }
 
 
+    unsigned RevTree::removeObsoleteRemoteData(function_ref<bool(RemoteID)> isKnownRemote,
+                                               size_t &bodyBytesRemoved)
+    {
+        decodeRemainder();
+        unsigned removed = 0;
+        for (auto i = _remoteRevs.begin(); i != _remoteRevs.end(); ) {
+            if (isKnownRemote(i->first)) {
+                ++i;
+            } else {
+                i = _remoteRevs.erase(i);
+                ++removed;
+            }
+        }
+        // A body is kept so it can be the source of a delta sent to the remote that has it, or
+        // the base of a merge; once no remote's latest revision is this one, it's useless:
+        for (Rev *rev : _revs) {
+            if (rev->keepBody() && !rev->isLeaf() && !isLatestRemoteRevision(rev)) {
+                bodyBytesRemoved += rev->_body.size;
+                rev->removeBody();
+                ++removed;
+            }
+        }
+        if (removed > 0)
+            _changed = true;
+        return removed;
+    }
+
+
 #pragma mark - SORT / SAVE:
 
     // Sort comparison function for an array of Revisions. Higher priority comes _first_, so this
@@ -601,6 +719,7 @@ void RevTree::resetConflictSequence(const Rev* winningRev) {
         if (_sorted)
             return;
         std::sort(_revs.begin(), _revs.end(), &compareRevs);
+        renumber();
         _sorted = true;
         checkForResolvedConflict();
     }
@@ -612,6 +731,7 @@ void RevTree::resetConflictSequence(const Rev* winningRev) {
     }
 
     bool RevTree::hasNewRevisions() const {
+        decodeRemainder();
         for (Rev *rev : _revs) {
             if (rev->isNew() || rev->sequence == 0)
                 return true;
@@ -620,6 +740,7 @@ void RevTree::resetConflictSequence(const Rev* winningRev) {
     }
 
     void RevTree::saved(sequence_t newSequence) {
+        decodeRemainder();
         for (Rev *rev : _revs) {
             rev->clearFlag(Rev::kNew);
             if (rev->sequence == 0) {
@@ -632,6 +753,7 @@ void RevTree::resetConflictSequence(const Rev* winningRev) {
 
 
     bool RevTree::isLatestRemoteRevision(const Rev *rev) const {
+        decodeRemainder();
         for (auto &r : _remoteRevs) {
             if (r.second == rev)
                 return true;
@@ -641,6 +763,7 @@ void RevTree::resetConflictSequence(const Rev* winningRev) {
 
     const Rev* RevTree::latestRevisionOnRemote(RemoteID remote) {
         Assert(remote != kNoRemoteID);
+        decodeRemainder();
         auto i = _remoteRevs.find(remote);
         if (i == _remoteRevs.end())
             return nullptr;
@@ -650,6 +773,7 @@ void RevTree::resetConflictSequence(const Rev* winningRev) {
 
     void RevTree::setLatestRevisionOnRemote(RemoteID remote, const Rev *rev) {
         Assert(remote != kNoRemoteID);
+        decodeRemainder();
         if (rev) {
             _remoteRevs[remote] = rev;
         } else {
@@ -665,6 +789,7 @@ void RevTree::resetConflictSequence(const Rev* winningRev) {
     }
 
     void RevTree::dump(std::ostream& out) {
+        decodeRemainder();
         int i = 0;
         for (Rev *rev : _revs) {
             out << "\t" << (++i) << ": ";
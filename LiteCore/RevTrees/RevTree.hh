@@ -20,9 +20,11 @@
 #include "PlatformCompat.hh"
 #include "fleece/slice.hh"
 #include "RevID.hh"
+#include "function_ref.hh"
 #include <climits>
-#include <deque>
+#include <new>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 
 
@@ -34,10 +36,11 @@ namespace litecore {
     class Rev {
     public:
         const RevTree*  owner;
-        const Rev*      parent;
         revid           revID;      /**< Revision ID (compressed) */
         sequence_t      sequence;   /**< DB sequence number that this revision has/had */
 
+        inline const Rev* parent() const;
+
         slice body() const;
         bool isBodyAvailable() const FLPURE{return _body.buf != nullptr;}
 
@@ -48,13 +51,13 @@ namespace litecore {
         bool isConflict() const FLPURE     {return (flags & kIsConflict) != 0;}
         bool isClosed() const FLPURE       {return (flags & kClosed) != 0;}
         bool keepBody() const FLPURE       {return (flags & kKeepBody) != 0;}
-        bool isActive() const FLPURE;
+        bool isActive() const;
 
         unsigned index() const FLPURE;
-        const Rev* next() const FLPURE;       // next by order in array, i.e. descending priority
+        const Rev* next() const;           // next by order in array, i.e. descending priority
         std::vector<const Rev*> history() const;
-        bool isAncestorOf(const Rev* NONNULL) const FLPURE;
-        bool isLatestRemoteRevision() const FLPURE;
+        bool isAncestorOf(const Rev* NONNULL) const;
+        bool isLatestRemoteRevision() const;
 
         enum Flags : uint8_t {
             kNoFlags        = 0x00,
@@ -71,7 +74,9 @@ namespace litecore {
         Flags flags;
 
     private:
+        const Rev*  _parent;        /**< Parent revision, if any */
         slice       _body;          /**< Revision body (JSON), or empty if not stored in this tree*/
+        uint32_t    _index;         /**< Position in owner's sorted array (see `index()`) */
 
         void addFlag(Flags f)           {flags = (Flags)(flags | f);}
         void clearFlag(Flags f)         {flags = (Flags)(flags & ~f);}
@@ -86,29 +91,71 @@ namespace litecore {
     };
 
 
+    /** A simple bump allocator that owns the Rev objects and inserted revIDs of a RevTree.
+        Memory is carved out of a few chunks that never move, so pointers into the arena stay
+        valid until it's reset or destroyed. Objects allocated in it are never destructed. */
+    class RevTreeArena {
+    public:
+        RevTreeArena() =default;
+        RevTreeArena(const RevTreeArena&) =delete;
+        RevTreeArena& operator=(const RevTreeArena&) =delete;
+        ~RevTreeArena()                                 {reset();}
+
+        /** Frees all memory. If `capacity` is nonzero, preallocates a chunk of that size. */
+        void reset(size_t capacity =0);
+
+        void* allocate(size_t size, size_t alignment);
+
+        template <class T, class... Args>
+        T* make(Args&&... args) {
+            return new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+        }
+
+        /** Copies the bytes of a slice into the arena. */
+        slice copy(slice);
+
+        /** True if the pointer points into memory allocated by this arena. */
+        bool owns(const void*) const FLPURE;
+
+    private:
+        struct Chunk;
+        void addChunk(size_t minSize);
+
+        Chunk*   _chunk {nullptr};          // Most recent chunk; earlier ones are linked to it
+        uint8_t* _next  {nullptr};          // Next free byte in _chunk
+        uint8_t* _end   {nullptr};          // End of _chunk
+    };
+
+
     /** A serializable tree of Revisions. */
     class RevTree {
     public:
         RevTree() { }
-        RevTree(slice body, slice extra, sequence_t seq);
+        RevTree(slice body, slice extra, sequence_t seq, bool lazily =false);
         RevTree(const RevTree&);
         virtual ~RevTree() { }
 
-        void decode(slice body, slice extra, sequence_t seq);
+        /** Decodes a tree from a record's body and extra. If `lazily` is true, only the current
+            revision is decoded at first; the rest of the tree is decoded from `extra` (which must
+            remain valid) the first time any other revision, or any tree-wide state, is needed. */
+        void decode(slice body, slice extra, sequence_t seq, bool lazily =false);
+
+        /** True if the tree was decoded lazily and so far only the current revision exists. */
+        bool isPartiallyDecoded() const FLPURE                 {return _undecodedTree.buf != nullptr;}
 
         pair<slice,alloc_slice> encode();
 
-        size_t size() const FLPURE                             {return _revs.size();}
-        const Rev* get(unsigned index) const FLPURE;
-        const Rev* get(revid) const FLPURE;
-        const Rev* operator[](unsigned index) const FLPURE {return get(index);}
-        const Rev* operator[](revid revID) const FLPURE    {return get(revID);}
-        const Rev* getBySequence(sequence_t) const FLPURE;
+        size_t size() const                             {decodeRemainder(); return _revs.size();}
+        const Rev* get(unsigned index) const;
+        const Rev* get(revid) const;
+        const Rev* operator[](unsigned index) const     {return get(index);}
+        const Rev* operator[](revid revID) const        {return get(revID);}
+        const Rev* getBySequence(sequence_t) const;
 
-        const std::vector<Rev*>& allRevisions() const FLPURE   {return _revs;}
+        const std::vector<Rev*>& allRevisions() const   {decodeRemainder(); return _revs;}
         const Rev* currentRevision();
-        bool hasConflict() const FLPURE;
-        bool hasNewRevisions() const FLPURE;
+        bool hasConflict() const;
+        bool hasNewRevisions() const;
 
         /// Given an array of revision IDs in consecutive descending-generation order,
         /// finds the first one that exists in this tree. Returns:
@@ -182,7 +229,15 @@ namespace litecore {
 
         const Rev* latestRevisionOnRemote(RemoteID);
         void setLatestRevisionOnRemote(RemoteID, const Rev*);
-        const RemoteRevMap& remoteRevisions() const         {return _remoteRevs;}
+        const RemoteRevMap& remoteRevisions() const         {decodeRemainder(); return _remoteRevs;}
+
+        /** Removes remote-revision data that's no longer needed: the markers of remotes for
+            which `isKnownRemote` returns false, and the bodies kept (`kKeepBody`) by non-leaf
+            revisions that aren't the latest revision of any remaining remote.
+            Returns the number of markers and bodies removed, and adds the total size of the
+            bodies to `bodyBytesRemoved`. */
+        unsigned removeObsoleteRemoteData(fleece::function_ref<bool(RemoteID)> isKnownRemote,
+                                          size_t &bodyBytesRemoved);
 
 #if DEBUG
         void dump();
@@ -190,7 +245,7 @@ namespace litecore {
 
     protected:
         virtual bool isBodyOfRevisionAvailable(const Rev* r NONNULL) const FLPURE;
-        bool isLatestRemoteRevision(const Rev* NONNULL) const FLPURE;
+        bool isLatestRemoteRevision(const Rev* NONNULL) const;
         virtual alloc_slice copyBody(slice body);
         virtual alloc_slice copyBody(const alloc_slice &body);
         void substituteBody(const Rev *rev, slice body)       {const_cast<Rev*>(rev)->_body = body;}
@@ -204,18 +259,32 @@ namespace litecore {
     private:
         friend class Rev;
         friend class RawRevision;
-        void initRevs();
+        void decodeRemainder() const {
+            if (_usuallyFalse(isPartiallyDecoded()))
+                const_cast<RevTree*>(this)->_decodeRemainder();
+        }
+        void _decodeRemainder();
         Rev* _insert(revid, const alloc_slice &body, Rev *parent, Rev::Flags, bool markConflicts);
         bool confirmLeaf(Rev* testRev NONNULL);
         void compact();
         void checkForResolvedConflict();
 
+        void renumber();
+
         bool                     _sorted {true};        // Is _revs currently sorted?
         std::vector<Rev*>        _revs;                 // Revs in sorted order
-        std::deque<Rev>          _revsStorage;          // Actual storage of the Rev objects
-        std::vector<alloc_slice> _insertedData;         // Storage for new revids
+        RevTreeArena             _arena;                // Storage of the Rev objects & new revIDs
+        std::vector<alloc_slice> _insertedData;         // Storage for new rev bodies
         RemoteRevMap             _remoteRevs;           // Tracks current rev for a remote DB URL
         unsigned                 _pruneDepth {UINT_MAX};// Tree depth to prune to
+        slice                    _undecodedTree;        // Raw tree, if only partially decoded
+        sequence_t               _undecodedSequence {0};// Sequence to give undecoded revs
     };
 
+
+    inline const Rev* Rev::parent() const {
+        owner->decodeRemainder();
+        return _parent;
+    }
+
 }
@@ -72,7 +72,8 @@ namespace litecore {
             _contentLoaded = _rec.contentLoaded();
             switch (_contentLoaded) {
                 case kEntireBody:
-                    RevTree::decode(_rec.body(), _rec.extra(),  _rec.sequence());
+                    // Decode lazily: many callers only ever look at the current revision.
+                    RevTree::decode(_rec.body(), _rec.extra(), _rec.sequence(), true);
                     if (auto cur = currentRevision(); cur && (_rec.flags() & DocumentFlags::kSynced)) {
                         // The kSynced flag is set when the document's current revision is pushed to a server.
                         // This is done instead of updating the doc body, for reasons of speed. So when loading
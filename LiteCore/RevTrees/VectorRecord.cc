@@ -54,12 +54,20 @@ namespace litecore {
      The indices of the Array correspond to `RemoteID`s. Each remote revision is stored at its
      RemoteID's index as a Dict, with keys:
        - `kRevPropertiesKey` --document body, itself a Dict
-       - `kRevIDKey`         --revision ID, binary data
+       - `kRevIDKey`         --revision ID, binary data (see below)
        - `kRevFlagsKey`      --DocumentFlags, int, omitted if 0
      An array item whose index doesn't correspond to any Revision contains a `null` instead
      of a Dict. This includes the first (0) item, since storing the local revision here would be
      redundant.
 
+     RELATIVE VERSION VECTORS:
+
+     A remote revision's version vector usually has the same authors as the current revision's,
+     and often is identical. So it's stored in VersionVector's "relative" binary form, using the
+     record's `version` as the base, which replaces each peerID with a 1-byte index (or stores
+     nothing at all if the vectors are identical.) These are expanded back to the regular form
+     when read, so the relative form never escapes this class. Tree-based revIDs are stored as-is.
+
      DE-DUPLICATING PROPERTY VALUES:
 
      It's very common for two or more RemoteIDs to refer to the same revision, i.e. have the same
@@ -110,6 +118,7 @@ namespace litecore {
     ,_docID(rec.key())
     ,_sequence(rec.sequence())
     ,_revID(rec.version())
+    ,_savedRevID(rec.version())
     ,_docFlags(rec.flags())
     ,_whichContent(rec.contentLoaded())
     ,_versioning(versioning)
@@ -152,6 +161,7 @@ namespace litecore {
     }
 
     void VectorRecord::readRecordExtra(const alloc_slice &extra) {
+        _expandedRevIDs.clear();
         if (extra) {
             _extraDoc = Doc(extra, kFLTrusted, sharedKeys(), _bodyDoc.data());
         }
@@ -188,8 +198,10 @@ namespace litecore {
         _whichContent = which;
         if (which >= kCurrentRevOnly && oldWhich < kCurrentRevOnly)
             readRecordBody(rec.body());
-        if (which == kEntireBody && oldWhich < kEntireBody)
+        if (which == kEntireBody && oldWhich < kEntireBody) {
+            _savedRevID = rec.version();
             readRecordExtra(rec.extra());
+        }
         return true;
     }
 
@@ -223,6 +235,8 @@ namespace litecore {
             // revisions have a top-level dict with the revID, flags, properties.
             Dict properties = revDict[kRevPropertiesKey].asDict();
             revid revID(revDict[kRevIDKey].asData());
+            if (VersionVector::isRelativeBinary(revID))
+                revID = expandedRevID(remote, revID);
             auto flags = DocumentFlags(revDict[kRevFlagsKey].asInt());
             if (!properties)
                 properties = Dict::emptyDict();
@@ -295,7 +309,10 @@ namespace litecore {
             MutableDict revDict = mutableRevisionDict(remote);
             if (!newRev.revID)
                 error::_throw(error::CorruptRevisionData);
-            if (auto oldRevID = revDict[kRevIDKey].asData(); newRev.revID != oldRevID) {
+            slice oldRevID = revDict[kRevIDKey].asData();
+            if (VersionVector::isRelativeBinary(oldRevID))
+                oldRevID = expandedRevID(remote, oldRevID);
+            if (newRev.revID != oldRevID) {
                 revDict[kRevIDKey].setData(newRev.revID);
                 _changed = true;
             }
@@ -330,6 +347,21 @@ namespace litecore {
     }
 
 
+    // Expands a remote revID stored relative to the saved current one, caching the result so the
+    // returned revid stays valid as long as the remote revision does.
+    revid VectorRecord::expandedRevID(RemoteID remote, slice relativeRevID) const {
+        auto i = size_t(remote);
+        if (_expandedRevIDs.size() <= i)
+            _expandedRevIDs.resize(i + 1);
+        if (!_expandedRevIDs[i]) {
+            VersionVector vec;
+            vec.readBinary(relativeRevID, VersionVector::fromBinary(_savedRevID));
+            _expandedRevIDs[i] = vec.asBinary();
+        }
+        return revid(_expandedRevIDs[i]);
+    }
+
+
 #pragma mark - CURRENT REVISION:
 
 
@@ -498,6 +530,7 @@ namespace litecore {
             return kConflict;
 
         _sequence = seq;
+        _savedRevID = _revID;
         _changed = _revIDChanged = false;
 
         // Update Fleece Doc to newly saved data:
@@ -542,9 +575,38 @@ namespace litecore {
             body = alloc_slice(FLEncoder_Snip(enc));
             enc.endDict();
 
-            // Write other revs:
+            // Write other revs, with version vectors relative to the current one. Rewritten revs
+            // are remembered so that duplicates stay duplicates and get de-duplicated:
+            optional<VersionVector> baseVec;
+            if (_current.revID.isVersion())
+                baseVec = VersionVector::fromBinary(_current.revID);
+            bool baseChanged = (_savedRevID != _current.revID);
+            vector<pair<FLValue,MutableDict>> rewritten;
             for (unsigned i = 1; i < nRevs; i++) {
                 Value rev = _revisions[i];
+                if (Dict revDict = rev.asDict(); revDict && baseVec) {
+                    slice storedRevID = revDict[kRevIDKey].asData();
+                    revid revID = remoteRevision(RemoteID(i))->revID;
+                    if (revID.isVersion()
+                            && (baseChanged || !VersionVector::isRelativeBinary(storedRevID))) {
+                        auto dup = find_if(rewritten.begin(), rewritten.end(),
+                                           [&](auto &r) {return r.first == FLValue(rev);});
+                        if (dup != rewritten.end()) {
+                            rev = dup->second;
+                        } else {
+                            alloc_slice relRevID = VersionVector::fromBinary(revID)
+                                                                .asBinaryRelativeTo(*baseVec);
+                            slice newRevID = (relRevID.size < revID.size) ? slice(relRevID)
+                                                                          : slice(revID);
+                            if (newRevID != storedRevID) {
+                                MutableDict copy = revDict.mutableCopy();
+                                copy[kRevIDKey].setData(newRevID);
+                                rewritten.emplace_back(FLValue(rev), copy);
+                                rev = copy;
+                            }
+                        }
+                    }
+                }
                 ddenc.writeValue(rev, 2);
             }
             enc.endArray();
@@ -691,11 +753,21 @@ namespace litecore {
         if (rec.extra.size > 0) {
             fleece::impl::Scope scope(rec.extra, nullptr, rec.body);
             Array remotes = Value::fromData(rec.extra, kFLTrusted).asArray();
+            optional<VersionVector> baseVec;
             int n = 0;
             for (Array::iterator i(remotes); i; ++i, ++n) {
                 if (n > 0) {
                     Dict remote = i.value().asDict();
-                    if (slice revID = remote[kRevIDKey].asData(); revID)
+                    slice revID = remote[kRevIDKey].asData();
+                    alloc_slice expandedRevID;
+                    if (VersionVector::isRelativeBinary(revID)) {
+                        if (!baseVec)
+                            baseVec = VersionVector::fromBinary(rec.version);
+                        VersionVector vec;
+                        vec.readBinary(revID, *baseVec);
+                        revID = expandedRevID = vec.asBinary();
+                    }
+                    if (revID)
                         callback(RemoteID(n), revid(revID), remote[kRevPropertiesKey] != nullptr);
                 }
             }
@@ -23,6 +23,7 @@
 #include "fleece/Mutable.hh"
 #include <iosfwd>
 #include <optional>
+#include <vector>
 
 namespace litecore {
     class KeyStore;
@@ -246,6 +247,7 @@ namespace litecore {
         bool propertiesChanged() const;
         void clearPropertiesChanged();
         void updateDocFlags();
+        revid expandedRevID(RemoteID, slice relativeRevID) const;
 
         KeyStore&                    _store;                // The database KeyStore
         FLEncoder                    _encoder {nullptr};    // Database shared Fleece Encoder
@@ -253,12 +255,14 @@ namespace litecore {
         sequence_t                   _sequence;             // The sequence
         DocumentFlags                _docFlags;             // Document-level flags
         alloc_slice                  _revID;                // Current revision ID backing store
+        alloc_slice                  _savedRevID;           // Current revision ID as last saved
         Revision                     _current;              // Current revision
         fleece::RetainedValue        _currentProperties;    // Retains local properties
         fleece::Doc                  _bodyDoc;              // If saved, a Doc of the Fleece body
         fleece::Doc                  _extraDoc;             // Fleece Doc holding record `extra`
         fleece::Array                _revisions;            // Top-level parsed body; stores revs
         mutable fleece::MutableArray _mutatedRevisions;     // Mutable version of `_revisions`
+        mutable std::vector<alloc_slice> _expandedRevIDs;   // Remote revIDs stored relative
         Versioning                   _versioning;           // RevIDs or VersionVectors?
         bool                         _changed {false};      // Set to true on explicit change
         bool                         _revIDChanged {false}; // Has setRevID() been called?
@@ -18,7 +18,6 @@
 #include "StringUtil.hh"
 #include "varint.hh"
 #include <algorithm>
-#include <unordered_map>
 
 
 namespace litecore {
@@ -66,6 +65,36 @@ namespace litecore {
     }
 
 
+    void VersionVector::readBinary(slice data, const VersionVector &base) {
+        if (!isRelativeBinary(data))
+            return readBinary(data);
+        data.moveStart(2);
+        if (data.size == 0) {
+            if (&base != this)
+                _vers = base._vers;             // same as the base
+            return;
+        }
+        reset();
+        while (data.size > 0) {
+            generation gen;
+            uint64_t ref;
+            peerID author;
+            if (!ReadUVarInt(&data, &gen) || !ReadUVarInt(&data, &ref))
+                Version::throwBadBinary();
+            if (ref == 0) {
+                if (!ReadUVarInt(&data, &author.id))
+                    Version::throwBadBinary();
+            } else if (ref <= base.count()) {
+                author = base[ref - 1].author();
+            } else {
+                Version::throwBadBinary();
+            }
+            _vers.emplace_back(gen, author);
+        }
+        validate();
+    }
+
+
     alloc_slice VersionVector::asBinary(peerID myID) const {
         return writeAlloced(1 + _vers.size() * 2 * kMaxVarintLen64, [&](slice *out) {
             if (!out->writeByte(0))           // leading 0 byte distinguishes it from a `revid`
@@ -78,6 +107,33 @@ namespace litecore {
     }
 
 
+    alloc_slice VersionVector::asBinaryRelativeTo(const VersionVector &base) const {
+        if (empty())
+            return asBinary();                  // relative form would mean "same as base"
+        return writeAlloced(2 + _vers.size() * 3 * kMaxVarintLen64, [&](slice *out) {
+            if (!out->writeByte(0) || !out->writeByte(0))
+                return false;
+            if (_vers.size() == base._vers.size()
+                    && std::equal(_vers.begin(), _vers.end(), base._vers.begin()))
+                return true;                    // same as the base; nothing more to write
+            for (auto &v : _vers) {
+                uint64_t ref = 0;
+                for (size_t i = 0; i < base._vers.size(); ++i) {
+                    if (base._vers[i].author() == v.author()) {
+                        ref = 1 + i;
+                        break;
+                    }
+                }
+                if (!WriteUVarInt(out, v.gen()) || !WriteUVarInt(out, ref))
+                    return false;
+                if (ref == 0 && !WriteUVarInt(out, v.author().id))
+                    return false;
+            }
+            return true;
+        });
+    }
+
+
     size_t VersionVector::maxASCIILen() const {
         return _vers.size() * (Version::kMaxASCIILength + 1);
     }
@@ -181,41 +237,98 @@ namespace litecore {
             return o;
     }
 
-    versionOrder VersionVector::compareTo(const VersionVector &other) const {
-        // First check if either or both are empty:
-        auto myCount = count(), otherCount = other.count();
-        if (myCount == 0)
-            return otherCount == 0 ? kSame : kOlder;
-        else if (otherCount == 0)
-            return kNewer;
+    // Looks up authors' generations in a vector. Vectors too long to search linearly are copied
+    // and sorted by author, so that lookups are O(log n) instead of O(n).
+    class genLookup {
+    public:
+        explicit genLookup(const vec &vers)
+        :_vers(vers)
+        {
+            if (vers.size() > kMaxLinearSearch) {
+                _sorted.reserve(vers.size());
+                for (auto &v : vers)
+                    _sorted.push_back(v);
+                sort(_sorted.begin(), _sorted.end(), [](const Version &a, const Version &b) {
+                    return a.author().id < b.author().id;
+                });
+            }
+        }
 
-        versionOrder o = kSame;
-        ssize_t countDiff = ssize_t(myCount) - ssize_t(otherCount);
-        if (countDiff < 0)
-            o = kOlder;             // other must have versions from authors I don't have
-        else if (countDiff > 0)
-            o = kNewer;             // I must have versions from authors other doesn't have
-        else if (myCount > 0 && (*this)[0] == other[0])
-            return kSame;           // first revs are identical so vectors are equal
+        generation operator[] (peerID author) const {
+            if (_sorted.empty()) {
+                for (auto &v : _vers)
+                    if (v.author() == author)
+                        return v.gen();
+            } else {
+                auto i = lower_bound(_sorted.begin(), _sorted.end(), author,
+                                     [](const Version &v, peerID a) {
+                    return v.author().id < a.id;
+                });
+                if (i != _sorted.end() && i->author() == author)
+                    return i->gen();
+            }
+            return 0;
+        }
 
-        //OPT: This is O(n^2), since the `for` loop calls `other[ ]`, which is a linear search.
-        for (auto &v : _vers) {
-            auto othergen = other[v.author()];
-            if (v.gen() < othergen) {
-                o = versionOrder(o | kOlder);
-            } else if (v.gen() > othergen) {
-                o = versionOrder(o | kNewer);
-                if (othergen == 0) {
-                    // other doesn't have this author, which makes its remaining entries more likely
-                    // to have authors I don't have; when that becomes certainty, set 'older' flag:
-                    if (--countDiff < 0)
-                        o = versionOrder(o | kOlder);
-                }
+        size_t size() const                     {return _vers.size();}
+
+    private:
+        static constexpr size_t kMaxLinearSearch = 8;
+
+        const vec&  _vers;
+        vec         _sorted;
+    };
+
+
+    // Compares a sequence of versions to another vector. `next` is called to get each version in
+    // turn, and returns false at the end.
+    static versionOrder compareVersions(function_ref<bool(generation&,peerID&)> next,
+                                        const genLookup &other)
+    {
+        int o = kSame;
+        size_t matched = 0;
+        generation gen = 0;
+        peerID author;
+        while (o != kConflicting && next(gen, author)) {
+            if (generation othergen = other[author]; othergen == 0) {
+                o |= kNewer;                    // I have an author that other doesn't
+            } else {
+                ++matched;
+                if (gen < othergen)
+                    o |= kOlder;
+                else if (gen > othergen)
+                    o |= kNewer;
             }
-            if (o == kConflicting)
-                break;
         }
-        return o;
+        if (matched < other.size())
+            o |= kOlder;                        // other has an author that I don't
+        return versionOrder(o);
+    }
+
+    versionOrder VersionVector::compareTo(const VersionVector &other) const {
+        if (count() == other.count() && count() > 0 && (*this)[0] == other[0])
+            return kSame;           // first revs are identical so vectors are equal
+        auto i = _vers.begin(), end = _vers.end();
+        return compareVersions([&](generation &gen, peerID &author) {
+            if (i == end)
+                return false;
+            gen = i->gen();
+            author = i->author();
+            ++i;
+            return true;
+        }, genLookup(other._vers));
+    }
+
+    versionOrder VersionVector::compareBinary(slice data, const VersionVector &other) {
+        if (data.size < 1 || data.readByte() != 0)
+            Version::throwBadBinary();
+        return compareVersions([&](generation &gen, peerID &author) {
+            if (data.size == 0)
+                return false;
+            if (!ReadUVarInt(&data, &gen) || !ReadUVarInt(&data, &author.id) || gen == 0)
+                Version::throwBadBinary();
+            return true;
+        }, genLookup(other._vers));
     }
 
     bool VersionVector::isNewerIgnoring(peerID ignoring, const VersionVector &other) const {
@@ -317,34 +430,11 @@ namespace litecore {
 #pragma mark - MERGING:
 
 
-    // A hash table mapping peerID->generation, as an optimization for versionVector operations
-    class versionMap {
-    public:
-        versionMap(const vec &vec) {
-            _map.reserve(vec.size());
-            for (auto &v : vec)
-                add(v);
-        }
-
-        void add(const Version &vers) {
-            _map[vers.author().id] = vers.gen();
-        }
-
-        generation operator[] (peerID author) {
-            auto i = _map.find(author.id);
-            return (i == _map.end()) ? 0 : i->second;
-        }
-
-    private:
-        unordered_map<uint64_t, generation> _map;
-    };
-    
-    
     VersionVector VersionVector::mergedWith(const VersionVector &other) const {
         // Walk through the two vectors in parallel, adding the current component from each if it's
         // newer than the corresponding component in the other. This isn't going to produce the
         // optimal ordering, but it should be pretty close.
-        versionMap myMap(_vers), otherMap(other._vers);
+        genLookup myMap(_vers), otherMap(other._vers);
         VersionVector result;
         size_t mySize = _vers.size(), itsSize = other._vers.size(), maxSize = max(mySize, itsSize);
         for (size_t i = 0; i < maxSize; ++i) {
@@ -17,7 +17,14 @@ namespace litecore {
     /** A version vector: an array of version identifiers in reverse chronological order.
         Can be serialized either as a human-readable string or as binary data.
         The string format is comma-separated Version strings (see above).
-        The binary format is consecutive binary Versions (see above). */
+        The binary format is a 0 byte followed by consecutive binary Versions (see above).
+
+        There's also a more compact "relative" binary format, which refers to authors by their
+        position in another vector (the "base") instead of by peerID. It begins with two 0 bytes,
+        which can't occur in the regular format since generations are nonzero. If nothing else
+        follows, the vector is the same as the base. Otherwise, each Version is a varint generation
+        followed by a varint that's either 1 + the author's index in the base, or 0 followed by
+        the varint peerID of an author not in the base. */
     class VersionVector {
     public:
         /** Returns a VersionVector parsed from ASCII; see `readASCII` for details. */
@@ -56,6 +63,14 @@ namespace litecore {
         /** Reads binary form. */
         void readBinary(slice binaryData);
 
+        /** Reads binary form, which may be relative to `base` (see `asBinaryRelativeTo`.) */
+        void readBinary(slice binaryData, const VersionVector &base);
+
+        /** True if binary data is in the relative form generated by `asBinaryRelativeTo`. */
+        static bool isRelativeBinary(slice binaryData) {
+            return binaryData.size >= 2 && binaryData[0] == 0 && binaryData[1] == 0;
+        }
+
         /** Reads just the current (first) Version from the binary form. */
         static Version readCurrentVersionFromBinary(slice binaryData);
 
@@ -92,6 +107,10 @@ namespace litecore {
         bool operator <= (const VersionVector& v) const     {return compareTo(v) <= kOlder;}
         bool operator >= (const VersionVector& v) const     {return v <= *this;}
 
+        /** Compares a vector in binary form to another vector, without decoding it.
+            (The binary form can't be relative.) */
+        static versionOrder compareBinary(slice binaryData, const VersionVector&);
+
         /** Compares with a single version, i.e. whether this vector is newer/older/same as a
             vector with the given current version. (Will never return kConflicting.) */
         versionOrder compareTo(const Version&) const;
@@ -104,6 +123,11 @@ namespace litecore {
         /** Generates binary form. */
         fleece::alloc_slice asBinary(peerID myID = kMePeerID) const;
 
+        /** Generates the compact binary form relative to `base`. This is much smaller than the
+            regular form when the two vectors have authors in common, as a document's revisions
+            usually do. Only `readBinary` given the same base can read it. */
+        fleece::alloc_slice asBinaryRelativeTo(const VersionVector &base) const;
+
         /** Converts the vector to a human-readable string.
             When sharing a vector with another peer, pass your actual peer ID in `myID`;
             then occurrences of kMePeerID will be written as that ID.
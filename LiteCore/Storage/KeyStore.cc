@@ -38,11 +38,42 @@ namespace litecore {
         return rec;
     }
 
-    void KeyStore::get(slice key, ContentOption option, function_ref<void(const Record&)> fn) {
-        // Subclasses can implement this differently for better memory management.
+    bool KeyStore::get(slice key, ContentOption option,
+                       function_ref<void(const RecordLite&)> fn) const
+    {
+        // Subclasses can implement this differently, to avoid copying the record.
         Record rec(key);
-        read(rec, option);
-        fn(rec);
+        if (!read(rec, option))
+            return false;
+        fn(RecordLite{rec.key(), rec.version(), rec.body(), rec.extra(),
+                      rec.sequence(), false, rec.flags()});
+        return true;
+    }
+
+    static string recordCacheGroupKey(const string &keyStoreName) {
+        return "RecordCache:" + keyStoreName;
+    }
+
+    void KeyStore::setRecordCacheSize(size_t maxBytes) {
+        if (maxBytes > 0) {
+            // Join the group before enabling, so no record can be cached without this cache
+            // being notified of other connections' changes to it:
+            string groupKey = recordCacheGroupKey(_name);
+            Retained<RefCounted> group = _db.sharedObject(groupKey);
+            if (!group)
+                group = _db.addSharedObject(groupKey, new RecordCache::Group);
+            _recordCache.joinGroup((RecordCache::Group*)group.get());
+        }
+        _recordCache.setMaxBytes(maxBytes);
+    }
+
+    void KeyStore::recordCacheTransactionEnded(bool committed) {
+        if (!_recordCache.hasChanges())
+            return;
+        Retained<RefCounted> group;
+        if (committed)
+            group = _db.sharedObject(recordCacheGroupKey(_name));
+        _recordCache.transactionEnded(committed, (RecordCache::Group*)group.get());
     }
 
 #if ENABLE_DELETE_KEY_STORES
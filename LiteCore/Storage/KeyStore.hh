@@ -20,6 +20,7 @@
 #include "IndexSpec.hh"
 #include "RefCounted.hh"
 #include "RecordEnumerator.hh"
+#include "RecordCache.hh"
 #include "function_ref.hh"
 #include <optional>
 #include <vector>
@@ -68,11 +69,26 @@ namespace litecore {
         Record get(slice key, ContentOption = kEntireBody) const;
         virtual Record get(sequence_t, ContentOption = kEntireBody) const =0;
 
-        virtual void get(slice key, ContentOption, function_ref<void(const Record&)>);
+        /** Reads a record and passes it to the callback, without copying its data: the slices in
+            the RecordLite may point directly into storage, and are only valid during the call.
+            The body is null with kMetaOnly, and the extra unless kEntireBody.
+            Returns false, without calling the callback, if the record doesn't exist.
+            The callback must not call back into this KeyStore. */
+        virtual bool get(slice key, ContentOption, function_ref<void(const RecordLite&)>) const;
 
         /** Reads a record whose key() is already set. */
         virtual bool read(Record &rec, ContentOption = kEntireBody) const =0;
 
+        /** The cache of recently read records consulted by `read`; it's disabled by default. */
+        RecordCache& recordCache() const            {return _recordCache;}
+
+        /** Sets the maximum size of the record cache in bytes; zero disables it. */
+        void setRecordCacheSize(size_t maxBytes);
+
+        /** Called by the DataFile after a transaction commits or aborts, to invalidate records
+            it changed in other connections' caches. */
+        void recordCacheTransactionEnded(bool committed);
+
         /** Creates a database query object. */
         virtual Retained<Query> compileQuery(slice expr, QueryLanguage =QueryLanguage::kJSON) =0;
 
@@ -171,6 +187,13 @@ namespace litecore {
         virtual void deleteIndex(slice name) =0;
         virtual std::vector<IndexSpec> getIndexes() const =0;
 
+        /** Brings deferred indexes (see IndexSpec::Options::deferred) up to date, by indexing at
+            most `maxDocs` of the documents that have changed since they were last updated.
+            Must be called within a Transaction.
+            @return  The number of documents indexed; if less than `maxDocs`, the indexes are
+                     now up to date. */
+        virtual unsigned updateDeferredIndexes(unsigned maxDocs)    {return 0;}
+
         // public for complicated reasons; clients should never call it
         virtual ~KeyStore()                             { }
 
@@ -188,6 +211,7 @@ namespace litecore {
         DataFile &          _db;            // The DataFile I'm contained in
         const std::string   _name;          // My name
         const Capabilities  _capabilities;  // Do I support sequences or soft deletes?
+        mutable RecordCache _recordCache;   // Recently read records (if enabled)
 
     private:
         KeyStore(const KeyStore&) = delete;     // not copyable
@@ -0,0 +1,219 @@
+//
+// RecordCache.cc
+//
+// Copyright (c) 2021 Couchbase, Inc All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "RecordCache.hh"
+#include "Error.hh"
+#include <algorithm>
+
+using namespace std;
+
+namespace litecore {
+
+    // Rough per-record overhead of the list node, hash table entry and alloc_slice headers
+    static constexpr size_t kRecordOverhead = 128;
+
+    // Past this many changed records, a commit just clears the other connections' caches
+    static constexpr size_t kMaxChangedKeys = 100;
+
+
+    RecordCache::~RecordCache() {
+        if (_group)
+            _group->remove(this);
+    }
+
+
+    void RecordCache::joinGroup(Group *group) {
+        if (group == _group)
+            return;
+        if (_group)
+            _group->remove(this);
+        _group = group;
+        if (_group)
+            _group->add(this);
+    }
+
+
+    size_t RecordCache::sizeOf(const Record &rec) {
+        return kRecordOverhead + rec.key().size + rec.version().size
+             + rec.body().size + rec.extra().size;
+    }
+
+
+    void RecordCache::setMaxBytes(size_t maxBytes) {
+        lock_guard<mutex> lock(_mutex);
+        _maxBytes = maxBytes;
+        _evictToFit(maxBytes);
+    }
+
+
+    bool RecordCache::lookup(Record &rec, ContentOption content) {
+        if (!enabled())
+            return false;
+        lock_guard<mutex> lock(_mutex);
+        auto i = _byKey.find(rec.key());
+        if (i == _byKey.end()) {
+            ++_misses;
+            return false;
+        }
+        ++_hits;
+        _lru.splice(_lru.begin(), _lru, i->second);     // Move to front
+
+        const Record &cached = *i->second;
+        rec.updateSequence(cached.sequence());
+        rec.setExists();
+        rec.setContentLoaded(content);
+        rec.setFlags(cached.flags());
+        rec.setVersion(cached.version());
+        if (content == kMetaOnly)
+            rec.setUnloadedBodySize(cached.bodySize());
+        else
+            rec.setBody(cached.body());
+        if (content == kEntireBody)
+            rec.setExtra(cached.extra());
+        else
+            rec.setUnloadedExtraSize(cached.extraSize());
+        return true;
+    }
+
+
+    void RecordCache::insert(const Record &rec, uint64_t generation) {
+        DebugAssert(rec.exists() && rec.contentLoaded() == kEntireBody);
+        size_t size = sizeOf(rec);
+        size_t maxBytes = _maxBytes;
+        if (size > maxBytes / 4)
+            return;         // Don't let one huge record flush everything else
+        lock_guard<mutex> lock(_mutex);
+        if (generation != _generation)
+            return;
+        if (auto i = _byKey.find(rec.key()); i != _byKey.end())
+            _remove(i->second);
+        _evictToFit(maxBytes - size);
+        _lru.push_front(rec);
+        _byKey.emplace(_lru.front().key(), _lru.begin());
+        _bytes += size;
+    }
+
+
+    void RecordCache::invalidate(slice key, sequence_t sequence) {
+        if (!enabled())
+            return;
+        lock_guard<mutex> lock(_mutex);
+        ++_generation;
+        auto i = _byKey.find(key);
+        if (i != _byKey.end() && (sequence == 0 || i->second->sequence() < sequence))
+            _remove(i->second);
+    }
+
+
+    void RecordCache::invalidateAll() {
+        lock_guard<mutex> lock(_mutex);
+        ++_generation;
+        _byKey.clear();
+        _lru.clear();
+        _bytes = 0;
+    }
+
+
+    void RecordCache::recordChanged(slice key) {
+        invalidate(key);
+        if (_changedAll)
+            return;
+        if (_changedKeys.size() < kMaxChangedKeys)
+            _changedKeys.emplace_back(key);
+        else
+            allRecordsChanged();
+    }
+
+
+    void RecordCache::allRecordsChanged() {
+        if (enabled())
+            invalidateAll();
+        _changedAll = true;
+        _changedKeys.clear();
+    }
+
+
+    void RecordCache::transactionEnded(bool committed, Group *group) {
+        if (committed && group && hasChanges())
+            group->invalidateOthers(this, _changedKeys, _changedAll);
+        _changedKeys.clear();
+        _changedAll = false;
+    }
+
+
+    RecordCache::Stats RecordCache::stats() const {
+        lock_guard<mutex> lock(_mutex);
+        Stats s;
+        s.hits = _hits;
+        s.misses = _misses;
+        s.evictions = _evictions;
+        s.count = _lru.size();
+        s.bytes = _bytes;
+        s.maxBytes = _maxBytes;
+        return s;
+    }
+
+
+    void RecordCache::_remove(LRUList::iterator i) {
+        _bytes -= sizeOf(*i);
+        _byKey.erase(i->key());
+        _lru.erase(i);
+    }
+
+
+    void RecordCache::_evictToFit(size_t maxBytes) {
+        while (_bytes > maxBytes && !_lru.empty()) {
+            _remove(prev(_lru.end()));
+            ++_evictions;
+        }
+    }
+
+
+#pragma mark - GROUP:
+
+
+    void RecordCache::Group::add(RecordCache *cache) {
+        lock_guard<mutex> lock(_mutex);
+        _members.push_back(cache);
+    }
+
+
+    void RecordCache::Group::remove(RecordCache *cache) {
+        lock_guard<mutex> lock(_mutex);
+        _members.erase(std::remove(_members.begin(), _members.end(), cache), _members.end());
+    }
+
+
+    void RecordCache::Group::invalidateOthers(RecordCache *except,
+                                              const vector<alloc_slice> &keys,
+                                              bool all)
+    {
+        lock_guard<mutex> lock(_mutex);
+        for (RecordCache *cache : _members) {
+            if (cache == except || !cache->enabled())
+                continue;
+            if (all) {
+                cache->invalidateAll();
+            } else {
+                for (auto &key : keys)
+                    cache->invalidate(key);
+            }
+        }
+    }
+
+}
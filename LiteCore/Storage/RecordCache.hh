@@ -0,0 +1,134 @@
+//
+// RecordCache.hh
+//
+// Copyright (c) 2021 Couchbase, Inc All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#pragma once
+#include "Record.hh"
+#include "RefCounted.hh"
+#include <atomic>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace litecore {
+
+    /** A bounded, thread-safe LRU cache of committed Records, keyed by record key, that a
+        KeyStore consults before reading from storage. It's disabled (and empty) until given a
+        nonzero size limit.
+
+        Cached Records share their body/extra buffers with the Records handed out, so a hit
+        doesn't copy any data.
+
+        The cache has to be kept coherent by its owner. The KeyStore's write methods call
+        `recordChanged`, which invalidates the record here and remembers its key; after the
+        transaction commits, `transactionEnded` invalidates those keys in the caches of the
+        KeyStores with the same name in all other connections to the file, which are members of
+        the same `Group`. To avoid caching a record that's being changed concurrently, a reader
+        gets the `generation` before reading from storage, and `insert` ignores the record if
+        anything's been invalidated since.
+
+        Lookups don't touch the database, so changes made by other processes aren't noticed. */
+    class RecordCache {
+    public:
+        struct Stats {
+            uint64_t hits {0};          ///< Lookups that found a record
+            uint64_t misses {0};        ///< Lookups that didn't
+            uint64_t evictions {0};     ///< Records removed to stay under the size limit
+            uint64_t count {0};         ///< Number of cached records
+            uint64_t bytes {0};         ///< Approximate memory used by cached records
+            uint64_t maxBytes {0};      ///< Size limit
+        };
+
+        /** The caches of same-named KeyStores in all the connections to a database file. */
+        class Group : public RefCounted {
+        public:
+            void add(RecordCache*);
+            void remove(RecordCache*);
+            void invalidateOthers(RecordCache *except, const std::vector<alloc_slice> &keys,
+                                  bool all);
+        private:
+            std::mutex                  _mutex;
+            std::vector<RecordCache*>   _members;
+        };
+
+        RecordCache() =default;
+        ~RecordCache();
+
+        /** Makes this cache a member of a Group. Must be called before enabling the cache. */
+        void joinGroup(Group*);
+
+        /** Sets the maximum size of the cache in bytes, evicting records if necessary.
+            Zero disables the cache. */
+        void setMaxBytes(size_t maxBytes);
+
+        bool enabled() const                        {return _maxBytes.load() > 0;}
+
+        /** Looks up a record by the key already set in `rec`, and if it's cached, fills in the
+            rest of `rec` with the requested content. */
+        bool lookup(Record &rec, ContentOption);
+
+        /** The current generation, which changes whenever anything is invalidated. */
+        uint64_t generation() const                 {return _generation.load();}
+
+        /** Adds a record, which must exist and have its entire body loaded, unless the cache's
+            generation has changed since `generation`. */
+        void insert(const Record&, uint64_t generation);
+
+        /** Removes a record, unless the cached one is at least as new as `sequence`.
+            A zero sequence (as for a purge) always removes it. */
+        void invalidate(slice key, sequence_t sequence =0);
+
+        /** Removes all records. */
+        void invalidateAll();
+
+        /** Call this when a record is changed by a transaction. It's invalidated immediately,
+            and in other connections' caches when the transaction commits. */
+        void recordChanged(slice key);
+
+        /** Call this when an unknown set of records is changed by a transaction. */
+        void allRecordsChanged();
+
+        /** Call this after a transaction commits or aborts. If it committed, the records it
+            changed are invalidated in the other caches of `group`, if it's non-null. */
+        void transactionEnded(bool committed, Group *group);
+
+        /** True if records have been changed by the current transaction. */
+        bool hasChanges() const                     {return _changedAll || !_changedKeys.empty();}
+
+        Stats stats() const;
+
+    private:
+        using LRUList = std::list<Record>;
+
+        static size_t sizeOf(const Record&);
+        void _remove(LRUList::iterator);
+        void _evictToFit(size_t maxBytes);
+
+        mutable std::mutex                          _mutex;
+        LRUList                                     _lru;       // Most recently used first
+        std::unordered_map<slice, LRUList::iterator> _byKey;    // Keys point into _lru's Records
+        size_t                                      _bytes {0};
+        std::atomic<size_t>                         _maxBytes {0};
+        std::atomic<uint64_t>                       _generation {0};
+        uint64_t                                    _hits {0}, _misses {0}, _evictions {0};
+        Retained<Group>                             _group;
+        std::vector<alloc_slice>                    _changedKeys;   // Changed in this transaction
+        bool                                        _changedAll {false};
+    };
+
+}
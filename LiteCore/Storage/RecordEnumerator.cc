@@ -59,6 +59,7 @@ namespace litecore {
     void RecordEnumerator::close() noexcept {
         _record.clear();
         _impl.reset();
+        _contentPending = false;
     }
 
 
@@ -74,6 +75,7 @@ namespace litecore {
                 close();
                 return false;
             }
+            _contentPending = true;     // Body and extra aren't read until they're accessed
             LogDebug(QueryLog, "RecordEnumerator %p  --> '%.*s'", this, SPLAT(_record.key()));
             return true;
         }
@@ -64,6 +64,7 @@ namespace litecore {
         RecordEnumerator& operator=(RecordEnumerator&& e) noexcept {
             _store = e._store;
             _impl = move(e._impl);
+            _contentPending = e._contentPending;
             return *this;
         }
 
@@ -78,19 +79,27 @@ namespace litecore {
         /** True if the enumerator is at a record, false if it's at the end. */
         bool hasRecord() const FLPURE            {return _record.key().buf != nullptr;}
 
-        /** The current record. */
-        const Record& record() const FLPURE      {return _record;}
+        /** The current record, including the content specified by the ContentOption. */
+        const Record& record() const             {loadContent(); return _record;}
+
+        /** The current record's key and metadata, without its body or extra. This avoids
+            copying the content, if the caller doesn't need it. (`bodySize` and `extraSize` are
+            still valid.) */
+        const Record& recordMetadata() const FLPURE {return _record;}
 
         // Can treat an enumerator as a record pointer:
-        operator const Record*() const FLPURE    {return hasRecord() ? &_record : nullptr;}
-        const Record* operator->() const FLPURE  {return hasRecord() ? &_record : nullptr;}
+        operator const Record*() const           {return hasRecord() ? &record() : nullptr;}
+        const Record* operator->() const         {return hasRecord() ? &record() : nullptr;}
 
         /** Internal implementation of enumerator; each storage type must subclass it. */
         class Impl {
         public:
             virtual ~Impl()                         { }
             virtual bool next() =0;
+            /** Reads the current record's key and metadata, including body and extra sizes. */
             virtual bool read(Record&) =0;
+            /** Reads the current record's body and/or extra, according to the ContentOption. */
+            virtual void readContent(Record&) =0;
         };
 
     private:
@@ -99,9 +108,17 @@ namespace litecore {
         RecordEnumerator(const RecordEnumerator&) = delete;               // no copying allowed
         RecordEnumerator& operator=(const RecordEnumerator&) = delete;    // no assignment allowed
 
+        void loadContent() const {
+            if (_contentPending) {
+                _contentPending = false;
+                _impl->readContent(_record);
+            }
+        }
+
         KeyStore *       _store;            // The KeyStore I'm enumerating
-        Record           _record;           // Current record
+        mutable Record   _record;           // Current record
         unique_ptr<Impl> _impl;             // The storage-specific implementation
+        mutable bool     _contentPending {false}; // True if _record's content hasn't been read
     };
 
 }
@@ -111,6 +111,17 @@ namespace litecore {
         LogTo(SQL, "... %s", st.getQuery().c_str());
     }
 
+    sqlite3_stmt* StatementHandle(SQLite::Database &db, const SQLite::Statement &st) {
+        const string &sql = st.getQuery();
+        sqlite3 *sqlite = db.getHandle();
+        for (auto stmt = sqlite3_next_stmt(sqlite, nullptr); stmt;
+                  stmt = sqlite3_next_stmt(sqlite, stmt)) {
+            if (sql == sqlite3_sql(stmt))
+                return stmt;
+        }
+        return nullptr;
+    }
+
     static void sqlite3_log_callback(void *pArg, int errCode, const char *msg) {
         if (errCode == SQLITE_NOTICE_RECOVER_WAL)
             return;     // harmless "recovered __ frames from WAL file" message
@@ -263,6 +274,8 @@ namespace litecore {
                 }
                 _schemaVersion = SchemaVersion::WithNewDocs;
             }
+
+            checkIndexLanguageColumn();
         });
 
         _exec(format("PRAGMA cache_size=%d; "            // Memory cache
@@ -505,6 +518,25 @@ namespace litecore {
         });
 
         exec(commit ? "COMMIT" : "ROLLBACK");
+
+        // Now that the changes are visible to other connections, invalidate their cached copies:
+        forOpenKeyStores([commit](KeyStore &ks) {
+            ks.recordCacheTransactionEnded(commit);
+        });
+    }
+
+
+    void SQLiteDataFile::setProgressHandler(ProgressHandler handler) {
+        static constexpr int kProgressInterval = 1000;     // # of SQLite VM ops between calls
+        checkOpen();
+        _progressHandler = move(handler);
+        if (_progressHandler) {
+            sqlite3_progress_handler(_sqlDb->getHandle(), kProgressInterval, [](void *context) {
+                return ((SQLiteDataFile*)context)->_progressHandler() ? 1 : 0;
+            }, this);
+        } else {
+            sqlite3_progress_handler(_sqlDb->getHandle(), 0, nullptr, nullptr);
+        }
     }
 
 
@@ -586,6 +618,16 @@ namespace litecore {
     }
 
 
+    // Unlike PRAGMA table_info, table_xinfo includes generated columns (requires SQLite 3.26+)
+    bool SQLiteDataFile::columnExists(const string &tableName, const string &columnName) const {
+        SQLite::Statement check(*_sqlDb, "SELECT 1 FROM pragma_table_xinfo(?) WHERE name = ?");
+        check.bind(1, tableName);
+        check.bind(2, columnName);
+        LogStatement(check);
+        return check.executeStep();
+    }
+
+
     // Returns true if an index/table exists in the database with the given type and SQL schema OR
     // Returns true if the given sql is empty and the schema doesn't exist.
     bool SQLiteDataFile::schemaExistsWithSQL(const string &name, const string &type,
@@ -21,6 +21,7 @@
 #include "DataFile.hh"
 #include "IndexSpec.hh"
 #include "UnicodeCollator.hh"
+#include <functional>
 #include <optional>
 #include <vector>
 
@@ -61,6 +62,7 @@ namespace litecore {
         std::vector<std::string> allKeyStoreNames() /*override*/;
         bool keyStoreExists(const std::string &name);
         bool tableExists(const std::string &name) const;
+        bool columnExists(const std::string &tableName, const std::string &columnName) const;
         bool getSchema(const std::string &name, const std::string &type,
                        const std::string &tableName, std::string &outSQL) const;
         bool schemaExistsWithSQL(const std::string &name, const std::string &type,
@@ -68,6 +70,13 @@ namespace litecore {
 
         fleece::alloc_slice rawQuery(const std::string &query) override;
 
+        using ProgressHandler = std::function<bool()>;
+
+        /** Sets a function that SQLite calls periodically while a statement runs. If it returns
+            true, the statement is interrupted and fails with SQLITE_INTERRUPT.
+            Pass nullptr to remove the handler. */
+        void setProgressHandler(ProgressHandler);
+
         class Factory : public DataFile::Factory {
         public:
             Factory();
@@ -130,13 +139,16 @@ namespace litecore {
         enum class SchemaVersion {
             None            = 0,    // Newly created database
             MinReadable     = 201,  // Cannot open earlier versions than this (CBL 2.0)
-            MaxReadable     = 499,  // Cannot open versions newer than this
+            MaxReadable     = 599,  // Cannot open versions newer than this
 
             WithIndexTable  = 301,  // Added 'indexes' table (CBL 2.5)
             WithPurgeCount  = 302,  // Added 'purgeCnt' column to KeyStores (CBL 2.7)
 
             WithNewDocs     = 400,  // New document/revision storage (CBL 3.0)
 
+            WithMaterializedIndexes = 500, // Added 'materialized' table; KeyStore tables may
+                                           // have indexes on new LiteCore functions
+
             Current = WithNewDocs
         };
 
@@ -148,11 +160,15 @@ namespace litecore {
 
         bool indexTableExists();
         void ensureIndexTableExists();
+        void checkIndexLanguageColumn();
+        void ensureMaterializedTableExists();
+        std::string selectIndexesSQL() const;
         void registerIndex(const litecore::IndexSpec&,
                            const std::string &keyStoreName,
                            const std::string &indexTableName);
         void unregisterIndex(slice indexName);
         void garbageCollectIndexTable(const std::string &tableName);
+        void dropIndexTableTriggers(const std::string &tableName);
         SQLiteIndexSpec specFromStatement(SQLite::Statement &stmt);
         std::vector<SQLiteIndexSpec> getIndexesOldStyle(const KeyStore *store =nullptr);
 
@@ -161,6 +177,8 @@ namespace litecore {
         unique_ptr<SQLite::Statement>   _getPurgeCntStmt, _setPurgeCntStmt;
         CollationContextVector          _collationContexts;
         SchemaVersion                   _schemaVersion {SchemaVersion::None};
+        bool                            _indexLanguageColumn {false}; // 'indexes' has 'language'?
+        ProgressHandler                 _progressHandler;
     };
 
 
@@ -169,8 +187,9 @@ namespace litecore {
                         IndexSpec::Type type,
                         alloc_slice expressionJSON,
                         const std::string &ksName,
-                        const std::string &itName)
-        :IndexSpec(name, type, expressionJSON)
+                        const std::string &itName,
+                        QueryLanguage queryLanguage =QueryLanguage::kJSON)
+        :IndexSpec(name, type, expressionJSON, queryLanguage)
         ,keyStoreName(ksName)
         ,indexTableName(itName)
         { }
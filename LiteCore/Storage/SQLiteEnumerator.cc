@@ -48,15 +48,37 @@ namespace litecore {
         }
 
         virtual bool read(Record &rec) override {
+            rec.setExists();
+            rec.setContentLoaded(kMetaOnly);
             rec.updateSequence((int64_t)_stmt->getColumn(0));
             rec.setFlags((DocumentFlags)(int)_stmt->getColumn(1));
             rec.setKey(SQLiteKeyStore::columnAsSlice(_stmt->getColumn(2)));
+            rec.setVersion(SQLiteKeyStore::columnAsSlice(_stmt->getColumn(3)));
+            rec.setUnloadedBodySize(columnSize(4, _content >= kCurrentRevOnly));
+            rec.setUnloadedExtraSize(columnSize(5, _content >= kEntireBody));
             rec.setExpiration(_stmt->getColumn(6));
-            SQLiteKeyStore::setRecordMetaAndBody(rec, *_stmt, _content);
             return true;
         }
 
+        virtual void readContent(Record &rec) override {
+            // The body and extra stay in the row until the next step, so copying them can be
+            // put off until the record is actually asked for:
+            if (_content >= kCurrentRevOnly)
+                rec.setBody(SQLiteKeyStore::columnAsSlice(_stmt->getColumn(4)));
+            if (_content >= kEntireBody)
+                rec.setExtra(SQLiteKeyStore::columnAsSlice(_stmt->getColumn(5)));
+            rec.setContentLoaded(_content);
+        }
+
     private:
+        // The size of the body or extra column, which is either the blob itself or its length.
+        size_t columnSize(int col, bool isBlob) {
+            if (isBlob)
+                return _stmt->getColumn(col).getBytes();
+            else
+                return (int64_t)_stmt->getColumn(col);
+        }
+
         unique_ptr<SQLite::Statement> _stmt;
         ContentOption _content;
     };
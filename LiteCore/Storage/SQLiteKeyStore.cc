@@ -24,6 +24,7 @@
 #include "StringUtil.hh"
 #include "SQLiteCpp/SQLiteCpp.h"
 #include "FleeceImpl.hh"
+#include <sqlite3.h>
 #include <sstream>
 
 using namespace std;
@@ -99,6 +100,7 @@ namespace litecore {
         _nextExpStmt.reset();
         _findExpStmt.reset();
         _withDocBodiesStmt.reset();
+        _recordCache.invalidateAll();
         KeyStore::close();
     }
 
@@ -227,14 +229,9 @@ namespace litecore {
         return slice(col.getBlob(), col.getBytes());
     }
 
-    static slice textColumnAsSlice(const SQLite::Column &col) {
-        return slice(col.getText(nullptr), col.getBytes());
-    }
-
 
-    // OPT: Would be nice to avoid copying key/vers/body here; this would require Record to
-    // know that the pointers are ephemeral, and create copies if they're accessed as
-    // alloc_slice (not just slice).
+    // This copies the version, body and extra into the Record. Callers that don't need to keep
+    // the data should use the callback form of `get`, which reads them in place.
 
 
     // Gets flags from col 1, version from col 3, body (or its size) from col 4,
@@ -258,24 +255,37 @@ namespace litecore {
     }
     
 
-    bool SQLiteKeyStore::read(Record &rec, ContentOption content) const {
-        SQLite::Statement *stmt;
+    // Returns the statement that reads a record by key with the given content,
+    // or nullptr if the content option is invalid.
+    SQLite::Statement* SQLiteKeyStore::getByKeyStatement(ContentOption content) const {
         switch (content) {
             case kMetaOnly:
-                stmt = &compile(_getMetaByKeyStmt,
+                return &compile(_getMetaByKeyStmt,
                         "SELECT sequence, flags, 0, version, length(body), length(extra) FROM kv_@ WHERE key=?");
-                break;
             case kCurrentRevOnly:
-                stmt = &compile(_getCurByKeyStmt,
+                return &compile(_getCurByKeyStmt,
                         "SELECT sequence, flags, 0, version, body, length(extra) FROM kv_@ WHERE key=?");
-                break;
             case kEntireBody:
-                stmt = &compile(_getByKeyStmt,
+                return &compile(_getByKeyStmt,
                         "SELECT sequence, flags, 0, version, body, extra FROM kv_@ WHERE key=?");
-                break;
             default:
-                return false;
+                return nullptr;
         }
+    }
+
+
+    bool SQLiteKeyStore::read(Record &rec, ContentOption content) const {
+        SQLite::Statement *stmt = getByKeyStatement(content);
+        if (!stmt)
+            return false;
+
+        // Only the latest committed records can be cached, so don't add any while in a
+        // transaction, even a read-only one whose snapshot may predate invalidated changes:
+        bool mayCache = _recordCache.enabled()
+                     && sqlite3_get_autocommit(((SQLite::Database&)db()).getHandle());
+        uint64_t cacheGeneration = _recordCache.generation();
+        if (_recordCache.lookup(rec, content))
+            return true;
 
         {
             lock_guard<mutex> lock(_stmtMutex);
@@ -289,6 +299,47 @@ namespace litecore {
             rec.updateSequence(seq);
             setRecordMetaAndBody(rec, *stmt, content);
         }
+        if (mayCache && content == kEntireBody)
+            _recordCache.insert(rec, cacheGeneration);
+        return true;
+    }
+
+
+    bool SQLiteKeyStore::get(slice key, ContentOption content,
+                             function_ref<void(const RecordLite&)> callback) const
+    {
+        // A cached record can be passed along just as cheaply. (But a miss doesn't add the
+        // record to the cache, since that would mean copying it.)
+        if (_recordCache.enabled()) {
+            Record cached(key);
+            if (_recordCache.lookup(cached, content)) {
+                callback(RecordLite{cached.key(), cached.version(), cached.body(), cached.extra(),
+                                    cached.sequence(), false, cached.flags()});
+                return true;
+            }
+        }
+
+        SQLite::Statement *stmt = getByKeyStatement(content);
+        if (!stmt)
+            return false;
+        lock_guard<mutex> lock(_stmtMutex);
+        stmt->bindNoCopy(1, (const char*)key.buf, (int)key.size);
+        UsingStatement u(*stmt);
+        if (!stmt->executeStep())
+            return false;
+
+        // The slices point into SQLite's row buffer, which stays valid until the statement is
+        // reset when `u` exits scope:
+        RecordLite rec;
+        rec.key = key;
+        rec.sequence = (int64_t)stmt->getColumn(0);
+        rec.flags = (DocumentFlags)(int)stmt->getColumn(1);
+        rec.version = columnAsSlice(stmt->getColumn(3));
+        if (content != kMetaOnly)
+            rec.body = columnAsSlice(stmt->getColumn(4));
+        if (content == kEntireBody)
+            rec.extra = columnAsSlice(stmt->getColumn(5));
+        callback(rec);
         return true;
     }
 
@@ -377,6 +428,7 @@ namespace litecore {
         if (db().willLog(LogLevel::Verbose) && name() != "default")
             db()._logVerbose("KeyStore(%-s) %s %.*s", name().c_str(), opName, SPLAT(rec.key));
 
+        _recordCache.recordChanged(rec.key);
         UsingStatement u(*stmt);
         if (stmt->exec() == 0)
             return 0;               // condition wasn't met
@@ -399,6 +451,7 @@ namespace litecore {
             stmt = &compile(_delByKeyStmt, "DELETE FROM kv_@ WHERE key=?");
         }
         stmt->bindNoCopy(1, (const char*)key.buf, (int)key.size);
+        _recordCache.recordChanged(key);
         UsingStatement u(*stmt);
         if(stmt->exec() == 0)
             return false;
@@ -412,6 +465,7 @@ namespace litecore {
                                          Transaction&)
     {
         compile(_setFlagStmt, "UPDATE kv_@ SET flags=(flags | ?) WHERE key=? AND sequence=?");
+        _recordCache.recordChanged(key);
         UsingStatement u(*_setFlagStmt);
         _setFlagStmt->bind      (1, (unsigned)flags);
         _setFlagStmt->bindNoCopy(2, (const char*)key.buf, (int)key.size);
@@ -422,13 +476,16 @@ namespace litecore {
 
     void SQLiteKeyStore::erase() {
         Transaction t(db());
+        _recordCache.allRecordsChanged();
         db().exec(string("DELETE FROM kv_"+name()));
         setLastSequence(0);
         t.commit();
     }
 
 
-    void SQLiteKeyStore::createTrigger(string_view triggerName,
+    // Creates a trigger, replacing any existing one of the same name whose SQL differs.
+    // Returns false if an identical trigger already exists.
+    bool SQLiteKeyStore::createTrigger(string_view triggerName,
                                        string_view triggerSuffix,
                                        string_view operation,
                                        string when,
@@ -436,11 +493,31 @@ namespace litecore {
     {
         if (hasPrefix(when, "WHERE"))
             when.replace(0, 5, "WHEN");
-        string sql = CONCAT("CREATE TRIGGER \"" << triggerName << "::" << triggerSuffix  << "\" "
+        string fullName = CONCAT(triggerName << "::" << triggerSuffix);
+        string sql = CONCAT("CREATE TRIGGER \"" << fullName << "\" "
                             << operation << " ON kv_" << name() << ' ' << when << ' '
                             << " BEGIN " << statements << "; END");
+        if (db().schemaExistsWithSQL(fullName, "trigger", tableName(), sql))
+            return false;
         LogTo(QueryLog, "    ...for index: %s", sql.c_str());
+        db().exec(CONCAT("DROP TRIGGER IF EXISTS \"" << fullName << "\""));
         db().exec(sql);
+        return true;
+    }
+
+
+    // Drops the 'preupdate' and 'postupdate' triggers that FTS and array index tables had before
+    // they got a single conditional 'upd' trigger. Returns true if there were any.
+    bool SQLiteKeyStore::dropObsoleteTriggers(const string &indexTableName) {
+        bool dropped = false;
+        for (const char *suffix : {"preupdate", "postupdate"}) {
+            string fullName = CONCAT(indexTableName << "::" << suffix);
+            if (!db().schemaExistsWithSQL(fullName, "trigger", tableName(), "")) {
+                db().exec(CONCAT("DROP TRIGGER \"" << fullName << "\""));
+                dropped = true;
+            }
+        }
+        return dropped;
     }
 
 
@@ -455,8 +532,7 @@ namespace litecore {
 
         // Construct SQL query with a big "IN (...)" clause for all the docIDs:
         stringstream sql;
-        sql << "SELECT key, fl_callback(key, version, body, extra, sequence, ?) FROM kv_" << name()
-            << " WHERE key IN ('";
+        sql << "SELECT key, version, body, extra, sequence FROM kv_" << name() << " WHERE key IN ('";
         unsigned n = 0;
         for (slice docID : docIDs) {
             docIndices.insert({docID, n});
@@ -474,20 +550,18 @@ namespace litecore {
 
         SQLite::Statement stmt(db(), sql.str());
         LogStatement(stmt);
-        stmt.bindPointer(1, &callback, kWithDocBodiesCallbackPointerType);
 
-        // Run the statement and put the results into an array in the same order as docIDs:
-        alloc_slice empty(size_t(0));
+        // Run the statement and put the results into an array in the same order as docIDs.
+        // The callback is given the row's data in place, without copying it:
         vector<alloc_slice> results(docIDs.size());
         while (stmt.executeStep()) {
-            slice docID = columnAsSlice(stmt.getColumn(0));
-            slice value = textColumnAsSlice(stmt.getColumn(1));
-            size_t i = docIndices[docID];
-            //Log("    -- %zu: %.*s --> '%.*s'", i, SPLAT(docID), SPLAT(revs));
-            if (value.size == 0 && value.buf != 0)
-                results[i] = empty;     // reuse one empty slice instead of creating one per row
-            else
-                results[i] = alloc_slice(value);
+            RecordLite rec;
+            rec.key = columnAsSlice(stmt.getColumn(0));
+            rec.version = columnAsSlice(stmt.getColumn(1));
+            rec.body = columnAsSlice(stmt.getColumn(2));
+            rec.extra = columnAsSlice(stmt.getColumn(3));
+            rec.sequence = (int64_t)stmt.getColumn(4);
+            results[docIndices[rec.key]] = callback(rec);
         }
         return results;
     }
@@ -583,6 +657,7 @@ namespace litecore {
             }
         }
         if (!none) {
+            _recordCache.allRecordsChanged();
             expired = db().exec(format("DELETE FROM kv_%s WHERE expiration <= %" PRId64,
                                        name().c_str(), t));
         }
@@ -22,6 +22,7 @@
 #include <atomic>
 #include <mutex>
 #include <optional>
+#include <set>
 #include <string_view>
 #include <vector>
 
@@ -38,6 +39,7 @@ namespace SQLite {
 namespace litecore {   
 
     class SQLiteDataFile;
+    struct SQLiteIndexSpec;
     
 
     /** SQLite implementation of KeyStore; corresponds to a SQL table. */
@@ -51,6 +53,8 @@ namespace litecore {
 
         Record get(sequence_t, ContentOption) const override;
         bool read(Record &rec, ContentOption) const override;
+        bool get(slice key, ContentOption,
+                 function_ref<void(const RecordLite&)>) const override;
 
         sequence_t set(const RecordLite&, Transaction&) override;
 
@@ -70,6 +74,14 @@ namespace litecore {
 
         void deleteIndex(slice name) override;
         std::vector<IndexSpec> getIndexes() const override;
+        unsigned updateDeferredIndexes(unsigned maxDocs) override;
+
+        /** The number of documents waiting to be indexed in the given index tables. */
+        uint64_t unindexedDocCount(const std::vector<std::string> &indexTables) const;
+
+        /** Indexes all the documents waiting in the given deferred index tables.
+            Must be called within a Transaction. */
+        void updateDeferredIndexes(const std::vector<std::string> &indexTables);
 
         virtual std::vector<alloc_slice> withDocBodies(const std::vector<slice> &docIDs,
                                                        WithDocBodyCallback callback) override;
@@ -86,6 +98,11 @@ namespace litecore {
         virtual std::string predictiveTableName(const std::string &property) const override;
 #endif
         virtual bool tableExists(const std::string &tableName) const override;
+        virtual bool isMaterialized(const std::string &property) const override;
+
+        /** Reloads the set of materialized properties if the database schema has changed.
+            Call this before parsing a query. */
+        void checkMaterializedProperties() const;
 
 
     protected:
@@ -103,6 +120,7 @@ namespace litecore {
         void close() override;
         void reopen() override;
 
+        SQLite::Statement* getByKeyStatement(ContentOption) const;
         static slice columnAsSlice(const SQLite::Column &col);
         static void setRecordMetaAndBody(Record &rec,
                                          SQLite::Statement &stmt,
@@ -120,19 +138,39 @@ namespace litecore {
         std::string subst(const char *sqlTemplate) const;
         void setLastSequence(sequence_t seq);
         void incrementPurgeCount();
-        void createTrigger(std::string_view triggerName,
+        bool createTrigger(std::string_view triggerName,
                            std::string_view triggerSuffix,
                            std::string_view operation,
                            std::string when,
                            std::string_view statements);
+        bool dropObsoleteTriggers(const std::string &indexTableName);
         bool createValueIndex(const IndexSpec&);
+        std::set<std::string> materializableProperties(const IndexSpec&) const;
+        bool registerMaterializedProperties(const IndexSpec&,
+                                            const std::set<std::string> &properties);
+        bool unregisterMaterializedProperties(const std::string &indexName,
+                                              const std::set<std::string> &keepProperties = {});
+        void rebuildValueIndexes(const std::string &exceptIndex);
+        void loadMaterializedProperties() const;
         bool createIndex(const IndexSpec&,
                               const std::string &sourceTableName,
                               fleece::impl::ArrayIterator &expressions);
         void _createFlagsIndex(const char *indexName NONNULL, DocumentFlags flag, bool &created);
         bool createFTSIndex(const IndexSpec&);
+        void updateFTSTable(const IndexSpec&, const std::string &ftsTableName,
+                            const std::string &docIDsSQL);
         bool createArrayIndex(const IndexSpec&);
-        std::string createUnnestedTable(const fleece::impl::Value *arrayPath, const IndexSpec::Options*);
+        std::string createUnnestedTable(const fleece::impl::Value *arrayPath,
+                                        const IndexSpec::Options*,
+                                        bool &outChanged);
+        void updateUnnestedTable(const std::string &unnestTableName,
+                                 const fleece::impl::Value *arrayPath,
+                                 const std::string &docIDsSQL);
+        static std::string pendingTableName(const std::string &indexTableName);
+        bool isDeferredIndexTable(const std::string &indexTableName) const;
+        bool createDeferredIndexTriggers(const std::string &indexTableName,
+                                         const std::string &unchangedSQL);
+        unsigned updateDeferredIndex(const SQLiteIndexSpec&, unsigned maxDocs);
         void addExpiration();
 
 #ifdef COUCHBASE_ENTERPRISE
@@ -160,6 +198,8 @@ namespace litecore {
         mutable std::atomic<uint64_t> _purgeCount {0};
         bool _hasExpirationColumn {false};
         bool _uncommittedExpirationColumn {false};
+        mutable std::set<std::string> _materializedProperties;  // Properties with columns
+        mutable int _materializedSchemaVersion {-1};  // `schema_version` they were loaded at
         mutable std::mutex _stmtMutex;
         Existence _existence;
     };
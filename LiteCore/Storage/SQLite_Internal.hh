@@ -22,6 +22,7 @@
 #include <memory>
 
 struct sqlite3;
+struct sqlite3_stmt;
 
 namespace SQLite {
     class Database;
@@ -39,8 +40,10 @@ namespace litecore {
 
     void LogStatement(const SQLite::Statement &st);
 
-
-    constexpr const char* kWithDocBodiesCallbackPointerType = "WithDocBodiesCallback";
+    // Returns the sqlite3_stmt of a Statement, for SQLite APIs that SQLiteCpp doesn't wrap,
+    // like sqlite3_stmt_status(). It's found by its SQL among the connection's statements,
+    // newest first, so call this right after compiling the Statement.
+    sqlite3_stmt* StatementHandle(SQLite::Database&, const SQLite::Statement&);
 
 
     // Little helper class that makes sure Statement objects get reset on exit
@@ -72,4 +75,10 @@ namespace litecore {
 
 
     void RegisterSQLiteFunctions(sqlite3 *db, fleeceFuncContext);
+
+    // Number of calls to Fleece functions that read a document body or Fleece value
+    // (`fl_value`, `fl_nested_value`, `fl_fts_value`, etc.) made on the current thread while
+    // `tCountFleeceValueCalls` was true (for profiling.)
+    extern thread_local bool tCountFleeceValueCalls;
+    extern thread_local uint64_t tFleeceValueCallCount;
 }
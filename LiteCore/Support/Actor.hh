@@ -38,10 +38,17 @@
 #include "Async.hh"
 #endif
 
+// Coroutines (ActorTask.hh) need C++20; build with LITECORE_CXX20 to enable them.
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+#define ACTORS_SUPPORT_COROUTINES
+#include <coroutine>
+#endif
+
 
 namespace litecore { namespace actor {
     class Actor;
     class AsyncContext;
+    class ActorTaskPromiseBase;
 
 
     //// Some support code for asynchronize(), from http://stackoverflow.com/questions/42124866
@@ -63,9 +70,14 @@ namespace litecore { namespace actor {
     #define ACTOR_BIND_FN(FN, ARGS)                 ^{ FN(ARGS...); }
 #else
     using Mailbox = ThreadedMailbox;
-    #define ACTOR_BIND_METHOD0(RCVR, METHOD)        std::bind(METHOD, RCVR)
-    #define ACTOR_BIND_METHOD(RCVR, METHOD, ARGS)   std::bind(METHOD, RCVR, ARGS...)
-    #define ACTOR_BIND_FN(FN, ARGS)                 std::bind(FN, ARGS...)
+    // These lambdas are small enough to be stored inline in an ActorMessage, without
+    // allocating. Each argument is passed to the method the way its parameter expects,
+    // moving it if it's passed by value, since the message is called only once.
+    #define ACTOR_BIND_METHOD0(RCVR, METHOD)        [rcvr = (RCVR), method = (METHOD)]() {(rcvr->*method)();}
+    #define ACTOR_BIND_METHOD(RCVR, METHOD, ARGS)   [rcvr = (RCVR), method = (METHOD), ARGS...]() mutable \
+                                                        {(rcvr->*method)(std::forward<Args>(ARGS)...);}
+    #define ACTOR_BIND_FN(FN, ARGS)                 [fn = (FN), ARGS...]() mutable \
+                                                        {fn(std::forward<Args>(ARGS)...);}
 #endif
 
     #define FUNCTION_TO_QUEUE(METHOD) #METHOD, &METHOD
@@ -89,6 +101,9 @@ namespace litecore { namespace actor {
 
         std::string actorName() const                       {return _mailbox.name();}
 
+        /** The name of the Actor's class, without namespaces. Metrics are grouped by this. */
+        std::string actorClassName() const                  {return Logging::loggingClassName();}
+
         /** The Actor that's currently running, else nullptr */
         static Actor* currentActor()                        {return Mailbox::currentActor();}
 
@@ -102,15 +117,23 @@ namespace litecore { namespace actor {
             @param domain The domain which this actor is logged to.
             @param name  Used for logging, and on Apple platforms for naming the GCD queue;
                         otherwise unimportant.
-            @param parentMailbox  Used for limiting concurrency on some platforms: if non-null,
-                        then only one Actor with the same parentMailbox can execute at once.
-                        This helps control the number of threads created by the OS. This is only
-                        implemented on Apple platforms, where it determines the target queue. */
+            @param parentMailbox  Used for limiting concurrency: if non-null, the number of
+                        Actors with the same parentMailbox that can execute at once is limited.
+                        On Apple platforms it determines the target queue, so only one can run
+                        at once; elsewhere the limit is set by the parent's
+                        `setMaxChildConcurrency`. The Actor also inherits the parent's priority. */
         Actor(LogDomain& domain, const std::string &name ="", Mailbox *parentMailbox =nullptr)
         :Logging(domain)
         ,_mailbox(this, name, parentMailbox)
         { }
 
+        /** The Actor's Mailbox. */
+        const Mailbox& mailbox() const                      {return _mailbox;}
+
+        /** Sets the scheduling priority of this Actor's messages. Call this from the
+            constructor. */
+        void setPriority(ActorPriority p)                   {_mailbox.setPriority(p);}
+
         /** Schedules a call to a method. */
         template <class Rcvr, class... Args>
         void enqueue(const char* methodName, void (Rcvr::*fn)(Args...), Args... args) {
@@ -169,12 +192,24 @@ namespace litecore { namespace actor {
         friend class ThreadedMailbox;
         friend class GCDMailbox;
         friend class AsyncContext;
+        friend class ActorTaskPromiseBase;
 
         template <class ACTOR, class ITEM> friend class ActorBatcher;
         template <class ACTOR>             friend class ActorCountBatcher;
 
         void _waitTillCaughtUp(std::mutex*, std::condition_variable*, bool*);
 
+#ifdef ACTORS_SUPPORT_COROUTINES
+        // Schedules a suspended coroutine to resume on my Mailbox. (Used by ActorTask.)
+        void resumeCoroutine(std::coroutine_handle<> h) {
+#ifdef ACTORS_USE_GCD
+            _mailbox.enqueue("resumeCoroutine", ^{ h.resume(); });
+#else
+            _mailbox.enqueue("resumeCoroutine", [h] {h.resume();});
+#endif
+        }
+#endif
+
         Mailbox _mailbox;
     };
 
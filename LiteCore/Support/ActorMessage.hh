@@ -0,0 +1,138 @@
+//
+// ActorMessage.hh
+//
+// Copyright (c) 2021 Couchbase, Inc All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace litecore { namespace actor {
+
+    /** A queued call to an Actor method: a move-only, type-erased `void()` callable.
+        Unlike `std::function`, a callable of up to `kInlineSize` bytes (enough for a receiver,
+        a method pointer and a few arguments) is stored inline, so creating, queueing and
+        running a typical message doesn't allocate any memory. Larger callables are moved to
+        the heap. */
+    class ActorMessage {
+    public:
+        static constexpr size_t kInlineSize = 8 * sizeof(void*);
+
+        ActorMessage() noexcept =default;
+
+        template <class F,
+                  class = std::enable_if_t<!std::is_same<std::decay_t<F>, ActorMessage>::value>>
+        ActorMessage(F &&f) {
+            using Fn = std::decay_t<F>;
+            if constexpr (fitsInline<Fn>()) {
+                ::new (_storage) Fn(std::forward<F>(f));
+                _ops = &kInlineOps<Fn>;
+            } else {
+                *reinterpret_cast<Fn**>(_storage) = new Fn(std::forward<F>(f));
+                _ops = &kHeapOps<Fn>;
+                sHeapAllocations.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+
+        ActorMessage(ActorMessage &&other) noexcept {
+            moveFrom(other);
+        }
+
+        ActorMessage& operator= (ActorMessage &&other) noexcept {
+            if (&other != this) {
+                reset();
+                moveFrom(other);
+            }
+            return *this;
+        }
+
+        ActorMessage(const ActorMessage&) =delete;
+        ActorMessage& operator= (const ActorMessage&) =delete;
+
+        ~ActorMessage()                                 {reset();}
+
+        explicit operator bool() const noexcept         {return _ops != nullptr;}
+
+        /** True if the callable is stored inline, without a heap allocation. */
+        bool isInline() const noexcept                  {return _ops && _ops->isInline;}
+
+        /** The number of callables so far that were too big to store inline. (For tests.) */
+        static uint64_t heapAllocationCount() noexcept {
+            return sHeapAllocations.load(std::memory_order_relaxed);
+        }
+
+        /** Calls the callable, which must exist. */
+        void operator() () const                        {_ops->call(const_cast<void*>((const void*)_storage));}
+
+        void reset() noexcept {
+            if (_ops) {
+                _ops->destroy(_storage);
+                _ops = nullptr;
+            }
+        }
+
+    private:
+        struct Ops {
+            void (*call)(void*);
+            void (*move)(void *dst, void *src) noexcept;    // Move-constructs dst, destroys src
+            void (*destroy)(void*) noexcept;
+            bool isInline;
+        };
+
+        template <class Fn>
+        static constexpr bool fitsInline() {
+            return sizeof(Fn) <= kInlineSize
+                && alignof(Fn) <= alignof(std::max_align_t)
+                && std::is_nothrow_move_constructible<Fn>::value;
+        }
+
+        template <class Fn>
+        static constexpr Ops kInlineOps = {
+            [](void *p)                         {(*static_cast<Fn*>(p))();},
+            [](void *dst, void *src) noexcept {
+                ::new (dst) Fn(std::move(*static_cast<Fn*>(src)));
+                static_cast<Fn*>(src)->~Fn();
+            },
+            [](void *p) noexcept                {static_cast<Fn*>(p)->~Fn();},
+            true
+        };
+
+        template <class Fn>
+        static constexpr Ops kHeapOps = {
+            [](void *p)                         {(**static_cast<Fn**>(p))();},
+            [](void *dst, void *src) noexcept   {*static_cast<Fn**>(dst) = *static_cast<Fn**>(src);},
+            [](void *p) noexcept                {delete *static_cast<Fn**>(p);},
+            false
+        };
+
+        void moveFrom(ActorMessage &other) noexcept {
+            if (other._ops) {
+                other._ops->move(_storage, other._storage);
+                _ops = other._ops;
+                other._ops = nullptr;
+            }
+        }
+
+        static inline std::atomic<uint64_t> sHeapAllocations {0};
+
+        alignas(std::max_align_t) unsigned char _storage[kInlineSize];
+        const Ops* _ops {nullptr};
+    };
+
+} }
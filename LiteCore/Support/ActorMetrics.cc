@@ -0,0 +1,139 @@
+//
+// ActorMetrics.cc
+//
+// Copyright (c) 2021 Couchbase, Inc All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "ActorMetrics.hh"
+#include "ThreadedMailbox.hh"
+#include "fleece/Fleece.hh"
+#include <algorithm>
+#include <map>
+#include <mutex>
+
+using namespace std;
+using namespace fleece;
+
+namespace litecore { namespace actor {
+
+    namespace {
+        struct Registry {
+            mutex                       _mutex;
+            map<string, ActorMetrics*>  _classes;   // Sorted, so the JSON is too
+        };
+
+        // (Never freed, since Mailboxes may be destructed during process exit.)
+        Registry& registry() {
+            static Registry* sRegistry = new Registry;
+            return *sRegistry;
+        }
+    }
+
+
+    ActorMetrics* ActorMetrics::forClass(const string &className) {
+        Registry &reg = registry();
+        lock_guard<mutex> lock(reg._mutex);
+        ActorMetrics* &metrics = reg._classes[className];
+        if (!metrics)
+            metrics = new ActorMetrics(className);
+        return metrics;
+    }
+
+
+    alloc_slice ActorMetrics::allToJSON() {
+        JSONEncoder enc;
+        enc.beginDict();
+        Registry &reg = registry();
+        {
+            lock_guard<mutex> lock(reg._mutex);
+            for (auto &[name, metrics] : reg._classes) {
+                enc.writeKey(slice(name));
+                metrics->writeJSON(enc);
+            }
+        }
+        enc.endDict();
+        return enc.finish();
+    }
+
+
+    // Precondition: the registry mutex is locked.
+    void ActorMetrics::writeJSON(JSONEncoder &enc) const {
+        uint64_t queueDepth = 0;
+#ifndef ACTORS_USE_GCD
+        for (auto mailbox : _mailboxes)
+            queueDepth += mailbox->eventCount();
+#endif
+        enc.beginDict();
+        enc.writeKey("actors"_sl);
+        enc.writeUInt(_mailboxes.size());
+        enc.writeKey("queueDepth"_sl);
+        enc.writeUInt(queueDepth);
+        enc.writeKey("maxQueueDepth"_sl);
+        enc.writeUInt(_maxQueueDepth.load(memory_order_relaxed));
+        enc.writeKey("messages"_sl);
+        enc.writeUInt(_messages.load(memory_order_relaxed));
+        enc.writeKey("activations"_sl);
+        enc.writeUInt(_activations.load(memory_order_relaxed));
+        enc.writeKey("busySeconds"_sl);
+        enc.writeDouble(_busyNanos.load(memory_order_relaxed) / 1e9);
+        enc.writeKey("queueLatency"_sl);
+        enc.beginArray();
+        for (auto &bucket : _latency)
+            enc.writeUInt(bucket.load(memory_order_relaxed));
+        enc.endArray();
+        enc.endDict();
+    }
+
+
+    void ActorMetrics::addMailbox(const ThreadedMailbox *mailbox) {
+        Registry &reg = registry();
+        lock_guard<mutex> lock(reg._mutex);
+        _mailboxes.insert(mailbox);
+    }
+
+
+    void ActorMetrics::removeMailbox(const ThreadedMailbox *mailbox) {
+        Registry &reg = registry();
+        lock_guard<mutex> lock(reg._mutex);
+        _mailboxes.erase(mailbox);
+    }
+
+
+    void ActorMetrics::recordActivation(size_t queueDepth, unsigned messages,
+                                        chrono::nanoseconds busy)
+    {
+        _activations.fetch_add(1, memory_order_relaxed);
+        _messages.fetch_add(messages, memory_order_relaxed);
+        _busyNanos.fetch_add(uint64_t(busy.count()), memory_order_relaxed);
+        uint64_t maxDepth = _maxQueueDepth.load(memory_order_relaxed);
+        while (queueDepth > maxDepth
+               && !_maxQueueDepth.compare_exchange_weak(maxDepth, queueDepth,
+                                                        memory_order_relaxed))
+            ;
+    }
+
+
+    void ActorMetrics::recordLatency(chrono::nanoseconds latency) {
+        auto micros = uint64_t(max(chrono::duration_cast<chrono::microseconds>(latency).count(),
+                                   int64_t(0)));
+        unsigned bucket = 0;
+        while (micros > 0 && bucket < kLatencyBuckets - 1) {
+            micros >>= 1;
+            ++bucket;
+        }
+        _latency[bucket].fetch_add(1, memory_order_relaxed);
+    }
+
+} }
@@ -0,0 +1,85 @@
+//
+// ActorMetrics.hh
+//
+// Copyright (c) 2021 Couchbase, Inc All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#pragma once
+#include "fleece/slice.hh"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <unordered_set>
+
+namespace fleece {
+    class JSONEncoder;
+}
+
+namespace litecore { namespace actor {
+    class ThreadedMailbox;
+
+    /** Runtime statistics of all the Actors of one class, for spotting backlogged Actors in
+        production: how many exist, how deep their queues are, how many messages they've
+        handled and how long that took, and a histogram of how long messages wait in a queue.
+
+        Mailboxes keep these up to date cheaply: they record each activation (a batch of
+        messages) rather than each message, and only sample the queue latency. A JSON snapshot
+        of every class's metrics is available from `c4_getActorMetrics`. */
+    class ActorMetrics {
+    public:
+        /** The latency histogram's bucket 0 counts waits under 1µs, and bucket i counts those
+            under 2^i µs; the last bucket counts everything longer. */
+        static constexpr unsigned kLatencyBuckets = 24;
+
+        /** One in this many messages has its queue latency measured. */
+        static constexpr unsigned kLatencySampleInterval = 16;
+
+        /** Returns the metrics of an Actor class, creating them the first time.
+            They're never freed, so the pointer remains valid. */
+        static ActorMetrics* forClass(const std::string &className);
+
+        /** Returns a JSON object with a key for each Actor class, whose value is an object
+            containing its metrics. */
+        static fleece::alloc_slice allToJSON();
+
+        const std::string& className() const                {return _className;}
+
+        void addMailbox(const ThreadedMailbox*);
+        void removeMailbox(const ThreadedMailbox*);
+
+        /** Records that a Mailbox, whose queue was `queueDepth` long when it was activated,
+            handled `messages` messages in `busy` time. */
+        void recordActivation(size_t queueDepth, unsigned messages, std::chrono::nanoseconds busy);
+
+        /** Records the time a (sampled) message waited in a queue. */
+        void recordLatency(std::chrono::nanoseconds);
+
+    private:
+        explicit ActorMetrics(const std::string &className)     :_className(className) { }
+        void writeJSON(fleece::JSONEncoder&) const;
+
+        using counter = std::atomic<uint64_t>;
+
+        std::string const                   _className;
+        std::unordered_set<const ThreadedMailbox*> _mailboxes;  // Live ones; guarded by registry mutex
+        counter                             _maxQueueDepth {0};
+        counter                             _messages {0};
+        counter                             _activations {0};
+        counter                             _busyNanos {0};
+        counter                             _latency[kLatencyBuckets] {};
+    };
+
+} }
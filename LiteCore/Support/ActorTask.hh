@@ -0,0 +1,269 @@
+//
+// ActorTask.hh
+//
+// Copyright (c) 2021 Couchbase, Inc All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#pragma once
+#include "Actor.hh"
+#include "Error.hh"
+
+#ifdef ACTORS_SUPPORT_COROUTINES
+#include <atomic>
+#include <exception>
+#include <optional>
+#include <type_traits>
+#include <utility>
+
+namespace litecore { namespace actor {
+
+    /*
+     ActorTask<T> is the return type of a C++20 coroutine that runs on an Actor's Mailbox,
+     so a chain of asynchronous calls can be written as straight-line code, with ordinary
+     local variables, instead of as callbacks or BEGIN_ASYNC macros:
+
+        class Fetcher : public Actor {
+        public:
+            ActorTask<alloc_slice> fetch(std::string url) {
+                Response r = co_await _http->get(url);
+                co_return r.body;
+            }
+        };
+
+        ActorTask<void> Puller::handleRev(std::string url) {
+            alloc_slice body = co_await _fetcher->fetch(url);
+            // ...now back on the Puller's Mailbox...
+        }
+
+     - A coroutine that's a method of an Actor runs on that Actor: if it's called from any
+       other thread it starts by scheduling itself on the Actor's Mailbox, and whenever it
+       resumes after a `co_await` it's back on the Mailbox. Other messages to the Actor can run
+       while it's suspended, just as with callbacks.
+     - Any other coroutine belongs to the Actor it was called from, if any.
+     - `co_await`ing an ActorTask suspends until it finishes, then returns its result or
+       rethrows its exception. A task can be awaited by only one coroutine.
+     - The ActorTask doesn't need to be kept; the coroutine runs to completion regardless.
+
+     Resuming a coroutine is just a Mailbox message, or a direct jump if it's already on the
+     right Actor, and the only allocation per call is the coroutine frame.
+     */
+
+
+    /** Implementation of ActorTask's promise types. */
+    class ActorTaskPromiseBase {
+    public:
+        // Moves the new coroutine onto its Actor before its body runs.
+        struct InitialAwaiter {
+            ActorTaskPromiseBase &promise;
+            bool await_ready() const noexcept   {return promise.isOnActor(promise._actor);}
+            void await_suspend(std::coroutine_handle<> h) const {promise._actor->resumeCoroutine(h);}
+            void await_resume() const noexcept  { }
+        };
+
+        // Hands control to the awaiting coroutine, if any, when the coroutine finishes.
+        struct FinalAwaiter {
+            bool await_ready() const noexcept   {return false;}
+            template <class P>
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<P> h) noexcept {
+                return h.promise().finish(h);
+            }
+            void await_resume() const noexcept  { }
+        };
+
+        InitialAwaiter initial_suspend() noexcept       {return {*this};}
+        FinalAwaiter final_suspend() noexcept           {return {};}
+        void unhandled_exception() noexcept             {_exception = std::current_exception();}
+
+        Actor* actor() const                            {return _actor;}
+
+        bool finished() const noexcept {
+            return _awaiter.load(std::memory_order_acquire) == kFinished;
+        }
+
+        /** Registers a coroutine to be resumed on `actor` (if non-null) when I finish.
+            Returns false, without registering, if I've already finished. */
+        bool setAwaiter(std::coroutine_handle<> awaiter, Actor *actor) noexcept {
+            _awaiterActor = actor;
+            void *expected = nullptr;
+            if (_awaiter.compare_exchange_strong(expected, awaiter.address(),
+                                                 std::memory_order_acq_rel))
+                return true;
+            DebugAssert(expected == kFinished, "Only one coroutine can await a task");
+            return false;
+        }
+
+        /** Releases a reference to the coroutine frame, destroying it after the last one.
+            The ActorTask has one, and the coroutine has one till it finishes. */
+        void release(std::coroutine_handle<> h) noexcept {
+            if (_refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+                h.destroy();
+        }
+
+    protected:
+        template <class... Args>
+        explicit ActorTaskPromiseBase(Args&... args)
+        :_actor(owningActor(args...))
+        { }
+
+        ~ActorTaskPromiseBase() {
+            if (_exception && !_exceptionTaken) {
+                try {
+                    std::rethrow_exception(_exception);
+                } catch (const std::exception &x) {
+                    WarnError("ActorTask threw an exception nobody awaited: %s", x.what());
+                } catch (...) {
+                    WarnError("ActorTask threw an exception nobody awaited");
+                }
+            }
+        }
+
+        void rethrowIfFailed() {
+            if (_exception) {
+                _exceptionTaken = true;
+                std::rethrow_exception(_exception);
+            }
+        }
+
+    private:
+        static inline char sFinished;                   // Its address is the kFinished marker
+        static constexpr void* kFinished = &sFinished;
+
+        // A method coroutine's first parameter is its receiver; if that's an Actor, the
+        // coroutine runs on it. Otherwise it runs on the calling Actor.
+        template <class First, class... Rest>
+        static Actor* owningActor(First &first, Rest&...) {
+            if constexpr (std::is_base_of_v<Actor, First>)
+                return const_cast<std::remove_const_t<First>*>(&first);
+            else
+                return Actor::currentActor();
+        }
+        static Actor* owningActor()                     {return Actor::currentActor();}
+
+        static bool isOnActor(Actor *actor)             {return !actor || actor == Actor::currentActor();}
+
+        // Called when the coroutine finishes; returns the coroutine to transfer control to.
+        std::coroutine_handle<> finish(std::coroutine_handle<> self) noexcept {
+            std::coroutine_handle<> next = std::noop_coroutine();
+            void *awaiter = _awaiter.exchange(kFinished, std::memory_order_acq_rel);
+            if (awaiter) {
+                auto h = std::coroutine_handle<>::from_address(awaiter);
+                if (isOnActor(_awaiterActor))
+                    next = h;
+                else
+                    _awaiterActor->resumeCoroutine(h);
+            }
+            release(self);      // Don't touch `this` after this!
+            return next;
+        }
+
+        Retained<Actor>         _actor;                 // Actor the coroutine runs on
+        std::atomic<void*>      _awaiter {nullptr};     // Awaiting coroutine, or kFinished
+        Actor*                  _awaiterActor {nullptr};// Actor to resume the awaiter on
+        std::atomic<int>        _refs {2};
+        std::exception_ptr      _exception;
+        bool                    _exceptionTaken {false};
+    };
+
+
+    template <class T>
+    class ActorTaskPromise : public ActorTaskPromiseBase {
+    public:
+        template <class... Args>
+        explicit ActorTaskPromise(Args&... args)        :ActorTaskPromiseBase(args...) { }
+
+        template <class U>
+        void return_value(U &&value)                    {_result.emplace(std::forward<U>(value));}
+
+        T takeResult() {
+            rethrowIfFailed();
+            return std::move(*_result);
+        }
+
+    private:
+        std::optional<T> _result;
+    };
+
+
+    template <>
+    class ActorTaskPromise<void> : public ActorTaskPromiseBase {
+    public:
+        template <class... Args>
+        explicit ActorTaskPromise(Args&... args)        :ActorTaskPromiseBase(args...) { }
+
+        void return_void()                              { }
+        void takeResult()                               {rethrowIfFailed();}
+    };
+
+
+    /** The result of a coroutine running on an Actor; see the description above. */
+    template <class T>
+    class ActorTask {
+    public:
+        class promise_type : public ActorTaskPromise<T> {
+        public:
+            template <class... Args>
+            explicit promise_type(Args&... args)        :ActorTaskPromise<T>(args...) { }
+
+            ActorTask get_return_object() {
+                return ActorTask(std::coroutine_handle<promise_type>::from_promise(*this));
+            }
+        };
+
+        ActorTask(ActorTask &&other) noexcept           :_handle(std::exchange(other._handle, {})) { }
+
+        ActorTask& operator= (ActorTask &&other) noexcept {
+            if (&other != this) {
+                reset();
+                _handle = std::exchange(other._handle, {});
+            }
+            return *this;
+        }
+
+        ~ActorTask()                                    {reset();}
+
+        /** True once the coroutine has finished. */
+        bool ready() const                              {return _handle.promise().finished();}
+
+        // Awaiter interface, so a coroutine can `co_await` an ActorTask:
+
+        bool await_ready() const noexcept               {return ready();}
+
+        template <class P>
+        bool await_suspend(std::coroutine_handle<P> awaiter) noexcept {
+            Actor *actor;
+            if constexpr (std::is_base_of_v<ActorTaskPromiseBase, P>)
+                actor = awaiter.promise().actor();
+            else
+                actor = Actor::currentActor();
+            return _handle.promise().setAwaiter(awaiter, actor);
+        }
+
+        T await_resume()                                {return _handle.promise().takeResult();}
+
+    private:
+        explicit ActorTask(std::coroutine_handle<promise_type> h)  :_handle(h) { }
+
+        void reset() {
+            if (_handle)
+                _handle.promise().release(_handle);
+            _handle = nullptr;
+        }
+
+        std::coroutine_handle<promise_type> _handle;
+    };
+
+} }
+
+#endif // ACTORS_SUPPORT_COROUTINES
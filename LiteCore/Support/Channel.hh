@@ -45,7 +45,7 @@ namespace litecore { namespace actor {
 
         /** Pushes a new value to the front of the queue.
             @return  True if the queue was empty before the push. */
-        bool push(const T &t);
+        bool push(T t);
 
         /** Pops the next value from the end of the queue.
             If the queue is empty, blocks until another thread adds something to the queue.
@@ -90,11 +90,11 @@ namespace litecore { namespace actor {
 
 
     template <class T>
-    bool Channel<T>::push(const T &t) {
+    bool Channel<T>::push(T t) {
         std::unique_lock<std::mutex> lock(_mutex);
         bool wasEmpty = _queue.empty();
         if (!_closed) {
-            _queue.push(t);
+            _queue.push(std::move(t));
         }
         lock.unlock();
 
@@ -194,6 +194,7 @@ namespace litecore {
         {SQLITE_FULL,                   error::POSIX,       ENOSPC},
         {SQLITE_CANTOPEN,               error::LiteCore,    error::CantOpenFile},
         {SQLITE_NOTADB,                 error::LiteCore,    error::NotADatabaseFile},
+        {SQLITE_INTERRUPT,              error::LiteCore,    error::Interrupted},
         {SQLITE_PERM,                   error::LiteCore,    error::NotWriteable},
         {0, /*must end with err=0*/     error::LiteCore,    0},
     };
@@ -276,6 +277,7 @@ namespace litecore {
             "database cannot be upgraded to the current version", // 30
             "can't apply document delta: base revision body unavailable",
             "can't apply document delta: format is invalid",
+            "operation was interrupted",
         };
         static_assert(sizeof(kLiteCoreMessages)/sizeof(kLiteCoreMessages[0]) ==
                         error::NumLiteCoreErrorsPlus1, "Incomplete error message table");
@@ -83,6 +83,7 @@ namespace litecore {
             CantUpgradeDatabase,
             DeltaBaseUnknown,
             CorruptDelta,
+            Interrupted,
 
             // Add new codes here. You MUST add messages to kLiteCoreMessages!
             // You MUST add corresponding kC4Err codes to the enum in C4Base.h!
@@ -51,6 +51,7 @@ namespace litecore { namespace actor {
 
     GCDMailbox::GCDMailbox(Actor *a, const std::string &name, GCDMailbox *parentMailbox)
     :_actor(a)
+    ,_hasParent(parentMailbox != nullptr)
     {
         dispatch_queue_t targetQueue;
         if (parentMailbox)
@@ -76,6 +77,19 @@ namespace litecore { namespace actor {
     }
 
 
+    void GCDMailbox::setPriority(ActorPriority priority) {
+        if (_hasParent)
+            return;
+        qos_class_t qos;
+        switch (priority) {
+            case ActorPriority::Background:     qos = QOS_CLASS_BACKGROUND; break;
+            case ActorPriority::Interactive:    qos = QOS_CLASS_USER_INITIATED; break;
+            default:                            qos = kQOS; break;
+        }
+        dispatch_set_target_queue(_queue, dispatch_get_global_queue(qos, 0));
+    }
+
+
     std::string GCDMailbox::name() const {
         return dispatch_queue_get_label(_queue);
     }
@@ -43,6 +43,14 @@ namespace litecore { namespace actor {
 
         unsigned eventCount() const                         {return _eventCount;}
 
+        /** Retargets the queue to the global queue with the matching QoS class. Has no effect
+            on a Mailbox with a parent, whose queue targets the parent's. */
+        void setPriority(ActorPriority);
+
+        /** Has no effect: a GCD Mailbox's children already run one at a time, since their
+            queues target its serial queue. */
+        void setMaxChildConcurrency(unsigned)               { }
+
         //void enqueue(std::function<void()> f);
         void enqueue(const char* name, void (^block)());
         void enqueueAfter(delay_t delay, const char* name, void (^block)());
@@ -62,6 +70,7 @@ namespace litecore { namespace actor {
         
         Actor *_actor;
         dispatch_queue_t _queue;
+        bool _hasParent;
         std::atomic<int32_t> _eventCount {0};
         
 #if ACTORS_USE_MANIFESTS
@@ -0,0 +1,163 @@
+//
+// MPSCQueue.hh
+//
+// Copyright (c) 2021 Couchbase, Inc All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <new>
+#include <thread>
+#include <utility>
+
+namespace litecore { namespace actor {
+
+    /** A lock-free, unbounded, multi-producer / single-consumer FIFO queue, used as an Actor's
+        mailbox. Any thread can push; only one thread at a time may call the consumer methods
+        (`front` and `pop`.) Unlike Channel it never blocks, so it's up to the caller to
+        arrange for a consumer to run when the queue becomes non-empty; `push` and `pop` return
+        whether the queue was / is empty, to make that easy.
+
+        Items are stored in a linked list of fixed-size segments. A producer claims a slot with
+        an atomic increment of its segment's index; whoever finds a segment full links in the
+        next one. The consumer frees a segment once it's consumed all of it, and no producer
+        could still be looking at it. Items don't move once pushed, so `front` can return a
+        reference that stays valid while other threads push. */
+    template <class T, uint32_t kSegmentSize = 16>
+    class MPSCQueue {
+    public:
+        MPSCQueue()
+        :_head(new Segment)
+        ,_oldest(_head)
+        {
+            _tail.store(_head, std::memory_order_relaxed);
+        }
+
+        ~MPSCQueue() {
+            size_t n = _count.load(std::memory_order_acquire);
+            for (size_t i = 0; i < n; ++i)
+                pop();
+            freeSegments(nullptr);
+        }
+
+        MPSCQueue(const MPSCQueue&) =delete;
+        MPSCQueue& operator= (const MPSCQueue&) =delete;
+
+        /** Adds an item to the end of the queue. Can be called on any thread.
+            @return  True if the queue was empty before the push. */
+        bool push(T t) {
+            _activeProducers.fetch_add(1, std::memory_order_seq_cst);
+            Segment *seg = _tail.load(std::memory_order_seq_cst);
+            while (true) {
+                uint32_t i = seg->reserved.fetch_add(1, std::memory_order_relaxed);
+                if (i < kSegmentSize) {
+                    Slot &slot = seg->slots[i];
+                    ::new (slot.storage) T(std::move(t));
+                    slot.ready.store(true, std::memory_order_release);
+                    break;
+                }
+                // Segment is full, so go on to the next, adding it if no one else has:
+                Segment *next = seg->next.load(std::memory_order_acquire);
+                if (!next) {
+                    auto fresh = new Segment;
+                    _segmentsAllocated.fetch_add(1, std::memory_order_relaxed);
+                    if (seg->next.compare_exchange_strong(next, fresh, std::memory_order_acq_rel,
+                                                          std::memory_order_acquire))
+                        next = fresh;
+                    else
+                        delete fresh;
+                }
+                _tail.compare_exchange_strong(seg, next, std::memory_order_seq_cst);
+                seg = _tail.load(std::memory_order_seq_cst);
+            }
+            _activeProducers.fetch_sub(1, std::memory_order_seq_cst);
+            return _count.fetch_add(1, std::memory_order_acq_rel) == 0;
+        }
+
+        /** Returns the item at the head of the queue. Consumer only; the queue must not be
+            empty (i.e. a push has returned true, or the last pop returned false.) */
+        T& front() {
+            if (_headIndex == kSegmentSize) {
+                // Move to the next segment, which has been linked already since there's an
+                // item in it. The old one may still be in use by a producer, so it can't be
+                // freed yet:
+                Segment *next;
+                while (!(next = _head->next.load(std::memory_order_acquire)))
+                    std::this_thread::yield();
+                _head = next;
+                _headIndex = 0;
+            }
+            if (_oldest != _head && _activeProducers.load(std::memory_order_seq_cst) == 0)
+                freeSegments(_head);
+
+            // The count says an item's been pushed, but possibly one in a later slot; the
+            // producer that claimed this slot may not have finished writing it yet.
+            Slot &slot = _head->slots[_headIndex];
+            for (unsigned spin = 0; !slot.ready.load(std::memory_order_acquire); ++spin) {
+                if (spin > 100)
+                    std::this_thread::yield();
+            }
+            return *reinterpret_cast<T*>(slot.storage);
+        }
+
+        /** Removes the item at the head of the queue. Consumer only.
+            @return  True if the queue is now empty. */
+        bool pop() {
+            T &item = front();
+            item.~T();
+            ++_headIndex;
+            return _count.fetch_sub(1, std::memory_order_acq_rel) == 1;
+        }
+
+        /** The number of items in the queue. (Approximate, if pushes are in progress.) */
+        size_t size() const             {return _count.load(std::memory_order_relaxed);}
+
+        bool empty() const              {return size() == 0;}
+
+        /** The number of segments allocated so far, including the first. (For tests.) */
+        size_t segmentsAllocated() const {return _segmentsAllocated.load(std::memory_order_relaxed);}
+
+    private:
+        struct Slot {
+            std::atomic<bool> ready {false};
+            alignas(T) unsigned char storage[sizeof(T)];
+        };
+
+        struct Segment {
+            std::atomic<Segment*>   next {nullptr};
+            std::atomic<uint32_t>   reserved {0};       // Number of slots claimed by producers
+            Slot                    slots[kSegmentSize];
+        };
+
+        // Frees the consumed segments before `end`.
+        void freeSegments(Segment *end) {
+            while (_oldest != end) {
+                Segment *next = _oldest->next.load(std::memory_order_relaxed);
+                delete _oldest;
+                _oldest = next;
+            }
+        }
+
+        alignas(64) std::atomic<Segment*>   _tail;      // Segment producers push to
+        std::atomic<uint32_t>   _activeProducers {0};   // Number of pushes in progress
+        alignas(64) std::atomic<size_t>     _count {0}; // Number of items pushed but not popped
+        alignas(64) Segment*    _head;                  // Consumer's current segment
+        uint32_t                _headIndex {0};         // Index of next item in _head
+        Segment*                _oldest;                // Oldest segment not yet freed
+        std::atomic<size_t>     _segmentsAllocated {1};
+    };
+
+} }
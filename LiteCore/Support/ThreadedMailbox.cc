@@ -19,13 +19,20 @@
 #include "ThreadedMailbox.hh"
 #ifndef ACTORS_USE_GCD
 #include "Actor.hh"
+#include "ActorMetrics.hh"
 #include "ThreadUtil.hh"
 #include "Error.hh"
 #include "Timer.hh"
+#include "WorkStealingScheduler.hh"
 #include "Logging.hh"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
 #include <future>
-#include <random>
+#include <inttypes.h>
 #include <map>
+#include <mutex>
+#include <optional>
 #include <sstream>
 
 using namespace std;
@@ -64,27 +71,84 @@ namespace litecore { namespace actor {
         }
     };
     
-    static Scheduler* sScheduler;
-    static random_device rd;
-    static mt19937 sRandGen(rd());
+    // Every this many Mailboxes, a thread takes the lowest-priority one waiting instead of the
+    // highest, so a steady stream of higher-priority work can't starve the rest.
+    static constexpr unsigned kLowPriorityInterval = 16;
+
+    static atomic<Scheduler*> sScheduler;
+    static mutex sSchedulerMutex;
+    static optional<Scheduler::Kind> sSharedSchedulerKind;
+
+
+    Scheduler* Scheduler::create(Kind kind, unsigned numThreads) {
+        switch (kind) {
+            case Kind::WorkStealing:    return new WorkStealingScheduler(numThreads);
+            default:                    return new Scheduler(numThreads);
+        }
+    }
+
+
+    static Scheduler::Kind defaultSchedulerKind() {
+        if (sSharedSchedulerKind)
+            return *sSharedSchedulerKind;
+        if (const char *env = getenv("LiteCoreScheduler"); env) {
+            if (strcmp(env, "workstealing") == 0)
+                return Scheduler::Kind::WorkStealing;
+            else if (strcmp(env, "shared") != 0)
+                Warn("Unknown LiteCoreScheduler value '%s'", env);
+        }
+        return Scheduler::Kind::SharedQueue;
+    }
+
 
     Scheduler* Scheduler::sharedScheduler() {
-        if (!sScheduler) {
-            sScheduler = new Scheduler;
-            sScheduler->start();
+        Scheduler *scheduler = sScheduler.load(memory_order_acquire);
+        if (_usuallyFalse(!scheduler)) {
+            lock_guard<mutex> lock(sSchedulerMutex);
+            scheduler = sScheduler.load(memory_order_relaxed);
+            if (!scheduler) {
+                scheduler = create(defaultSchedulerKind());
+                scheduler->start();
+                sScheduler.store(scheduler, memory_order_release);
+            }
+        }
+        return scheduler;
+    }
+
+
+    void Scheduler::setSharedSchedulerKind(Kind kind) {
+        lock_guard<mutex> lock(sSchedulerMutex);
+        if (sScheduler)
+            Warn("Scheduler::setSharedSchedulerKind called after the Scheduler started");
+        sSharedSchedulerKind = kind;
+    }
+
+
+    Scheduler* Scheduler::replaceSharedScheduler(Scheduler *scheduler) {
+        Assert(scheduler);
+        scheduler->start();
+        lock_guard<mutex> lock(sSchedulerMutex);
+        return sScheduler.exchange(scheduler);
+    }
+
+
+    void Scheduler::resolveNumThreads() {
+        if (_numThreads == 0) {
+            _numThreads = thread::hardware_concurrency();
+            if (_numThreads == 0)
+                _numThreads = 2;
         }
-        return sScheduler;
     }
 
 
     void Scheduler::start() {
         if (!_started.test_and_set()) {
-            if (_numThreads == 0) {
-                _numThreads = thread::hardware_concurrency();
-                if (_numThreads == 0)
-                    _numThreads = 2;
-            }
+            resolveNumThreads();
             LogTo(ActorLog, "Starting Scheduler<%p> with %u threads", this, _numThreads);
+            {
+                lock_guard<mutex> lock(_queueMutex);
+                _closed = false;
+            }
             for (unsigned id = 1; id <= _numThreads; id++)
                 _threadPool.emplace_back([this,id]{task(id);});
         }
@@ -93,10 +157,15 @@ namespace litecore { namespace actor {
 
     void Scheduler::stop() {
         LogTo(ActorLog, "Stopping Scheduler<%p>...", this);
-        _queue.close();
+        {
+            lock_guard<mutex> lock(_queueMutex);
+            _closed = true;
+            _queueCond.notify_all();
+        }
         for (auto &t : _threadPool) {
             t.join();
         }
+        _threadPool.clear();
         LogTo(ActorLog, "Scheduler<%p> has stopped", this);
         _started.clear();
     }
@@ -108,7 +177,7 @@ namespace litecore { namespace actor {
         sprintf(name, "CBL Scheduler#%u", taskID);
         SetThreadName(name);
         ThreadedMailbox *mailbox;
-        while ((mailbox = _queue.pop()) != nullptr) {
+        while ((mailbox = pop()) != nullptr) {
             LogVerbose(ActorLog, "   task %d calling Actor<%p>", taskID, mailbox);
             mailbox->performNextMessage();
             mailbox = nullptr;
@@ -117,15 +186,42 @@ namespace litecore { namespace actor {
     }
 
 
+    void Scheduler::_schedule(ThreadedMailbox *mbox) {
+        lock_guard<mutex> lock(_queueMutex);
+        _queues[unsigned(mbox->priority())].push_back(mbox);
+        _queueCond.notify_one();
+    }
+
+
+    // Blocks until a Mailbox is scheduled, then removes and returns the one with the highest
+    // priority. Returns nullptr once the Scheduler is stopped and nothing's left to run.
+    ThreadedMailbox* Scheduler::pop() {
+        unique_lock<mutex> lock(_queueMutex);
+        while (true) {
+            bool lowestFirst = (++_popCount % kLowPriorityInterval == 0);
+            for (unsigned i = 0; i < kNumActorPriorities; ++i) {
+                auto &queue = _queues[lowestFirst ? i : kNumActorPriorities - 1 - i];
+                if (!queue.empty()) {
+                    ThreadedMailbox *mbox = queue.front();
+                    queue.pop_front();
+                    return mbox;
+                }
+            }
+            if (_closed)
+                return nullptr;
+            _queueCond.wait(lock);
+        }
+    }
+
+
     void Scheduler::schedule(ThreadedMailbox *mbox) {
-        sScheduler->_queue.push(mbox);
+        sScheduler.load(memory_order_acquire)->_schedule(mbox);
     }
 
 
-    // Explicitly instantiate the Channel specializations we need; this corresponds to the
-    // "extern template..." declarations at the bottom of Actor.hh
-    template class Channel<ThreadedMailbox*>;
-    template class Channel<std::function<void()>>;
+    void Scheduler::performNextMessage(ThreadedMailbox *mbox) {
+        mbox->performNextMessage();
+    }
 
 
 #pragma mark - MAILBOX:
@@ -136,88 +232,159 @@ namespace litecore { namespace actor {
     thread_local shared_ptr<ChannelManifest> ThreadedMailbox::sThreadManifest;
 #endif
 
+    /** Limits how many child Mailboxes of a parent can be scheduled or running at once.
+        A child that has messages while the limit's reached waits in a FIFO queue, and is
+        scheduled when a running child finishes its activation. */
+    class ThreadedMailbox::ChildLimit {
+    public:
+        explicit ChildLimit(unsigned max)   :_max(max) { }
+
+        void setMax(unsigned max) {
+            vector<ThreadedMailbox*> ready;
+            {
+                lock_guard<mutex> lock(_mutex);
+                _max = max;
+                while (!_waiting.empty() && (_max == 0 || _running < _max)) {
+                    ++_running;
+                    ready.push_back(_waiting.front());
+                    _waiting.pop_front();
+                }
+            }
+            for (auto mbox : ready)
+                Scheduler::schedule(mbox);
+        }
+
+        // Schedules a child, or queues it if too many are running.
+        void schedule(ThreadedMailbox *child) {
+            {
+                lock_guard<mutex> lock(_mutex);
+                if (_max > 0 && _running >= _max) {
+                    _waiting.push_back(child);
+                    return;
+                }
+                ++_running;
+            }
+            Scheduler::schedule(child);
+        }
+
+        // Called when a child's activation ends; hands its slot to the next waiting child.
+        void finished() {
+            ThreadedMailbox *next;
+            {
+                lock_guard<mutex> lock(_mutex);
+                if (_waiting.empty()) {
+                    --_running;
+                    return;
+                }
+                next = _waiting.front();
+                _waiting.pop_front();
+            }
+            Scheduler::schedule(next);
+        }
+
+    private:
+        mutex _mutex;
+        unsigned _max;                          // Max running children, or 0 for no limit
+        unsigned _running {0};                  // Number of children scheduled or running
+        deque<ThreadedMailbox*> _waiting;       // Children waiting to be scheduled
+    };
+
+
     ThreadedMailbox::ThreadedMailbox(Actor *a, const std::string &name, ThreadedMailbox *parent)
     :_actor(a)
     ,_name(name)
+    ,_priority(parent ? parent->priority() : ActorPriority::Normal)
+    ,_limit(parent ? parent->_childLimit.get() : nullptr)
     {
         Scheduler::sharedScheduler()->start();
     }
 
-    void ThreadedMailbox::enqueue(const char* name, const std::function<void()> &f) {
-        beginLatency();
-        retain(_actor);
-
-#if ACTORS_USE_MANIFESTS
-        auto threadManifest = sThreadManifest ? sThreadManifest : make_shared<ChannelManifest>();
-        threadManifest->addEnqueueCall(_actor, name);
-        _localManifest.addEnqueueCall(_actor, name);
-        const auto wrappedBlock = [f, threadManifest, name, SELF]
-        {
-            threadManifest->addExecution(_actor, name);
-            sThreadManifest = threadManifest;
-            _localManifest.addExecution(_actor, name);
-#else
-        const auto wrappedBlock = [f, SELF]
-        {
-#endif
-            endLatency();
-            beginBusy();
-            safelyCall(f);
-            afterEvent();
+    ThreadedMailbox::~ThreadedMailbox() {
+        if (_metrics)
+            _metrics->removeMailbox(this);
+    }
 
-#if ACTORS_USE_MANIFESTS
-            sThreadManifest.reset();
-#endif
-        };
+    void ThreadedMailbox::setMaxChildConcurrency(unsigned max) {
+        if (_childLimit)
+            _childLimit->setMax(max);
+        else
+            _childLimit = make_unique<ChildLimit>(max);
+    }
 
-        if (push(wrappedBlock))
+    void ThreadedMailbox::enqueue(const char* name, ActorMessage f) {
+        retain(_actor);
+        if (_queue.push(queued(wrap(name, move(f)))))
             reschedule();
     }
 
-    void ThreadedMailbox::enqueueAfter(delay_t delay, const char* name, const std::function<void()> &f) {
+    void ThreadedMailbox::enqueueAfter(delay_t delay, const char* name, ActorMessage f) {
         if (delay <= delay_t::zero())
-            return enqueue(name, f);
+            return enqueue(name, move(f));
 
-        beginLatency();
         _delayedEventCount++;
         retain(_actor);
+        Timer::callAfter(chrono::duration_cast<Timer::duration>(delay), &deliverDelayed, this,
+                         wrap(name, move(f), delay.count()));
+    }
+
+    // Called on the Timer thread when a delayed message's time comes.
+    void ThreadedMailbox::deliverDelayed(void *context, ActorMessage &msg) {
+        auto self = (ThreadedMailbox*)context;
+        --self->_delayedEventCount;
+        if (self->_queue.push(queued(move(msg))))
+            self->reschedule();
+    }
+
+    // Adds the time to a message, if it's one of those whose queue latency is measured.
+    ThreadedMailbox::QueuedMessage ThreadedMailbox::queued(ActorMessage msg) {
+        static thread_local unsigned tMessageCount = 0;
+        QueuedMessage q {move(msg), {}};
+        if (++tMessageCount % ActorMetrics::kLatencySampleInterval == 0)
+            q.enqueuedAt = chrono::steady_clock::now();
+        return q;
+    }
+
+    // The Actor's class isn't known yet when the Mailbox is constructed, so this is called when
+    // the Mailbox first runs.
+    ActorMetrics* ThreadedMailbox::metrics() {
+        if (!_metrics) {
+            _metrics = ActorMetrics::forClass(_actor->actorClassName());
+            _metrics->addMailbox(this);
+        }
+        return _metrics;
+    }
 
+    // Normally a message is queued as-is, and performNextMessage does the bookkeeping. When
+    // tracking stats or manifests, it's wrapped in a lambda that records them.
+    ActorMessage ThreadedMailbox::wrap(const char *name, ActorMessage f, double delay) {
 #if ACTORS_USE_MANIFESTS
+        beginLatency();
         auto threadManifest = sThreadManifest ? sThreadManifest : make_shared<ChannelManifest>();
-        threadManifest->addEnqueueCall(_actor, name, delay.count());
-        _localManifest.addEnqueueCall(_actor, name, delay.count());
-        auto timer = new Timer([f, threadManifest, name, this]
+        threadManifest->addEnqueueCall(_actor, name, delay);
+        _localManifest.addEnqueueCall(_actor, name, delay);
+        return [f = move(f), threadManifest, name, SELF]
         {
-            const auto wrappedBlock = [f, threadManifest, name, SELF]
-            {
-                threadManifest->addExecution(_actor, name);
-                sThreadManifest = threadManifest;
-                _localManifest.addExecution(_actor, name);
-#else
-        auto timer = new Timer([f, this]
+            threadManifest->addExecution(_actor, name);
+            sThreadManifest = threadManifest;
+            _localManifest.addExecution(_actor, name);
+            endLatency();
+            f();
+            sThreadManifest.reset();
+        };
+#elif ACTORS_TRACK_STATS
+        beginLatency();
+        return [f = move(f), SELF]
         {
-             const auto wrappedBlock = [f, SELF]
-             {
-#endif
-                endLatency();
-                beginBusy();
-                safelyCall(f);
-                --_delayedEventCount;
-                afterEvent();
-#if ACTORS_USE_MANIFESTS
-                sThreadManifest.reset();
+            endLatency();
+            f();
+        };
+#else
+        (void)name; (void)delay;
+        return f;
 #endif
-            };
-            
-            if (push(wrappedBlock))
-                reschedule();
-        });
-
-        timer->autoDelete();
-        timer->fireAfter(chrono::duration_cast<Timer::duration>(delay));
     }
 
-    void ThreadedMailbox::safelyCall(const std::function<void()>& f) const
+    void ThreadedMailbox::safelyCall(const ActorMessage &f) const
     {
         try {
             f();
@@ -231,6 +398,7 @@ namespace litecore { namespace actor {
             _localManifest.dump(manifest);
             const auto dumped = manifest.str();
             Warn("%s", dumped.c_str());
+            sThreadManifest.reset();
 #endif
         }
     }
@@ -250,29 +418,85 @@ namespace litecore { namespace actor {
 
 
     void ThreadedMailbox::reschedule() {
-        Scheduler::schedule(this);
+        if (_limit)
+            _limit->schedule(this);
+        else
+            Scheduler::schedule(this);
+    }
+
+
+    static atomic<unsigned> sMaxBatchMessages {32};
+    static atomic<int64_t>  sMaxBatchMicros {1000};
+
+
+    ThreadedMailbox::BatchLimits ThreadedMailbox::batchLimits() {
+        return {sMaxBatchMessages, chrono::microseconds(sMaxBatchMicros)};
+    }
+
+
+    void ThreadedMailbox::setBatchLimits(BatchLimits limits) {
+        sMaxBatchMessages = max(limits.maxMessages, 1u);
+        sMaxBatchMicros = max(limits.maxTime.count(), int64_t(0));
     }
 
 
     void ThreadedMailbox::performNextMessage() {
         LogVerbose(ActorLog, "%s performNextMessage", _actor->actorName().c_str());
         DebugAssert(++_active == 1);     // Fail-safe check to detect 'impossible' re-entrant call
+        ++_activationCount;
         sCurrentActor = _actor;
-        auto &fn = front();
-        fn();
-        sCurrentActor = nullptr;
-        
-        DebugAssert(--_active == 0);
 
+        ActorMetrics *metrics = this->metrics();
+        const size_t queueDepth = _queue.size();
+        const auto startTime = chrono::steady_clock::now();
+
+        // Handle queued messages until the queue is empty or the batch limits are reached:
+        const unsigned maxMessages = sMaxBatchMessages.load(memory_order_relaxed);
+        const auto maxTime = chrono::microseconds(sMaxBatchMicros.load(memory_order_relaxed));
+        const auto deadline = (maxTime.count() > 0) ? startTime + maxTime
+                                                    : chrono::steady_clock::time_point::max();
+        unsigned n = 0;
         bool empty;
-        popNoWaiting(empty);
-        release(_actor); // For enqueue's retain call
-        if (!empty)
-            reschedule();
+        do {
+            QueuedMessage &next = _queue.front();
+            if (next.enqueuedAt != chrono::steady_clock::time_point())
+                metrics->recordLatency(chrono::steady_clock::now() - next.enqueuedAt);
+            beginBusy();
+            safelyCall(next.message);
+            afterEvent();
+            ++_messageCount;
+            // Once the queue is empty, a new message will reschedule this mailbox, possibly on
+            // another thread, so nothing below may touch `this` except to release the actor:
+            DebugAssert(--_active == 0);
+            empty = _queue.pop();
+            if (empty) {
+                sCurrentActor = nullptr;
+                metrics->recordActivation(queueDepth, n + 1,
+                                          chrono::steady_clock::now() - startTime);
+                if (_limit)
+                    _limit->finished();
+                release(_actor); // For enqueue's retain call
+                return;
+            }
+            DebugAssert(++_active == 1);
+            release(_actor); // Safe, since the next message retains the actor too
+        } while (++n < maxMessages && (maxTime.count() == 0
+                                       || chrono::steady_clock::now() < deadline));
+
+        sCurrentActor = nullptr;
+        metrics->recordActivation(queueDepth, n, chrono::steady_clock::now() - startTime);
+        DebugAssert(--_active == 0);
+        ChildLimit *limit = _limit;     // (`this` may be gone once I'm rescheduled)
+        reschedule();
+        if (limit)
+            limit->finished();      // After rescheduling, so waiting siblings go first
     }
 
     void ThreadedMailbox::logStats() const
     {
+        LogTo(ActorLog, "%s handled %" PRIu64 " messages in %" PRIu64 " activations (%.1f per activation)",
+              _actor->actorName().c_str(), _messageCount, _activationCount,
+              _activationCount ? double(_messageCount) / _activationCount : 0.0);
 #if ACTORS_TRACK_STATS
         LogTo(ActorLog, "%s handled %d events; max queue depth was %d; max latency was %s; busy %s (%.1f%%)",
             _actor->actorName().c_str(), _callCount, _maxEventCount,
@@ -17,13 +17,19 @@
 //
 
 #pragma once
+#include "ActorMessage.hh"
 #include "Channel.hh"
 #include "ChannelManifest.hh"
+#include "MPSCQueue.hh"
 #include "RefCounted.hh"
 #include "Stopwatch.hh"
 #include <atomic>
 #include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <thread>
 #include <functional>
@@ -35,6 +41,7 @@ namespace litecore { namespace actor {
 
     class Scheduler;
     class Actor;
+    class ActorMetrics;
     class MailboxProxy;
 
 
@@ -42,37 +49,98 @@ namespace litecore { namespace actor {
     using delay_t = std::chrono::duration<double>;
 
 
+    /** The scheduling priority of an Actor. When there's a backlog, Actors with higher priority
+        get to run first, so latency-sensitive work isn't stuck behind bulk work. */
+    enum class ActorPriority : uint8_t {
+        Background,         ///< Bulk work that can wait, like inserting pulled revisions
+        Normal,             ///< The default
+        Interactive,        ///< Latency-sensitive work, like live queries
+    };
+
+    static constexpr unsigned kNumActorPriorities = 3;
+
+
     #ifndef ACTORS_USE_GCD
-    /** Default Actor mailbox implementation that uses a thread pool run by a Scheduler. */
-    class ThreadedMailbox : Channel<std::function<void()>> {
+    /** Default Actor mailbox implementation that uses a thread pool run by a Scheduler.
+        Messages are queued in a lock-free MPSCQueue; the Mailbox is scheduled whenever its
+        queue becomes non-empty, and only one thread at a time runs its messages. */
+    class ThreadedMailbox {
     public:
         ThreadedMailbox(Actor*, const std::string &name ="", ThreadedMailbox *parentMailbox =nullptr);
+        ~ThreadedMailbox();
 
         const std::string& name() const                     {return _name;}
 
-        unsigned eventCount() const                         {return (unsigned)size() + (unsigned)_delayedEventCount;}
+        unsigned eventCount() const                         {return (unsigned)_queue.size() + (unsigned)_delayedEventCount;}
 
-        void enqueue(const char* name, const std::function<void()>&);
-        void enqueueAfter(delay_t delay, const char* name, const std::function<void()>&);
+        void enqueue(const char* name, ActorMessage);
+        void enqueueAfter(delay_t delay, const char* name, ActorMessage);
 
         static Actor* currentActor()                        {return sCurrentActor;}
 
+        ActorPriority priority() const                      {return _priority;}
+
+        /** Sets the priority with which this Mailbox is scheduled. Mailboxes created later
+            with this one as their `parentMailbox` inherit it. */
+        void setPriority(ActorPriority p)                   {_priority = p;}
+
+        /** Limits how many Mailboxes created with this one as their `parentMailbox` can run at
+            once; any others with messages wait their turn. Zero (the default) means no limit.
+            Must be called before any such Mailboxes are created. */
+        void setMaxChildConcurrency(unsigned);
+
         static void runAsyncTask(void (*task)(void*), void *context);
 
+        /** Limits on how much work a Mailbox does each time it's scheduled, before it yields its
+            thread to other Mailboxes. Running several messages in a row saves a round trip
+            through the Scheduler per message and keeps the Actor's data in the CPU cache. */
+        struct BatchLimits {
+            unsigned maxMessages;           ///< Max messages to handle per activation (>= 1)
+            std::chrono::microseconds maxTime;  ///< Stop after this long; zero for no limit
+        };
+
+        static BatchLimits batchLimits();
+
+        /** Sets the batch limits of all ThreadedMailboxes. */
+        static void setBatchLimits(BatchLimits);
+
         void logStats() const;
 
+        /** Number of messages each segment of the message queue holds. */
+        static constexpr uint32_t kQueueSegmentSize = 16;
+
+        /** The number of segments the message queue has allocated so far. (For tests.) */
+        size_t queueSegmentsAllocated() const               {return _queue.segmentsAllocated();}
+
     private:
         friend class Scheduler;
+        class ChildLimit;
+
+        struct QueuedMessage {
+            ActorMessage message;
+            std::chrono::steady_clock::time_point enqueuedAt;   // Only if sampled for metrics
+        };
         
         void reschedule();
         void performNextMessage();
+        static QueuedMessage queued(ActorMessage);
+        ActorMetrics* metrics();
         void afterEvent();
-        void safelyCall(const std::function<void()> &f) const;
+        static void deliverDelayed(void *context, ActorMessage&);
+        ActorMessage wrap(const char *name, ActorMessage, double delay =0.0);
+        void safelyCall(const ActorMessage&) const;
 
         Actor* const _actor;
         std::string const _name;
-
-        int _delayedEventCount {0};
+        MPSCQueue<QueuedMessage, kQueueSegmentSize> _queue;
+        std::atomic<ActorPriority> _priority;
+        ChildLimit* const _limit;           // Parent's concurrency limit that applies to me
+        std::unique_ptr<ChildLimit> _childLimit;    // Concurrency limit for my children
+
+        std::atomic<int> _delayedEventCount {0};
+        uint64_t _activationCount {0};      // Number of times performNextMessage was called
+        uint64_t _messageCount {0};         // Number of messages handled
+        ActorMetrics* _metrics {nullptr};   // Metrics of my Actor's class (set when first run)
 #if DEBUG
         std::atomic_int _active {0};
 #endif
@@ -94,21 +162,47 @@ namespace litecore { namespace actor {
     };
 
     /** The Scheduler is reponsible for calling ThreadedMailboxes to run their Actor methods.
-        It managers a thread pool on which Mailboxes and Actors will run. */
+        It managers a thread pool on which Mailboxes and Actors will run.
+        This base implementation has all its threads pop Mailboxes from one shared queue per
+        ActorPriority; see WorkStealingScheduler for an alternative. */
     class Scheduler {
     public:
+        /** The available Scheduler implementations. */
+        enum class Kind {
+            SharedQueue,        ///< Scheduler: one queue shared by all threads
+            WorkStealing,       ///< WorkStealingScheduler: per-thread queues
+        };
+
         Scheduler(unsigned numThreads =0)
         :_numThreads(numThreads)
         { }
 
+        virtual ~Scheduler() =default;
+
+        /** Creates a new (unstarted) Scheduler of the given kind. */
+        static Scheduler* create(Kind, unsigned numThreads =0);
+
         /** Returns a per-process shared instance. */
         static Scheduler* sharedScheduler();
 
+        /** Sets the kind of Scheduler that `sharedScheduler` will create. This has to be called
+            at startup, before any Actors are created, else it has no effect.
+            The default kind can also be set with the environment variable
+            `LiteCoreScheduler`, whose value can be "shared" or "workstealing". */
+        static void setSharedSchedulerKind(Kind);
+
+        /** Replaces the shared instance, returning the previous one, which should then be
+            stopped (it will finish running any Mailboxes already scheduled on it.)
+            This is only meant for tests and benchmarks. */
+        static Scheduler* replaceSharedScheduler(Scheduler*);
+
+        unsigned numThreads() const                         {return _numThreads;}
+
         /** Starts the background threads that will run queued Actors. */
-        void start();
+        virtual void start();
 
         /** Stops the background threads. Blocks until all pending messages are handled. */
-        void stop();
+        virtual void stop();
 
         /** Runs the scheduler on the current thread; doesn't return until all pending
             messages are handled. */
@@ -120,20 +214,28 @@ namespace litecore { namespace actor {
         /** A request for an Actor's performNextMessage method to be called. */
         static void schedule(ThreadedMailbox* mbox);
 
-    private:
-        void task(unsigned taskID);
+        /** Adds a Mailbox to the queue of ones to be run. */
+        virtual void _schedule(ThreadedMailbox* mbox);
+
+        /** The body of a scheduler thread. */
+        virtual void task(unsigned taskID);
+
+        static void performNextMessage(ThreadedMailbox* mbox);
+        void resolveNumThreads();
 
         unsigned _numThreads;
-        Channel<ThreadedMailbox*> _queue;
         std::vector<std::thread> _threadPool;
         std::atomic_flag _started = ATOMIC_FLAG_INIT;
 
+    private:
+        ThreadedMailbox* pop();
 
+        std::mutex _queueMutex;
+        std::condition_variable _queueCond;
+        std::deque<ThreadedMailbox*> _queues[kNumActorPriorities];  // Indexed by ActorPriority
+        unsigned _popCount {0};
+        bool _closed {false};
     };
-
-    // This prevents the compiler from specializing Channel in every compilation unit:
-    extern template class Channel<ThreadedMailbox*>;
-    extern template class Channel<std::function<void()>>;
 #endif
 
 } }
@@ -18,82 +18,302 @@
 
 #include "Timer.hh"
 #include "ThreadUtil.hh"
-#include <vector>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
 
 using namespace std;
 
 namespace litecore { namespace actor {
 
+    /* The Manager keeps scheduled entries in a hierarchical timer wheel. Time is divided into
+       1ms ticks. Each of the wheel's levels has 64 slots; an entry at level L is in the slot
+       given by the L'th 6-bit digit of its fire tick. An entry goes in the lowest level whose
+       64 slots reach far enough ahead to hold it. When the wheel's time reaches the start of a
+       higher-level slot, its entries are "cascaded": reinserted at lower levels. When it
+       reaches a level-0 slot, its entries are due and are moved to the `_due` list to fire.
+       Bitmaps of the occupied slots let the Manager's thread find the next tick at which
+       anything happens, and sleep till then. */
+
+
+    // An entry for Timer::callAfter. These are recycled, to avoid allocation.
+    struct Timer::DelayedCall : public Timer::Entry {
+        void (*fn)(void*, ActorMessage&);
+        void *context;
+        ActorMessage msg;
+    };
+
+    static constexpr size_t kMaxFreeCalls = 1024;
+
+
+    static inline unsigned countTrailingZeroes(uint64_t n) {
+#ifdef _MSC_VER
+        unsigned long index;
+        _BitScanForward64(&index, n);
+        return index;
+#else
+        return __builtin_ctzll(n);
+#endif
+    }
+
+    // Rotates a 64-slot bitmap so bit 0 corresponds to slot `first`.
+    static inline uint64_t rotateBitmap(uint64_t bits, unsigned first) {
+        return (bits >> first) | (bits << ((64 - first) & 63));
+    }
+
+
     Timer::Manager& Timer::manager() {
         static Manager* sManager = new Manager;
         return *sManager;
     }
 
 
+    void Timer::callAfter(duration d, void (*fn)(void*, ActorMessage&), void *context,
+                          ActorMessage msg)
+    {
+        manager().callAfter(d, fn, context, move(msg));
+    }
+
+
+    size_t Timer::scheduledCount() {
+        return manager().count();
+    }
+
+    size_t Timer::delayedCallsAllocated() {
+        return manager().callsAllocated();
+    }
+
+
     Timer::Manager::Manager()
-    :_thread([this](){ run(); })
+    :_epoch(clock::now())
+    ,_thread([this](){ run(); })
     { }
 
 
+    // Converts a time to a tick, rounding up so a timer never fires early.
+    uint64_t Timer::Manager::tickAt(time t) const {
+        if (t <= _epoch)
+            return 0;
+        auto ns = chrono::duration_cast<chrono::nanoseconds>(t - _epoch).count();
+        return (uint64_t(ns) + 999999) / 1000000;
+    }
+
+
+    Timer::time Timer::Manager::timeOfTick(uint64_t tick) const {
+        return _epoch + chrono::milliseconds(tick);
+    }
+
+
+    Timer::Entry*& Timer::Manager::listHead(uint8_t level, uint8_t slot) {
+        return (level == kDueLevel) ? _due : _wheel[level][slot];
+    }
+
+
+    // Adds an entry to the wheel. Precondition: _mutex must be locked.
+    void Timer::Manager::insert(Entry *e) {
+        uint64_t tick = max(e->tick, _now);
+        unsigned level = 0;
+        uint64_t digits = tick, nowDigits = _now;
+        while (digits - nowDigits >= kSlots && level < kLevels - 1) {
+            ++level;
+            digits >>= kLevelBits;
+            nowDigits >>= kLevelBits;
+        }
+        if (digits - nowDigits >= kSlots)
+            digits = nowDigits + kSlots - 1;    // Too far ahead; it'll be re-inserted later
+        e->level = uint8_t(level);
+        e->slot = uint8_t(digits & (kSlots - 1));
+        Entry *&head = _wheel[level][e->slot];
+        e->prev = nullptr;
+        e->next = head;
+        if (head)
+            head->prev = e;
+        head = e;
+        _occupied[level] |= (1ull << e->slot);
+    }
+
+
+    // Removes an entry from the wheel or the _due list. Precondition: _mutex must be locked.
+    void Timer::Manager::remove(Entry *e) {
+        Entry *&head = listHead(e->level, e->slot);
+        if (e->prev)
+            e->prev->next = e->next;
+        else
+            head = e->next;
+        if (e->next)
+            e->next->prev = e->prev;
+        e->prev = e->next = nullptr;
+        if (!head && e->level != kDueLevel)
+            _occupied[e->level] &= ~(1ull << e->slot);
+    }
+
+
+    // Returns the next tick (>= _now) at which a slot needs processing, or UINT64_MAX.
+    uint64_t Timer::Manager::nextEventTick() const {
+        uint64_t result = UINT64_MAX;
+        if (_occupied[0]) {
+            auto bits = rotateBitmap(_occupied[0], _now & (kSlots - 1));
+            result = _now + countTrailingZeroes(bits);
+        }
+        for (unsigned level = 1; level < kLevels; ++level) {
+            if (!_occupied[level])
+                continue;
+            unsigned shift = level * kLevelBits;
+            uint64_t nowDigits = _now >> shift;
+            auto bits = rotateBitmap(_occupied[level], nowDigits & (kSlots - 1));
+            uint64_t tick;
+            if ((bits & 1) && (_now & ((1ull << shift) - 1)) == 0) {
+                tick = _now;                    // Current slot starts right now
+            } else {
+                bits &= ~1ull;
+                if (!bits)
+                    continue;
+                tick = (nowDigits + countTrailingZeroes(bits)) << shift;
+            }
+            result = min(result, tick);
+        }
+        return result;
+    }
+
+
+    // Processes all ticks up through `target`, moving entries that are due to _due.
+    // Precondition: _mutex must be locked.
+    void Timer::Manager::advanceTo(uint64_t target) {
+        while (true) {
+            uint64_t tick = nextEventTick();
+            if (tick > target) {
+                _now = target + 1;
+                return;
+            }
+            _now = tick;
+            // Cascade higher-level slots that start at this tick, from the top down:
+            for (unsigned level = kLevels - 1; level >= 1; --level) {
+                unsigned shift = level * kLevelBits;
+                if ((_now & ((1ull << shift) - 1)) != 0)
+                    continue;
+                auto slot = uint8_t((_now >> shift) & (kSlots - 1));
+                Entry *e = _wheel[level][slot];
+                _wheel[level][slot] = nullptr;
+                _occupied[level] &= ~(1ull << slot);
+                while (e) {
+                    Entry *next = e->next;
+                    insert(e);
+                    e = next;
+                }
+            }
+            // Move the current level-0 slot's entries to _due:
+            auto slot = uint8_t(_now & (kSlots - 1));
+            Entry *e = _wheel[0][slot];
+            _wheel[0][slot] = nullptr;
+            _occupied[0] &= ~(1ull << slot);
+            while (e) {
+                Entry *next = e->next;
+                e->level = kDueLevel;
+                e->prev = nullptr;
+                e->next = _due;
+                if (_due)
+                    _due->prev = e;
+                _due = e;
+                e = next;
+            }
+            ++_now;
+        }
+    }
+
+
     // Body of the manager's background thread. Waits for timers and calls their callbacks.
     void Timer::Manager::run() {
         SetThreadName("Timer (CBL)");
         unique_lock<mutex> lock(_mutex);
         while(true) {
-            auto earliest = _schedule.begin();
-            if (earliest == _schedule.end()) {
-                // Schedule is empty; just wait for a change
+            if (_due) {
+                // An entry is ready to fire, so remove it and fire it:
+                Entry *entry = _due;
+                remove(entry);
+                --_count;
+                fire(entry, lock);
+                continue;
+            }
+
+            auto nowTick = uint64_t(chrono::duration_cast<chrono::milliseconds>(
+                                                                clock::now() - _epoch).count());
+            if (nowTick >= _now) {
+                advanceTo(nowTick);
+                if (_due)
+                    continue;
+            }
+
+            // Wait for the next tick with something to do, or until an earlier entry is added:
+            _wakeTick = nextEventTick();
+            if (_wakeTick == UINT64_MAX)
                 _condition.wait(lock);
+            else
+                _condition.wait_until(lock, timeOfTick(_wakeTick));
+            _wakeTick = 0;      // While awake, no need to notify me
+        }
+    }
 
-            } else if (earliest->first <= clock::now()) {
-                // A Timer is ready to fire, so remove it and call the callback:
-                auto timer = earliest->second;
-                timer->_triggered = true;
-                _unschedule(timer);
-
-                // Fire the timer, while not holding the mutex (to avoid deadlocks if the
-                // timer callback calls the Timer API.)
-                lock.unlock();
-                try {
-                    timer->_callback();
-                } catch (...) { }
-                timer->_triggered = false;                   // note: not holding any lock
-                if (timer->_autoDelete)
-                    delete timer;
-                lock.lock();
 
+    // Calls an entry's Timer or DelayedCall. The entry must already have been removed.
+    // Precondition: _mutex must be locked. (It's unlocked during the call, to avoid deadlocks
+    // if the callback calls the Timer API.)
+    void Timer::Manager::fire(Entry *entry, unique_lock<mutex> &lock) {
+        if (Timer *timer = entry->timer; timer) {
+            timer->_triggered = true;
+            timer->_state = kUnscheduled;
+            timer->_fireTime = time();
+            lock.unlock();
+            try {
+                timer->_callback();
+            } catch (...) { }
+            timer->_triggered = false;                   // note: not holding any lock
+            if (timer->_autoDelete)
+                delete timer;
+            lock.lock();
+        } else {
+            // Recycle the DelayedCall first, so it's free by the time the message is handled:
+            auto call = static_cast<DelayedCall*>(entry);
+            auto fn = call->fn;
+            void *context = call->context;
+            ActorMessage msg = move(call->msg);
+            if (_freeCallCount < kMaxFreeCalls) {
+                call->next = _freeCalls;
+                _freeCalls = call;
+                ++_freeCallCount;
             } else {
-                // Wait for the first timer's fireTime, or until the _schedule is updated:
-                auto nextFireTime = earliest->first;
-                _condition.wait_until(lock, nextFireTime);
+                delete call;
             }
+            lock.unlock();
+            try {
+                fn(context, msg);
+            } catch (...) { }
+            msg.reset();
+            lock.lock();
         }
     }
 
 
-    // Removes a Timer from _scheduled. Returns true if the next fire time is affected.
+    // Removes a Timer from the wheel. Returns true if it was scheduled.
     // Precondition: _mutex must be locked.
-    // Postconditions: timer is not in _scheduled. timer->_state != kScheduled.
+    // Postconditions: timer is not in the wheel. timer->_state != kScheduled.
     bool Timer::Manager::_unschedule(Timer *timer) {
         if (timer->_state != kScheduled)
             return false;
-        bool affectsTiming = (timer->_entry == _schedule.begin());
-        _schedule.erase(timer->_entry);
-        timer->_entry = _schedule.end();
+        remove(&timer->_entry);
+        --_count;
         timer->_state = kUnscheduled;
         timer->_fireTime = time();
-        return affectsTiming && !_schedule.empty();
+        return true;
     }
 
 
     // Unschedules a timer, preventing it from firing if it hasn't been triggered yet.
     // (Called by Timer::stop())
     // Precondition: _mutex must NOT be locked.
-    // Postcondition: timer is not in _scheduled. timer->_state != kScheduled.
+    // Postcondition: timer is not in the wheel. timer->_state != kScheduled.
     void Timer::Manager::unschedule(Timer *timer, bool deleting) {
         unique_lock<mutex> lock(_mutex);
-        if (_unschedule(timer))
-            _condition.notify_one();        // wakes up run() so it can recalculate its wait time
+        _unschedule(timer);     // (If the thread wakes up early as a result, it's harmless)
 
         if (deleting) {
             timer->_state = kDeleted;
@@ -108,7 +328,7 @@ namespace litecore { namespace actor {
     // Schedules or re-schedules a timer. (Called by Timer::fireAt/fireAfter())
     // If `earlier` is true, it will only move the fire time closer, else it returns `false`.
     // Precondition: _mutex must NOT be locked.
-    // Postcondition: timer is in _scheduled. timer->_state == kScheduled.
+    // Postcondition: timer is in the wheel. timer->_state == kScheduled.
     bool Timer::Manager::setFireTime(Timer *timer, clock::time_point when, bool earlier) {
         unique_lock<mutex> lock(_mutex);
         // Don't allow timer's callback to reschedule itself when deletion is pending:
@@ -116,14 +336,53 @@ namespace litecore { namespace actor {
             return false;
         if (earlier && timer->scheduled() && when >= timer->_fireTime)
             return false;
-        bool notify = _unschedule(timer);
-        timer->_entry = _schedule.insert({when, timer});
+        _unschedule(timer);
+        timer->_entry.tick = tickAt(when);
+        insert(&timer->_entry);
+        ++_count;
         timer->_state = kScheduled;
         timer->_fireTime = when;
-        if (timer->_entry == _schedule.begin() || notify)
+        if (timer->_entry.tick < _wakeTick)
             _condition.notify_one();        // wakes up run() so it can recalculate its wait time
         return true;
     }
 
 
+    // Schedules a one-shot DelayedCall. (Called by Timer::callAfter())
+    void Timer::Manager::callAfter(duration d, void (*fn)(void*, ActorMessage&), void *context,
+                                   ActorMessage msg)
+    {
+        auto fireTime = clock::now() + d;
+        unique_lock<mutex> lock(_mutex);
+        DelayedCall *call = _freeCalls;
+        if (call) {
+            _freeCalls = static_cast<DelayedCall*>(call->next);
+            --_freeCallCount;
+        } else {
+            call = new DelayedCall;
+            ++_callsAllocated;
+        }
+        call->fn = fn;
+        call->context = context;
+        call->msg = move(msg);
+        call->tick = tickAt(fireTime);
+        insert(call);
+        ++_count;
+        if (call->tick < _wakeTick)
+            _condition.notify_one();
+    }
+
+
+    size_t Timer::Manager::count() {
+        lock_guard<mutex> lock(_mutex);
+        return _count;
+    }
+
+
+    size_t Timer::Manager::callsAllocated() {
+        lock_guard<mutex> lock(_mutex);
+        return _callsAllocated;
+    }
+
+
 } }
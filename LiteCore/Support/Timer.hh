@@ -17,10 +17,11 @@
 //
 
 #pragma once
+#include "ActorMessage.hh"
 #include <atomic>
 #include <chrono>
+#include <cstdint>
 #include <functional>
-#include <map>
 #include <mutex>
 #include <thread>
 #include <condition_variable>
@@ -39,7 +40,7 @@ namespace litecore { namespace actor {
             The call happens on an unspecified background thread.
             It should not block, or it will delay all other timers from firing.
             It may call the Timer API, including re-scheduling itself. */
-        Timer(callback cb)              :_callback(cb) { }
+        Timer(callback cb)              :_callback(cb) {_entry.timer = this;}
 
         /** Destructs a timer. If the timer was scheduled, and the destructor is called just as
             it fires, it is possible for the callback to be running (on another thread) while this
@@ -82,30 +83,83 @@ namespace litecore { namespace actor {
         /** Is the timer active: waiting to fire or in the act of firing? */
         bool scheduled() const          {return _state == kScheduled || _triggered;}
 
+        /** A one-shot alternative to an auto-deleting Timer: after the delay, calls
+            `fn(context, msg)` on the timer thread. It can't be cancelled. In the steady state
+            this doesn't allocate any memory, so it's suitable for frequent delayed messages. */
+        static void callAfter(duration,
+                              void (*fn)(void *context, ActorMessage&),
+                              void *context,
+                              ActorMessage msg);
+
+        /** The number of scheduled Timers and delayed calls. */
+        static size_t scheduledCount();
+
+        /** The number of delayed calls allocated so far; since they're recycled, this stops
+            growing once enough have been made. (For tests.) */
+        static size_t delayedCallsAllocated();
+
     private:
 
         enum state : uint8_t {
             kUnscheduled,               // Idle
-            kScheduled,                 // In _scheduled queue, waiting to fire
+            kScheduled,                 // In the Manager's timer wheel, waiting to fire
             kDeleted,                   // Destructor called, waiting for fire to complete
         };
 
-        /** Internal singleton that tracks all scheduled Timers and runs a background thread. */
+        /** A node in a list of the Manager's timer wheel. */
+        struct Entry {
+            Entry*      prev {nullptr};
+            Entry*      next {nullptr};
+            uint64_t    tick {0};           // Wheel tick (ms since Manager started) to fire at
+            uint8_t     level {0};          // Wheel level and slot of the list I'm in
+            uint8_t     slot {0};
+            Timer*      timer {nullptr};    // Owning Timer, or null for a DelayedCall
+        };
+
+        struct DelayedCall;
+
+        /** Internal singleton that tracks all scheduled Timers and runs a background thread.
+            Timers are kept in a hierarchical timer wheel, so scheduling or unscheduling one
+            takes constant time regardless of how many are scheduled. */
         class Manager {
         public:
-            using map = std::multimap<time, Timer*>;
-            
             Manager();
             bool setFireTime(Timer*, time, bool ifEarlier =false);
             void unschedule(Timer*, bool deleting =false);
-            
+            void callAfter(duration, void (*fn)(void*, ActorMessage&), void*, ActorMessage);
+            size_t count();
+            size_t callsAllocated();
+
         private:
+            static constexpr unsigned kLevelBits = 6;
+            static constexpr unsigned kSlots     = 1 << kLevelBits;     // Slots per level
+            static constexpr unsigned kLevels    = 5;       // Covers 2^30 ms, about 12 days
+            static constexpr uint8_t  kDueLevel  = kLevels; // `level` of entries in _due
+
+            uint64_t tickAt(time) const;
+            time timeOfTick(uint64_t) const;
+            Entry*& listHead(uint8_t level, uint8_t slot);
+            void insert(Entry*);
+            void remove(Entry*);
             bool _unschedule(Timer*);
+            void advanceTo(uint64_t tick);
+            uint64_t nextEventTick() const;
+            void fire(Entry*, std::unique_lock<std::mutex>&);
             void run();
 
-            map _schedule;                      // A priority queue of Timers ordered by time
-            std::mutex _mutex;                  // Thread-safety for _schedule
-            std::condition_variable _condition; // Used to signal that _schedule has changed
+            time const _epoch;                  // Time of tick 0
+            Entry* _wheel[kLevels][kSlots] {};  // Lists of entries; slot index is a tick's
+                                                //   6-bit digit at that level
+            uint64_t _occupied[kLevels] {};     // Bitmaps of the non-empty slots in _wheel
+            Entry* _due {nullptr};              // Entries whose time has come
+            uint64_t _now {0};                  // The next tick to process
+            uint64_t _wakeTick {UINT64_MAX};    // When the thread will next wake up
+            size_t _count {0};                  // Number of entries in the wheel or _due
+            DelayedCall* _freeCalls {nullptr};  // Recycled DelayedCalls
+            size_t _freeCallCount {0};
+            size_t _callsAllocated {0};         // Number of DelayedCalls ever allocated
+            std::mutex _mutex;                  // Thread-safety for everything above
+            std::condition_variable _condition; // Used to signal that _wakeTick has changed
             std::thread _thread;                // Bg thread that waits & fires Timers
         };
 
@@ -117,7 +171,7 @@ namespace litecore { namespace actor {
         std::atomic<state> _state {kUnscheduled};   // Current state
         std::atomic<bool> _triggered {false};   // True while callback is being called
         bool _autoDelete {false};               // If true, delete after firing
-        Manager::map::iterator _entry;          // My map entry in Manager::_schedule
+        Entry _entry;                           // My entry in the Manager's timer wheel
     };
 
 } }
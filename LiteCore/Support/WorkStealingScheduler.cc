@@ -0,0 +1,332 @@
+//
+// WorkStealingScheduler.cc
+//
+// Copyright (c) 2021 Couchbase, Inc All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "WorkStealingScheduler.hh"
+#ifndef ACTORS_USE_GCD
+#include "ThreadUtil.hh"
+#include "Error.hh"
+#include "Logging.hh"
+#include <stdio.h>
+
+using namespace std;
+
+namespace litecore { namespace actor {
+
+    // Every this many Mailboxes, a thread looks at its oldest work first, so that a group of
+    // Actors that keep messaging each other can't starve the rest of its queue.
+    static constexpr unsigned kFairnessInterval = 61;
+
+    static constexpr size_t kInitialDequeCapacity = 256;
+
+
+#pragma mark - DEQUE:
+
+
+    /** A Chase-Lev work-stealing deque. (See "Correct and Efficient Work-Stealing for Weak
+        Memory Models", Lê et al, PPoPP 2013.) Only the owning thread can push and pop, at the
+        bottom; any thread can steal from the top. */
+    class WorkStealingScheduler::Deque {
+    public:
+        Deque()
+        :_array(new Array(kInitialDequeCapacity))
+        { }
+
+        ~Deque() {
+            delete _array.load();
+        }
+
+        /** Adds a Mailbox at the bottom. Only the owner thread may call this. */
+        void push(ThreadedMailbox *mbox) {
+            int64_t b = _bottom.load(memory_order_relaxed);
+            int64_t t = _top.load(memory_order_acquire);
+            Array *a = _array.load(memory_order_relaxed);
+            if (b - t > int64_t(a->mask)) {
+                // Full; grow. Thieves may still be reading the old array, so it's kept until
+                // this Deque is destroyed.
+                _retired.emplace_back(a);
+                a = a->grow(t, b);
+                _array.store(a, memory_order_release);
+            }
+            a->put(b, mbox);
+            atomic_thread_fence(memory_order_release);
+            _bottom.store(b + 1, memory_order_relaxed);
+        }
+
+        /** Removes the Mailbox at the bottom (the newest), or returns nullptr if empty.
+            Only the owner thread may call this. */
+        ThreadedMailbox* pop() {
+            int64_t b = _bottom.load(memory_order_relaxed) - 1;
+            Array *a = _array.load(memory_order_relaxed);
+            _bottom.store(b, memory_order_relaxed);
+            atomic_thread_fence(memory_order_seq_cst);
+            int64_t t = _top.load(memory_order_relaxed);
+            ThreadedMailbox *mbox = nullptr;
+            if (t <= b) {
+                mbox = a->get(b);
+                if (t == b) {
+                    // Last item; race any thieves for it:
+                    if (!_top.compare_exchange_strong(t, t + 1, memory_order_seq_cst,
+                                                      memory_order_relaxed))
+                        mbox = nullptr;
+                    _bottom.store(b + 1, memory_order_relaxed);
+                }
+            } else {
+                _bottom.store(b + 1, memory_order_relaxed);
+            }
+            return mbox;
+        }
+
+        /** Removes the Mailbox at the top (the oldest.) Returns nullptr if the deque is empty,
+            or if another thread took that Mailbox first. Any thread may call this. */
+        ThreadedMailbox* steal() {
+            int64_t t = _top.load(memory_order_acquire);
+            atomic_thread_fence(memory_order_seq_cst);
+            int64_t b = _bottom.load(memory_order_acquire);
+            if (t >= b)
+                return nullptr;
+            Array *a = _array.load(memory_order_acquire);
+            ThreadedMailbox *mbox = a->get(t);
+            if (!_top.compare_exchange_strong(t, t + 1, memory_order_seq_cst,
+                                              memory_order_relaxed))
+                return nullptr;
+            return mbox;
+        }
+
+        bool empty() const {
+            return _top.load(memory_order_acquire) >= _bottom.load(memory_order_acquire);
+        }
+
+    private:
+        struct Array {
+            explicit Array(size_t capacity)
+            :mask(capacity - 1)
+            ,items(new atomic<ThreadedMailbox*>[capacity])
+            { }
+
+            ThreadedMailbox* get(int64_t i) const {
+                return items[size_t(i) & mask].load(memory_order_relaxed);
+            }
+
+            void put(int64_t i, ThreadedMailbox *mbox) {
+                items[size_t(i) & mask].store(mbox, memory_order_relaxed);
+            }
+
+            Array* grow(int64_t top, int64_t bottom) const {
+                auto a = new Array(2 * (mask + 1));
+                for (int64_t i = top; i < bottom; ++i)
+                    a->put(i, get(i));
+                return a;
+            }
+
+            size_t const                            mask;
+            unique_ptr<atomic<ThreadedMailbox*>[]>  items;
+        };
+
+        alignas(64) atomic<int64_t>     _top {0};
+        alignas(64) atomic<int64_t>     _bottom {0};
+        atomic<Array*>                  _array;
+        vector<unique_ptr<Array>>       _retired;       // Outgrown arrays; owner-only
+    };
+
+
+    struct WorkStealingScheduler::Worker {
+        Worker(WorkStealingScheduler *o, uint32_t seed)   :owner(o), randomState(seed | 1) { }
+
+        // A cheap xorshift PRNG, for picking which thread to steal from
+        uint32_t random() {
+            randomState ^= randomState << 13;
+            randomState ^= randomState >> 17;
+            randomState ^= randomState << 5;
+            return randomState;
+        }
+
+        Deque                           deque;
+        WorkStealingScheduler* const    owner;
+        uint32_t                        randomState;
+        unsigned                        tick {0};
+    };
+
+
+    thread_local WorkStealingScheduler::Worker* WorkStealingScheduler::sCurrentWorker;
+
+
+#pragma mark - SCHEDULER:
+
+
+    WorkStealingScheduler::WorkStealingScheduler(unsigned numThreads)
+    :Scheduler(numThreads)
+    {
+        resolveNumThreads();
+        for (unsigned i = 0; i <= _numThreads; ++i)
+            _workers.emplace_back(new Worker(this, 2654435761u * (i + 1)));
+    }
+
+
+    WorkStealingScheduler::~WorkStealingScheduler() {
+        DebugAssert(_threadPool.empty());
+    }
+
+
+    void WorkStealingScheduler::start() {
+        if (!_started.test_and_set()) {
+            LogTo(ActorLog, "Starting WorkStealingScheduler<%p> with %u threads",
+                  this, _numThreads);
+            _stopping = false;
+            for (unsigned id = 1; id <= _numThreads; id++)
+                _threadPool.emplace_back([this,id]{task(id);});
+        }
+    }
+
+
+    void WorkStealingScheduler::stop() {
+        LogTo(ActorLog, "Stopping WorkStealingScheduler<%p>...", this);
+        {
+            lock_guard<mutex> lock(_parkMutex);
+            _stopping = true;
+            _parkCond.notify_all();
+        }
+        for (auto &t : _threadPool)
+            t.join();
+        _threadPool.clear();
+        LogTo(ActorLog, "WorkStealingScheduler<%p> has stopped", this);
+        _started.clear();
+    }
+
+
+    void WorkStealingScheduler::_schedule(ThreadedMailbox *mbox) {
+        Worker *worker = sCurrentWorker;
+        ActorPriority priority = mbox->priority();
+        if (worker && worker->owner == this && priority == ActorPriority::Normal) {
+            worker->deque.push(mbox);
+        } else {
+            auto p = unsigned(priority);
+            lock_guard<mutex> lock(_injectedMutex);
+            _injected[p].push_back(mbox);
+            _injectedCount[p].fetch_add(1, memory_order_relaxed);
+        }
+        // Pairs with the fence in park(): either a parking thread sees the new work, or I see
+        // that it's parked and wake it.
+        atomic_thread_fence(memory_order_seq_cst);
+        if (_parkedCount.load(memory_order_relaxed) > 0)
+            wakeOne();
+    }
+
+
+    void WorkStealingScheduler::task(unsigned taskID) {
+        LogVerbose(ActorLog, "   task %d starting", taskID);
+        char name[100];
+        sprintf(name, "CBL Scheduler#%u", taskID);
+        SetThreadName(name);
+        Worker &worker = *_workers[taskID];
+        sCurrentWorker = &worker;
+        while (true) {
+            if (ThreadedMailbox *mailbox = findWork(worker); mailbox) {
+                LogVerbose(ActorLog, "   task %d calling Actor<%p>", taskID, mailbox);
+                performNextMessage(mailbox);
+            } else if (_stopping.load() && !hasWork()) {
+                break;
+            } else {
+                park();
+            }
+        }
+        sCurrentWorker = nullptr;
+        LogTo(ActorLog, "   task %d finished", taskID);
+    }
+
+
+    ThreadedMailbox* WorkStealingScheduler::findWork(Worker &worker) {
+        if (++worker.tick % kFairnessInterval == 0) {
+            // Look at the oldest, lowest-priority work first:
+            for (unsigned p = 0; p < kNumActorPriorities; ++p) {
+                if (auto mbox = popInjected(ActorPriority(p)); mbox)
+                    return mbox;
+            }
+            if (auto mbox = worker.deque.steal(); mbox)
+                return mbox;
+        }
+        if (auto mbox = popInjected(ActorPriority::Interactive); mbox)
+            return mbox;
+        if (auto mbox = worker.deque.pop(); mbox)
+            return mbox;
+        if (auto mbox = popInjected(ActorPriority::Normal); mbox)
+            return mbox;
+        if (auto mbox = steal(worker); mbox)
+            return mbox;
+        return popInjected(ActorPriority::Background);
+    }
+
+
+    ThreadedMailbox* WorkStealingScheduler::popInjected(ActorPriority priority) {
+        auto p = unsigned(priority);
+        if (_injectedCount[p].load(memory_order_relaxed) == 0)
+            return nullptr;
+        lock_guard<mutex> lock(_injectedMutex);
+        if (_injected[p].empty())
+            return nullptr;
+        ThreadedMailbox *mbox = _injected[p].front();
+        _injected[p].pop_front();
+        _injectedCount[p].fetch_sub(1, memory_order_relaxed);
+        return mbox;
+    }
+
+
+    ThreadedMailbox* WorkStealingScheduler::steal(Worker &thief) {
+        auto n = _workers.size();
+        auto start = thief.random() % n;
+        for (size_t i = 0; i < n; ++i) {
+            Worker *victim = _workers[(start + i) % n].get();
+            if (victim == &thief)
+                continue;
+            if (auto mbox = victim->deque.steal(); mbox)
+                return mbox;
+        }
+        return nullptr;
+    }
+
+
+    bool WorkStealingScheduler::hasWork() const {
+        for (auto &count : _injectedCount) {
+            if (count.load(memory_order_relaxed) > 0)
+                return true;
+        }
+        for (auto &worker : _workers) {
+            if (!worker->deque.empty())
+                return true;
+        }
+        return false;
+    }
+
+
+    void WorkStealingScheduler::park() {
+        unique_lock<mutex> lock(_parkMutex);
+        _parkedCount.fetch_add(1, memory_order_relaxed);
+        atomic_thread_fence(memory_order_seq_cst);
+        // Look once more, now that any thread scheduling work will see I'm parked:
+        if (!hasWork() && !_stopping.load())
+            _parkCond.wait(lock);
+        _parkedCount.fetch_sub(1, memory_order_relaxed);
+    }
+
+
+    void WorkStealingScheduler::wakeOne() {
+        lock_guard<mutex> lock(_parkMutex);
+        _parkCond.notify_one();
+    }
+
+} }
+#endif
@@ -0,0 +1,81 @@
+//
+// WorkStealingScheduler.hh
+//
+// Copyright (c) 2021 Couchbase, Inc All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#pragma once
+#include "ThreadedMailbox.hh"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#ifndef ACTORS_USE_GCD
+namespace litecore { namespace actor {
+
+    /** A Scheduler whose threads each have their own queue of Mailboxes, so they don't all
+        contend for one lock.
+
+        A Mailbox scheduled by a scheduler thread (typically because one Actor sent a message
+        to another) goes on that thread's queue, and the thread runs the most recently queued
+        Mailbox first, which is likely still in its CPU cache. A Mailbox scheduled by any other
+        thread goes on a shared "injection" queue. A thread with nothing to do takes from the
+        injection queue, or else steals the oldest Mailbox from another thread's queue; if it
+        still finds nothing it parks until more work is scheduled.
+
+        Only Mailboxes of Normal priority go on the per-thread queues. Interactive and
+        Background ones always go on injection queues of their own; a thread checks the
+        Interactive queue before anything else, and the Background one only when it's found no
+        other work. */
+    class WorkStealingScheduler : public Scheduler {
+    public:
+        WorkStealingScheduler(unsigned numThreads =0);
+        ~WorkStealingScheduler();
+
+        void start() override;
+        void stop() override;
+
+    protected:
+        void _schedule(ThreadedMailbox*) override;
+        void task(unsigned taskID) override;
+
+    private:
+        class Deque;
+        struct Worker;
+
+        ThreadedMailbox* findWork(Worker&);
+        ThreadedMailbox* popInjected(ActorPriority);
+        ThreadedMailbox* steal(Worker&);
+        bool hasWork() const;
+        void park();
+        void wakeOne();
+
+        std::vector<std::unique_ptr<Worker>> _workers;  // [0] is for runSynchronous
+        std::mutex                  _injectedMutex;
+        std::deque<ThreadedMailbox*> _injected[kNumActorPriorities];     // Indexed by priority
+        std::atomic<size_t>         _injectedCount[kNumActorPriorities] {};
+        std::mutex                  _parkMutex;
+        std::condition_variable     _parkCond;
+        std::atomic<unsigned>       _parkedCount {0};
+        std::atomic<bool>           _stopping {false};
+
+        static thread_local Worker* sCurrentWorker;
+    };
+
+} }
+#endif
@@ -0,0 +1,800 @@
+//
+// ActorTest.cc
+//
+// Copyright (c) 2021 Couchbase, Inc All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "LiteCoreTest.hh"
+#include "Actor.hh"
+#include "ActorMetrics.hh"
+#include "ActorTask.hh"
+#include "MPSCQueue.hh"
+#include "Stopwatch.hh"
+#include "Timer.hh"
+#include "fleece/Fleece.hh"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <stdio.h>
+#include <thread>
+#include <vector>
+
+using namespace std;
+using namespace litecore;
+using namespace litecore::actor;
+using namespace fleece;
+
+
+#ifndef ACTORS_USE_GCD
+
+namespace {
+
+    class RingActor;
+
+    // A ring of Actors that pass tokens around; each token is forwarded a fixed number of
+    // times. This is a rough model of a replicator's actors sending each other messages.
+    class ActorRing {
+    public:
+        ActorRing(unsigned numActors);
+        ~ActorRing();
+
+        // Injects `numTokens` tokens (from the current, non-scheduler thread), each of which
+        // will hop `hops` times, and waits until they've all finished.
+        void run(unsigned numTokens, unsigned hops);
+
+        uint64_t messagesHandled() const        {return _messages;}
+
+    private:
+        friend class RingActor;
+        void tokenFinished();
+
+        vector<Retained<RingActor>> _actors;
+        atomic<uint64_t>            _messages {0};
+        mutex                       _mutex;
+        condition_variable          _cond;
+        unsigned                    _tokensLeft {0};
+    };
+
+
+    class RingActor : public Actor {
+    public:
+        RingActor(ActorRing *ring, unsigned index)
+        :Actor(ActorLog, "RingActor")
+        ,_ring(ring)
+        ,_index(index)
+        { }
+
+        void token(unsigned hopsLeft)           {enqueue(FUNCTION_TO_QUEUE(RingActor::_token), hopsLeft);}
+
+    private:
+        void _token(unsigned hopsLeft) {
+            ++_ring->_messages;
+            if (hopsLeft == 0) {
+                _ring->tokenFinished();
+            } else {
+                auto &actors = _ring->_actors;
+                actors[(_index + 1) % actors.size()]->token(hopsLeft - 1);
+            }
+        }
+
+        ActorRing* const _ring;
+        unsigned const _index;
+    };
+
+
+    ActorRing::ActorRing(unsigned numActors) {
+        for (unsigned i = 0; i < numActors; ++i)
+            _actors.push_back(make_retained<RingActor>(this, i));
+    }
+
+
+    ActorRing::~ActorRing() {
+        for (auto &actor : _actors)
+            actor->waitTillCaughtUp();
+    }
+
+
+    void ActorRing::run(unsigned numTokens, unsigned hops) {
+        _tokensLeft = numTokens;
+        for (unsigned i = 0; i < numTokens; ++i)
+            _actors[i % _actors.size()]->token(hops);
+        unique_lock<mutex> lock(_mutex);
+        _cond.wait(lock, [&]{return _tokensLeft == 0;});
+    }
+
+
+    void ActorRing::tokenFinished() {
+        lock_guard<mutex> lock(_mutex);
+        if (--_tokensLeft == 0)
+            _cond.notify_all();
+    }
+
+
+    // Temporarily makes a new Scheduler the shared one.
+    class SchedulerSwap {
+    public:
+        SchedulerSwap(Scheduler::Kind kind, unsigned numThreads)
+        :_scheduler(Scheduler::create(kind, numThreads))
+        {
+            _previous = Scheduler::replaceSharedScheduler(_scheduler.get());
+        }
+
+        ~SchedulerSwap() {
+            Scheduler::replaceSharedScheduler(_previous);
+            _scheduler->stop();
+        }
+
+    private:
+        unique_ptr<Scheduler> _scheduler;
+        Scheduler* _previous;
+    };
+
+
+    // An Actor that appends integers to a shared log.
+    class RecordingActor : public Actor {
+    public:
+        RecordingActor(vector<int> &log, mutex &logMutex,
+                       ActorPriority priority =ActorPriority::Normal)
+        :Actor(ActorLog, "RecordingActor")
+        ,_log(log)
+        ,_logMutex(logMutex)
+        {
+            setPriority(priority);
+        }
+
+        void record(int value)                  {enqueue(FUNCTION_TO_QUEUE(RecordingActor::_record), value);}
+        void recordAfter(delay_t d, int value)  {enqueueAfter(d, FUNCTION_TO_QUEUE(RecordingActor::_record), value);}
+        void wait(shared_future<void> *f)       {enqueue(FUNCTION_TO_QUEUE(RecordingActor::_wait), f);}
+
+        // Waits until the log has at least `n` values; returns false if the timeout expires.
+        bool waitForLog(size_t n, chrono::milliseconds timeout) {
+            unique_lock<mutex> lock(_logMutex);
+            return _logged.wait_for(lock, timeout, [&] {return _log.size() >= n;});
+        }
+
+    private:
+        void _record(int value) {
+            lock_guard<mutex> lock(_logMutex);
+            _log.push_back(value);
+            _logged.notify_all();
+        }
+
+        void _wait(shared_future<void> *f)      {f->wait();}
+
+        vector<int> &_log;
+        mutex &_logMutex;
+        condition_variable _logged;
+    };
+
+
+    // An Actor whose messages keep track of how many Actors sharing a parent Mailbox run at once.
+    class ConcurrencyActor : public Actor {
+    public:
+        ConcurrencyActor(Mailbox *parent, atomic<int> &running, atomic<int> &maxRunning)
+        :Actor(ActorLog, "ConcurrencyActor", parent)
+        ,_running(running)
+        ,_maxRunning(maxRunning)
+        { }
+
+        void work()                             {enqueue(FUNCTION_TO_QUEUE(ConcurrencyActor::_work));}
+
+        int workDone() const                    {return _workDone;}
+
+    private:
+        void _work() {
+            int running = ++_running;
+            int prevMax = _maxRunning;
+            while (running > prevMax && !_maxRunning.compare_exchange_weak(prevMax, running))
+                ;
+            this_thread::sleep_for(chrono::microseconds(200));
+            --_running;
+            ++_workDone;
+        }
+
+        atomic<int> &_running, &_maxRunning;
+        atomic<int> _workDone {0};
+    };
+
+
+    class CountingActor : public Actor {
+    public:
+        CountingActor()                         :Actor(ActorLog, "CountingActor") { }
+
+        void add(int n, alloc_slice data)       {enqueue(FUNCTION_TO_QUEUE(CountingActor::_add), n, data);}
+        void wait(shared_future<void> *f)       {enqueue(FUNCTION_TO_QUEUE(CountingActor::_wait), f);}
+
+        int64_t total() const                   {return _total;}
+        size_t queueSegmentsAllocated() const   {return mailbox().queueSegmentsAllocated();}
+
+    private:
+        void _add(int n, alloc_slice data)      {_total += n + data.size;}
+        void _wait(shared_future<void> *f)      {f->wait();}
+
+        atomic<int64_t> _total {0};
+    };
+
+}
+
+
+TEST_CASE("ActorMessage", "[Actor]") {
+    int calls = 0;
+    ActorMessage small([&]{ ++calls; });
+    CHECK(small.isInline());
+
+    char bigData[ActorMessage::kInlineSize] = {};
+    ActorMessage big([&calls, bigData]{ calls += 1 + bigData[0]; });
+    CHECK(!big.isInline());
+
+    ActorMessage moved(move(small));
+    CHECK(!small);
+    CHECK(moved.isInline());
+    moved();
+    big();
+    CHECK(calls == 2);
+
+    // Move-only callables work:
+    auto ptr = make_unique<int>(40);
+    ActorMessage owner([&calls, ptr = move(ptr)]{ calls += *ptr; });
+    owner = move(big);
+    big = ActorMessage([&calls, ptr = make_unique<int>(40)]{ calls += *ptr; });
+    big();
+    CHECK(calls == 42);
+}
+
+
+TEST_CASE("MPSCQueue", "[Actor]") {
+    static constexpr int kNumProducers = 4, kPerProducer = 20000;
+    MPSCQueue<pair<int,int>> queue;
+    CHECK(queue.empty());
+    CHECK(queue.push({-1, 0}));
+    CHECK(!queue.push({-1, 1}));
+    CHECK(queue.size() == 2);
+    CHECK(queue.front() == make_pair(-1, 0));
+    CHECK(!queue.pop());
+    CHECK(queue.front() == make_pair(-1, 1));
+    CHECK(queue.pop());
+    CHECK(queue.empty());
+
+    // Items are stored in segments, so a push only allocates when it fills one:
+    {
+        MPSCQueue<int> q;
+        for (int i = 0; i < 1000; ++i)
+            q.push(i);
+        CHECK(q.segmentsAllocated() == 1000 / 16 + 1);
+    }
+
+    // Several producers, and a consumer that runs only while the queue is non-empty, as a
+    // Mailbox does. Each producer's items have to arrive in order:
+    atomic<bool> consumerWanted {false};
+    vector<int> lastSeen(kNumProducers, -1);
+    bool outOfOrder = false;
+    int consumed = 0;
+    thread consumer([&] {
+        while (consumed < kNumProducers * kPerProducer) {
+            if (!consumerWanted.exchange(false)) {
+                this_thread::yield();
+                continue;
+            }
+            bool empty;
+            do {
+                auto [producer, value] = queue.front();
+                if (value != lastSeen[producer] + 1)
+                    outOfOrder = true;  // (Catch assertions aren't thread-safe)
+                lastSeen[producer] = value;
+                empty = queue.pop();
+                ++consumed;
+            } while (!empty);
+        }
+    });
+    vector<thread> producers;
+    for (int p = 0; p < kNumProducers; ++p) {
+        producers.emplace_back([&, p] {
+            for (int i = 0; i < kPerProducer; ++i) {
+                if (queue.push({p, i}))
+                    consumerWanted = true;
+            }
+        });
+    }
+    for (auto &t : producers)
+        t.join();
+    consumer.join();
+    CHECK(!outOfOrder);
+    CHECK(queue.empty());
+    for (int p = 0; p < kNumProducers; ++p)
+        CHECK(lastSeen[p] == kPerProducer - 1);
+}
+
+
+TEST_CASE("Actor enqueue doesn't allocate", "[Actor]") {
+    static constexpr int kNumMessages = 1000;
+    auto actor = make_retained<CountingActor>();
+    alloc_slice data("some data");
+
+    // Block the actor so the messages pile up in its queue:
+    promise<void> gate;
+    shared_future<void> gateFuture = gate.get_future().share();
+    actor->wait(&gateFuture);
+
+    // The messages are small enough to be stored inline in the queue, so the only allocations
+    // are the queue's segments, each of which holds several messages:
+    auto heapMessages = ActorMessage::heapAllocationCount();
+    auto segments = actor->queueSegmentsAllocated();
+    for (int i = 0; i < kNumMessages; ++i)
+        actor->add(1, data);
+    CHECK(ActorMessage::heapAllocationCount() == heapMessages);
+    CHECK(actor->queueSegmentsAllocated() - segments
+              <= kNumMessages / ThreadedMailbox::kQueueSegmentSize + 1);
+
+    gate.set_value();
+    actor->waitTillCaughtUp();
+    CHECK(actor->total() == int64_t(kNumMessages * (1 + data.size)));
+}
+
+
+TEST_CASE("WorkStealingScheduler", "[Actor]") {
+    static constexpr unsigned kNumTokens = 500, kHops = 100;
+    unsigned numThreads = GENERATE(1u, 2u, 4u);
+    SchedulerSwap swap(Scheduler::Kind::WorkStealing, numThreads);
+    {
+        ActorRing ring(50);
+        ring.run(kNumTokens, kHops);
+        CHECK(ring.messagesHandled() == kNumTokens * (kHops + 1));
+    }
+}
+
+
+TEST_CASE("ThreadedMailbox batching", "[Actor]") {
+    static constexpr unsigned kBatch = 8;
+    static constexpr int kFlood = 200;
+    auto savedLimits = ThreadedMailbox::batchLimits();
+    ThreadedMailbox::setBatchLimits({kBatch, chrono::microseconds(0)});
+    {
+        SchedulerSwap swap(Scheduler::Kind::SharedQueue, 1);
+        vector<int> log;
+        mutex logMutex;
+        auto flood = make_retained<RecordingActor>(log, logMutex);
+        auto other = make_retained<RecordingActor>(log, logMutex);
+
+        // Block the only scheduler thread in `flood` until it has a backlog of messages,
+        // and `other` is waiting its turn:
+        promise<void> gate;
+        shared_future<void> gateFuture = gate.get_future().share();
+        flood->wait(&gateFuture);
+        for (int i = 0; i < kFlood; ++i)
+            flood->record(i);
+        other->record(-1);
+        gate.set_value();
+        flood->waitTillCaughtUp();
+        other->waitTillCaughtUp();
+
+        // `flood` should have handled one batch, then yielded to `other`:
+        lock_guard<mutex> lock(logMutex);
+        REQUIRE(log.size() == kFlood + 1);
+        auto otherPos = find(log.begin(), log.end(), -1) - log.begin();
+        CHECK(otherPos == ptrdiff_t(kBatch) - 1);
+        log.erase(log.begin() + otherPos);
+        for (int i = 0; i < kFlood; ++i)
+            CHECK(log[i] == i);
+    }
+    ThreadedMailbox::setBatchLimits(savedLimits);
+}
+
+
+TEST_CASE("Actor priorities", "[Actor]") {
+    auto kind = GENERATE(Scheduler::Kind::SharedQueue, Scheduler::Kind::WorkStealing);
+    SchedulerSwap swap(kind, 1);
+    vector<int> log;
+    mutex logMutex;
+    auto blocker = make_retained<RecordingActor>(log, logMutex);
+    auto background = make_retained<RecordingActor>(log, logMutex, ActorPriority::Background);
+    auto normal = make_retained<RecordingActor>(log, logMutex);
+    auto interactive = make_retained<RecordingActor>(log, logMutex, ActorPriority::Interactive);
+
+    // Block the only scheduler thread while the others queue up; then they should run in
+    // order of priority, not in the order they were scheduled:
+    promise<void> gate;
+    shared_future<void> gateFuture = gate.get_future().share();
+    blocker->wait(&gateFuture);
+    background->record(1);
+    normal->record(2);
+    interactive->record(3);
+    gate.set_value();
+    for (auto actor : {blocker, background, normal, interactive})
+        actor->waitTillCaughtUp();
+    lock_guard<mutex> lock(logMutex);
+    CHECK(log == (vector<int>{3, 2, 1}));
+}
+
+
+TEST_CASE("Mailbox child concurrency", "[Actor]") {
+    static constexpr int kNumActors = 8, kMessagesPerActor = 10;
+    static constexpr unsigned kMaxConcurrency = 2;
+    auto kind = GENERATE(Scheduler::Kind::SharedQueue, Scheduler::Kind::WorkStealing);
+    SchedulerSwap swap(kind, 4);
+    Mailbox parent(nullptr, "parent");
+    parent.setPriority(ActorPriority::Background);
+    parent.setMaxChildConcurrency(kMaxConcurrency);
+    atomic<int> running {0}, maxRunning {0};
+    {
+        vector<Retained<ConcurrencyActor>> actors;
+        for (int i = 0; i < kNumActors; ++i)
+            actors.push_back(make_retained<ConcurrencyActor>(&parent, running, maxRunning));
+        for (int m = 0; m < kMessagesPerActor; ++m) {
+            for (auto &actor : actors)
+                actor->work();
+        }
+        for (auto &actor : actors)
+            actor->waitTillCaughtUp();
+        for (auto &actor : actors)
+            CHECK(actor->workDone() == kMessagesPerActor);
+    }
+    CHECK(maxRunning >= 1);
+    CHECK(maxRunning <= int(kMaxConcurrency));
+}
+
+
+TEST_CASE("Actor metrics", "[Actor]") {
+    static constexpr int kNumMessages = 1000;
+    auto metricsOf = [](Doc &doc, slice className) {
+        doc = Doc::fromJSON(ActorMetrics::allToJSON());
+        REQUIRE(doc);
+        return doc.asDict()[className].asDict();
+    };
+    Doc doc;
+    uint64_t messagesBefore = metricsOf(doc, "CountingActor"_sl)["messages"_sl].asUnsigned();
+
+    auto actor = make_retained<CountingActor>();
+    alloc_slice data("some data");
+    promise<void> gate;
+    shared_future<void> gateFuture = gate.get_future().share();
+    actor->wait(&gateFuture);
+    for (int i = 0; i < kNumMessages; ++i)
+        actor->add(1, data);
+    gate.set_value();
+    actor->waitTillCaughtUp();
+
+    // The messages are `wait`, the `add`s, and waitTillCaughtUp's own message. That last one is
+    // counted after it's woken this thread, so poll for it:
+    const uint64_t expectedMessages = messagesBefore + kNumMessages + 2;
+    Dict metrics;
+    auto deadline = chrono::steady_clock::now() + chrono::seconds(5);
+    do {
+        metrics = metricsOf(doc, "CountingActor"_sl);
+        REQUIRE(metrics);
+        if (metrics["messages"_sl].asUnsigned() >= expectedMessages)
+            break;
+        this_thread::sleep_for(chrono::milliseconds(1));
+    } while (chrono::steady_clock::now() < deadline);
+    INFO("Metrics: " << metrics.toJSONString());
+    CHECK(metrics["actors"_sl].asUnsigned() >= 1);
+    CHECK(metrics["messages"_sl].asUnsigned() == expectedMessages);
+    CHECK(metrics["queueDepth"_sl].asUnsigned() == 0);
+    CHECK(metrics["maxQueueDepth"_sl].asUnsigned() >= kNumMessages / 2);
+    CHECK(metrics["busySeconds"_sl].asDouble() > 0.0);
+    uint64_t latencySamples = 0;
+    for (Array::iterator i(metrics["queueLatency"_sl].asArray()); i; ++i)
+        latencySamples += i->asUnsigned();
+    CHECK(latencySamples >= kNumMessages / ActorMetrics::kLatencySampleInterval - 1);
+}
+
+
+TEST_CASE("Timer", "[Actor]") {
+    mutex logMutex;
+    vector<int> log;
+    auto record = [&](int n) {
+        lock_guard<mutex> lock(logMutex);
+        log.push_back(n);
+    };
+    Timer t1([&]{ record(1); }), t2([&]{ record(2); }), t3([&]{ record(3); }),
+          t4([&]{ record(4); }), t5([&]{ record(5); });
+    t1.fireAfter(chrono::milliseconds(60));
+    t2.fireAfter(chrono::milliseconds(20));
+    t3.fireAfter(chrono::milliseconds(40));
+    t4.fireAfter(chrono::milliseconds(30));
+    t5.fireAfter(chrono::hours(24 * 30));       // Far beyond the wheel's first levels
+    CHECK(t3.scheduled());
+    t3.stop();
+    CHECK(!t3.scheduled());
+    t4.fireAfter(chrono::milliseconds(80));     // Reschedule later
+    CHECK(t1.fireEarlierAfter(chrono::milliseconds(10)));
+    CHECK(!t2.fireEarlierAfter(chrono::milliseconds(500)));
+    CHECK(Timer::scheduledCount() >= 4);
+
+    this_thread::sleep_for(chrono::milliseconds(150));
+    {
+        lock_guard<mutex> lock(logMutex);
+        CHECK(log == (vector<int>{1, 2, 4}));
+    }
+    CHECK(!t1.scheduled());
+    CHECK(t5.scheduled());
+    t5.stop();
+}
+
+
+TEST_CASE("Actor delayed messages", "[Actor]") {
+    static constexpr int kNumMessages = 200;
+    vector<int> log;
+    mutex logMutex;
+    auto actor = make_retained<RecordingActor>(log, logMutex);
+    // (waitTillCaughtUp wouldn't do, since the messages aren't queued till they're due.)
+    for (int i : {4, 1, 3, 2})
+        actor->recordAfter(chrono::milliseconds(20 * i), i);
+    REQUIRE(actor->waitForLog(4, chrono::seconds(5)));
+    {
+        lock_guard<mutex> lock(logMutex);
+        CHECK(log == (vector<int>{1, 2, 3, 4}));
+        log.clear();
+    }
+
+    // After the first round, the Timer reuses its entries, so scheduling doesn't allocate:
+    size_t callsAllocated = 0;
+    uint64_t heapMessages = 0;
+    for (int round = 0; round < 2; ++round) {
+        callsAllocated = Timer::delayedCallsAllocated();
+        heapMessages = ActorMessage::heapAllocationCount();
+        for (int i = 0; i < kNumMessages; ++i)
+            actor->recordAfter(chrono::milliseconds(1 + i % 10), i);
+        REQUIRE(actor->waitForLog((round + 1) * kNumMessages, chrono::seconds(5)));
+    }
+    CHECK(Timer::delayedCallsAllocated() == callsAllocated);
+    CHECK(ActorMessage::heapAllocationCount() == heapMessages);
+    lock_guard<mutex> lock(logMutex);
+    CHECK(log.size() == 2 * kNumMessages);
+}
+
+
+TEST_CASE("Actor message dispatch performance", "[Actor][Perf][.slow]") {
+    static constexpr int kNumMessages = 1000000;
+    auto actor = make_retained<CountingActor>();
+    alloc_slice data("some data");
+    Stopwatch st;
+    for (int i = 0; i < kNumMessages; ++i)
+        actor->add(1, data);
+    actor->waitTillCaughtUp();
+    st.printReport("Enqueue and dispatch", kNumMessages, "message");
+    CHECK(actor->total() == int64_t(kNumMessages * (1 + data.size)));
+}
+
+
+TEST_CASE("Actor contended mailbox performance", "[Actor][Perf][.slow]") {
+    // Many threads sending messages to one Actor, like Workers messaging their Replicator:
+    static constexpr int kMessagesPerThread = 200000;
+    alloc_slice data("some data");
+    for (unsigned numThreads : {1u, 4u, 16u}) {
+        auto actor = make_retained<CountingActor>();
+        Stopwatch st;
+        vector<thread> producers;
+        for (unsigned t = 0; t < numThreads; ++t) {
+            producers.emplace_back([&] {
+                for (int i = 0; i < kMessagesPerThread; ++i)
+                    actor->add(1, data);
+            });
+        }
+        for (auto &t : producers)
+            t.join();
+        actor->waitTillCaughtUp();
+        double elapsed = st.elapsed();
+        int64_t total = int64_t(numThreads) * kMessagesPerThread;
+        CHECK(actor->total() == total * int64_t(1 + data.size));
+        fprintf(stderr, "%2u sending threads: %10.0f messages/sec\n",
+                numThreads, total / elapsed);
+    }
+}
+
+
+TEST_CASE("Timer performance", "[Actor][Perf][.slow]") {
+    // Lots of simultaneously scheduled Timers, like per-connection retry and keepalive timers:
+    static constexpr int kNumTimers = 100000;
+    atomic<int> fired {0};
+    vector<unique_ptr<Timer>> timers;
+    for (int i = 0; i < kNumTimers; ++i)
+        timers.emplace_back(new Timer([&]{ ++fired; }));
+    mt19937 random(12345);
+    auto randomDelay = [&](int maxMS) {return chrono::milliseconds(1000 + random() % maxMS);};
+
+    Stopwatch st;
+    for (auto &timer : timers)
+        timer->fireAfter(randomDelay(60000));
+    st.printReport("Scheduling", kNumTimers, "timer");
+    CHECK(Timer::scheduledCount() >= kNumTimers);
+
+    st.reset();
+    for (auto &timer : timers)
+        timer->fireAfter(randomDelay(60000));
+    st.printReport("Rescheduling", kNumTimers, "timer");
+
+    st.reset();
+    for (auto &timer : timers)
+        timer->stop();
+    st.printReport("Cancelling", kNumTimers, "timer");
+    CHECK(fired == 0);
+
+    // Now let them all fire, within a few seconds:
+    for (auto &timer : timers)
+        timer->fireAfter(chrono::milliseconds(random() % 2000));
+    st.reset();
+    while (fired < kNumTimers && st.elapsed() < 10.0)
+        this_thread::sleep_for(chrono::milliseconds(10));
+    CHECK(fired == kNumTimers);
+    fprintf(stderr, "All %d timers fired %.0fms after the last was due\n",
+            kNumTimers, st.elapsedMS() - 2000);
+}
+
+
+TEST_CASE("Actor throughput", "[Actor][Perf][.slow]") {
+    static constexpr unsigned kNumActors = 256, kNumTokens = 2048, kHops = 1000;
+    unsigned maxThreads = max(2u, thread::hardware_concurrency());
+    for (auto kind : {Scheduler::Kind::SharedQueue, Scheduler::Kind::WorkStealing}) {
+        const char *kindName = (kind == Scheduler::Kind::SharedQueue) ? "shared queue"
+                                                                      : "work stealing";
+        for (unsigned numThreads = 1; numThreads <= maxThreads; numThreads *= 2) {
+            SchedulerSwap swap(kind, numThreads);
+            ActorRing ring(kNumActors);
+            Stopwatch st;
+            ring.run(kNumTokens, kHops);
+            double elapsed = st.elapsed();
+            CHECK(ring.messagesHandled() == uint64_t(kNumTokens) * (kHops + 1));
+            fprintf(stderr, "%-14s %2u threads: %10.0f messages/sec\n",
+                    kindName, numThreads, ring.messagesHandled() / elapsed);
+        }
+    }
+}
+
+
+#ifdef ACTORS_SUPPORT_COROUTINES
+
+namespace {
+
+    // An Actor whose methods are coroutines, plus a callback-based equivalent.
+    class SquareActor : public Actor {
+    public:
+        SquareActor()                           :Actor(ActorLog, "SquareActor") { }
+
+        ActorTask<int64_t> square(int64_t n) {
+            if (currentActor() != this)
+                _wrongActor = true;
+            co_return n * n;
+        }
+
+        ActorTask<int64_t> fail() {
+            throw runtime_error("no squares today");
+            co_return 0;
+        }
+
+        void squareThen(int64_t n, function<void(int64_t)> callback) {
+            enqueue(FUNCTION_TO_QUEUE(SquareActor::_squareThen), n, callback);
+        }
+
+        bool wrongActor() const                 {return _wrongActor;}
+
+    private:
+        void _squareThen(int64_t n, function<void(int64_t)> callback) {
+            callback(n * n);
+        }
+
+        atomic<bool> _wrongActor {false};
+    };
+
+
+    // Sums squares by asking a SquareActor for each one in turn, one round trip at a time.
+    class SumActor : public Actor {
+    public:
+        SumActor(SquareActor *squarer)          :Actor(ActorLog, "SumActor"), _squarer(squarer) { }
+
+        ActorTask<int64_t> sumSquares(int64_t n) {
+            int64_t total = 0;
+            for (int64_t i = 0; i < n; ++i) {
+                total += co_await _squarer->square(i);
+                if (currentActor() != this)
+                    _wrongActor = true;
+            }
+            co_return total;
+        }
+
+        ActorTask<bool> catchFailure() {
+            try {
+                co_await _squarer->fail();
+            } catch (const runtime_error&) {
+                co_return currentActor() == this;
+            }
+            co_return false;
+        }
+
+        void sumSquaresWithCallbacks(int64_t n, function<void(int64_t)> onDone) {
+            enqueue(FUNCTION_TO_QUEUE(SumActor::_sumFrom), int64_t(0), n, int64_t(0), onDone);
+        }
+
+        bool wrongActor() const                 {return _wrongActor;}
+
+    private:
+        void _sumFrom(int64_t i, int64_t n, int64_t total, function<void(int64_t)> onDone) {
+            if (i == n) {
+                onDone(total);
+                return;
+            }
+            _squarer->squareThen(i, asynchronize("_sumFrom", [this, i, n, total, onDone](int64_t sq) {
+                _sumFrom(i + 1, n, total + sq, onDone);
+            }));
+        }
+
+        Retained<SquareActor> _squarer;
+        atomic<bool> _wrongActor {false};
+    };
+
+
+    // Blocks the (non-Actor) calling thread until an ActorTask finishes; returns its result.
+    template <class T>
+    T waitFor(ActorTask<T> task) {
+        auto result = make_shared<promise<T>>();
+        auto waiter = [](ActorTask<T> task, shared_ptr<promise<T>> result) -> ActorTask<void> {
+            try {
+                result->set_value(co_await task);
+            } catch (...) {
+                result->set_exception(current_exception());
+            }
+        };
+        waiter(std::move(task), result);
+        return result->get_future().get();
+    }
+
+
+    int64_t sumOfSquares(int64_t n) {
+        int64_t total = 0;
+        for (int64_t i = 0; i < n; ++i)
+            total += i * i;
+        return total;
+    }
+
+}
+
+
+TEST_CASE("ActorTask", "[Actor]") {
+    auto squarer = make_retained<SquareActor>();
+    auto summer = make_retained<SumActor>(squarer);
+
+    CHECK(waitFor(squarer->square(12)) == 144);
+    CHECK(waitFor(summer->sumSquares(1000)) == sumOfSquares(1000));
+    CHECK(waitFor(summer->catchFailure()));
+    CHECK_THROWS_AS(waitFor(squarer->fail()), runtime_error);
+
+    CHECK(!squarer->wrongActor());
+    CHECK(!summer->wrongActor());
+}
+
+
+TEST_CASE("ActorTask performance", "[Actor][Perf][.slow]") {
+    static constexpr int64_t kRoundTrips = 200000;
+    auto squarer = make_retained<SquareActor>();
+    auto summer = make_retained<SumActor>(squarer);
+
+    Stopwatch st;
+    CHECK(waitFor(summer->sumSquares(kRoundTrips)) == sumOfSquares(kRoundTrips));
+    st.printReport("Coroutine", kRoundTrips, "round trip");
+
+    st.reset();
+    promise<int64_t> result;
+    summer->sumSquaresWithCallbacks(kRoundTrips, [&](int64_t total) {result.set_value(total);});
+    CHECK(result.get_future().get() == sumOfSquares(kRoundTrips));
+    st.printReport("Callbacks", kRoundTrips, "round trip");
+}
+
+#endif // ACTORS_SUPPORT_COROUTINES
+
+#endif
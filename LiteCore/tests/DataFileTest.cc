@@ -117,6 +117,41 @@ N_WAY_TEST_CASE_METHOD (DataFileTestFixture, "DataFile CreateDoc", "[DataFile]")
 }
 
 
+N_WAY_TEST_CASE_METHOD (DataFileTestFixture, "DataFile Get With Callback", "[DataFile]") {
+    alloc_slice key("key");
+    {
+        Transaction t(db);
+        RecordLite rec;
+        rec.key = key;
+        rec.body = "body"_sl;
+        rec.version = "version"_sl;
+        rec.extra = "extra"_sl;
+        store->set(rec, t);
+        t.commit();
+    }
+
+    for (auto content : {kMetaOnly, kCurrentRevOnly, kEntireBody}) {
+        INFO("content = " << content);
+        int calls = 0;
+        bool found = store->get(key, content, [&](const RecordLite &rec) {
+            ++calls;
+            CHECK(rec.key == key);
+            CHECK(rec.sequence == 1);
+            CHECK(rec.version == "version"_sl);
+            CHECK(rec.body == (content >= kCurrentRevOnly ? "body"_sl : nullslice));
+            CHECK(rec.extra == (content >= kEntireBody ? "extra"_sl : nullslice));
+        });
+        CHECK(found);
+        CHECK(calls == 1);
+    }
+
+    bool found = store->get("nope"_sl, kEntireBody, [&](const RecordLite&) {
+        FAIL("Callback shouldn't be called for a nonexistent record");
+    });
+    CHECK(!found);
+}
+
+
 N_WAY_TEST_CASE_METHOD (DataFileTestFixture, "DataFile SaveDocs", "[DataFile]") {
     {
         //WORKAROUND: Add a rec before the main transaction so it doesn't start at sequence 0
@@ -196,9 +231,15 @@ N_WAY_TEST_CASE_METHOD (DataFileTestFixture, "DataFile EnumerateDocs", "[DataFil
             RecordEnumerator e(*store, opts);
             for (; e.next(); ++i) {
                 string expectedDocID = stringWithFormat("rec-%03d", i);
+                // The metadata is available without reading the body:
+                REQUIRE(e.recordMetadata().key() == alloc_slice(expectedDocID));
+                REQUIRE(e.recordMetadata().body() == nullslice);
+                REQUIRE(e.recordMetadata().bodySize() == expectedDocID.size());
                 REQUIRE(e->key() == alloc_slice(expectedDocID));
                 REQUIRE(e->sequence() == (sequence_t)i);
                 REQUIRE(e->bodySize() > 0); // even metaOnly should set the body size
+                if (!metaOnly)
+                    REQUIRE(e->body() == slice(expectedDocID));
             }
             REQUIRE(i == 101);
             REQUIRE_FALSE(e);
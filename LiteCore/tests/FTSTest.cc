@@ -200,6 +200,58 @@ TEST_CASE_METHOD(FTSTest, "Query Full-Text Stop-words In Target", "[Query][FTS]"
 }
 
 
+TEST_CASE_METHOD(FTSTest, "Query Full-Text Deferred Index", "[Query][FTS]") {
+    IndexSpec::Options options {"english", true};
+    options.deferred = true;
+    createIndex(options);
+
+    // The existing docs aren't indexed yet, so a query doesn't find them...
+    Retained<Query> query{ store->compileQuery(json5(
+        "['SELECT', {'WHERE': ['MATCH()', 'sentence', 'search'], WHAT: [['.sentence']]}]")) };
+    CHECK(query->unindexedDocCount() == 5);
+    Retained<QueryEnumerator> e(query->createEnumerator());
+    CHECK(e->getRowCount() == 0);
+
+    // ...until the query brings its indexes up to date:
+    {
+        Transaction t(store->dataFile());
+        query->updateDeferredIndexes();
+        t.commit();
+    }
+    CHECK(query->unindexedDocCount() == 0);
+    testQuery(
+        "['SELECT', {'WHERE': ['MATCH()', 'sentence', 'search'],\
+                    ORDER_BY: [['DESC', ['rank()', 'sentence']]],\
+                        WHAT: [['.sentence']]}]",
+              {1, 2, 0, 4},
+              {3, 3, 1, 1});
+
+    {
+        Transaction t(store->dataFile());
+        createDoc(t, 5, "Kumquats are small citrus fruits.");
+        t.commit();
+    }
+    query = store->compileQuery(json5(
+        "['SELECT', {'WHERE': ['MATCH()', 'sentence', 'kumquats'], WHAT: [['.sentence']]}]"));
+
+    // A query doesn't see the new doc yet:
+    CHECK(query->unindexedDocCount() == 1);
+    e = query->createEnumerator();
+    CHECK(e->getRowCount() == 0);
+
+    // ...until the background update indexes it:
+    {
+        Transaction t(store->dataFile());
+        CHECK(store->updateDeferredIndexes(100) == 1);
+        CHECK(store->updateDeferredIndexes(100) == 0);
+        t.commit();
+    }
+    CHECK(query->unindexedDocCount() == 0);
+    e = query->createEnumerator();
+    CHECK(e->getRowCount() == 1);
+}
+
+
 TEST_CASE_METHOD(FTSTest, "Query Full-Text Partial Index", "[Query][FTS]") {
     // the WHERE clause prevents row 4 from being indexed/searched.
     IndexSpec::Options options {"english", true};
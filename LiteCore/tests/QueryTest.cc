@@ -18,11 +18,14 @@
 
 #include "QueryTest.hh"
 #include "SQLiteDataFile.hh"
+#include "SQLiteCpp/SQLiteCpp.h"
+#include <sqlite3.h>
 #include <ctime>
 #include <cfloat>
 #include <cinttypes>
 #include <chrono>
 #include <numeric>
+#include <thread>
 #include "date/date.h"
 #include "ParseDate.hh"
 
@@ -167,6 +170,107 @@ TEST_CASE_METHOD(QueryTest, "Query SELECT", "[Query]") {
 }
 
 
+TEST_CASE_METHOD(QueryTest, "Query materialized value index", "[Query]") {
+    if (sqlite3_libversion_number() < 3041000) {
+        WARN("Skipping test: materialized indexes require SQLite 3.41+");
+        return;
+    }
+    addNumberedDocs();
+    {
+        Transaction t(store->dataFile());
+        writeMultipleTypeDocs(t);
+        writeFalselyDocs(t);
+        writeDoc("doc9"_sl, DocumentFlags::kNone, t, [=](Encoder &enc) {
+            enc.writeKey("value");
+            enc.writeNull();
+        });
+        t.commit();
+    }
+    deleteDoc("rec-035"_sl, false);
+
+    IndexSpec::Options options {};
+    options.materialized = true;
+    store->createIndex("num"_sl, "[[\".num\"]]"_sl, IndexSpec::kValue, &options);
+    store->createIndex("value"_sl, "[[\".value\"]]"_sl, IndexSpec::kValue, &options);
+    // Redundant createIndex should not fail:
+    CHECK(!store->createIndex("num"_sl, "[[\".num\"]]"_sl, IndexSpec::kValue, &options));
+
+    // The indexes are only writable by versions that know about fl_materialize:
+    SQLite::Database &sqlDb = (SQLiteDataFile&)store->dataFile();
+    auto indexSQL = [&](const char *indexName) {
+        SQLite::Statement stmt(sqlDb, "SELECT sql FROM sqlite_master WHERE type='index' AND name=?");
+        stmt.bind(1, indexName);
+        return stmt.executeStep() ? stmt.getColumn(0).getString() : string();
+    };
+    CHECK(sqlDb.execAndGet("PRAGMA user_version").getInt() == 500);
+    CHECK(indexSQL("num").find("fl_materialize(body, 'num'), flags,"
+                               " fl_materialize_subtype(body, 'num')") != string::npos);
+
+    // Look up and return an indexed property, without reading document bodies:
+    Retained<Query> query = store->compileQuery(json5(
+        "{WHAT: ['.num'], WHERE: ['AND', ['>=', ['.num'], 30], ['<=', ['.num'], 40]],"
+        " ORDER_BY: [['.num']]}"));
+    string explanation = query->explain();
+    Log("%s", explanation.c_str());
+    CHECK(explanation.find("fl_value") == string::npos);
+    CHECK(explanation.find("COVERING INDEX num") != string::npos);
+    Retained<QueryEnumerator> e(query->createEnumerator());
+    vector<int64_t> nums;
+    while (e->next())
+        nums.push_back(e->columns()[0]->asInt());
+    CHECK(nums == (vector<int64_t>{30, 31, 32, 33, 34, 36, 37, 38, 39, 40}));
+
+    // Values of every type come back unchanged:
+    query = store->compileQuery(json5(
+        "{WHAT: ['.value'], WHERE: ['IS NOT', ['.value'], ['MISSING']], ORDER_BY: [['._id']]}"));
+    e = query->createEnumerator();
+    vector<string> values;
+    while (e->next())
+        values.push_back(e->columns()[0]->toJSONString());
+    CHECK(values == (vector<string>{"[1]", "\"cool value\"", "4.5", "{\"subvalue\":\"FTW\"}",
+                                    "true", "[]", "{}", "false", "null"}));
+
+    // Booleans still compare equal to true/false, and are still booleans to functions:
+    query = store->compileQuery(json5("{WHAT: ['._id'], WHERE: ['=', ['.value'], true]}"));
+    e = query->createEnumerator();
+    REQUIRE(e->next());
+    CHECK(e->columns()[0]->asString() == "doc5"_sl);
+    CHECK(!e->next());
+    query = store->compileQuery(json5(
+        "{WHAT: ['._id'], WHERE: ['ISBOOLEAN()', ['.value']], ORDER_BY: [['._id']]}"));
+    e = query->createEnumerator();
+    CHECK(e->getRowCount() == 2);
+
+    // Index stays up to date as documents change:
+    deleteDoc("rec-031"_sl, true);
+    addNumberedDocs(101, 1);
+    query = store->compileQuery(json5("{WHAT: ['.num'], WHERE: ['>=', ['.num'], 30]}"));
+    CHECK(query->createEnumerator()->getRowCount() == 70);
+
+    // Deleting the index un-materializes its property, and a plain index on it is rebuilt:
+    store->createIndex("num2"_sl, "[[\".num\"], [\".value\"]]"_sl);
+    CHECK(indexSQL("num2").find("fl_materialize(body, 'num')") != string::npos);
+    store->deleteIndex("num"_sl);
+    CHECK(indexSQL("num2").find("fl_materialize(body, 'num')") == string::npos);
+    CHECK(indexSQL("num2").find("fl_materialize(body, 'value')") != string::npos);
+    query = store->compileQuery(json5("{WHAT: ['.num'], WHERE: ['>=', ['.num'], 30]}"));
+    explanation = query->explain();
+    CHECK(explanation.find("fl_value") != string::npos);
+    CHECK(explanation.find("INDEX num2") != string::npos);
+    CHECK(query->createEnumerator()->getRowCount() == 70);
+
+    // Recreating the other index without materializing un-materializes the rest:
+    CHECK(store->createIndex("value"_sl, "[[\".value\"]]"_sl));
+    CHECK(indexSQL("value").find("fl_materialize") == string::npos);
+    CHECK(indexSQL("num2").find("fl_materialize") == string::npos);
+    query = store->compileQuery(json5("{WHAT: ['._id'], WHERE: ['=', ['.value'], true]}"));
+    e = query->createEnumerator();
+    REQUIRE(e->next());
+    CHECK(e->columns()[0]->asString() == "doc5"_sl);
+    CHECK(!e->next());
+}
+
+
 TEST_CASE_METHOD(QueryTest, "Query SELECT WHAT", "[Query][N1QL]") {
     addNumberedDocs();
     Retained<Query> query;
@@ -1452,6 +1556,92 @@ TEST_CASE_METHOD(QueryTest, "Negative Limit / Offset", "[Query]") {
 }
 
 
+TEST_CASE_METHOD(QueryTest, "Query row limit", "[Query]") {
+    addNumberedDocs(1, 100);
+    Retained<Query> query = store->compileQuery(json5("{WHAT: [['.num']]}"));
+
+    Query::Options options;
+    options.maxRows = 100;
+    Retained<QueryEnumerator> e(query->createEnumerator(&options));
+    CHECK(e->getRowCount() == 100);
+
+    options.maxRows = 99;
+    ExpectException(error::LiteCore, error::Interrupted, [&]{
+        e = query->createEnumerator(&options);
+    });
+}
+
+
+// A three-way join whose WHERE clause matches nothing, but only after a million comparisons.
+static const char* kSlowJoinQuery =
+    "{WHAT: [['.a.num']], FROM: [{AS: 'a'},"
+                                "{AS: 'b', ON: ['>', ['.b.num'], 0]},"
+                                "{AS: 'c', ON: ['>', ['.c.num'], 0]}],"
+    " WHERE: ['<', ['+', ['.a.num'], ['.b.num'], ['.c.num']], 0]}";
+
+
+TEST_CASE_METHOD(QueryTest, "Query time limit", "[Query]") {
+    addNumberedDocs(1, 100);
+    Retained<Query> query = store->compileQuery(json5(kSlowJoinQuery));
+
+    Query::Options options;
+    options.timeout = 0.01;
+    Stopwatch st;
+    ExpectException(error::LiteCore, error::Interrupted, [&]{
+        Retained<QueryEnumerator> e(query->createEnumerator(&options));
+    });
+    CHECK(st.elapsed() < 1.0);
+
+    // The interruption doesn't affect later queries:
+    query = store->compileQuery(json5("{WHAT: [['.num']]}"));
+    Retained<QueryEnumerator> e(query->createEnumerator(&options));
+    CHECK(e->getRowCount() == 100);
+}
+
+
+TEST_CASE_METHOD(QueryTest, "Query cancel", "[Query]") {
+    addNumberedDocs(1, 100);
+    // A four-way join that would take a hundred million comparisons, so it can't finish
+    // before it's canceled:
+    Retained<Query> query = store->compileQuery(json5(
+        "{WHAT: [['.a.num']], FROM: [{AS: 'a'},"
+                                    "{AS: 'b', ON: ['>', ['.b.num'], 0]},"
+                                    "{AS: 'c', ON: ['>', ['.c.num'], 0]},"
+                                    "{AS: 'd', ON: ['>', ['.d.num'], 0]}],"
+        " WHERE: ['<', ['+', ['.a.num'], ['.b.num'], ['.c.num'], ['.d.num']], 0]}"));
+
+    SECTION("Cancel while running") {
+        atomic<int> errorCode {0};
+        atomic<bool> finished {false};
+        thread runner([&]{
+            try {
+                Retained<QueryEnumerator> e(query->createEnumerator());
+            } catch (const error &x) {
+                errorCode = x.code;
+            }
+            finished = true;
+        });
+        // (Keep canceling, in case the first call happens before the query starts running.)
+        while (!finished) {
+            this_thread::sleep_for(10ms);
+            query->cancel();
+        }
+        runner.join();
+        REQUIRE(errorCode == error::Interrupted);
+    }
+
+    SECTION("Cancel before running") {
+        // A cancel after the caller captured the count still interrupts the run:
+        Query::Options options;
+        options.cancelCount = query->cancelCount();
+        query->cancel();
+        ExpectException(error::LiteCore, error::Interrupted, [&]{
+            Retained<QueryEnumerator> e(query->createEnumerator(&options));
+        });
+    }
+}
+
+
 TEST_CASE_METHOD(QueryTest, "Query JOINs", "[Query]") {
      {
         Transaction t(store->dataFile());
@@ -1524,7 +1714,7 @@ protected:
         }
     }
 
-    void testArrayQuery(const string &json, bool checkOptimization) {
+    void testArrayQuery(const string &json, bool checkOptimization, bool deferred =false) {
         addArrayDocs(1, 90);
 
         query = store->compileQuery(json);
@@ -1533,29 +1723,43 @@ protected:
         checkQuery(88, 3);
 
         Log("-------- Creating index --------");
+        IndexSpec::Options options {};
+        options.deferred = deferred;
         store->createIndex("numbersIndex"_sl,
                            "[[\".numbers\"]]"_sl,
-                           IndexSpec::kArray);
+                           IndexSpec::kArray,
+                           &options);
         Log("-------- Recompiling query with index --------");
         query = store->compileQuery(json);
         checkOptimized(query, checkOptimization);
-        checkQuery(88, 3);
+        checkIndexedQuery(88, 3, deferred);
 
         Log("-------- Adding a doc --------");
         addArrayDocs(91, 1);
-        checkQuery(88, 4);
+        checkIndexedQuery(88, 4, deferred);
 
         Log("-------- Purging a doc --------");
         deleteDoc("rec-091"_sl, true);
-        checkQuery(88, 3);
+        checkIndexedQuery(88, 3, deferred);
 
         Log("-------- Soft-deleting a doc --------");
         deleteDoc("rec-090"_sl, false);
-        checkQuery(88, 2);
+        checkIndexedQuery(88, 2, deferred);
 
         Log("-------- Un-deleting a doc --------");
         undeleteDoc("rec-090"_sl);
-        checkQuery(88, 3);
+        checkIndexedQuery(88, 3, deferred);
+    }
+
+    // A deferred index doesn't reflect changes until it's brought up to date.
+    void checkIndexedQuery(int docNo, int expectedRowCount, bool deferred) {
+        if (deferred) {
+            Transaction t(store->dataFile());
+            query->updateDeferredIndexes();
+            t.commit();
+            CHECK(query->unindexedDocCount() == 0);
+        }
+        checkQuery(docNo, expectedRowCount);
     }
 };
 
@@ -1575,6 +1779,163 @@ TEST_CASE_METHOD(ArrayQueryTest, "Query UNNEST", "[Query]") {
 }
 
 
+TEST_CASE_METHOD(ArrayQueryTest, "Query UNNEST deferred index", "[Query]") {
+    testArrayQuery(json5("['SELECT', {\
+                              FROM: [{as: 'doc'}, \
+                                     {as: 'num', 'unnest': ['.doc.numbers']}],\
+                              WHERE: ['=', ['.num'], 'eight-eight']}]"),
+                   true, true);
+
+    // The index is already up to date, so the background update has nothing to do:
+    Transaction t(store->dataFile());
+    CHECK(store->updateDeferredIndexes(100) == 0);
+    t.commit();
+}
+
+
+TEST_CASE_METHOD(ArrayQueryTest, "Query UNNEST index ignores unrelated changes", "[Query]") {
+    testArrayQuery(json5("['SELECT', {\
+                              FROM: [{as: 'doc'}, \
+                                     {as: 'num', 'unnest': ['.doc.numbers']}],\
+                              WHERE: ['=', ['.num'], 'eight-eight']}]"),
+                   true, true);
+    {
+        Transaction t(store->dataFile());
+        CHECK(store->updateDeferredIndexes(100) == 0);
+        t.commit();
+    }
+
+    // Updates rec-088 in place, so the database's update triggers run:
+    auto updateDoc = [&](Transaction &t, int firstNumber, int lastNumber) {
+        Record rec = store->get("rec-088"_sl);
+        REQUIRE(rec.exists());
+        Encoder enc;
+        enc.beginDictionary();
+        enc.writeKey("numbers");
+        enc.beginArray();
+        for (int j = firstNumber; j <= lastNumber; j++)
+            enc.writeString(numberString(j));
+        enc.endArray();
+        enc.writeKey("type");
+        enc.writeString("modified");
+        enc.endDictionary();
+        alloc_slice body = enc.finish();
+        CHECK(store->set(rec.key(), nullslice, body, DocumentFlags::kNone, t, rec.sequence()) > 0);
+    };
+
+    Log("-------- Changing a property that isn't indexed --------");
+    {
+        Transaction t(store->dataFile());
+        updateDoc(t, 83, 88);
+        // The array didn't change, so the document doesn't need re-indexing:
+        CHECK(store->updateDeferredIndexes(100) == 0);
+        t.commit();
+    }
+    checkQuery(88, 3);
+
+    Log("-------- Changing the indexed array --------");
+    {
+        Transaction t(store->dataFile());
+        updateDoc(t, 1, 1);
+        CHECK(store->updateDeferredIndexes(100) == 1);
+        t.commit();
+    }
+    checkQuery(89, 2);
+}
+
+
+TEST_CASE_METHOD(ArrayQueryTest, "Index triggers skip unchanged values", "[Query][FTS]") {
+    addArrayDocs(1, 90);
+    SQLite::Database &sqlDb = (SQLiteDataFile&)store->dataFile();
+
+    // Updates rec-088 and returns the number of rows SQLite changed, including by triggers:
+    int extra = 0;
+    auto updateDoc = [&](const char *type, int firstNumber) -> int64_t {
+        Transaction t(store->dataFile());
+        int64_t changesBefore = sqlDb.execAndGet("SELECT total_changes()").getInt64();
+        Record rec = store->get("rec-088"_sl);
+        REQUIRE(rec.exists());
+        Encoder enc;
+        enc.beginDictionary();
+        enc.writeKey("numbers");
+        enc.beginArray();
+        for (int j = firstNumber; j <= 88; j++)
+            enc.writeString(numberString(j));
+        enc.endArray();
+        enc.writeKey("type");
+        enc.writeString(type);
+        enc.writeKey("extra");
+        enc.writeInt(++extra);
+        enc.endDictionary();
+        alloc_slice body = enc.finish();
+        CHECK(store->set(rec.key(), nullslice, body, DocumentFlags::kNone, t, rec.sequence()) > 0);
+        t.commit();
+        return sqlDb.execAndGet("SELECT total_changes()").getInt64() - changesBefore;
+    };
+
+    // The rows an update changes when there are no indexes:
+    const int64_t baseChanges = updateDoc("array", 83);
+
+    IndexSpec::Options ftsOptions {"en", true};
+    store->createIndex("numbersIndex"_sl, "[[\".numbers\"]]"_sl, IndexSpec::kArray);
+    store->createIndex("typeText"_sl, "[[\".type\"]]"_sl, IndexSpec::kFullText, &ftsOptions);
+    store->createIndex("typeIndex"_sl, "[[\".type\"]]"_sl, IndexSpec::kValue);
+
+    Retained<Query> typeQuery = store->compileQuery(json5(
+                            "{WHAT: [['._id']], WHERE: ['=', ['.type'], 'modified']}"));
+    Retained<Query> matchQuery = store->compileQuery(json5(
+                            "{WHAT: [['._id']], WHERE: ['MATCH()', 'typeText', 'modified']}"));
+    query = store->compileQuery(json5("['SELECT', {\
+                              FROM: [{as: 'doc'}, \
+                                     {as: 'num', 'unnest': ['.doc.numbers']}],\
+                              WHERE: ['=', ['.num'], 'eight-three']}]"));
+
+    Log("-------- Changing a property that isn't indexed --------");
+    CHECK(updateDoc("array", 83) == baseChanges);
+    checkQuery(83, 6);
+
+    Log("-------- Changing the indexed properties --------");
+    CHECK(updateDoc("modified", 84) > baseChanges);
+    checkQuery(83, 5);
+    Retained<QueryEnumerator> e(typeQuery->createEnumerator());
+    CHECK(e->getRowCount() == 1);
+    e = matchQuery->createEnumerator();
+    CHECK(e->getRowCount() == 1);
+
+    Log("-------- Changing a property that isn't indexed, again --------");
+    CHECK(updateDoc("modified", 84) == baseChanges);
+    e = typeQuery->createEnumerator();
+    CHECK(e->getRowCount() == 1);
+    e = matchQuery->createEnumerator();
+    CHECK(e->getRowCount() == 1);
+
+    Log("-------- Upgrading triggers of an older version --------");
+    {
+        // Make the 'upd' triggers unconditional, like those an older version created:
+        vector<pair<string,string>> triggers;
+        SQLite::Statement stmt(sqlDb, "SELECT name, sql FROM sqlite_master "
+                                      "WHERE type='trigger' AND name LIKE '%::upd'");
+        while (stmt.executeStep())
+            triggers.emplace_back(stmt.getColumn(0).getString(), stmt.getColumn(1).getString());
+        CHECK(triggers.size() == 2);
+        for (auto &[name, sql] : triggers) {
+            replace(sql, "WHEN NOT (", "WHEN 1 OR NOT (");
+            sqlDb.exec("DROP TRIGGER \"" + name + "\"");
+            sqlDb.exec(sql);
+        }
+    }
+    CHECK(updateDoc("modified", 84) > baseChanges);
+
+    // Re-creating the indexes brings their triggers up to date:
+    CHECK(store->createIndex("numbersIndex"_sl, "[[\".numbers\"]]"_sl, IndexSpec::kArray));
+    CHECK(store->createIndex("typeText"_sl, "[[\".type\"]]"_sl, IndexSpec::kFullText, &ftsOptions));
+    CHECK(!store->createIndex("numbersIndex"_sl, "[[\".numbers\"]]"_sl, IndexSpec::kArray));
+    CHECK(updateDoc("modified", 84) == baseChanges);
+    e = matchQuery->createEnumerator();
+    CHECK(e->getRowCount() == 1);
+}
+
+
 TEST_CASE_METHOD(ArrayQueryTest, "Query ANY expression", "[Query]") {
     addArrayDocs(1, 90);
 
@@ -1603,17 +1964,25 @@ TEST_CASE_METHOD(ArrayQueryTest, "Query UNNEST expression", "[Query]") {
     checkQuery(22, 2);
 
     Log("-------- Creating index --------");
+    QueryLanguage language = QueryLanguage::kJSON;
     SECTION("JSON index expression") {
         store->createIndex("numbersIndex"_sl,
                            json5("[['[]', ['.numbers[0]'], ['.numbers[1]']]]"),
                            IndexSpec::kArray);
+        language = QueryLanguage::kJSON;
     }
     SECTION("N1QL index expression") {
+        // (This N1QL expression looks like JSON, so the language has to be stored explicitly.)
         store->createIndex("numbersIndex"_sl,
                            "[numbers[0], numbers[1]]",
                            QueryLanguage::kN1QL,
                            IndexSpec::kArray);
+        language = QueryLanguage::kN1QL;
     }
+    auto indexes = store->getIndexes();
+    REQUIRE(indexes.size() == 1);
+    CHECK(indexes[0].queryLanguage == language);
+
     Log("-------- Recompiling query with index --------");
     query = store->compileQuery(json);
     checkOptimized(query);
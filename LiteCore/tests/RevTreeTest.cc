@@ -0,0 +1,224 @@
+//
+// RevTreeTest.cc
+//
+// Copyright (c) 2021 Couchbase, Inc All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "LiteCoreTest.hh"
+#include "RevTree.hh"
+#include "Benchmark.hh"
+#include <algorithm>
+#include <stdio.h>
+
+using namespace std;
+using namespace litecore;
+using namespace fleece;
+
+
+static revidBuffer revIDForGen(unsigned gen) {
+    char buf[40];
+    sprintf(buf, "%u-%08x%08x", gen, gen * 2654435761u, ~gen);
+    return revidBuffer(slice(buf));
+}
+
+
+// Builds a linear tree of `depth` revisions that looks like a saved document's: only the
+// current revision has a body, and remote #1 is one revision behind.
+static pair<alloc_slice,alloc_slice> encodedLinearTree(unsigned depth) {
+    alloc_slice body("{\"this is\":\"a revision body\"}");
+    RevTree tree;
+    const Rev *parent = nullptr;
+    for (unsigned gen = 1; gen <= depth; ++gen) {
+        int status;
+        parent = tree.insert(revIDForGen(gen), body, Rev::kNoFlags, parent, false, false, status);
+        REQUIRE(parent);
+    }
+    tree.saved(1);
+    tree.removeNonLeafBodies();
+    if (depth > 1)
+        tree.setLatestRevisionOnRemote(1, tree.get(revIDForGen(depth - 1)));
+    auto [curBody, extra] = tree.encode();
+    return {alloc_slice(curBody), extra};
+}
+
+
+TEST_CASE("RevTree encode and decode", "[RevTree]") {
+    auto [body, extra] = encodedLinearTree(30);
+
+    RevTree tree(body, extra, 1);
+    REQUIRE(tree.size() == 30);
+    const Rev *cur = tree.currentRevision();
+    CHECK(cur->revID == revIDForGen(30));
+    CHECK(cur->body() == body);
+    CHECK(cur->index() == 0);
+    CHECK(tree.latestRevisionOnRemote(1) == cur->parent());
+    unsigned depth = 0;
+    for (const Rev *rev = cur; rev; rev = rev->parent()) {
+        CHECK(rev->revID.generation() == 30 - depth);
+        CHECK(rev->owner == &tree);
+        CHECK(tree.get(rev->index()) == rev);
+        ++depth;
+    }
+    CHECK(depth == 30);
+
+    // Insert a revision, then copy the tree; the copy has to own its own copy of the new revID:
+    int status;
+    alloc_slice newBody("{\"new\":true}");
+    const Rev *newRev = tree.insert(revIDForGen(31), newBody, Rev::kNoFlags, cur, false, false,
+                                    status);
+    REQUIRE(newRev);
+    CHECK(status == 201);
+    auto copy = make_unique<RevTree>(tree);
+    const Rev *copiedRev = copy->get(revIDForGen(31));
+    REQUIRE(copiedRev);
+    CHECK(copiedRev != newRev);
+    CHECK(copiedRev->revID.buf != newRev->revID.buf);
+    CHECK(copiedRev->owner == copy.get());
+    CHECK(copiedRev->parent() == copy->get(revIDForGen(30)));
+    CHECK(copy->latestRevisionOnRemote(1) == copy->get(revIDForGen(29)));
+
+    // Prune the copy and make sure it re-encodes correctly:
+    CHECK(copy->prune(10) == 21);
+    CHECK(copy->size() == 10);
+    auto [body2, extra2] = copy->encode();
+    RevTree tree2(body2, extra2, 2);
+    REQUIRE(tree2.size() == 10);
+    CHECK(tree2.currentRevision()->revID == revIDForGen(31));
+    CHECK(tree2.currentRevision()->body() == newBody);
+    CHECK(tree2.get(revIDForGen(22))->parent() == nullptr);
+    CHECK(tree2.latestRevisionOnRemote(1) == tree2.get(revIDForGen(29)));
+}
+
+
+TEST_CASE("RevTree lazy decoding", "[RevTree]") {
+    auto [body, extra] = encodedLinearTree(30);
+
+    RevTree tree(body, extra, 1, true);
+    CHECK(tree.isPartiallyDecoded());
+    const Rev *cur = tree.currentRevision();
+    REQUIRE(cur);
+    CHECK(cur->revID == revIDForGen(30));
+    CHECK(cur->body() == body);
+    CHECK(cur->isLeaf());
+    CHECK(tree[revIDForGen(30)] == cur);
+
+    // Inserting the current revision again is a no-op that doesn't need the rest of the tree:
+    vector<revidBuffer> history {revIDForGen(30), revIDForGen(29)};
+    CHECK(tree.insertHistory(history, body, Rev::kNoFlags, false, false) == 0);
+    CHECK(tree.isPartiallyDecoded());
+
+    // Following the parent link decodes the rest, without moving the current revision:
+    const Rev *parent = cur->parent();
+    CHECK(!tree.isPartiallyDecoded());
+    REQUIRE(parent);
+    CHECK(parent->revID == revIDForGen(29));
+    CHECK(tree.currentRevision() == cur);
+    CHECK(tree.size() == 30);
+    CHECK(tree.latestRevisionOnRemote(1) == parent);
+
+    // Looking up any other revision also decodes it:
+    RevTree tree2(body, extra, 1, true);
+    CHECK(tree2.isPartiallyDecoded());
+    CHECK(tree2[revIDForGen(10)] != nullptr);
+    CHECK(!tree2.isPartiallyDecoded());
+    auto [body2, extra2] = tree2.encode();
+    CHECK(body2 == body);
+    CHECK(extra2 == extra);
+}
+
+
+TEST_CASE("RevTree remove obsolete remote data", "[RevTree]") {
+    alloc_slice body("{\"this is\":\"a revision body\"}");
+    RevTree tree;
+    const Rev *parent = nullptr;
+    for (unsigned gen = 1; gen <= 10; ++gen) {
+        int status;
+        parent = tree.insert(revIDForGen(gen), body, Rev::kNoFlags, parent, false, false, status);
+        REQUIRE(parent);
+    }
+    // Remote #2 is at revision 8, whose body is kept for it; remote #1 is at revision 9:
+    tree.keepBody(tree.get(revIDForGen(8)));
+    tree.setLatestRevisionOnRemote(1, tree.get(revIDForGen(9)));
+    tree.setLatestRevisionOnRemote(2, tree.get(revIDForGen(8)));
+    tree.saved(1);
+    tree.removeNonLeafBodies();
+    CHECK(tree.get(revIDForGen(8))->body() == body);
+
+    // While both remotes are known, nothing is removed:
+    size_t bytes = 0;
+    CHECK(tree.removeObsoleteRemoteData([](RemoteID) {return true;}, bytes) == 0);
+    CHECK(bytes == 0);
+
+    // Forgetting remote #2 removes its marker and the body it was keeping:
+    CHECK(tree.removeObsoleteRemoteData([](RemoteID r) {return r == 1;}, bytes) == 2);
+    CHECK(bytes == body.size);
+    CHECK(tree.latestRevisionOnRemote(2) == nullptr);
+    CHECK(tree.latestRevisionOnRemote(1) == tree.get(revIDForGen(9)));
+    CHECK(!tree.get(revIDForGen(8))->body());
+    CHECK(!tree.get(revIDForGen(8))->keepBody());
+
+    // It survives encoding:
+    auto [curBody, extra] = tree.encode();
+    RevTree tree2(curBody, extra, 2);
+    CHECK(tree2.remoteRevisions().size() == 1);
+    CHECK(tree2.latestRevisionOnRemote(1) == tree2.get(revIDForGen(9)));
+    CHECK(!tree2.get(revIDForGen(8))->body());
+}
+
+
+TEST_CASE("RevTree performance", "[RevTree][Perf][.slow]") {
+    for (unsigned depth : {20, 100, 1000}) {
+        auto [body, extra] = encodedLinearTree(depth);
+        const unsigned kRepeat = max(100u, 100000u / depth);
+        revidBuffer newRevID = revIDForGen(depth + 1);
+        alloc_slice newBody("{\"new\":true}");
+
+        Benchmark lazyBench, decodeBench, insertBench, pruneBench, encodeBench;
+        for (unsigned i = 0; i < kRepeat; ++i) {
+            lazyBench.start();
+            RevTree lazyTree(body, extra, 1, true);
+            auto cur = lazyTree.currentRevision();
+            lazyBench.stop();
+            REQUIRE(cur);
+
+            decodeBench.start();
+            RevTree tree(body, extra, 1);
+            decodeBench.stop();
+
+            insertBench.start();
+            int status;
+            auto rev = tree.insert(newRevID, newBody, Rev::kNoFlags, tree.currentRevision(),
+                                   false, false, status);
+            insertBench.stop();
+            REQUIRE(rev);
+
+            pruneBench.start();
+            tree.prune(20);
+            pruneBench.stop();
+
+            encodeBench.start();
+            auto encoded = tree.encode();
+            encodeBench.stop();
+            REQUIRE(encoded.second);
+        }
+
+        fprintf(stderr, "---- %u revisions:\n", depth);
+        lazyBench.printReport(1.0, "lazy tree");
+        decodeBench.printReport(1.0, "tree");
+        insertBench.printReport(1.0, "insert");
+        pruneBench.printReport(1.0, "prune");
+        encodeBench.printReport(1.0, "encode");
+    }
+}
@@ -18,6 +18,11 @@
 
 #include "LiteCoreTest.hh"
 #include "SequenceTracker.hh"
+#include "StringUtil.hh"
+#include "Benchmark.hh"
+#include <map>
+#include <random>
+#include <set>
 #include <sstream>
 
 using namespace std;
@@ -51,7 +56,7 @@ namespace litecore {
         string dump(bool verbose =false) { return tracker.dump(verbose); }
 #endif
 
-        SequenceTracker::const_iterator since(sequence_t s) {
+        SequenceTracker::LogPosition since(sequence_t s) {
             return tracker._since(s);
         }
 
@@ -59,8 +64,46 @@ namespace litecore {
             return tracker._docIDAt(s);
         }
         
-        SequenceTracker::const_iterator end() {
-            return tracker.end();
+        SequenceTracker::LogPosition end() {
+            return tracker._logEnd;
+        }
+
+        void setMinChangesToKeep(size_t n) {
+            SequenceTracker::kMinChangesToKeep = n;
+        }
+
+        size_t logCapacity() {
+            return tracker._log.size();
+        }
+
+        // True if the live part of the log runs past the end of the ring buffer
+        bool logWrapsAround() {
+            auto start = tracker._logStart & (tracker._log.size() - 1);
+            return start + (tracker._logEnd - tracker._logStart) > tracker._log.size();
+        }
+
+        // Checks that every entry in the docID index can be found by looking up its docID
+        // (`docIDs` must include every docID the tracker knows), and returns the entry count.
+        size_t checkDocIndex(const vector<alloc_slice> &docIDs) {
+            set<SequenceTracker::EntryIndex> found, indexed;
+            for (auto &docID : docIDs) {
+                if (auto e = tracker.findEntry(docID); e != UINT32_MAX)
+                    CHECK(found.insert(e).second);
+            }
+            size_t count = 0;
+            for (auto e : tracker._docIndex) {
+                if (e != UINT32_MAX) {
+                    indexed.insert(e);
+                    ++count;
+                }
+            }
+            CHECK(indexed.size() == count);
+            CHECK(found == indexed);
+            return count;
+        }
+
+        bool hasEntry(slice docID) {
+            return tracker.findEntry(docID) != UINT32_MAX;
         }
 
     private:
@@ -236,6 +279,48 @@ TEST_CASE_METHOD(litecore::SequenceTrackerTest, "SequenceTracker DocChangeNotifi
 }
 
 
+TEST_CASE_METHOD(litecore::SequenceTrackerTest, "SequenceTracker DocSetChangeNotifier", "[notification]") {
+    vector<alloc_slice> changedIDs, changedPrefixed;
+
+    DocSetChangeNotifier idsNotifier(tracker, {"A"_asl, "B"_asl, "BB"_asl, "D"_asl}, false,
+                                     [&](DocSetChangeNotifier&, slice docID, sequence_t s) {
+        CHECK((s == seq || s == 0));    // (0 means a purge)
+        changedIDs.emplace_back(docID);
+    });
+    DocSetChangeNotifier prefixNotifier(tracker, {"user:"_asl, "user:admin:"_asl, "B"_asl}, true,
+                                        [&](DocSetChangeNotifier&, slice docID, sequence_t s) {
+        CHECK(s == seq);
+        changedPrefixed.emplace_back(docID);
+    });
+
+    tracker.beginTransaction();
+    for (auto docID : {"A", "B", "BB", "BBB", "C", "user:", "user:x", "user:admin:y", "use", "D"})
+        tracker.documentChanged(alloc_slice(docID), "1-aa"_asl, ++seq, Flag1);
+    tracker.documentPurged("A"_sl);
+    tracker.endTransaction(true);
+
+    CHECK(changedIDs == (vector<alloc_slice>{"A"_asl, "B"_asl, "BB"_asl, "D"_asl, "A"_asl}));
+    // A doc matching more than one prefix is only reported once:
+    CHECK(changedPrefixed == (vector<alloc_slice>{"B"_asl, "BB"_asl, "BBB"_asl, "user:"_asl,
+                                                  "user:x"_asl, "user:admin:y"_asl}));
+
+    // External changes are reported too, and a removed notifier isn't called any more:
+    changedIDs.clear();
+    changedPrefixed.clear();
+    {
+        DocSetChangeNotifier temp(tracker, {"user:"_asl}, true,
+                                  [&](DocSetChangeNotifier&, slice, sequence_t) {FAIL();});
+    }
+    SequenceTracker track2;
+    track2.beginTransaction();
+    track2.documentChanged("user:z"_asl, "1-ff"_asl, ++seq, Flag2);
+    tracker.addExternalTransaction(track2);
+    track2.endTransaction(true);
+    CHECK(changedIDs.empty());
+    CHECK(changedPrefixed == vector<alloc_slice>{"user:z"_asl});
+}
+
+
 TEST_CASE("SequenceTracker Transaction", "[notification]") {
     SequenceTracker tracker;
 
@@ -437,3 +522,179 @@ TEST_CASE_METHOD(litecore::SequenceTrackerTest, "SequenceTracker Purge", "[notif
         CHECK(changes[1].sequence == 0);
     }
 }
+
+
+TEST_CASE_METHOD(litecore::SequenceTrackerTest, "SequenceTracker Ring Buffer", "[notification]") {
+    // Makes enough changes that the change log outgrows its initial 64 slots, wraps around its
+    // ring buffer and gets compacted, while notifiers reading at different rates keep their
+    // placeholders spread across it, and DocChangeNotifiers come and go. Everything the
+    // notifiers see is checked against a simple model.
+    static constexpr unsigned kNumDocs = 400, kNumHotDocs = 10, kNumTransactions = 1000;
+    mt19937 random(4321);
+    vector<alloc_slice> docIDs;
+    for (unsigned i = 0; i < kNumDocs; ++i)
+        docIDs.emplace_back(format("doc-%03u", i));
+    alloc_slice revID("1-abcdef");
+
+    struct Reader {
+        unsigned interval;                  // Reads after every `interval` transactions
+        size_t batchSize;                   // Max changes per readChanges call
+        unique_ptr<DatabaseChangeNotifier> notifier;
+        vector<string> unread;              // Expected changes, as "docID@seq", oldest first
+    };
+    Reader readers[] = {{1, 1000}, {4, 5}, {16, 32}, {64, 50}};
+    for (auto &r : readers)
+        r.notifier = make_unique<DatabaseChangeNotifier>(tracker, nullptr);
+
+    struct Watcher {
+        unique_ptr<DocChangeNotifier> notifier;
+        unsigned calls = 0, expectedCalls = 0;
+    };
+    map<unsigned, Watcher> watchers;        // Keyed by doc number
+
+    auto readAll = [&](Reader &r) {
+        vector<SequenceTracker::Change> changes(r.batchSize);
+        bool external;
+        size_t n;
+        do {
+            n = r.notifier->readChanges(changes.data(), r.batchSize, external);
+            REQUIRE(n == min(r.batchSize, r.unread.size()));
+            CHECK(!external);
+            vector<string> got;
+            for (size_t i = 0; i < n; ++i)
+                got.push_back(format("%.*s@%" PRIu64, SPLAT(changes[i].docID), changes[i].sequence));
+            CHECK(got == vector<string>(r.unread.begin(), r.unread.begin() + n));
+            r.unread.erase(r.unread.begin(), r.unread.begin() + n);
+        } while (n > 0);
+        CHECK(!r.notifier->hasChanges());
+    };
+
+    size_t compactions = 0, wrappedReads = 0;
+    for (unsigned t = 1; t <= kNumTransactions; ++t) {
+        tracker.beginTransaction();
+        for (auto n = 1 + random() % 8; n > 0; --n) {
+            // Most changes go to a few hot docs, which leaves lots of vacated slots:
+            unsigned d = (random() % 4) ? random() % kNumHotDocs : random() % kNumDocs;
+            auto before = end();
+            tracker.documentChanged(docIDs[d], revID, ++seq, Flag1);
+            if (end() < before)
+                ++compactions;
+
+            string change = format("%.*s@%" PRIu64, SPLAT(docIDs[d]), seq);
+            for (auto &r : readers) {
+                auto prefix = string(docIDs[d]) + "@";
+                auto i = find_if(r.unread.begin(), r.unread.end(),
+                                 [&](const string &c) {return hasPrefix(c, prefix);});
+                if (i != r.unread.end())
+                    r.unread.erase(i);
+                r.unread.push_back(change);
+            }
+            if (auto w = watchers.find(d); w != watchers.end())
+                ++w->second.expectedCalls;
+        }
+        tracker.endTransaction(true);
+
+        for (auto &r : readers) {
+            if (t % r.interval == 0) {
+                if (logWrapsAround())
+                    ++wrappedReads;
+                readAll(r);
+            }
+        }
+
+        // Start or stop watching a random doc, which may be idle, in the log, or unknown:
+        if (t % 5 == 0) {
+            unsigned d = random() % kNumDocs;
+            if (auto w = watchers.find(d); w != watchers.end()) {
+                CHECK(w->second.calls == w->second.expectedCalls);
+                watchers.erase(w);
+            } else {
+                Watcher &nw = watchers[d];
+                nw.notifier = make_unique<DocChangeNotifier>(tracker, docIDs[d],
+                                      [&nw](DocChangeNotifier&, slice, sequence_t) {++nw.calls;});
+            }
+        }
+
+        if (t % 50 == 0) {
+            checkDocIndex(docIDs);
+            for (auto &[d, w] : watchers)
+                CHECK(hasEntry(docIDs[d]));
+        }
+    }
+
+    CHECK(logCapacity() > 64);
+    CHECK(compactions > 0);
+    CHECK(wrappedReads > 0);
+
+    // Once the watchers are gone and everyone's caught up, only kMinChangesToKeep are left:
+    for (auto &[d, w] : watchers)
+        CHECK(w.calls == w.expectedCalls);
+    watchers.clear();
+    for (auto &r : readers)
+        readAll(r);
+    CHECK(checkDocIndex(docIDs) == 2);
+}
+
+
+TEST_CASE_METHOD(litecore::SequenceTrackerTest, "SequenceTracker performance", "[notification][Perf][.slow]") {
+    setMinChangesToKeep(100);
+    static constexpr unsigned kNumDocs = 100000, kNumUpdates = 1000000, kTransactionSize = 100;
+    static constexpr unsigned kNumNotifiers = 4;
+
+    vector<alloc_slice> docIDs;
+    for (unsigned i = 0; i < kNumDocs; ++i)
+        docIDs.emplace_back(format("doc-%07u", i));
+    alloc_slice revID("1-abcdef");
+
+    // Observe some documents, and the database with notifiers that read at different rates:
+    unsigned docNotifications = 0;
+    vector<unique_ptr<DocChangeNotifier>> docNotifiers;
+    for (unsigned i = 0; i < kNumDocs; i += 1000)
+        docNotifiers.emplace_back(new DocChangeNotifier(tracker, docIDs[i],
+                                            [&](DocChangeNotifier&, slice, sequence_t) {
+                                                ++docNotifications;
+                                            }));
+    vector<unique_ptr<DatabaseChangeNotifier>> notifiers;
+    for (unsigned i = 0; i < kNumNotifiers; ++i)
+        notifiers.emplace_back(new DatabaseChangeNotifier(tracker, nullptr));
+    vector<sequence_t> lastSeen(kNumNotifiers);
+    SequenceTracker::Change changes[100];
+    bool external;
+
+    auto readChanges = [&](unsigned n) {
+        while (size_t count = notifiers[n]->readChanges(changes, 100, external))
+            lastSeen[n] = changes[count - 1].sequence;
+    };
+
+    Benchmark changeBench, readBench;
+    uint32_t rnd = 12345;
+    for (unsigned update = 0; update < kNumUpdates; update += kTransactionSize) {
+        changeBench.start();
+        tracker.beginTransaction();
+        for (unsigned i = 0; i < kTransactionSize; ++i) {
+            rnd = rnd * 1664525 + 1013904223;
+            // Skew the updates toward a small set of "hot" documents:
+            unsigned doc = (rnd >> 8) % ((rnd & 1) ? 1000 : kNumDocs);
+            tracker.documentChanged(docIDs[doc], revID, ++seq, SequenceTracker::RevisionFlags::None);
+        }
+        tracker.endTransaction(true);
+        changeBench.stop();
+
+        readBench.start();
+        for (unsigned n = 0; n < kNumNotifiers; ++n) {
+            if ((update / kTransactionSize) % (1 << n) == 0)
+                readChanges(n);
+        }
+        readBench.stop();
+    }
+
+    for (unsigned n = 0; n < kNumNotifiers; ++n) {
+        readChanges(n);
+        CHECK(lastSeen[n] == seq);
+        CHECK(!notifiers[n]->hasChanges());
+    }
+    CHECK(docNotifications > 0);
+
+    changeBench.printReport(1.0 / kTransactionSize, "document change");
+    readBench.printReport(1.0, "notifiers' readChanges");
+}
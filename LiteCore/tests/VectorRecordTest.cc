@@ -17,6 +17,7 @@
 //
 
 #include "VectorRecord.hh"
+#include "VersionVector.hh"
 #include "fleece/Mutable.hh"
 #include <iostream>
 
@@ -266,3 +267,56 @@ N_WAY_TEST_CASE_METHOD (DataFileTestFixture, "VectorRecord Remote Update", "[Vec
         CHECK(props1["age"] != props2["age"]);
     }
 }
+
+
+N_WAY_TEST_CASE_METHOD (DataFileTestFixture, "VectorRecord Relative Remote Versions", "[VectorRecord]") {
+    Transaction t(db);
+    alloc_slice localRev = VersionVector::fromASCII("3@*,2@a1b2c3d4e5f60718,1@1827364554637281"_sl)
+                                .asBinary();
+    alloc_slice remoteRev = VersionVector::fromASCII("2@*,2@a1b2c3d4e5f60718,1@1827364554637281"_sl)
+                                .asBinary();
+    {
+        VectorRecord doc(*store, Versioning::Vectors, "Nuu");
+        doc.mutableProperties()["rodent"] = "mouse";
+        doc.setRevID(revid(localRev));
+        doc.setRemoteRevision(kRemote1, doc.currentRevision());
+        MutableDict remoteProps = MutableDict::newDict();
+        remoteProps["rodent"] = "capybara";
+        doc.setRemoteRevision(kRemote2, Revision{remoteProps, revid(remoteRev)});
+        CHECK(doc.save(t) == VectorRecord::kNewSequence);
+
+        // The remotes' versions are stored relative to the current one, but read back normally:
+        Array storage = doc.revisionStorage();
+        CHECK(storage[1].asDict()["@"_sl].asData() == "\0\0"_sl);
+        slice storedRemoteRev = storage[2].asDict()["@"_sl].asData();
+        CHECK(VersionVector::isRelativeBinary(storedRemoteRev));
+        CHECK(storedRemoteRev.size < remoteRev.size);
+        CHECK(doc.remoteRevision(kRemote1)->revID == revid(localRev));
+        CHECK(doc.remoteRevision(kRemote2)->revID == revid(remoteRev));
+    }
+    {
+        VectorRecord doc(*store, Versioning::Vectors, "Nuu");
+        CHECK(doc.remoteRevision(kRemote1)->revID == revid(localRev));
+        CHECK(doc.remoteRevision(kRemote2)->revID == revid(remoteRev));
+        CHECK(doc.remoteRevision(kRemote2)->properties.toJSON(true, true) == "{rodent:\"capybara\"}"_sl);
+
+        // Setting a remote to the revision it already has isn't a change:
+        doc.setRemoteRevision(kRemote2, doc.remoteRevision(kRemote2));
+        CHECK(!doc.changed());
+
+        // Saving a new current revision re-encodes the remotes' versions relative to it:
+        doc.mutableProperties()["age"] = 2;
+        alloc_slice newRev = VersionVector::fromASCII("1@4444,3@*,2@a1b2c3d4e5f60718,1@1827364554637281"_sl)
+                                .asBinary();
+        doc.setRevID(revid(newRev));
+        CHECK(doc.save(t) == VectorRecord::kNewSequence);
+        CHECK(doc.remoteRevision(kRemote1)->revID == revid(localRev));
+        CHECK(doc.remoteRevision(kRemote2)->revID == revid(remoteRev));
+    }
+    {
+        VectorRecord doc(*store, Versioning::Vectors, "Nuu");
+        CHECK(doc.revisionStorage()[1].asDict()["@"_sl].asData() != "\0\0"_sl);
+        CHECK(doc.remoteRevision(kRemote1)->revID == revid(localRev));
+        CHECK(doc.remoteRevision(kRemote2)->revID == revid(remoteRev));
+    }
+}
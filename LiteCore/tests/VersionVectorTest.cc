@@ -20,6 +20,7 @@
 #include "RevTree.hh"
 #include "LiteCoreTest.hh"
 #include "StringUtil.hh"
+#include "Benchmark.hh"
 
 using namespace litecore;
 using namespace std;
@@ -187,6 +188,54 @@ TEST_CASE("VersionVector conflicts", "[RevIDs]") {
     CHECK(!(v1 > v3));
 
     CHECK(v1.mergedWith(v3).asASCII() == "3@*,4@100,1@103,2@102");
+
+    // Comparing the binary form gives the same results:
+    alloc_slice b1 = v1.asBinary();
+    CHECK(VersionVector::compareBinary(b1, v1) == kSame);
+    CHECK(VersionVector::compareBinary(b1, "2@100,1@103,2@102"_vv) == kNewer);
+    CHECK(VersionVector::compareBinary(b1, VersionVector()) == kNewer);
+    CHECK(VersionVector::compareBinary(b1, "2@103,1@666,3@*,2@100,9@102"_vv) == kOlder);
+    CHECK(VersionVector::compareBinary(b1, v3) == kConflicting);
+    CHECK(VersionVector::compareBinary(VersionVector().asBinary(), v3) == kOlder);
+}
+
+
+TEST_CASE("VersionVector relative binary", "[RevIDs]") {
+    VersionVector base = "3@*,2@100,1@103,2@102"_vv;
+    auto testRoundTrip = [&](VersionVector v, size_t expectedSize) {
+        INFO("v = '" << v << "'");
+        alloc_slice binary = v.asBinaryRelativeTo(base);
+        CHECK(VersionVector::isRelativeBinary(binary));
+        CHECK(binary.size == expectedSize);
+        VersionVector v2;
+        v2.readBinary(binary, base);
+        CHECK(v2.asASCII() == v.asASCII());
+    };
+    testRoundTrip(base,                         2);
+    testRoundTrip("2@*,2@100,1@103,2@102"_vv,   2 + 4*2);
+    testRoundTrip("2@100,1@103"_vv,             2 + 2*2);
+    testRoundTrip("1@ffff,3@*,2@100"_vv,        2 + 5 + 2*2);
+
+    // An empty vector just uses the regular form, which can be read either way:
+    alloc_slice empty = VersionVector().asBinaryRelativeTo(base);
+    CHECK(!VersionVector::isRelativeBinary(empty));
+    VersionVector v;
+    v.readBinary(empty, base);
+    CHECK(v.empty());
+
+    // The relative form can only be read with the base:
+    alloc_slice regular = base.asBinary();
+    CHECK(!VersionVector::isRelativeBinary(regular));
+    v.readBinary(regular, "1@101"_vv);
+    CHECK(v == base);
+    alloc_slice relative = "2@100,1@103"_vv.asBinaryRelativeTo(base);
+    ExpectException(error::LiteCore, error::BadRevisionID, [&]{
+        VersionVector::fromBinary(relative);
+    });
+    ExpectException(error::LiteCore, error::BadRevisionID, [&]{
+        VersionVector v3;
+        v3.readBinary(relative, "1@101"_vv);
+    });
 }
 
 
@@ -216,6 +265,67 @@ TEST_CASE("VersionVector deltas", "[RevIDs]") {
 }
 
 
+TEST_CASE("VersionVector performance", "[RevIDs][Perf][.slow]") {
+    for (unsigned size : {4, 16, 64}) {
+        // Build a vector, an older one, and one that conflicts with it:
+        VersionVector vec, older, conflicting;
+        for (unsigned i = size; i > 0; --i) {
+            peerID author {0x1000000000000000ull + i * 0x12345};
+            vec.push_back(Version(10 + i, author));
+            older.push_back(Version(5 + i, author));
+            conflicting.push_back(Version(i == 1 ? 20 : 5 + i, author));
+        }
+        alloc_slice binary = vec.asBinary(), olderBinary = older.asBinary();
+        const unsigned kRepeat = 100000 / size;
+
+        Benchmark compareBench, binaryCompareBench, mergeBench, encodeBench, relEncodeBench;
+        Benchmark decodeBench, relDecodeBench;
+        alloc_slice relBinary;
+        for (unsigned n = 0; n < kRepeat; ++n) {
+            compareBench.start();
+            CHECK(vec.compareTo(older) == kNewer);
+            compareBench.stop();
+
+            binaryCompareBench.start();
+            CHECK(VersionVector::compareBinary(olderBinary, vec) == kOlder);
+            binaryCompareBench.stop();
+
+            mergeBench.start();
+            auto merged = vec.mergedWith(conflicting);
+            mergeBench.stop();
+            CHECK(merged.count() == size);
+
+            encodeBench.start();
+            alloc_slice encoded = older.asBinary();
+            encodeBench.stop();
+
+            relEncodeBench.start();
+            relBinary = older.asBinaryRelativeTo(vec);
+            relEncodeBench.stop();
+
+            decodeBench.start();
+            VersionVector decoded = VersionVector::fromBinary(olderBinary);
+            decodeBench.stop();
+
+            relDecodeBench.start();
+            VersionVector relDecoded;
+            relDecoded.readBinary(relBinary, vec);
+            relDecodeBench.stop();
+        }
+
+        fprintf(stderr, "---- %u versions: binary %zu bytes, relative %zu bytes\n",
+                size, olderBinary.size, relBinary.size);
+        compareBench.printReport(1.0, "compare");
+        binaryCompareBench.printReport(1.0, "binary compare");
+        mergeBench.printReport(1.0, "merge");
+        encodeBench.printReport(1.0, "encode");
+        relEncodeBench.printReport(1.0, "relative encode");
+        decodeBench.printReport(1.0, "decode");
+        relDecodeBench.printReport(1.0, "relative decode");
+    }
+}
+
+
 #pragma mark - REVID:
 
 
@@ -41,6 +41,9 @@ namespace litecore { namespace blip {
     // How many bytes to receive before sending an ACK
     static const size_t kIncomingAckThreshold = 50000;
 
+    // Minimum number of bytes to grow an incoming body buffer by, when inflating into it
+    static const size_t kMinBodyGrowth = 4096;
+
 
     void Message::sendProgress(MessageProgress::State state,
                                MessageSize bytesSent, MessageSize bytesReceived,
@@ -179,12 +182,12 @@ namespace litecore { namespace blip {
             }
 
             bool justFinishedProperties = false;
-            if (!_in) {
+            if (!_started) {
                 // First frame!
-                // Update my flags and allocate the Writer:
+                // Update my flags:
                 DebugAssert(_number > 0);
                 _flags = (FrameFlags)(frameFlags & ~kMoreComing);
-                _in.reset(new fleece::JSONEncoder);
+                _started = true;
 
                 // Read just a few bytes to get the length of the properties (a varint at the
                 // start of the frame):
@@ -203,9 +206,13 @@ namespace litecore { namespace blip {
                 _propertiesRemaining.writeFrom(dst.readAtMost(_propertiesSize));
                 if (_propertiesRemaining.size == 0)
                     justFinishedProperties = true;
-                // And anything left over after that becomes the start of the body:
-                if (dst.size > 0)
-                    _in->writeRaw(dst);
+                // And anything left over after that becomes the start of the body. Size the
+                // buffer from the whole first frame, to make later growth less likely:
+                if (dst.size > 0) {
+                    reserveBody(dst.size + frame.size, (frameFlags & kMoreComing) != 0);
+                    memcpy((void*)&_bodyBuffer[_bodySize], dst.buf, dst.size);
+                    _bodySize += dst.size;
+                }
             }
 
             if (_propertiesRemaining.size > 0) {
@@ -233,21 +240,20 @@ namespace litecore { namespace blip {
             }
 
             if (_propertiesRemaining.size == 0) {
-                // Read/decompress the frame into _in:
-                readFrame(codec, int(mode), frame, frameFlags);
+                // Read/decompress the frame into the body buffer:
+                readFrame(codec, int(mode), frame, (frameFlags & kMoreComing) != 0);
             }
 
             slice checksumSlice{checksum, Codec::kChecksumSize};
             codec.readAndVerifyChecksum(checksumSlice);
 
-            bodyBytesReceived = _in->bytesWritten();
+            bodyBytesReceived = _bodySize;
 
             if (!(frameFlags & kMoreComing)) {
                 // Completed!
                 if (_propertiesRemaining.size > 0)
                     throw std::runtime_error("message ends before end of properties");
-                _body = _in->finish();
-                _in.reset();
+                _body = takeBody();
                 _complete = true;
 
                 if (_connection->willLog(LogLevel::Verbose))
@@ -288,17 +294,53 @@ namespace litecore { namespace blip {
     }
 
 
-    void MessageIn::readFrame(Codec &codec, int mode, slice &frame, bool finalFrame) {
-        uint8_t buffer[4096];
-        while (frame.size > 0) {
-            slice output {buffer, sizeof(buffer)};
+    // Decodes a frame directly into the body buffer, growing it as necessary.
+    void MessageIn::readFrame(Codec &codec, int mode, slice &frame, bool moreComing) {
+        bool raw = (Codec::Mode(mode) == Codec::Mode::Raw);
+        if (raw) {
+            // Uncompressed, so the frame adds exactly its own size to the body:
+            reserveBody(frame.size, moreComing);
+        }
+        // If the inflater fills the buffer it may still have output pending, even after it's
+        // consumed all the input, so go around again:
+        bool filled = false;
+        while (frame.size > 0 || (filled && !raw)) {
+            if (_bodySize == _bodyBuffer.size)
+                reserveBody(max(2 * frame.size, kMinBodyGrowth), true);
+            slice output(&_bodyBuffer[_bodySize], _bodyBuffer.size - _bodySize);
             codec.write(frame, output, Codec::Mode(mode));
-            if (output.buf > buffer)
-                _in->writeRaw(slice(buffer, output.buf));
+            _bodySize = (uint8_t*)output.buf - (uint8_t*)_bodyBuffer.buf;
+            filled = (output.size == 0);
         }
     }
 
 
+    // Makes room in the body buffer for at least `size` more bytes. The first allocation is
+    // exact if no more frames are coming; otherwise the buffer grows geometrically, with
+    // realloc, to keep copying down when a large body arrives in many frames.
+    void MessageIn::reserveBody(size_t size, bool moreComing) {
+        size_t needed = _bodySize + size;
+        if (needed <= _bodyBuffer.size)
+            return;
+        if (!_bodyBuffer)
+            _bodyBuffer = alloc_slice(moreComing ? max(2 * needed, kMinBodyGrowth) : needed);
+        else
+            _bodyBuffer.resize(max(needed, 2 * _bodyBuffer.size));
+    }
+
+
+    // Returns the body received so far, and starts a new one. The buffer's spare room is
+    // trimmed off in place with a realloc, which doesn't copy the data.
+    alloc_slice MessageIn::takeBody() {
+        if (_bodyBuffer)
+            _bodyBuffer.resize(_bodySize);
+        alloc_slice body = move(_bodyBuffer);
+        _bodyBuffer = nullslice;
+        _bodySize = 0;
+        return body;
+    }
+
+
     void MessageIn::setProgressCallback(MessageProgressCallback callback) {
         lock_guard<mutex> lock(_receiveMutex);
         _onProgress = callback;
@@ -338,9 +380,8 @@ namespace litecore { namespace blip {
         alloc_slice body = _body;
         if (body) {
             _body = nullslice;
-        } else if (_in) {
-            body = _in->finish();
-            _in->reset();
+        } else if (_bodySize > 0) {
+            body = takeBody();
         }
         return body;
     }
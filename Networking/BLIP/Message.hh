@@ -199,13 +199,16 @@ namespace litecore { namespace blip {
         std::string description();
 
     private:
-        void readFrame(Codec&, int mode, slice &frame, bool finalFrame);
+        void readFrame(Codec&, int mode, slice &frame, bool moreComing);
+        void reserveBody(size_t size, bool moreComing);
+        alloc_slice takeBody();
         void acknowledge(uint32_t frameSize);
 
         Retained<Connection> _connection;       // The owning BLIP connection     
         mutable std::mutex _receiveMutex;
         MessageSize _rawBytesReceived {0};
-        std::unique_ptr<fleece::JSONEncoder> _in; // Accumulates body data (not JSON)
+        alloc_slice _bodyBuffer;                // Accumulates body data; may have spare room
+        size_t _bodySize {0};                   // Number of bytes of _bodyBuffer in use
         uint32_t _propertiesSize {0};           // Length of properties in bytes
         slice _propertiesRemaining;             // Subrange of _properties still to be read
         uint32_t _unackedBytes {0};             // # bytes received that haven't been ACKed yet
@@ -213,6 +216,7 @@ namespace litecore { namespace blip {
         alloc_slice _body;                      // Just the body
         alloc_slice _bodyAsFleece;              // Body re-encoded into Fleece [lazy]
         const MessageSize _outgoingSize {0};
+        bool _started {false};                  // Has the first frame arrived?
         bool _complete {false};
         bool _responded {false};
     };
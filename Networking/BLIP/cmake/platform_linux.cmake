@@ -12,6 +12,7 @@ function(set_source_files)
         ${LINUX_SSS_RESULT}
         ${BASE_SRC_FILES}
         ${SUPPORT_LOCATION}/ThreadedMailbox.cc
+        ${SUPPORT_LOCATION}/WorkStealingScheduler.cc
         PARENT_SCOPE
     )
 endfunction()
@@ -33,6 +33,11 @@
 #include <poll.h>
 #endif
 
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#endif
+
 #define WSLog (*(LogDomain*)kC4WebSocketLog)
 
 namespace litecore { namespace net {
@@ -51,6 +56,24 @@ namespace litecore { namespace net {
 
 
     Poller::Poller() {
+#ifdef __linux__
+        // epoll_wait() watches an eventfd, so writing to it will make epoll_wait() return.
+        // The eventfd can't carry data, so interrupt() queues its messages in a vector.
+        _epollFD = ::epoll_create1(EPOLL_CLOEXEC);
+        if (_epollFD < 0)
+            throwSocketError();
+        _eventFD = ::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        epoll_event ev = {};
+        ev.events = EPOLLIN;
+        ev.data.fd = _eventFD;
+        if (_eventFD < 0 || ::epoll_ctl(_epollFD, EPOLL_CTL_ADD, _eventFD, &ev) < 0) {
+            int err = errno;
+            if (_eventFD >= 0)
+                ::close(_eventFD);
+            ::close(_epollFD);
+            error::_throw(error::POSIX, err);
+        }
+#else
         // To allow poll() system calls to be interrupted, we create a pipe and have poll()
         // watch its read end. Then writing to the pipe will cause poll() to return. As a bonus,
         // we can use the data written to the pipe as a message, to let waitForIO know what happened.
@@ -74,11 +97,19 @@ namespace litecore { namespace net {
             throwSocketError();
         _interruptReadFD = readSock.release();
         _interruptWriteFD = writeSock.release();
+#endif
 #endif
     }
 
 
     Poller::~Poller() {
+        // The poll thread must not be using the fds when they're closed:
+        if (_thread.joinable())
+            stop();
+#ifdef __linux__
+        ::close(_eventFD);
+        ::close(_epollFD);
+#else
         if (_interruptReadFD >= 0) {
 #ifndef _WIN32
             ::close(_interruptReadFD);
@@ -88,6 +119,7 @@ namespace litecore { namespace net {
             ::closesocket(_interruptWriteFD);
 #endif
         }
+#endif
     }
 
 
@@ -100,9 +132,14 @@ namespace litecore { namespace net {
     void Poller::addListener(int fd, Event event, Listener listener) {
         Assert(fd >= 0);
         lock_guard<mutex> lock(_mutex);
-        _listeners[fd][event] = move(listener);
+        Listeners &listeners = _listeners[fd];
+        listeners[event] = move(listener);
+#ifdef __linux__
+        armEpoll(fd, listeners);
+#else
         if (_waiting)
             interrupt(0);
+#endif
     }
 
 
@@ -111,6 +148,10 @@ namespace litecore { namespace net {
         lock_guard<mutex> lock(_mutex);
         if (auto i = _listeners.find(fd); i != _listeners.end())
             _listeners.erase(i);
+#ifdef __linux__
+        // (Fails harmlessly if the fd was never registered, or has already been closed.)
+        ::epoll_ctl(_epollFD, EPOLL_CTL_DEL, fd, nullptr);
+#endif
         // no need to interrupt the poll thread
     }
 
@@ -123,10 +164,14 @@ namespace litecore { namespace net {
             if (i == _listeners.end())
                 return;
             auto &lref = i->second[event];
-            if (!lref)
-                return;
             listener = move(lref);
             lref = nullptr;
+#ifdef __linux__
+            // The registration was one-shot, so re-arm it for the other event, if wanted:
+            armEpoll(fd, i->second);
+#endif
+            if (!listener)
+                return;
         }
         // Unlock mutex before calling listener
         listener();
@@ -134,7 +179,14 @@ namespace litecore { namespace net {
 
 
     void Poller::interrupt(int message) {
-#ifdef WIN32
+#ifdef __linux__
+        {
+            lock_guard<mutex> lock(_mutex);
+            _interruptMessages.push_back(message);
+        }
+        uint64_t one = 1;
+        if (::write(_eventFD, &one, sizeof(one)) < 0)
+#elif defined(WIN32)
         if(::send(_interruptWriteFD, (const char *)&message, sizeof(message), 0) < 0)
 #else
         if(::write(_interruptWriteFD, &message, sizeof(message)) < 0)
@@ -149,7 +201,6 @@ namespace litecore { namespace net {
             while (poll())
                 ;
         });
-        _thread.detach();
         return *this;
     }
 
@@ -159,7 +210,87 @@ namespace litecore { namespace net {
         _thread.join();
     }
 
-#ifdef WIN32
+#ifdef __linux__
+
+    // Registers the fd with epoll for the events that have listeners, if any. Registrations
+    // are one-shot: after reporting an event the fd stays registered, but disabled, until it's
+    // re-armed here. Returns false (after dropping the fd's listeners) if the fd is invalid.
+    // The mutex must be locked.
+    bool Poller::armEpoll(int fd, const Listeners &listeners) {
+        epoll_event ev = {};
+        if (listeners[kReadable])
+            ev.events |= EPOLLIN | EPOLLRDHUP;
+        if (listeners[kWriteable])
+            ev.events |= EPOLLOUT;
+        if (ev.events == 0)
+            return true;
+        ev.events |= EPOLLONESHOT;
+        ev.data.fd = fd;
+        if (::epoll_ctl(_epollFD, EPOLL_CTL_MOD, fd, &ev) == 0)
+            return true;
+        // Not registered yet, or the fd was closed (which unregisters it) and its number reused:
+        if (errno == ENOENT && ::epoll_ctl(_epollFD, EPOLL_CTL_ADD, fd, &ev) == 0)
+            return true;
+        LogDebug(WSLog, "Poller: can't watch fd %d: errno %d", fd, errno);
+        _listeners.erase(fd);
+        return false;
+    }
+
+
+    // Resets the eventfd and handles the messages sent by interrupt().
+    bool Poller::handleInterrupts() {
+        uint64_t count;
+        ssize_t n = ::read(_eventFD, &count, sizeof(count));
+        (void)n;
+        vector<int> messages;
+        {
+            lock_guard<mutex> lock(_mutex);
+            swap(messages, _interruptMessages);
+        }
+        bool result = true;
+        for (int message : messages) {
+            LogDebug(WSLog, "Poller: interruption %d", message);
+            if (message < 0) {
+                // Receiving a negative message aborts the loop
+                result = false;
+            } else if (message > 0) {
+                // A positive message is a file descriptor to call:
+                callAndRemoveListener(message, kReadable);
+                callAndRemoveListener(message, kWriteable);
+            }
+        }
+        return result;
+    }
+
+
+    bool Poller::poll() {
+        static constexpr int kMaxEvents = 256;
+        epoll_event events[kMaxEvents];
+        int n;
+        while ((n = ::epoll_wait(_epollFD, events, kMaxEvents, -1)) < 0) {
+            if (errno != EINTR)
+                return false;
+        }
+
+        bool result = true;
+        for (int i = 0; i < n; ++i) {
+            int fd = events[i].data.fd;
+            uint32_t revents = events[i].events;
+            if (fd == _eventFD) {
+                if (!handleInterrupts())
+                    result = false;
+            } else {
+                LogDebug(WSLog, "Poller: fd %d got event 0x%02x", fd, revents);
+                if (revents & (EPOLLIN | EPOLLRDHUP | EPOLLERR | EPOLLHUP))
+                    callAndRemoveListener(fd, kReadable);
+                if (revents & (EPOLLOUT | EPOLLERR | EPOLLHUP))
+                    callAndRemoveListener(fd, kWriteable);
+            }
+        }
+        return result;
+    }
+
+#elif defined(WIN32)
     // WSAPoll has proven to be weirdly unreliable, so fall back
     // to a select based implementation
     bool Poller::poll() {
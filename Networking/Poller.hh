@@ -11,6 +11,7 @@
 #include <mutex>
 #include <thread>
 #include <unordered_map>
+#include <vector>
 #include "sockpp/platform.h"
 #include "sockpp/socket.h"
 
@@ -20,7 +21,10 @@ namespace litecore { namespace net {
 	// Unix has them in this namespace)
 	using namespace sockpp; 
 	
-    /** Enables async I/O by running `poll` on a background thread. */
+    /** Enables async I/O by running `poll` on a background thread.
+        On Linux it uses epoll instead, and file descriptors stay registered with the kernel
+        between listeners, so each wakeup costs time proportional to the number of ready
+        sockets rather than the number of open ones. */
     class Poller {
     public:
         /// The single shared instance (all that's necessary in normal use)
@@ -52,16 +56,28 @@ namespace litecore { namespace net {
 
     private:
         Poller(bool startNow)               :Poller() {if (startNow) start();}
+        using Listeners = std::array<Listener,2>;
+
         bool poll();
         void callAndRemoveListener(int fd, Event);
         
         std::mutex _mutex;
-        std::unordered_map<socket_t, std::array<Listener,2>> _listeners;
+        std::unordered_map<socket_t, Listeners> _listeners;
         std::thread _thread;
+
+#ifdef __linux__
+        bool armEpoll(int fd, const Listeners&);
+        bool handleInterrupts();
+
+        int _epollFD {-1};
+        int _eventFD {-1};                          // eventfd used to interrupt epoll_wait()
+        std::vector<int> _interruptMessages;        // Messages sent by interrupt()
+#else
         std::atomic_bool _waiting {false};
 
         socket_t _interruptReadFD  {INVALID_SOCKET}; // Pipe used to interrupt poll()
         socket_t _interruptWriteFD {INVALID_SOCKET}; // Other end of the pipe
+#endif
     };
 
 } }
@@ -0,0 +1,182 @@
+//
+// BLIPTest.cc
+//
+// Copyright (c) 2021 Couchbase, Inc All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "LiteCoreTest.hh"
+#include "BLIPConnection.hh"
+#include "LoopbackProvider.hh"
+#include "Message.hh"
+#include "MessageBuilder.hh"
+#include "Stopwatch.hh"
+#include <condition_variable>
+#include <mutex>
+#include <random>
+#include <stdio.h>
+#include <vector>
+
+using namespace std;
+using namespace fleece;
+using namespace litecore;
+using namespace litecore::blip;
+using namespace litecore::websocket;
+
+
+namespace {
+
+    // Collects the requests arriving at one end of a BLIP connection.
+    class BLIPTestDelegate : public ConnectionDelegate {
+    public:
+        bool keepBodies {true};
+
+        void onTLSCertificate(slice) override { }
+
+        void onClose(Connection::CloseStatus, Connection::State) override {
+            lock_guard<mutex> lock(_mutex);
+            _closed = true;
+            _cond.notify_all();
+        }
+
+        void onRequestReceived(MessageIn *request) override {
+            alloc_slice body = request->body();
+            lock_guard<mutex> lock(_mutex);
+            _bytesReceived += body.size;
+            if (keepBodies)
+                _bodies.push_back(body);
+            ++_requestCount;
+            _cond.notify_all();
+        }
+
+        // Waits until `n` requests have arrived in all, and returns the bodies received.
+        vector<alloc_slice> waitForRequests(size_t n) {
+            unique_lock<mutex> lock(_mutex);
+            _cond.wait(lock, [&] {return _requestCount >= n;});
+            return _bodies;
+        }
+
+        uint64_t bytesReceived() {
+            lock_guard<mutex> lock(_mutex);
+            return _bytesReceived;
+        }
+
+        void waitForClose() {
+            unique_lock<mutex> lock(_mutex);
+            _cond.wait(lock, [&] {return _closed;});
+        }
+
+    private:
+        mutex _mutex;
+        condition_variable _cond;
+        vector<alloc_slice> _bodies;
+        size_t _requestCount {0};
+        uint64_t _bytesReceived {0};
+        bool _closed {false};
+    };
+
+
+    // A pair of BLIP Connections joined by LoopbackWebSockets.
+    class BLIPLoopback {
+    public:
+        BLIPTestDelegate clientDelegate, serverDelegate;
+        Retained<Connection> client, server;
+
+        BLIPLoopback() {
+            client = new Connection(new LoopbackWebSocket(alloc_slice("ws://srv/"_sl), Role::Client),
+                                    AllocedDict(), clientDelegate);
+            server = new Connection(new LoopbackWebSocket(alloc_slice("ws://cli/"_sl), Role::Server),
+                                    AllocedDict(), serverDelegate);
+            LoopbackWebSocket::bind(client->webSocket(), server->webSocket());
+            client->start();
+            server->start();
+        }
+
+        ~BLIPLoopback() {
+            client->close();
+            clientDelegate.waitForClose();
+            serverDelegate.waitForClose();
+            client->terminate();
+            server->terminate();
+        }
+
+        void sendRequest(slice body, bool compressed) {
+            MessageBuilder msg("test"_sl);
+            msg.noreply = true;
+            msg.compressed = compressed;
+            msg.write(body);
+            client->sendRequest(msg);
+        }
+    };
+
+
+    // Makes a message body of JSON-like text, which compresses about as well as real revisions.
+    alloc_slice makeBody(size_t size, unsigned seed) {
+        static const char* const kWords[] = {"couch", "base", "lite", "core", "blip", "sync",
+                                             "gateway", "revision", "sequence", "attachment"};
+        mt19937 random(seed);
+        string body;
+        body.reserve(size + 100);
+        while (body.size() < size) {
+            body += "{\"seq\":" + to_string(random()) + ",\"value\":\"";
+            for (int i = 0; i < 8; ++i)
+                (body += kWords[random() % 10]) += ' ';
+            body += "\"}\n";
+        }
+        body.resize(size);
+        return alloc_slice(body);
+    }
+
+}
+
+
+TEST_CASE("BLIP message bodies", "[BLIP]") {
+    bool compressed = GENERATE(false, true);
+    INFO("compressed=" << compressed);
+    // Bodies small enough for one frame, and big enough for many:
+    vector<alloc_slice> sent;
+    for (size_t size : {10, 1000, 100000, 3000000})
+        sent.push_back(makeBody(size, unsigned(size)));
+
+    BLIPLoopback blip;
+    for (auto &body : sent)
+        blip.sendRequest(body, compressed);
+    vector<alloc_slice> received = blip.serverDelegate.waitForRequests(sent.size());
+
+    REQUIRE(received.size() == sent.size());
+    for (size_t i = 0; i < sent.size(); ++i)
+        CHECK(received[i] == sent[i]);
+}
+
+
+TEST_CASE("BLIP loopback throughput", "[BLIP][Perf][.slow]") {
+    // Large messages, like revisions with big inline attachments:
+    static constexpr size_t kMessageSize = 4 * 1024 * 1024;
+    static constexpr unsigned kNumMessages = 20;
+    alloc_slice body = makeBody(kMessageSize, 1234);
+
+    for (bool compressed : {false, true}) {
+        BLIPLoopback blip;
+        blip.serverDelegate.keepBodies = false;
+        Stopwatch st;
+        for (unsigned i = 0; i < kNumMessages; ++i)
+            blip.sendRequest(body, compressed);
+        blip.serverDelegate.waitForRequests(kNumMessages);
+        double elapsed = st.elapsed();
+        CHECK(blip.serverDelegate.bytesReceived() == uint64_t(kNumMessages) * kMessageSize);
+        fprintf(stderr, "%-12s messages: %8.1f MB/sec\n",
+                (compressed ? "Compressed" : "Uncompressed"),
+                kNumMessages * kMessageSize / elapsed / 1e6);
+    }
+}
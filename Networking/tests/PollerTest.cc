@@ -0,0 +1,172 @@
+//
+// PollerTest.cc
+//
+// Copyright (c) 2021 Couchbase, Inc All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "LiteCoreTest.hh"
+#include "Poller.hh"
+#include "Stopwatch.hh"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdio.h>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace std;
+using namespace litecore::net;
+
+
+namespace {
+
+    // A connected pair of Unix-domain sockets; bytes sent to `fd[0]` arrive at `fd[1]`.
+    struct SocketPair {
+        int fd[2] {-1, -1};
+
+        SocketPair()                {REQUIRE(::socketpair(AF_UNIX, SOCK_STREAM, 0, fd) == 0);}
+        ~SocketPair()               {::close(fd[0]); ::close(fd[1]);}
+
+        bool send()                 {char c = 'x'; return ::write(fd[0], &c, 1) == 1;}
+        bool receive()              {char c; return ::read(fd[1], &c, 1) == 1;}
+    };
+
+
+    // Waits up to a few seconds for a condition to become true.
+    bool waitUntil(function<bool()> condition) {
+        for (int i = 0; i < 500; ++i) {
+            if (condition())
+                return true;
+            this_thread::sleep_for(chrono::milliseconds(10));
+        }
+        return false;
+    }
+
+
+    void settle()                   {this_thread::sleep_for(chrono::milliseconds(50));}
+
+}
+
+
+TEST_CASE("Poller", "[Poller]") {
+    Poller poller;
+    poller.start();
+    SocketPair pair;
+    atomic<int> reads {0}, writes {0};
+    auto onReadable = [&] {++reads;};
+
+    // A listener is called when its socket becomes readable:
+    poller.addListener(pair.fd[1], Poller::kReadable, onReadable);
+    settle();
+    CHECK(reads == 0);
+    REQUIRE(pair.send());
+    CHECK(waitUntil([&] {return reads == 1;}));
+
+    // ...but only once, until it's added again:
+    settle();
+    CHECK(reads == 1);
+    poller.addListener(pair.fd[1], Poller::kReadable, onReadable);
+    CHECK(waitUntil([&] {return reads == 2;}));
+    REQUIRE(pair.receive());
+
+    poller.addListener(pair.fd[0], Poller::kWriteable, [&] {++writes;});
+    CHECK(waitUntil([&] {return writes == 1;}));
+
+    // Interrupting calls the listener right away:
+    poller.addListener(pair.fd[1], Poller::kReadable, onReadable);
+    poller.interrupt(pair.fd[1]);
+    CHECK(waitUntil([&] {return reads == 3;}));
+
+    // A removed listener isn't called:
+    poller.addListener(pair.fd[1], Poller::kReadable, onReadable);
+    poller.removeListeners(pair.fd[1]);
+    REQUIRE(pair.send());
+    settle();
+    CHECK(reads == 3);
+
+    poller.stop();
+}
+
+
+TEST_CASE("Poller performance", "[Poller][Perf][.slow]") {
+    // Many connections, mostly idle, like a listener serving thousands of peers. Each active
+    // connection has one byte in flight: its listener reads it, sends another and re-listens.
+    static constexpr unsigned kNumActive = 100, kNumWakeups = 200000;
+
+    rlimit limit;
+    REQUIRE(::getrlimit(RLIMIT_NOFILE, &limit) == 0);
+    limit.rlim_cur = limit.rlim_max;
+    ::setrlimit(RLIMIT_NOFILE, &limit);
+    ::getrlimit(RLIMIT_NOFILE, &limit);
+    auto maxIdle = unsigned(min(rlim_t(100000), (limit.rlim_cur - 2 * kNumActive - 100) / 2));
+
+    for (unsigned numIdle : {0u, 1000u, 4000u}) {
+        if (numIdle > maxIdle) {
+            fprintf(stderr, "Skipping %u idle sockets; not enough file descriptors\n", numIdle);
+            break;
+        }
+        Poller poller;
+        poller.start();
+        vector<unique_ptr<SocketPair>> idle, active;
+        for (unsigned i = 0; i < numIdle; ++i) {
+            idle.emplace_back(new SocketPair);
+            poller.addListener(idle.back()->fd[1], Poller::kReadable, [] { });
+        }
+
+        atomic<unsigned> wakeups {0};
+        mutex doneMutex;
+        condition_variable doneCond;
+        bool done = false;
+        function<void(SocketPair*)> listen = [&](SocketPair *pair) {
+            poller.addListener(pair->fd[1], Poller::kReadable, [&, pair] {
+                pair->receive();
+                unsigned n = ++wakeups;
+                if (n < kNumWakeups) {
+                    pair->send();
+                    listen(pair);
+                } else if (n == kNumWakeups) {
+                    lock_guard<mutex> lock(doneMutex);
+                    done = true;
+                    doneCond.notify_one();
+                }
+            });
+        };
+
+        Stopwatch st;
+        for (unsigned i = 0; i < kNumActive; ++i) {
+            active.emplace_back(new SocketPair);
+            REQUIRE(active.back()->send());
+            listen(active.back().get());
+        }
+        {
+            unique_lock<mutex> lock(doneMutex);
+            doneCond.wait(lock, [&] {return done;});
+        }
+        double elapsed = st.elapsed();
+        poller.stop();
+        fprintf(stderr, "%5u idle sockets: %10.0f wakeups/sec\n", numIdle, kNumWakeups / elapsed);
+    }
+}
+
+#endif // _WIN32
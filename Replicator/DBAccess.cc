@@ -86,6 +86,19 @@ namespace litecore { namespace repl {
     }
 
 
+    bool DBAccess::getDocCurrentRevision(slice docID, C4DocumentFlags *outFlags,
+                                         alloc_slice *outRevID, C4Error *outError) const
+    {
+        return use<bool>([&](C4Database *db) {
+            C4SliceResult revID {};
+            if (!c4db_getDocCurrentRevision(db, docID, outFlags, &revID, outError))
+                return false;
+            *outRevID = alloc_slice(std::move(revID));
+            return true;
+        });
+    }
+
+
     string DBAccess::convertVersionToAbsolute(slice revID) {
         string version(revID);
         if (_usingVersionVectors) {
@@ -65,6 +65,11 @@ namespace litecore { namespace repl {
             });
         }
 
+        /** Gets a document's flags and current revID (in global form), without loading the
+            document or copying its body. */
+        bool getDocCurrentRevision(slice docID, C4DocumentFlags *outFlags,
+                                   alloc_slice *outRevID, C4Error *outError) const;
+
         /** Gets a RawDocument. */
         C4RawDocument* getRawDoc(slice storeID, slice docID, C4Error *outError) const {
             return use<C4RawDocument*>([&](C4Database *db) {
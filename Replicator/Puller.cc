@@ -43,10 +43,10 @@ namespace litecore { namespace repl {
     ,_revFinder(new RevFinder(replicator, this))
     ,_provisionallyHandledRevs(this, "provisionallyHandledRevs", &Puller::_revsWereProvisionallyHandled)
     ,_returningRevs(this, "returningRevs", &Puller::_revsFinished)
-#if __APPLE__
     ,_revMailbox(nullptr, "Puller revisions")
-#endif
     {
+        _revMailbox.setPriority(actor::ActorPriority::Background);
+        _revMailbox.setMaxChildConcurrency(tuning::kMaxRunningIncomingRevs);
         _passive = _options.pull <= kC4Passive;
         registerHandler("rev",              &Puller::handleRev);
         registerHandler("norev",            &Puller::handleNoRev);
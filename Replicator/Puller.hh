@@ -92,11 +92,9 @@ namespace litecore { namespace repl {
         unsigned _activeIncomingRevs {0};   // # of IncomingRev workers running
         unsigned _unfinishedIncomingRevs {0};
 
-#if __APPLE__
-        // This helps limit the number of threads used by GCD:
+        // This limits the number of threads used by IncomingRevs, and lowers their priority:
         virtual actor::Mailbox* mailboxForChildren() override       {return &_revMailbox;}
         actor::Mailbox _revMailbox;
-#endif
     };
 
 
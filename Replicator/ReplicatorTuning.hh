@@ -68,6 +68,11 @@ namespace litecore { namespace repl {
            (and are thus holding onto the document bodies in memory.) */
         constexpr unsigned kMaxActiveIncomingRevs = 100;
 
+        /* Maximum number of IncomingRev actors that can be running at once, so that a bulk
+           pull leaves Scheduler threads free for other Actors. (On Apple platforms they always
+           run one at a time, as their GCD queues target a serial queue.) */
+        constexpr unsigned kMaxRunningIncomingRevs = 2;
+
 
         //// Pusher:
 
@@ -327,10 +327,8 @@ namespace litecore::repl {
             // Get the local doc's current revID/vector and flags:
             outCurrentRevID = nullslice;
             C4Error err;
-            if (c4::ref<C4Document> doc = _db->getDoc(docID, kDocGetMetadata, &err); doc) {
-                flags = doc->flags;
-                outCurrentRevID = c4doc_getSelectedRevIDGlobalForm(doc);
-            } else if (!isNotFoundError(err)) {
+            if (!_db->getDocCurrentRevision(docID, &flags, &outCurrentRevID, &err)
+                    && !isNotFoundError(err)) {
                 gotError(err);
                 return 500;
             }
@@ -42,6 +42,7 @@ function(set_litecore_source_base)
         LiteCore/Database/LegacyAttachments.cc
         LiteCore/Database/LiveQuerier.cc
         LiteCore/Database/PrebuiltCopier.cc
+        LiteCore/Database/RemoteRevisionGC.cc
         LiteCore/Database/SequenceTracker.cc
         LiteCore/Database/TreeDocument.cc
         LiteCore/Database/Upgrader.cc
@@ -74,6 +75,7 @@ function(set_litecore_source_base)
         LiteCore/Storage/DataFile.cc
         LiteCore/Storage/KeyStore.cc
         LiteCore/Storage/Record.cc
+        LiteCore/Storage/RecordCache.cc
         LiteCore/Storage/RecordEnumerator.cc
         LiteCore/Storage/SQLiteDataFile.cc
         LiteCore/Storage/SQLiteEnumerator.cc